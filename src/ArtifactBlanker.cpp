@@ -0,0 +1,133 @@
+#include "ArtifactBlanker.h"
+#include "RC/Errors.h"
+#include "RC/Macros.h"
+#include <algorithm>
+#include <cmath>
+
+namespace CML {
+  /// Constructor
+  /** @param settings The window margins, latency, and blanking mode
+   */
+  ArtifactBlanker::ArtifactBlanker(const ArtifactBlankerSettings& settings)
+    : settings(settings) {
+    if ( (settings.pre_ms < 0) || (settings.post_ms < 0) ||
+         (settings.latency_ms < 0) ) {
+      Throw_RC_Error("Artifact blanking pre_ms, post_ms, and latency_ms "
+          "must be non-negative.");
+    }
+  }
+
+  void ArtifactBlanker::Reset() {
+    windows.Clear();
+    last_good.Clear();
+  }
+
+  /// Registers a stimulation event to be blanked
+  /** @param onset_sec The RC::Time::Get() time of stimulation onset
+   *  @param duration_sec The duration of the stimulation
+   */
+  void ArtifactBlanker::AddStim(f64 onset_sec, f64 duration_sec) {
+    ArtifactBlankRecord window;
+    window.onset_sec = onset_sec;
+    window.window_start_sec = onset_sec - settings.pre_ms * 1e-3;
+    window.window_end_sec = onset_sec + duration_sec +
+      settings.post_ms * 1e-3;
+    windows += window;
+  }
+
+  void ArtifactBlanker::Process(EEGDataDouble& data, f64 read_sec,
+      RC::Data1D<ArtifactBlankRecord>& completed) {
+    auto& datar = data.data;
+    size_t len = 0;
+    RC_ForIndex(c, datar) {
+      len = std::max(len, datar[c].size());
+    }
+    if (len == 0) {
+      return;
+    }
+
+    if (last_good.size() != datar.size()) {
+      last_good.Resize(datar.size());
+      last_good.Zero();
+    }
+
+    const f64 fs = data.sampling_rate;
+    const f64 first_sec = read_sec - settings.latency_ms * 1e-3 -
+      (len - 1) / fs;
+    const f64 last_sec = first_sec + (len - 1) / fs;
+
+    // Sample index range of the block covered by each window, end exclusive.
+    // The tolerance keeps samples exactly on a window edge inside it.
+    const f64 tol = 1e-6;
+    size_t blank_start = len;
+    size_t blank_end = 0;
+    RC::Data1D<size_t> starts(windows.size());
+    RC::Data1D<size_t> ends(windows.size());
+    RC_ForIndex(w, windows) {
+      f64 start = (windows[w].window_start_sec - first_sec) * fs;
+      f64 end = (windows[w].window_end_sec - first_sec) * fs;
+      starts[w] = size_t(std::max(0.0, std::min(f64(len), std::ceil(start - tol))));
+      ends[w] = size_t(std::max(0.0, std::min(f64(len),
+              std::floor(end + tol) + 1)));
+      if (starts[w] < ends[w]) {
+        blank_start = std::min(blank_start, starts[w]);
+        blank_end = std::max(blank_end, ends[w]);
+      }
+    }
+
+    if (blank_start >= blank_end) {
+      // Nothing to blank, so only the hold values need updating.
+      RC_ForIndex(c, datar) {
+        if (datar[c].size() > 0) {
+          last_good[c] = datar[c][datar[c].size()-1];
+        }
+      }
+    }
+    else {
+      RC_ForRange(i, 0, len) {
+        bool blank = false;
+        if (i >= blank_start && i < blank_end) {
+          RC_ForIndex(w, windows) {
+            if (i >= starts[w] && i < ends[w]) {
+              windows[w].samples_blanked++;
+              blank = true;
+            }
+          }
+        }
+
+        RC_ForIndex(c, datar) {
+          if (i >= datar[c].size()) {
+            continue;
+          }
+          if (blank) {
+            datar[c][i] = (settings.mode == BlankMode::Hold) ?
+              last_good[c] : 0;
+          }
+          else {
+            last_good[c] = datar[c][i];
+          }
+        }
+      }
+    }
+
+    size_t chans_with_data = 0;
+    RC_ForIndex(c, datar) {
+      if (datar[c].size() > 0) {
+        chans_with_data++;
+      }
+    }
+
+    for (size_t w=0; w<windows.size(); w++) {
+      if (starts[w] < ends[w]) {
+        windows[w].channels_blanked = chans_with_data;
+      }
+      if (windows[w].window_end_sec <= last_sec) {
+        completed += windows[w];
+        windows.Remove(w);
+        starts.Remove(w);
+        ends.Remove(w);
+        w--;
+      }
+    }
+  }
+}
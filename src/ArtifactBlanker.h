@@ -0,0 +1,65 @@
+#ifndef ARTIFACTBLANKER_H
+#define ARTIFACTBLANKER_H
+
+#include "EEGData.h"
+#include "RC/Data1D.h"
+#include "RC/Types.h"
+
+namespace CML {
+  enum class BlankMode { Zero, Hold };
+
+  class ArtifactBlankerSettings {
+    public:
+    // Margin blanked before the recorded stimulation onset.
+    double pre_ms = 2;
+    // Margin blanked after the stimulation offset.
+    double post_ms = 50;
+    // Delay from a sample being acquired to it being read from the source.
+    double latency_ms = 0;
+    // Zero replaces blanked samples with 0.  Hold repeats each channel's
+    // last sample before the window, a causal zero-order interpolation.
+    BlankMode mode = BlankMode::Hold;
+  };
+
+  /// A record of the samples modified for one stimulation event.
+  class ArtifactBlankRecord {
+    public:
+    f64 onset_sec = 0;
+    f64 window_start_sec = 0;
+    f64 window_end_sec = 0;
+    size_t samples_blanked = 0;
+    size_t channels_blanked = 0;
+  };
+
+  /// Blanks stimulation artifacts from streaming EEG data.
+  /** Stimulation times are registered with AddStim as they happen, and each
+   *  block of data passing through Process has the samples falling within
+   *  [onset - pre_ms, offset + post_ms] replaced in place on every channel.
+   *  Sample times are reconstructed from the time the block was read, so
+   *  the accuracy is limited by the acquisition polling jitter, which the
+   *  pre_ms and post_ms margins should cover.
+   */
+  class ArtifactBlanker {
+    public:
+    ArtifactBlanker(const ArtifactBlankerSettings& settings);
+
+    void Reset();
+    void AddStim(f64 onset_sec, f64 duration_sec);
+
+    /// Blanks the artifact windows within a block of data.
+    /** @param data The data to modify in place
+     *  @param read_sec The time at which the block's final sample was read
+     *  @param completed Records for windows which have fully passed are
+     *  appended here
+     */
+    void Process(EEGDataDouble& data, f64 read_sec,
+        RC::Data1D<ArtifactBlankRecord>& completed);
+
+    protected:
+    ArtifactBlankerSettings settings;
+    RC::Data1D<ArtifactBlankRecord> windows;
+    RC::Data1D<double> last_good;
+  };
+}
+
+#endif // ARTIFACTBLANKER_H
@@ -0,0 +1,144 @@
+#include "BandPowerStim.h"
+#include "EEGAcq.h"
+#include "Handler.h"
+#include "JSONLines.h"
+#include "StimWorker.h"
+#include "RC/Macros.h"
+#include "RC/RTime.h"
+
+namespace CML {
+  /// Constructor which validates the settings and registers on EEGAcq
+  /** @param hndl The Handler, for EEGAcq, StimWorker, and event logging
+   *  @param settings The channels, band, and detection rule
+   *  @param sampling_rate The sampling rate of the EEGAcq callback data
+   */
+  BandPowerStim::BandPowerStim(RC::Ptr<Handler> hndl,
+      BandPowerStimSettings settings, size_t sampling_rate)
+    : hndl(hndl), settings(settings),
+      trigger(hndl, "BAND_POWER_STIM", "Band power stimulation",
+          settings.trigger) {
+    this->settings.tracker.sampling_rate = sampling_rate;
+    if (settings.min_channels < 1) {
+      Throw_RC_Error("Band power stimulation min_channels must be at least "
+          "1.");
+    }
+    if ( (settings.channels.size() > 0) &&
+         (settings.min_channels > settings.channels.size()) ) {
+      Throw_RC_Error((RC::RStr("Band power stimulation min_channels of ") +
+            settings.min_channels + " exceeds the " +
+            settings.channels.size() + " configured channels.").c_str());
+    }
+
+    // Report invalid filter settings now rather than on the first block.
+    BandPowerTracker check(this->settings.tracker);
+
+    callback_ID = "BandPowerStim";
+    hndl->eeg_acq.RegisterEEGCallback(callback_ID, Process);
+    hndl->eeg_acq.SetEEGCallbackPolicy(callback_ID,
+        EEGCallbackPolicy::Realtime(this));
+  }
+
+  BandPowerStim::~BandPowerStim() {
+    Shutdown_Handler();
+  }
+
+  void BandPowerStim::Shutdown_Handler() {
+    if (trigger.IsArmed()) {
+      trigger.SetArmed(false);
+    }
+    if (callback_ID.size() > 0) {
+      hndl->eeg_acq.RemoveEEGCallback(callback_ID);
+      callback_ID = "";
+    }
+  }
+
+  void BandPowerStim::SetArmed_Handler(const bool& new_armed) {
+    trigger.SetArmed(new_armed);
+    held_samples = 0;
+  }
+
+  /// Creates the trackers once the available channels are known
+  /** @param data The first block of EEG data
+   */
+  void BandPowerStim::SetupTrackers(const EEGDataDouble& data) {
+    auto& datar = data.data;
+    if (settings.channels.IsEmpty()) {
+      RC_ForIndex(c, datar) {
+        if (datar[c].size() > 0) {
+          settings.channels += c;
+        }
+      }
+      if (settings.min_channels > settings.channels.size()) {
+        Throw_RC_Error((RC::RStr("Band power stimulation min_channels of ") +
+              settings.min_channels + " exceeds the " +
+              settings.channels.size() + " channels with data.").c_str());
+      }
+    }
+
+    RC_ForIndex(c, settings.channels) {
+      size_t chan = settings.channels[c];
+      if (chan >= datar.size()) {
+        Throw_RC_Error((RC::RStr("Band power stimulation channel ") + chan +
+              " is out of range for " + datar.size() + " channels.").c_str());
+      }
+      trackers += RC::MakeAPtr<BandPowerTracker>(settings.tracker);
+    }
+  }
+
+  /// Handler that updates the envelopes and triggers stimulation
+  /** @param data The newest block of referenced, binned EEG data
+   */
+  void BandPowerStim::Process_Handler(RC::APtr<const EEGDataDouble>& data) {
+    if (trackers.IsEmpty()) {
+      SetupTrackers(*data);
+    }
+
+    auto& datar = data->data;
+    size_t block_len = 0;
+    size_t detecting = 0;
+    double max_zscore = 0;
+    bool ready = true;
+    RC_ForIndex(c, settings.channels) {
+      auto& samples = datar[settings.channels[c]];
+      trackers[c]->Process(samples);
+      block_len = std::max(block_len, samples.size());
+      ready = ready && trackers[c]->Ready();
+
+      double zscore = trackers[c]->ZScore();
+      if (zscore > settings.threshold_sd) {
+        detecting++;
+      }
+      max_zscore = std::max(max_zscore, zscore);
+    }
+
+    if (!trigger.IsArmed() || !ready || ShouldAbort()) {
+      return;
+    }
+
+    f64 now = RC::Time::Get();
+    if (trigger.Refractory(now)) {
+      held_samples = 0;
+      return;
+    }
+
+    if (detecting < settings.min_channels) {
+      held_samples = 0;
+      return;
+    }
+    held_samples += block_len;
+    double held_ms = held_samples * 1e3 / settings.tracker.sampling_rate;
+    if (held_ms < settings.min_duration_ms) {
+      return;
+    }
+
+    trigger.Triggered(now);
+    held_samples = 0;
+    hndl->stim_worker.TryStimulate();
+
+    JSONFile event;
+    event.Set(detecting, "channels_detecting");
+    event.Set(max_zscore, "max_zscore");
+    event.Set(held_ms, "held_ms");
+    hndl->event_log.Log(MakeResp("BAND_POWER_STIM", 0, event).Line());
+  }
+}
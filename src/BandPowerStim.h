@@ -0,0 +1,74 @@
+#ifndef BANDPOWERSTIM_H
+#define BANDPOWERSTIM_H
+
+#include "BandPowerTracker.h"
+#include "EEGData.h"
+#include "StimTrigger.h"
+#include "RC/APtr.h"
+#include "RC/Data1D.h"
+#include "RC/Ptr.h"
+#include "RC/RStr.h"
+#include "RCqt/Worker.h"
+
+namespace CML {
+  class Handler;
+
+  class BandPowerStimSettings {
+    public:
+    // Indices into the EEGAcq callback data.  Empty selects every channel
+    // with data.
+    RC::Data1D<size_t> channels;
+    BandPowerTrackerSettings tracker;
+    // Envelope z-score a channel must exceed to count as detecting.
+    double threshold_sd = 3;
+    // Number of channels that must detect simultaneously.
+    size_t min_channels = 1;
+    // How long the multi-channel rule must hold before triggering.
+    double min_duration_ms = 0;
+    StimTriggerSettings trigger;
+  };
+
+  /// Event-triggered stimulation from band-limited envelope power.
+  /** Each acquisition block updates a BandPowerTracker per selected channel.
+   *  When armed, and at least min_channels channels have exceeded
+   *  threshold_sd for min_duration_ms, this triggers StimWorker::TryStimulate
+   *  and then waits out the trigger's refractory_sec.
+   */
+  class BandPowerStim : public RCqt::WorkerThread {
+    public:
+    BandPowerStim(RC::Ptr<Handler> hndl, BandPowerStimSettings settings,
+        size_t sampling_rate);
+    ~BandPowerStim();
+
+    // Rule of 3.
+    BandPowerStim(const BandPowerStim&) = delete;
+    BandPowerStim& operator=(const BandPowerStim&) = delete;
+
+    RCqt::TaskCaller<const bool> SetArmed =
+      TaskHandler(BandPowerStim::SetArmed_Handler);
+
+    RCqt::TaskBlocker<> Shutdown =
+      TaskHandler(BandPowerStim::Shutdown_Handler);
+
+    protected:
+    RCqt::TaskCaller<RC::APtr<const EEGDataDouble>> Process =
+      TaskHandler(BandPowerStim::Process_Handler);
+
+    void Process_Handler(RC::APtr<const EEGDataDouble>& data);
+    void SetArmed_Handler(const bool& new_armed);
+    void Shutdown_Handler();
+
+    void SetupTrackers(const EEGDataDouble& data);
+
+    RC::Ptr<Handler> hndl;
+    RC::RStr callback_ID;
+
+    BandPowerStimSettings settings;
+    RC::Data1D<RC::APtr<BandPowerTracker>> trackers;
+
+    StimTrigger trigger;
+    size_t held_samples = 0;
+  };
+}
+
+#endif // BANDPOWERSTIM_H
@@ -0,0 +1,92 @@
+#include "BandPowerTracker.h"
+#include "RC/Errors.h"
+#include "RC/RStr.h"
+#include <algorithm>
+#include <cmath>
+
+namespace CML {
+  /// Constructor which sets up the band-pass and smoothing coefficients
+  /** @param settings The frequency band, sampling rate, and time constants
+   */
+  BandPowerTracker::BandPowerTracker(const BandPowerTrackerSettings& settings)
+    : settings(settings) {
+    const double fs = settings.sampling_rate;
+    if ( (settings.low_freq <= 0) || (settings.high_freq <= settings.low_freq) ||
+         (settings.high_freq >= fs/2) ) {
+      Throw_RC_Error((RC::RStr("Invalid band power band (") +
+            settings.low_freq + ", " + settings.high_freq + ") Hz for a " +
+            "sampling rate of " + settings.sampling_rate + " Hz.").c_str());
+    }
+    if ( (settings.filter_order < 1) || (settings.filter_order > 4) ) {
+      Throw_RC_Error((RC::RStr("Band power filter order ") +
+            settings.filter_order + " must be from 1 to 4.").c_str());
+    }
+    if ( (settings.smoothing_ms <= 0) || (settings.baseline_sec <= 0) ||
+         (settings.baseline_clip_sd < 0) ) {
+      Throw_RC_Error("Band power smoothing_ms and baseline_sec must be "
+          "positive, and baseline_clip_sd non-negative.");
+    }
+
+    bandpass.setup(settings.filter_order, fs,
+        (settings.low_freq + settings.high_freq) / 2,
+        settings.high_freq - settings.low_freq);
+
+    power_alpha = 1 - std::exp(-1 / (settings.smoothing_ms * 1e-3 * fs));
+    baseline_alpha = 1 - std::exp(-1 / (settings.baseline_sec * fs));
+    warmup_samples = size_t(settings.baseline_sec * fs);
+
+    Reset();
+  }
+
+  void BandPowerTracker::Reset() {
+    bandpass.reset();
+    power = 0;
+    baseline_mean = 0;
+    baseline_var = 0;
+    samples_seen = 0;
+  }
+
+  /// Filters new samples and updates the envelope and its baseline
+  /** @param samples The new samples, oldest first
+   */
+  void BandPowerTracker::Process(const RC::Data1D<double>& samples) {
+    size_t len = samples.size();
+    if (len == 0) {
+      return;
+    }
+    if (scratch.size() < len) {
+      scratch.Resize(len);
+    }
+
+    double* s = scratch.Raw();
+    const double* in = samples.Raw();
+    for (size_t i=0; i<len; i++) {
+      s[i] = in[i];
+    }
+    double* chans[1] = {s};
+    bandpass.process(int(len), chans);
+
+    bool clip = Ready() && (settings.baseline_clip_sd > 0);
+    for (size_t i=0; i<len; i++) {
+      power += power_alpha * (s[i]*s[i] - power);
+
+      // Exponentially weighted mean and variance of the envelope.
+      double delta = std::sqrt(power) - baseline_mean;
+      if (clip) {
+        double limit = settings.baseline_clip_sd * std::sqrt(baseline_var);
+        delta = std::max(-limit, std::min(limit, delta));
+      }
+      baseline_mean += baseline_alpha * delta;
+      baseline_var = (1 - baseline_alpha) *
+        (baseline_var + baseline_alpha * delta * delta);
+    }
+    samples_seen += len;
+  }
+
+  double BandPowerTracker::ZScore() const {
+    if (baseline_var <= 0) {
+      return 0;
+    }
+    return (Envelope() - baseline_mean) / std::sqrt(baseline_var);
+  }
+}
@@ -0,0 +1,64 @@
+#ifndef BANDPOWERTRACKER_H
+#define BANDPOWERTRACKER_H
+
+#include <cmath>
+#include "RC/Data1D.h"
+#include "DSPFilters/Dsp.h"
+
+namespace CML {
+  class BandPowerTrackerSettings {
+    public:
+    double low_freq = 80;
+    double high_freq = 120;
+    size_t sampling_rate = 1000;
+    int filter_order = 2;
+    // Time constant of the envelope smoothing.
+    double smoothing_ms = 20;
+    // Time constant of the envelope baseline mean and variance.
+    double baseline_sec = 30;
+    // After warmup, envelope deviations larger than this many standard
+    // deviations are clipped before updating the baseline, so detected
+    // events do not inflate it.  0 disables clipping.
+    double baseline_clip_sd = 4;
+  };
+
+  /// A recursive band-limited envelope tracker for a single channel.
+  /** Samples pass through a causal Butterworth band-pass, are squared, and
+   *  smoothed by a one-pole low-pass to give an RMS envelope.  The envelope
+   *  baseline mean and variance are tracked with exponential moving
+   *  averages, so the z-scored envelope is available after every block at a
+   *  fixed cost per sample and with no history buffer.
+   */
+  class BandPowerTracker {
+    public:
+    BandPowerTracker(const BandPowerTrackerSettings& settings);
+
+    void Reset();
+    void Process(const RC::Data1D<double>& samples);
+
+    /// True once one baseline time constant of data has been seen.
+    bool Ready() const { return samples_seen >= warmup_samples; }
+
+    /// The RMS envelope at the most recent sample.
+    double Envelope() const { return std::sqrt(power); }
+    /// The envelope at the most recent sample in baseline standard deviations.
+    double ZScore() const;
+
+    protected:
+    BandPowerTrackerSettings settings;
+
+    Dsp::SimpleFilter<Dsp::Butterworth::BandPass<4>, 1> bandpass;
+    RC::Data1D<double> scratch;
+
+    double power_alpha;
+    double baseline_alpha;
+    size_t warmup_samples;
+
+    double power = 0;
+    double baseline_mean = 0;
+    double baseline_var = 0;
+    size_t samples_seen = 0;
+  };
+}
+
+#endif // BANDPOWERTRACKER_H
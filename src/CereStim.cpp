@@ -52,6 +52,9 @@ namespace CML {
     );
 
     is_open = true;
+    // Device waveform and sequence state is unknown after connecting.
+    loaded_patterns.clear();
+    sequence_loaded = false;
 
     stim_width_us = 300;
     CSMaxValues max_vals;
@@ -74,6 +77,8 @@ namespace CML {
       CS_Disconnect();
 
       is_open = false;
+      loaded_patterns.clear();
+      sequence_loaded = false;
 //      is_configured = false;
     }
   }
@@ -151,24 +156,33 @@ namespace CML {
     );
   }
 
+  // The waveform for one channel of a profile with the given burst
+  // settings.
+  static CereStim::CSPattern MakePattern(const StimChannel& chan,
+      float burst_frac, float burst_slow_freq) {
+    uint64_t pulses_64 = (uint64_t(chan.duration) * chan.frequency) / 1000000;
+    if (burst_frac < 1) {
+      // Configure stim profile for burst-on period only.
+      pulses_64 = uint64_t(round(chan.frequency * burst_frac /
+                                 burst_slow_freq));
+    }
+
+    if (pulses_64 < 1) {
+      pulses_64 = 1;
+    }
+    if (pulses_64 > 255) {
+      throw std::runtime_error(std::to_string(chan.duration) + "us pulse "
+          "duration too long for " + std::to_string(chan.frequency) + "Hz "
+          "stimulus.");
+    }
+    return CereStim::CSPattern{chan.frequency, chan.amplitude,
+      uint16_t(pulses_64)};
+  }
+
   void CereStim::ConfigureStimulation_Helper(const StimProfile& profile) {
 //    is_configured = false;
     BeOpen();
 
-    StopStimulation();
-
-    struct FreqDurAmp {
-      uint32_t frequency;
-      uint32_t duration;
-      uint16_t amplitude;
-      bool operator==(const FreqDurAmp& other) const {
-          return frequency == other.frequency &&
-                 duration == other.duration &&
-                 amplitude == other.amplitude;
-      }
-    };
-    std::vector<FreqDurAmp> fda_vec;
-
     size_t prof_size = profile.size();
 
     size_t max_bipolar_pairs = (128-2)/2;  // From stim script max length.
@@ -177,33 +191,6 @@ namespace CML {
           " bipolar pairs can be stimulated.");
     }
 
-    // Verify electrodes are all unique.
-    //std::vector<uint16_t> uniqueness_check(256);
-    //for (size_t i=0; i<profile.size(); i++) {
-    //  auto& prof =  profile[i];
-
-    //  if (uniqueness_check.at(prof.electrode_pos) ||
-    //      uniqueness_check.at(prof.electrode_neg) ||
-    //      prof.electrode_pos == prof.electrode_neg) {
-    //    throw std::runtime_error("Stimulation channels must be unique");
-    //  }
-    //  uniqueness_check.at(prof.electrode_pos) = 1;
-    //  uniqueness_check.at(prof.electrode_neg) = 1;
-
-    //  if (i==0) {  // Save first burst setting.
-    //    burst_slow_freq = prof.burst_slow_freq;
-    //    burst_frac = prof.burst_frac;
-    //    burst_duration_us = prof.duration;
-    //  }  // All burst settings must be identical.
-    //  else if ((burst_slow_freq != prof.burst_slow_freq) ||
-    //           (std::abs(burst_frac - prof.burst_frac) > 0.001) ||
-    //           (burst_duration_us != prof.duration)) {
-    //    throw std::runtime_error("Simultaneous stim channels must be all "
-    //        "identical duration and burst stim settings, or all not burst "
-    //        "stim.");
-    //  }
-    //}
-
     // Sensible burst settings only.
     if (burst_frac > 1) {
       throw std::runtime_error("Attempted to configure stim burst fraction "
@@ -219,65 +206,58 @@ namespace CML {
       burst_slow_freq = 0;  // Triggers no burst in stim worker.
     }
 
-    std::vector<size_t> pattern_index(prof_size);
-
+    std::vector<CSPattern> patterns(prof_size);
     for (size_t i=0; i<prof_size; i++) {
+      // Enforce Shannon criteria for safety.
+      ShannonAssert(profile[i]);
+      patterns[i] = MakePattern(profile[i], burst_frac, burst_slow_freq);
+    }
+
+    // Reprogram the waveforms only if a preloaded bank, or the previous
+    // configuration, does not already have them all.
+    bool all_loaded = true;
+    for (size_t i=0; i<prof_size && all_loaded; i++) {
+      all_loaded = std::find(loaded_patterns.begin(), loaded_patterns.end(),
+          patterns[i]) != loaded_patterns.end();
+    }
+    if (!all_loaded) {
       // CS can only store 15 stimulus patterns.
       // For bipolar stimulation, only 7 pairs can be stored.
       // Extract and index the unique ones.
-      auto& chan = profile[i];
-
-      // Enforce Shannon criteria for safety.
-      ShannonAssert(chan);
-
-      FreqDurAmp fda{chan.frequency, chan.duration, chan.amplitude};
-      auto res = std::find(fda_vec.begin(), fda_vec.end(), fda);
-      if (res == fda_vec.end()) {
-        // 15 / 2 = 7 for bipolar.
-        if (fda_vec.size() >= 7) {
-          throw std::runtime_error("Only 7 variations of stimulation "
-              "amplitude, frequency, and duration allowed.");
+      std::vector<CSPattern> unique;
+      for (size_t i=0; i<prof_size; i++) {
+        if (std::find(unique.begin(), unique.end(), patterns[i]) ==
+            unique.end()) {
+          // 15 / 2 = 7 for bipolar.
+          if (unique.size() >= max_pattern_pairs) {
+            throw std::runtime_error("Only 7 variations of stimulation "
+                "amplitude, frequency, and duration allowed.");
+          }
+          unique.push_back(patterns[i]);
         }
-        fda_vec.push_back(fda);
-        res = std::prev(fda_vec.end());
       }
-      auto pat_index = res - fda_vec.begin();
-      pattern_index[i] = size_t(pat_index);
+      StopStimulation();
+      ProgramPatterns(unique);
     }
 
-    for (size_t i=0; i<fda_vec.size(); i++) {
-      auto& afd = fda_vec[i];
-      uint16_t interphase = 53;
-      uint64_t pulses_64 = (uint64_t(afd.duration) * afd.frequency) / 1000000;
-      if (burst_frac < 1) {
-        // Configure stim profile for burst-on period only.
-        pulses_64 = uint64_t(round(afd.frequency * burst_frac /
-                                   burst_slow_freq));
-      }
+    std::vector<uint16_t> sequence;
+    for (size_t i=0; i<prof_size; i++) {
+      uint16_t pat_index = uint16_t(std::find(loaded_patterns.begin(),
+            loaded_patterns.end(), patterns[i]) - loaded_patterns.begin());
+      // anode-first / then cathode-first, same settings.
+      sequence.push_back(profile[i].electrode_pos);
+      sequence.push_back(uint16_t(2*pat_index+1));
+      sequence.push_back(profile[i].electrode_neg);
+      sequence.push_back(uint16_t(2*pat_index+2));
+    }
 
-      if (pulses_64 < 1) {
-        pulses_64 = 1;
-      }
-      if (pulses_64 > 255) {
-        throw std::runtime_error(std::to_string(afd.duration) + "us pulse "
-            "duration too long for " + std::to_string(afd.frequency) + "Hz "
-            "stimulus.");
-      }
-      uint16_t pulses = uint16_t(pulses_64);
-      // Anodic/positive first waveform
-      ErrorCheck(
-        CS_ConfigureStimulusPattern(uint16_t(2*i+1), 0, pulses, afd.amplitude,
-          afd.amplitude, stim_width_us, stim_width_us, afd.frequency,
-          interphase)
-      );
-      // Cathodic/negative first waveform
-      ErrorCheck(
-        CS_ConfigureStimulusPattern(uint16_t(2*i+2), 1, pulses, afd.amplitude,
-          afd.amplitude, stim_width_us, stim_width_us, afd.frequency,
-          interphase)
-      );
+    if (sequence_loaded && sequence == loaded_sequence) {
+      return;  // Already selected.
     }
 
+    StopStimulation();
+    sequence_loaded = false;
+
     ErrorCheck(
       CS_BeginningOfSequence()
     );
@@ -285,16 +265,9 @@ namespace CML {
       CS_BeginningOfGroup()
     );
 
-
-    for (size_t i=0; i<prof_size; i++) {
-      // anode-first / then cathode-first, same settings.
-      ErrorCheck(
-        CS_AutoStimulus(profile[i].electrode_pos,
-          uint16_t(2*(pattern_index[i])+1))
-      );
+    for (size_t i=0; i<sequence.size(); i+=2) {
       ErrorCheck(
-        CS_AutoStimulus(profile[i].electrode_neg,
-          uint16_t(2*(pattern_index[i])+2))
+        CS_AutoStimulus(sequence[i], sequence[i+1])
       );
     }
 
@@ -305,9 +278,84 @@ namespace CML {
       CS_EndOfSequence()
     );
 
+    loaded_sequence = sequence;
+    sequence_loaded = true;
 //    is_configured = true;
   }
 
+  /// Programs every waveform needed by a bank of profiles into the device.
+  /** Afterwards, configuring any of the profiles only rewrites the short
+   *  stimulation sequence that selects among the loaded waveforms.
+   *  @param profiles The profiles to preload
+   */
+  void CereStim::PreloadProfiles_Helper(
+      const std::vector<StimProfile>& profiles) {
+    BeOpen();
+
+    std::vector<CSPattern> bank;
+    for (size_t p=0; p<profiles.size(); p++) {
+      const StimProfile& profile = profiles[p];
+      if (profile.size() == 0) {
+        continue;
+      }
+      // As in StimInterface, burst settings come from the first channel.
+      float prof_burst_frac = profile[0].burst_frac;
+      float prof_slow_freq = profile[0].burst_slow_freq;
+      if (prof_burst_frac >= 1) {
+        prof_burst_frac = 1;
+        prof_slow_freq = 0;
+      }
+      else if (prof_slow_freq == 0) {
+        throw std::runtime_error("Attempted burst fraction less than 1 at "
+            "0 Hz.");
+      }
+
+      for (size_t i=0; i<profile.size(); i++) {
+        ShannonAssert(profile[i]);
+        CSPattern pattern = MakePattern(profile[i], prof_burst_frac,
+            prof_slow_freq);
+        if (std::find(bank.begin(), bank.end(), pattern) == bank.end()) {
+          bank.push_back(pattern);
+        }
+      }
+    }
+
+    if (bank.size() > max_pattern_pairs) {
+      throw std::runtime_error("Stim profile bank needs " +
+          std::to_string(bank.size()) + " variations of stimulation "
+          "amplitude, frequency, and duration, but only " +
+          std::to_string(max_pattern_pairs) + " fit on the CereStim.");
+    }
+
+    StopStimulation();
+    ProgramPatterns(bank);
+  }
+
+  void CereStim::ProgramPatterns(const std::vector<CSPattern>& patterns) {
+    // Invalid until complete, should an error interrupt programming.
+    loaded_patterns.clear();
+    sequence_loaded = false;
+
+    uint16_t interphase = 53;
+    for (size_t i=0; i<patterns.size(); i++) {
+      auto& pat = patterns[i];
+      // Anodic/positive first waveform
+      ErrorCheck(
+        CS_ConfigureStimulusPattern(uint16_t(2*i+1), 0, pat.pulses,
+          pat.amplitude, pat.amplitude, stim_width_us, stim_width_us,
+          pat.frequency, interphase)
+      );
+      // Cathodic/negative first waveform
+      ErrorCheck(
+        CS_ConfigureStimulusPattern(uint16_t(2*i+2), 1, pat.pulses,
+          pat.amplitude, pat.amplitude, stim_width_us, stim_width_us,
+          pat.frequency, interphase)
+      );
+    }
+
+    loaded_patterns = patterns;
+  }
+
 // TODO: JPB: (need) Remove all this old CereStim code 
 //  void CereStim::ConfigureStimulation(CSStimProfile profile) {
 //    is_configured = false;
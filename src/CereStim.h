@@ -36,6 +36,7 @@ namespace CML {
     CereStim& operator=(const CereStim& other) = delete;
  
     void ConfigureStimulation(StimProfile profile) override { ConfigureStimulation_Handler(profile); }
+    void PreloadProfiles(std::vector<StimProfile> profiles) override { PreloadProfiles_Handler(profiles); }
     void OpenInterface() override { OpenInterface_Handler(); }
     void CloseInterface() override { CloseInterface_Handler(); }
     void Stimulate() override { Stimulate_Handler(); }
@@ -47,6 +48,21 @@ namespace CML {
 
     void StopStimulation();
 
+    // One anodic and cathodic first pair of device waveform slots.
+    class CSPattern {
+      public:
+      uint32_t frequency;
+      uint16_t amplitude;
+      uint16_t pulses;
+      bool operator==(const CSPattern& other) const {
+        return frequency == other.frequency &&
+               amplitude == other.amplitude &&
+               pulses == other.pulses;
+      }
+    };
+    // CS can only store 15 stimulus patterns, so 7 bipolar pairs.
+    static constexpr size_t max_pattern_pairs = 7;
+
 //    uint16_t ShannonCriteria(float area_mmsq);
 //    uint16_t ShannonCriteria(const StimChannel& chan);
 //    bool ShannonSafe(float area_mmsq, uint16_t amplitude_uA);
@@ -59,6 +75,8 @@ namespace CML {
 
     protected:
     void ConfigureStimulation_Helper(const StimProfile& profile) override;
+    void PreloadProfiles_Helper(
+        const std::vector<StimProfile>& profiles) override;
     void OpenInterface_Helper() override;  // Automatic at first use.
     void CloseInterface_Helper() override;
     void Stimulate_Helper() override;
@@ -67,6 +85,7 @@ namespace CML {
     private:
     void BeOpen();
     void ErrorCheck(int err);
+    void ProgramPatterns(const std::vector<CSPattern>& patterns);
 
 //    float burst_slow_freq = 0; // Unit Hz.  Slower envelope freq of bursts.
 //    float burst_frac = 1; // Fraction of 1/burst_slow_freq to stimulate for.
@@ -76,6 +95,12 @@ namespace CML {
 //    bool is_configured = false;
     bool was_active = false;
     bool is_open = false;
+
+    // Waveforms in the device, with pattern i in slots 2i+1 and 2i+2.
+    std::vector<CSPattern> loaded_patterns;
+    // Electrode and slot pairs of the sequence in the device.
+    std::vector<uint16_t> loaded_sequence;
+    bool sequence_loaded = false;
   };
 
 
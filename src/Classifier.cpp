@@ -32,6 +32,27 @@ namespace CML {
     }
   }
 
+  /// Handler that replaces the classifier weights between classifications.
+  /** @param new_weights The replacement weights, which must have the same
+   *         dimensions as the current weights.
+   */
+  void Classifier::SetWeights_Handler(RC::APtr<const FeatureWeights>& new_weights) {
+    if ( (new_weights->coef.size1() != weights->coef.size1()) ||
+         (new_weights->coef.size2() != weights->coef.size2()) ) {
+      Throw_RC_Error((RC::RStr("New classifier weight dimensions (") +
+            new_weights->coef.size2() + ", " + new_weights->coef.size1() +
+            ") do not match the current dimensions (" + weights->coef.size2() +
+            ", " + weights->coef.size1() + ").").c_str());
+    }
+
+    weights = new_weights;
+
+    JSONFile d;
+    d.Set(weights->intercept, "intercept");
+    d.Set(weights->coef.RawData(), "coef");
+    hndl->event_log.Log(MakeResp("CLASSIFIER_WEIGHTS", 0, d).Line());
+  }
+
   /// Handler that starts the classification and reports the result with a callback
   /** @param data The input data to the classifier
    */
@@ -47,10 +68,7 @@ namespace CML {
       {
         double result = Classification(data);
 
-        JSONFile d;
-        d.Set(result, "result");
-        d.Set(task_classifier_settings.duration_ms, "duration");
-        const RC::RStr type = [&] {
+        const char* type = [&] {
             switch (task_classifier_settings.cl_type) {
               case ClassificationType::STIM: return "STIM_CLASSIFY";
               case ClassificationType::SHAM: return "SHAM_CLASSIFY";
@@ -58,8 +76,11 @@ namespace CML {
               default: Throw_RC_Error("Invalid classification type received.");
             }
         }();
-        JSONFile resp = MakeResp(type, task_classifier_settings.classif_id, d);
-        hndl->event_log.Log(resp.Line());
+        auto resp = hndl->event_log.NewRecord(type,
+            task_classifier_settings.classif_id);
+        resp->Add("result", result);
+        resp->Add("duration", task_classifier_settings.duration_ms);
+        hndl->event_log.Submit(resp);
 
         ExecuteCallbacks(result, task_classifier_settings);
         break;
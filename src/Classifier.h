@@ -28,6 +28,9 @@ namespace CML {
     RCqt::TaskBlocker<const RC::RStr> RemoveCallback =
       TaskHandler(Classifier::RemoveCallback_Handler);
 
+    RCqt::TaskCaller<RC::APtr<const FeatureWeights>> SetWeights =
+      TaskHandler(Classifier::SetWeights_Handler);
+
 
     protected:
     void ExecuteCallbacks(const double& result, const TaskClassifierSettings& task_classifier_settings);
@@ -38,6 +41,7 @@ namespace CML {
     void RegisterCallback_Handler(const RC::RStr& tag,
                                   const ClassifierCallback& callback);
     void RemoveCallback_Handler(const RC::RStr& tag);
+    void SetWeights_Handler(RC::APtr<const FeatureWeights>& new_weights);
 
     struct TaggedCallback {
       RC::RStr tag;
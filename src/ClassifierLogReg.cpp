@@ -13,6 +13,7 @@ namespace CML {
       RC::APtr<const FeatureWeights> weights)
     : Classifier(hndl, weights){
     //callback_ID = RC::RStr("ClassifierLogReg_") + RC::RStr(classifier_settings);
+    kernels = FeatureKernelSet::Select(weights->coef.size2());
   }
 
   /// Handler that actually does the classification and reports the result with a callback
@@ -35,12 +36,7 @@ namespace CML {
                                "and coefficient dimensions (" + coef.size2() + ", " + coef.size1() + ", " + 1 + ") do not match.").c_str());
     }
 
-    double logodds = intercept;
-    RC_ForRange(i, 0, freqlen) { // Iterate over frequencies
-      RC_ForRange(j, 0, chanlen) { // Iterate over channels
-        logodds += datar[i][j][0] * coef[i][j];
-      }
-    }
+    double logodds = kernels.LogOdds(datar, coef, intercept);
 
     double prob = 1 / (1 + std::exp(-logodds));
 
@@ -2,6 +2,7 @@
 #define CLASSIFIERLOGREG_H
 
 #include "Classifier.h"
+#include "FeatureKernels.h"
 
 namespace CML {
   class ClassifierLogRegSettings {
@@ -20,6 +21,7 @@ namespace CML {
     protected:
     double Classification(RC::APtr<const EEGPowers>& data);
 
+    FeatureKernelSet kernels;
   };
 }
 
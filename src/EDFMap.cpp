@@ -0,0 +1,235 @@
+#include "EDFMap.h"
+#include "RC/Errors.h"
+#include <cstring>
+
+#ifdef WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace CML {
+  static RC::RStr HeaderField(const uint8_t* p, size_t len) {
+    RC::RStr field(reinterpret_cast<const char*>(p), len);
+    field.Trim();
+    return field;
+  }
+
+
+  EDFMap::~EDFMap() {
+    Close();
+  }
+
+
+  void EDFMap::Open(const RC::RStr& new_filename) {
+    Close();
+    filename = new_filename;
+
+#ifdef WIN32
+    HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ,
+        FILE_SHARE_READ | FILE_SHARE_WRITE, NULL, OPEN_EXISTING,
+        FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) {
+      Throw_RC_Type(File, (RC::RStr("Could not open edf file: ") +
+          filename).c_str());
+    }
+    file_hdl = file;
+    LARGE_INTEGER size;
+    if ( ! GetFileSizeEx(file, &size) ) {
+      Close();
+      Throw_RC_Type(File, (RC::RStr("Could not size edf file: ") +
+          filename).c_str());
+    }
+    file_size = u64(size.QuadPart);
+    if (file_size > 0) {
+      map_hdl = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+      if (map_hdl) {
+        base = static_cast<const uint8_t*>(MapViewOfFile(map_hdl,
+              FILE_MAP_READ, 0, 0, 0));
+      }
+    }
+#else
+    int fd = open(filename.c_str(), O_RDONLY);
+    if (fd < 0) {
+      Throw_RC_Type(File, (RC::RStr("Could not open edf file: ") +
+          filename).c_str());
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0) {
+      close(fd);
+      Throw_RC_Type(File, (RC::RStr("Could not size edf file: ") +
+          filename).c_str());
+    }
+    file_size = u64(st.st_size);
+    if (file_size > 0) {
+      void* addr = mmap(nullptr, file_size, PROT_READ, MAP_SHARED, fd, 0);
+      if (addr != MAP_FAILED) {
+        base = static_cast<const uint8_t*>(addr);
+        madvise(addr, file_size, MADV_SEQUENTIAL);
+      }
+    }
+    // The mapping holds its own reference to the file.
+    close(fd);
+#endif
+
+    if (base == nullptr) {
+      Close();
+      Throw_RC_Type(File, (RC::RStr("Could not map edf file: ") +
+          filename).c_str());
+    }
+
+    try {
+      ParseHeader();
+    }
+    catch (...) {
+      Close();
+      throw;
+    }
+  }
+
+
+  void EDFMap::Close() {
+#ifdef WIN32
+    if (base) {
+      UnmapViewOfFile(base);
+    }
+    if (map_hdl) {
+      CloseHandle(map_hdl);
+      map_hdl = nullptr;
+    }
+    if (file_hdl) {
+      CloseHandle(file_hdl);
+      file_hdl = nullptr;
+    }
+#else
+    if (base) {
+      munmap(const_cast<uint8_t*>(base), file_size);
+    }
+#endif
+    base = nullptr;
+    file_size = 0;
+    num_records = 0;
+    header_records = -1;
+    annot_offset = -1;
+    annot_bytes = 0;
+    samples_per_record = 0;
+    signals.Clear();
+  }
+
+
+  void EDFMap::ParseHeader() {
+    if (file_size < 256) {
+      Throw_RC_Type(File, ("Truncated edf header in " + filename).c_str());
+    }
+    if (HeaderField(base, 8) != "0") {
+      Throw_RC_Type(File, ("Not an EDF file, " + filename).c_str());
+    }
+
+    header_bytes = HeaderField(base+184, 8).Get_u64(10);
+    RC::RStr reserved = HeaderField(base+192, 44);
+    bool edf_plus = reserved.substr(0, 4) == "EDF+";
+    header_records = HeaderField(base+236, 8).Get_i64(10);
+    record_duration = HeaderField(base+244, 8).Get_f64();
+    size_t ns = size_t(HeaderField(base+252, 4).Get_u64(10));
+
+    if (ns == 0 || header_bytes != 256*(ns+1) || header_bytes > file_size) {
+      Throw_RC_Type(File, ("Invalid edf header in " + filename).c_str());
+    }
+
+    const uint8_t* samples_field = base + 256 + ns*216;
+    record_bytes = 0;
+    for (size_t s=0; s<ns; s++) {
+      RC::RStr label = HeaderField(base + 256 + s*16, 16);
+      size_t spr = size_t(HeaderField(samples_field + s*8, 8).Get_u64(10));
+
+      if (edf_plus && label == "EDF Annotations") {
+        if (annot_offset < 0) {
+          annot_offset = i64(record_bytes);
+          annot_bytes = 2*spr;
+        }
+      }
+      else {
+        if (signals.size() == 0) {
+          samples_per_record = spr;
+        }
+        else if (spr != samples_per_record) {
+          Throw_RC_Type(File, ("EDF signals have differing sampling rates "
+                "in " + filename).c_str());
+        }
+        Signal sig;
+        sig.label = label;
+        sig.record_offset = record_bytes;
+        signals += sig;
+      }
+      record_bytes += 2*spr;
+    }
+
+    if (signals.size() == 0 || samples_per_record == 0) {
+      Throw_RC_Type(File, ("No data signals in edf file " + filename).c_str());
+    }
+
+    // The record count is -1 if writing did not finish, and the file may be
+    // truncated, so only trust complete records present.
+    u64 records_present = (file_size - header_bytes) / record_bytes;
+    num_records = records_present;
+    if (header_records >= 0 && u64(header_records) < records_present) {
+      num_records = u64(header_records);
+    }
+  }
+
+
+  f64 EDFMap::SamplingRate() const {
+    if (record_duration <= 0) {
+      return 0;
+    }
+    return samples_per_record / record_duration;
+  }
+
+
+  void EDFMap::Read(int16_t* dest, size_t chan, u64 start, size_t len) const {
+    if (chan >= signals.size()) {
+      Throw_RC_Type(Bounds, ("EDF channel " + RC::RStr(chan) +
+            " out of range in " + filename).c_str());
+    }
+    if (start > NumSamples() || len > NumSamples() - start) {
+      Throw_RC_Type(Bounds, ("EDF read past end of " + filename).c_str());
+    }
+
+    u64 record = start / samples_per_record;
+    size_t within = size_t(start % samples_per_record);
+    const uint8_t* rec_base = base + header_bytes + signals[chan].record_offset;
+    while (len > 0) {
+      size_t amnt = std::min(len, samples_per_record - within);
+      // EDF is little-endian int16, as are all Elemem hosts.
+      std::memcpy(dest, rec_base + record*record_bytes + 2*within, 2*amnt);
+      dest += amnt;
+      len -= amnt;
+      record++;
+      within = 0;
+    }
+  }
+
+
+  void EDFMap::ReadLooped(int16_t* dest, size_t chan, u64 start,
+      size_t len) const {
+    u64 total = NumSamples();
+    if (total == 0) {
+      Throw_RC_Type(File, ("No complete data records in " + filename).c_str());
+    }
+    start %= total;
+    while (len > 0) {
+      size_t amnt = size_t(std::min(u64(len), total - start));
+      Read(dest, chan, start, amnt);
+      dest += amnt;
+      len -= amnt;
+      start = 0;
+    }
+  }
+}
+
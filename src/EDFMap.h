@@ -0,0 +1,89 @@
+#ifndef EDFMAP_H
+#define EDFMAP_H
+
+#include "RC/Data1D.h"
+#include "RC/RStr.h"
+#include "RC/Types.h"
+
+namespace CML {
+  /// Reads EDF and EDF+ samples directly from a memory-mapped file.
+  /** Samples are copied out of the mapped data records on demand, so any
+   *  sample offset and any subset of channels can be read without
+   *  buffering or reopening the file.  EDF+ annotation signals are
+   *  skipped, so channel numbers match edflib's edfsignals.  All data
+   *  signals must share one samples per data record, as for EDFSave
+   *  output.  EDF+D files are read as if contiguous.
+   */
+  class EDFMap {
+    public:
+    EDFMap() = default;
+    ~EDFMap();
+
+    // Rule of 3.
+    EDFMap(const EDFMap&) = delete;
+    EDFMap& operator=(const EDFMap&) = delete;
+
+    /// Maps filename and parses its header.
+    void Open(const RC::RStr& filename);
+    void Close();
+    bool IsOpen() const { return base != nullptr; }
+
+    size_t NumChannels() const { return signals.size(); }
+    /// Samples per channel in the complete data records.
+    u64 NumSamples() const { return num_records * samples_per_record; }
+    /// Samples per second per channel.
+    f64 SamplingRate() const;
+    RC::RStr Label(size_t chan) const { return signals[chan].label; }
+
+    /// The complete data records present.
+    u64 NumRecords() const { return num_records; }
+    u64 HeaderBytes() const { return header_bytes; }
+    /// Bytes per data record, including any annotation signals.
+    u64 RecordBytes() const { return record_bytes; }
+    /// The header's data record count, or -1 if writing did not finish.
+    i64 HeaderRecords() const { return header_records; }
+    /// Seconds per data record.
+    f64 RecordDuration() const { return record_duration; }
+    /// Offset of the first EDF+ annotation signal within each data record,
+    /// or -1 if there is none.
+    i64 AnnotationOffset() const { return annot_offset; }
+    u64 AnnotationBytes() const { return annot_bytes; }
+
+    /// Copies len samples of chan from sample start into dest.
+    void Read(int16_t* dest, size_t chan, u64 start, size_t len) const;
+    /// As Read, continuing from the first sample past the end.
+    void ReadLooped(int16_t* dest, size_t chan, u64 start, size_t len) const;
+
+    RC::RStr filename;
+
+    protected:
+    void ParseHeader();
+
+    class Signal {
+      public:
+      RC::RStr label;
+      // Byte offset of this signal within each data record.
+      size_t record_offset;
+    };
+
+    const uint8_t* base = nullptr;
+    u64 file_size = 0;
+#ifdef WIN32
+    void* file_hdl = nullptr;
+    void* map_hdl = nullptr;
+#endif
+
+    u64 header_bytes = 0;
+    u64 record_bytes = 0;
+    u64 num_records = 0;
+    i64 header_records = -1;
+    i64 annot_offset = -1;
+    u64 annot_bytes = 0;
+    f64 record_duration = 0;
+    size_t samples_per_record = 0;
+    RC::Data1D<Signal> signals;
+  };
+}
+
+#endif // EDFMAP_H
+
@@ -0,0 +1,272 @@
+#include "EDFRecovery.h"
+#include "EDFMap.h"
+#include "ConfigFile.h"
+#include "RC/Errors.h"
+#include "RC/File.h"
+#include <cmath>
+#include <cstdio>
+#include <string>
+
+#ifdef WIN32
+#include <io.h>
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#endif
+
+namespace CML {
+  // edflib's limit for annotation text.
+  static constexpr size_t max_annotation_len = 40;
+  static constexpr char tal_sep = 20;
+  // The header's data record count is 8 digits.
+  static constexpr u64 max_header_records = 99999999;
+
+
+  static void SyncFile(FILE* fp) {
+    fflush(fp);
+#ifdef WIN32
+    _commit(_fileno(fp));
+#else
+    fsync(fileno(fp));
+#endif
+  }
+
+
+  static bool SeekTo(FILE* fp, u64 pos) {
+#ifdef WIN32
+    return _fseeki64(fp, i64(pos), SEEK_SET) == 0;
+#else
+    return fseeko(fp, off_t(pos), SEEK_SET) == 0;
+#endif
+  }
+
+
+  static u64 FileSize(FILE* fp) {
+#ifdef WIN32
+    _fseeki64(fp, 0, SEEK_END);
+    return u64(_ftelli64(fp));
+#else
+    fseeko(fp, 0, SEEK_END);
+    return u64(ftello(fp));
+#endif
+  }
+
+
+  // Renames over dest, durably where the platform allows.
+  static void ReplaceFile(const RC::RStr& src, const RC::RStr& dest) {
+#ifdef WIN32
+    if ( ! MoveFileExA(src.c_str(), dest.c_str(),
+          MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) ) {
+      Throw_RC_Type(File, ("Could not replace " + dest).c_str());
+    }
+#else
+    if (std::rename(src.c_str(), dest.c_str())) {
+      Throw_RC_Type(File, ("Could not replace " + dest).c_str());
+    }
+    // Sync the directory entry too.
+    int dir_fd = open(RC::File::Dirname(dest).c_str(), O_RDONLY);
+    if (dir_fd >= 0) {
+      fsync(dir_fd);
+      close(dir_fd);
+    }
+#endif
+  }
+
+
+  void SaveDurably(const JSONFile& json, const RC::RStr& filename) {
+    RC::RStr tmp_file = filename + ".tmp";
+    RC::FileWrite fw(tmp_file);
+    json.Save(fw);
+    SyncFile(fw.Raw());
+    fw.Close();
+    ReplaceFile(tmp_file, filename);
+  }
+
+
+  void EDFCheckpoint::Save(const RC::RStr& journal_file) const {
+    JSONFile journal;
+    journal.json["edf_file"] = edf_file.Raw();
+    journal.json["records"] = records;
+    journal.json["time"] = time_ms;
+    journal.json["annotations"] = nlohmann::json::array();
+    for (size_t i=0; i<annotations.size(); i++) {
+      journal.json["annotations"].push_back({
+          {"onset", annotations[i].onset},
+          {"text", annotations[i].text.Raw()}});
+    }
+
+    SaveDurably(journal, journal_file);
+  }
+
+
+  void EDFCheckpoint::Load(const RC::RStr& journal_file) {
+    JSONFile journal(journal_file);
+    journal.Get(edf_file, "edf_file");
+    journal.Get(records, "records");
+    journal.Get(time_ms, "time");
+
+    const nlohmann::json& annots = journal.json.at("annotations");
+    annotations.Resize(annots.size());
+    for (size_t i=0; i<annots.size(); i++) {
+      annotations[i].onset = annots[i].at("onset").get<i64>();
+      annotations[i].text = annots[i].at("text").get<std::string>();
+    }
+  }
+
+
+  // Returns the length of the time-keeping annotation opening a data
+  // record's annotation signal if it marks the given onset, or else 0.
+  static size_t TimeKeepingLen(const std::string& slot, f64 onset_sec) {
+    if (slot.size() < 4 || slot[0] != '+') {
+      return 0;
+    }
+    size_t end = slot.find(tal_sep);
+    if (end == std::string::npos || end + 2 >= slot.size() ||
+        slot[end+1] != tal_sep || slot[end+2] != 0) {
+      return 0;
+    }
+    f64 onset = RC::RStr(slot.substr(1, end-1)).Get_f64();
+    if (std::abs(onset - onset_sec) > 1e-6 * (1 + onset_sec)) {
+      return 0;
+    }
+    return end + 3;
+  }
+
+
+  // Appends an annotation after the time-keeping one, as edflib does when
+  // closing a file.
+  static bool AddAnnotation(std::string& slot, size_t tal_len,
+      const EDFAnnotation& annot) {
+    i64 onset = std::max(annot.onset, i64(0));
+    std::string tal = "+" + std::to_string(onset / 10000);
+    if (onset % 10000) {
+      char frac[8];
+      snprintf(frac, sizeof(frac), ".%04d", int(onset % 10000));
+      tal += frac;
+    }
+    tal += tal_sep;
+    tal += annot.text.Raw().substr(0, max_annotation_len);
+    tal += tal_sep;
+
+    if (tal_len + tal.size() >= slot.size()) {
+      return false;
+    }
+    std::fill(slot.begin() + long(tal_len), slot.end(), 0);
+    std::copy(tal.begin(), tal.end(), slot.begin() + long(tal_len));
+    return true;
+  }
+
+
+  EDFRecoveryResult RecoverEDF(const RC::RStr& edf_file) {
+    EDFRecoveryResult result;
+
+    EDFMap map;
+    map.Open(edf_file);
+    if (map.HeaderRecords() >= 0) {
+      Throw_RC_Type(File, (edf_file + " was closed normally and needs no "
+            "recovery.").c_str());
+    }
+    if (map.AnnotationOffset() < 0) {
+      Throw_RC_Type(File, ("No EDF+ annotation signal to verify records "
+            "in " + edf_file).c_str());
+    }
+    u64 records_present = map.NumRecords();
+    u64 header_bytes = map.HeaderBytes();
+    u64 record_bytes = map.RecordBytes();
+    f64 record_duration = map.RecordDuration();
+    u64 annot_offset = u64(map.AnnotationOffset());
+    size_t annot_bytes = size_t(map.AnnotationBytes());
+    map.Close();
+
+    EDFCheckpoint checkpoint;
+    RC::RStr journal_file = EDFCheckpoint::JournalFile(edf_file);
+    if (RC::File::Exists(journal_file)) {
+      checkpoint.Load(journal_file);
+      result.journaled = true;
+      result.checkpoint_records = checkpoint.records;
+    }
+
+    FILE* fp = fopen(edf_file.c_str(), "r+b");
+    if (fp == nullptr) {
+      Throw_RC_Type(File, ("Could not open " + edf_file +
+            " for recovery").c_str());
+    }
+    RC::FileWrite fw(fp, true);  // Closes fp on any exit.
+    u64 file_size = FileSize(fp);
+
+    auto read_slot = [&](u64 record, std::string& slot) {
+      slot.assign(annot_bytes, 0);
+      return SeekTo(fp, header_bytes + record*record_bytes + annot_offset) &&
+        fread(&slot[0], 1, annot_bytes, fp) == annot_bytes;
+    };
+
+    // Records are kept while their time-keeping annotations, written last,
+    // are intact.  Those the journal counts as synced are verified too, so
+    // a stale or mismatched journal cannot keep records the file lacks.
+    std::string slot;
+    u64 max_kept = std::min(records_present, max_header_records);
+    u64 kept = 0;
+    while (kept < max_kept && read_slot(kept, slot) &&
+        TimeKeepingLen(slot, kept * record_duration) > 0) {
+      kept++;
+    }
+    result.checkpoint_intact = kept >= checkpoint.records;
+    if (kept == 0) {
+      Throw_RC_Type(File, ("No complete data records to recover in " +
+            edf_file).c_str());
+    }
+
+    // edflib holds annotations until closing, giving one per data record.
+    EDFAnnotation rec_end;
+    rec_end.onset = i64(std::round(kept * record_duration * 10000));
+    rec_end.text = "Recording ends";
+    RC::Data1D<EDFAnnotation> annotations = checkpoint.annotations;
+    annotations += rec_end;
+    for (u64 a=0; a<annotations.size() && a<kept; a++) {
+      if ( ! read_slot(a, slot) ) {
+        break;
+      }
+      size_t tal_len = TimeKeepingLen(slot, a * record_duration);
+      if (tal_len == 0 || ! AddAnnotation(slot, tal_len, annotations[a])) {
+        continue;
+      }
+      SeekTo(fp, header_bytes + a*record_bytes + annot_offset);
+      fwrite(slot.data(), 1, slot.size(), fp);
+    }
+
+    char count[24];
+    snprintf(count, sizeof(count), "%-8llu",
+        static_cast<unsigned long long>(kept));
+    if ( ! SeekTo(fp, 236) || fwrite(count, 1, 8, fp) != 8 ) {
+      Throw_RC_Type(File, ("Could not write the header of " +
+            edf_file).c_str());
+    }
+
+    u64 recovered_size = header_bytes + kept*record_bytes;
+    fflush(fp);
+#ifdef WIN32
+    int trunc_err = _chsize_s(_fileno(fp), i64(recovered_size));
+#else
+    int trunc_err = ftruncate(fileno(fp), off_t(recovered_size));
+#endif
+    if (trunc_err) {
+      Throw_RC_Type(File, ("Could not truncate " + edf_file).c_str());
+    }
+    SyncFile(fp);
+    fw.Close();
+
+    if (result.journaled) {
+      RC::File::Delete(journal_file);
+    }
+
+    result.records = kept;
+    result.duration_sec = kept * record_duration;
+    result.dropped_bytes = file_size > recovered_size ?
+      file_size - recovered_size : 0;
+    return result;
+  }
+}
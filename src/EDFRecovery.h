@@ -0,0 +1,78 @@
+#ifndef EDFRECOVERY_H
+#define EDFRECOVERY_H
+
+#include "RC/Data1D.h"
+#include "RC/RStr.h"
+#include "RC/Types.h"
+
+namespace CML {
+  class JSONFile;
+
+  /// Replaces filename atomically with json, synced to disk.
+  void SaveDurably(const JSONFile& json, const RC::RStr& filename);
+
+
+  class EDFAnnotation {
+    public:
+    // Units of 100us from the start of the file, as for edflib.
+    i64 onset = 0;
+    RC::RStr text;
+  };
+
+
+  /// The durable state of an EDF file being written, journaled beside it.
+  /** EDFWriter saves this once the data records it counts are synced to
+   *  disk.  The annotations are those edflib holds in memory until the file
+   *  is closed, so they can be restored if it never is.  The journal is
+   *  removed once the file closes normally.
+   */
+  class EDFCheckpoint {
+    public:
+    /// The journal kept for edf_file.
+    static RC::RStr JournalFile(const RC::RStr& edf_file) {
+      return edf_file + ".ckpt";
+    }
+
+    /// Replaces journal_file atomically, synced to disk.
+    void Save(const RC::RStr& journal_file) const;
+    void Load(const RC::RStr& journal_file);
+
+    RC::RStr edf_file;
+    // Complete data records synced to disk.
+    u64 records = 0;
+    // ms from 1970-01-01 00:00:00 UTC
+    f64 time_ms = 0;
+    RC::Data1D<EDFAnnotation> annotations;
+  };
+
+
+  class EDFRecoveryResult {
+    public:
+    // Data records durable at the last checkpoint, if journaled.
+    u64 checkpoint_records = 0;
+    bool journaled = false;
+    // False if fewer records were intact than the journal counted.
+    bool checkpoint_intact = true;
+    // Data records kept, which includes any complete records written
+    // after the last checkpoint.
+    u64 records = 0;
+    f64 duration_sec = 0;
+    // Incomplete or unverifiable data truncated from the end.
+    u64 dropped_bytes = 0;
+  };
+
+
+  /// Repairs an EDF file which was not closed, as after a crash.
+  /** The data records are kept from the start for as long as each
+   *  record's time-keeping annotation shows it was completely written,
+   *  including those the journal counts as checkpointed.  The file is
+   *  truncated after these, the header's data record count is set, and
+   *  the journaled annotations are restored with "Recording ends" marking
+   *  the recovered end.  The journal is then removed.
+   *  @param edf_file The unfinished EDF+ file from EDFSave.
+   *  @return A summary of what was recovered.
+   */
+  EDFRecoveryResult RecoverEDF(const RC::RStr& edf_file);
+}
+
+#endif // EDFRECOVERY_H
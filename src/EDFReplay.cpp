@@ -6,13 +6,30 @@
 /////////////////////////////////////////////////////////////////////////////
 
 #include "EDFReplay.h"
-#include "EDFSynch.h"
+#include "ConfigFile.h"
 #include "Popup.h"
 #include "RC/RTime.h"
 #include "RC/Errors.h"
+#include <cmath>
+#include <limits>
 
 
 namespace CML {
+  // The message types TaskNetWorker accepts from the task laptop.  Elemem
+  // logs its own EXIT with a data source of "elemem", which is not one.
+  static bool IsTaskMessage(const std::string& type, const JSONFile& line) {
+    std::string source;
+    if (line.TryGet(source, "data", "source") && source == "elemem") {
+      return false;
+    }
+    return type == RC::OneOf("CONNECTED", "CONFIGURE", "READY", "HEARTBEAT",
+        "WORD", "STIMSELECT", "STIM", "CLSTIM", "CLSHAM", "CLNORMALIZE",
+        "CLLABEL", "CCLSTARTSTIM", "SESSION", "TRIAL", "EXIT", "ORIENT",
+        "COUNTDOWN", "DISTRACT", "RECALL", "REST", "INSTRUCT", "TRIALEND",
+        "MATH", "ENCODING");
+  }
+
+
   EDFReplay::EDFReplay(RC::RStr edf_filename)
       : filename(edf_filename) {
   }
@@ -23,149 +40,189 @@ namespace CML {
   }
 
 
-  void EDFReplay::Open(bool prebuffer) {
+  void EDFReplay::Open() {
     static bool first_run = true;
 
-    Close();
-
-    int res = EDFSynch::OpenRead(filename.c_str(), &edf_hdr,
-        EDFLIB_DO_NOT_READ_ANNOTATIONS);
-    if (res < 0) {
-      Throw_RC_Type(File, (RC::RStr("Could not open edf file: ") +
-          filename).c_str());
+    // The mapping persists, so reopening only rewinds.
+    if ( ! edf.IsOpen() ) {
+      edf.Open(filename);
+    }
+    // EDFMap accepts this, as crash-truncated files are recovered with it.
+    if (edf.NumSamples() == 0) {
+      Throw_RC_Type(File, ("No complete data records to replay in edf file " +
+            filename).c_str());
     }
 
-    edf_hdl = res;
+    for (size_t c=0; c<channels.size(); c++) {
+      if (channels[c] >= edf.NumChannels()) {
+        Throw_RC_Type(File, ("Replay channel " + RC::RStr(channels[c]+1) +
+              " not in edf file " + filename).c_str());
+      }
+    }
 
     // Invariant match linked to GetData function.
-    file_bufs.Resize(edf_hdr.edfsignals);
-    channel_data.resize(file_bufs.size());
+    size_t num_chans = channels.size() ? channels.size() : edf.NumChannels();
+    channel_data.resize(num_chans);
+    for (size_t c=0; c<channel_data.size(); c++) {
+      // TODO - Set this from montage, using edf.Label?
+      // Note, might make usage more difficult.  Consider a fallback mode.
+      channel_data[c].chan = channels.size() ? channels[c] : uint16_t(c);
+    }
 
-    amnt_buffered = 0;
-    max_requested = 1024;
+    position = uint64_t(start_sec * edf.SamplingRate()) % edf.NumSamples();
+    next_event = 0;
 
     if (first_run) {
       PopupWin("EDFReplay activated", "Warning");
       first_run = false;
     }
 
-    if (prebuffer) {
-      Prebuffer();
-
-      TimeSinceLast_samples();
-    }
+    TimeSinceLast_samples();
   }
 
 
   void EDFReplay::Close() {
-    if (edf_hdl >= 0) {
-      EDFSynch::Close(edf_hdl);
-    }
-    edf_hdl = -1;
+    edf.Close();
   }
 
 
   void EDFReplay::InitializeChannels(size_t sampling_rate_Hz) {
     sampling_rate = sampling_rate_Hz;
+    virtual_running = false;
     Open();
   }
 
 
   void EDFReplay::StartingExperiment() {
+    // Replayed READY messages arrive here too, and must not rewind.
+    if (virtual_clock) {
+      if (virtual_running) {
+        return;
+      }
+      virtual_running = true;
+    }
     Open();
   }
 
 
   void EDFReplay::ExperimentReady() {
-    Open();
+    StartingExperiment();
   }
 
 
-  void EDFReplay::Prebuffer() {
-    if (file_bufs.size() == 0) { return; }
+  void EDFReplay::SetChannels(const RC::Data1D<uint16_t>& new_channels) {
+    channels = new_channels;
+    if (edf.IsOpen()) {
+      Open();
+    }
+  }
 
-    size_t buf_target = 2*max_requested;
-    size_t smpdr = edf_hdr.signalparam[0].smp_in_datarecord;
-    u32 attempt_num = 0;
-    while (amnt_buffered < buf_target && (attempt_num++)<4) {
-      size_t dr_cnt = (buf_target - amnt_buffered)/smpdr;
 
-      // No space for sampling rate data records.
-      if (dr_cnt < 1) {
-        // Because full of them.
-        if (buf_target / smpdr > 2) {
-          break;
-        }
-        // Because buffer too small.
-        else {
-          max_requested *= 2;
-          buf_target *= 2;
-          attempt_num--;
-          continue;
-        }
-      }
+  void EDFReplay::Seek(double seconds) {
+    start_sec = std::max(0.0, seconds);
+    if (edf.IsOpen()) {
+      Open();
+    }
+  }
 
 
-      int amnt_read_final = 0;
+  void EDFReplay::SetVirtualClock(bool enable) {
+    virtual_clock = enable;
+    virtual_running = false;
+  }
 
-      for (size_t s=0; s<file_bufs.size(); s++) {
-        // Down-shift existing buffer contents.
-        size_t first_filled = file_bufs[s].size() - amnt_buffered;
-        if (amnt_buffered > 0 && first_filled > 0) {
-          file_bufs[s].CopyData(0, first_filled);
-        }
 
-        // Fill up the rest
-        file_bufs[s].Resize(std::max(buf_target, amnt_buffered + smpdr));
-        int amnt_read = edfread_digital_samples(edf_hdl, s, smpdr,
-            file_bufs[s].Raw() + amnt_buffered);
+  void EDFReplay::LoadEvents(const RC::RStr& event_log) {
+    RC::FileRead fr(event_log);
+    RC::Data1D<RC::RStr> lines;
+    fr.ReadAllLines(lines);
+
+    bool have_start = false;
+    bool has_exit = false;
+    double start_ms = 0;
+    std::vector<ReplayEvent> loaded;
+    for (size_t i=0; i<lines.size(); i++) {
+      JSONFile line;
+      std::string type;
+      double time_ms;
+      try {
+        line.Parse(lines[i]);
+      }
+      catch (...) {
+        continue;
+      }
+      if ( ! line.TryGet(type, "type") || ! line.TryGet(time_ms, "time") ) {
+        continue;
+      }
 
-        if (amnt_read < 0) {
-          DEBLOG_OUT(amnt_read, s, edf_hdl, filename);
-          Throw_RC_Type(File, "EDFReplay file read error");
+      if (type == "EEGSTART") {
+        if ( ! have_start ) {
+          start_ms = time_ms;
+          have_start = true;
         }
+      }
+      else if (IsTaskMessage(type, line)) {
+        has_exit = has_exit || type == "EXIT";
+        loaded.push_back({time_ms, lines[i].Raw()});
+      }
+    }
 
-        file_bufs[s].Resize(amnt_buffered + amnt_read);
+    if ( ! have_start ) {
+      Throw_RC_Type(File, ("No EEGSTART to align replay events in " +
+            event_log).c_str());
+    }
 
-        if (s==0) {
-          amnt_read_final = amnt_read;
-        }
-        else {
-          if (amnt_read_final != amnt_read) {
-            Throw_RC_Type(File, "Uneven amounts of data in edf channels.");
-          }
-        }
-      }
+    for (auto& ev : loaded) {
+      ev.offset_ms -= start_ms;
+    }
+    // A session cut short has no EXIT, so end it with the data instead.
+    if ( ! has_exit ) {
+      loaded.push_back({std::numeric_limits<double>::infinity(),
+          "{\"type\":\"EXIT\"}"});
+    }
+    std::stable_sort(loaded.begin(), loaded.end(),
+        [](const ReplayEvent& a, const ReplayEvent& b) {
+          return a.offset_ms < b.offset_ms;
+        });
+    events = std::move(loaded);
+    next_event = 0;
+  }
 
-      amnt_buffered += amnt_read_final;
-      if (file_bufs.size() > 0 && file_bufs[0].size() < amnt_buffered) {
-        Throw_RC_Type(File, "Reported reading more than capacity!  "
-            "This should never happen.");
-      }
 
-      // Reopen the file and grab some more from the beginning if not full.
-      if (size_t(amnt_read_final) != smpdr) {
-        Open(false);
-      }
-      else {
+  bool EDFReplay::VirtualClock() const {
+    return virtual_clock && virtual_running;
+  }
+
+
+  void EDFReplay::TakeDueEvents(std::vector<std::string>& due) {
+    if ( ! VirtualClock() ) {
+      return;
+    }
+
+    bool at_end = position >= edf.NumSamples();
+    while (next_event < events.size()) {
+      if (EventSample(next_event) > position && ! at_end) {
         break;
       }
+      due.push_back(events[next_event].line);
+      next_event++;
     }
   }
 
 
-  int16_t EDFReplay::ClampInt(int val) {
-    if (val < -32768) { return -32768; }
-    if (val > 32767) { return 32767; }
-    return val;
+  uint64_t EDFReplay::EventSample(size_t i) const {
+    double offset_ms = std::max(0.0, events[i].offset_ms);
+    if (std::isinf(offset_ms)) {
+      return std::numeric_limits<uint64_t>::max();
+    }
+    return uint64_t(offset_ms * edf.SamplingRate() / 1000);
   }
 
 
   uint64_t EDFReplay::TimeSinceLast_samples() {
-    static uint64_t last = uint64_t(RC::Time::Get()*sampling_rate);
     uint64_t cur = uint64_t(RC::Time::Get()*sampling_rate);
-    uint64_t diff = cur - last;
-    last = cur;
+    uint64_t diff = cur - last_time_samples;
+    last_time_samples = cur;
     return diff;
   }
 
@@ -175,40 +232,60 @@ namespace CML {
       throw std::runtime_error("Initialize channels before getting data");
     }
 
-    if (edf_hdl < 0) {
+    if ( ! edf.IsOpen() ) {
       Throw_RC_Type(File,
           ("EDF file " + RC::RStr(filename) + " not opened.").c_str());
     }
 
-    size_t data_len = TimeSinceLast_samples();
-    max_requested = std::max(max_requested, data_len);
-    if (amnt_buffered < data_len) {
-      Prebuffer();
+    if (virtual_clock) {
+      return GetVirtualData();
     }
 
-    if (file_bufs.size() < 1) {
-      Throw_RC_Type(File, "No channels in edf file.");
+    size_t data_len = TimeSinceLast_samples();
+
+    // Samples are decoded straight from the mapped data records, wrapping
+    // to the start of the file to loop.
+    for (size_t c=0; c<channel_data.size(); c++) {
+      channel_data[c].data.resize(data_len);
+      edf.ReadLooped(channel_data[c].data.data(), channel_data[c].chan,
+          position, data_len);
     }
 
-    if (amnt_buffered < data_len) {
-      Throw_RC_Type(File, ("Could not obtain requested " + RC::RStr(data_len)
-          + " samples from " + filename).c_str());
+    position = (position + data_len) % edf.NumSamples();
+
+    return channel_data;
+  }
+
+
+  const std::vector<TrialData>& EDFReplay::GetVirtualData() {
+    uint64_t data_len = 0;
+    if (virtual_running) {
+      if (position < edf.NumSamples()) {
+        data_len = std::max(uint64_t(1),
+            uint64_t(virtual_block_sec * edf.SamplingRate()));
+        data_len = std::min(data_len, edf.NumSamples() - position);
+        // End the block where the next event is due, so it is delivered
+        // between exactly the right samples.
+        if (next_event < events.size()) {
+          uint64_t sample = EventSample(next_event);
+          if (sample > position) {
+            data_len = std::min(data_len, sample - position);
+          }
+        }
+      }
+      else {
+        virtual_running = false;
+        DebugLog("EDFReplay virtual clock reached the end of " + filename);
+      }
     }
 
-    size_t offset = file_bufs[0].size() - amnt_buffered;
     for (size_t c=0; c<channel_data.size(); c++) {
-      // TODO - Set this from montage, using edf_hdr's edf_param_struct label?
-      // Note, might make usage more difficult.  Consider a fallback mode.
-      channel_data[c].chan = c;
       channel_data[c].data.resize(data_len);
-      for (size_t d=0; d<data_len; d++) {
-        channel_data[c].data[d] = ClampInt(file_bufs[c][offset + d]);
-      }
+      edf.Read(channel_data[c].data.data(), channel_data[c].chan,
+          position, data_len);
     }
-
-    amnt_buffered -= data_len;
+    position += data_len;
 
     return channel_data;
   }
 }
-
@@ -8,7 +8,7 @@
 #ifndef EDFREPLAY_H
 #define EDFREPLAY_H
 
-#include "edflib/edflib.h"
+#include "EDFMap.h"
 #include "EEGSource.h"
 #include "RC/Data1D.h"
 #include "RC/RStr.h"
@@ -39,22 +39,56 @@ namespace CML {
 
     const std::vector<TrialData>& GetData();
 
+    /// Replays only these zero-based file channels.  Empty for all.
+    void SetChannels(const RC::Data1D<uint16_t>& new_channels);
+    /// Sets the time into the file that replay starts, and restarts, from.
+    void Seek(double seconds);
+
+    /// Replays on a virtual sample clock instead of real time.
+    /** Replay waits for the experiment to start, then provides data as
+     *  fast as EEGAcq's consumers accept it, once through the file.
+     */
+    void SetVirtualClock(bool enable);
+    /// Loads task laptop messages from a prior session's event.log.
+    /** Each is due at its sample offset from that session's EEGSTART,
+     *  which marks the start of the recording being replayed.  Any due
+     *  before the replay start are delivered as it starts.
+     */
+    void LoadEvents(const RC::RStr& event_log);
+
+    bool VirtualClock() const;
+    void TakeDueEvents(std::vector<std::string>& events);
+
 
     protected:
 
-    void Open(bool prebuffer=true);  // Automatic at first use.
-    void Prebuffer();
-    int16_t ClampInt(int val);
+    void Open();  // Automatic at first use.
     uint64_t TimeSinceLast_samples();
+    const std::vector<TrialData>& GetVirtualData();
+    uint64_t EventSample(size_t i) const;
+
+    // Samples per block on the virtual clock, as read live every 5ms.
+    static constexpr double virtual_block_sec = 0.005;
+
+    class ReplayEvent {
+      public:
+      double offset_ms;
+      std::string line;
+    };
 
     size_t sampling_rate = 0;
-    int edf_hdl = -1;
-    edf_hdr_struct edf_hdr;
+    EDFMap edf;
     RC::RStr filename;
-    std::vector<TrialData> channel_data;  // TODO Do we need this?
-    RC::Data1D<RC::Data1D<int>> file_bufs;
-    size_t amnt_buffered = 0;
-    size_t max_requested = 1024;
+    RC::Data1D<uint16_t> channels;
+    std::vector<TrialData> channel_data;
+    double start_sec = 0;
+    uint64_t position = 0;
+    uint64_t last_time_samples = 0;
+
+    bool virtual_clock = false;
+    bool virtual_running = false;
+    std::vector<ReplayEvent> events;
+    size_t next_event = 0;
   };
 }
 
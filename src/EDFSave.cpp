@@ -7,8 +7,200 @@
 #include "ConfigFile.h"
 #include "Popup.h"
 #include "Utils.h"
+#include <cmath>
+
+#ifdef WIN32
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
 
 namespace CML {
+  void EDFRing::Resize(size_t num_slots, size_t channels,
+      size_t record_len) {
+    // Drain any prior permits, then release one per slot.
+    while (free_slots.tryAcquire()) { }
+    records.Resize(num_slots);
+    for (size_t s=0; s<num_slots; s++) {
+      records[s].Resize(channels);
+      for (size_t c=0; c<channels; c++) {
+        records[s][c].Resize(record_len);
+      }
+    }
+    free_slots.release(int(num_slots));
+  }
+
+
+  void EDFWriter::Begin_Handler(const int& new_edf_hdl,
+      const RC::RStr& filename, const RC::Ptr<EDFRing>& new_ring,
+      const EDFCheckpoint& new_checkpoint,
+      const u64& new_checkpoint_records) {
+    End_Handler();
+    edf_hdl = new_edf_hdl;
+    ring = new_ring;
+    write_err = 0;
+    bytes_written = 0;
+    prealloc_end = 0;
+#ifdef __linux__
+    prealloc_fd = open(filename.c_str(), O_WRONLY);
+#endif
+
+    checkpoint = new_checkpoint;
+    checkpoint_records = new_checkpoint_records;
+    records_since_checkpoint = 0;
+    journal_file = EDFCheckpoint::JournalFile(filename);
+    if (checkpoint_records > 0) {
+#ifdef WIN32
+      sync_fd = _open(filename.c_str(), _O_WRONLY | _O_BINARY);
+#else
+      sync_fd = open(filename.c_str(), O_WRONLY);
+#endif
+      if (sync_fd < 0) {
+        checkpoint_records = 0;
+        ErrorWin("Could not open " + filename + " to sync checkpoints.  "
+            "Recording without checkpoints.");
+      }
+    }
+  }
+
+
+  void EDFWriter::WriteRecord_Handler(const size_t& slot) {
+    auto& record = ring->records[slot];
+    if (write_err == 0 && edf_hdl >= 0) {
+      u64 record_bytes = 0;
+      for (size_t c=0; c<record.size(); c++) {
+        record_bytes += record[c].size() * sizeof(int16_t);
+      }
+      Preallocate(record_bytes);
+
+      for (size_t c=0; c<record.size(); c++) {
+        int err = edfwrite_digital_short_samples(edf_hdl, record[c].Raw());
+        if (err) {
+          write_err = err;
+          break;
+        }
+      }
+      bytes_written += record_bytes;
+
+      if (write_err == 0) {
+        checkpoint.records++;
+        records_since_checkpoint++;
+        if (checkpoint_records > 0 &&
+            records_since_checkpoint >= checkpoint_records) {
+          Checkpoint();
+        }
+      }
+    }
+    ring->free_slots.release();
+  }
+
+
+  void EDFWriter::Rotate_Handler(const int& new_edf_hdl,
+      const RC::RStr& filename, const EDFCheckpoint& new_checkpoint,
+      const u64& new_checkpoint_records, const EDFSegment& finished) {
+    EDFSegment done = finished;
+    if (End_Handler()) {
+      done.write_error = true;
+    }
+    finalizer->Finalize(done);
+
+    RC::Ptr<EDFRing> same_ring = ring;
+    Begin_Handler(new_edf_hdl, filename, same_ring, new_checkpoint,
+        new_checkpoint_records);
+  }
+
+
+  int EDFWriter::End_Handler() {
+#ifdef __linux__
+    if (prealloc_fd >= 0) {
+      close(prealloc_fd);
+    }
+#endif
+    prealloc_fd = -1;
+    if (sync_fd >= 0) {
+#ifdef WIN32
+      _close(sync_fd);
+#else
+      close(sync_fd);
+#endif
+    }
+    sync_fd = -1;
+    checkpoint_records = 0;
+    edf_hdl = -1;
+    return write_err;
+  }
+
+
+  // Syncs the data records written so far to disk, which edflib has
+  // already flushed to the OS, and only then journals them.
+  void EDFWriter::Checkpoint() {
+    records_since_checkpoint = 0;
+    try {
+#ifdef WIN32
+      int sync_err = _commit(sync_fd);
+#else
+      int sync_err = fsync(sync_fd);
+#endif
+      if (sync_err) {
+        Throw_RC_Type(File, "Could not sync edf data to disk");
+      }
+      checkpoint.time_ms = RC::Time::Get()*1e3;
+      checkpoint.Save(journal_file);
+    }
+    catch (RC::ErrorMsg& err) {
+      // The last good checkpoint remains for recovery.
+      checkpoint_records = 0;
+      ErrorWin(RC::RStr("EDF checkpoints stopped.  ") + err.GetError());
+    }
+  }
+
+
+  // Reserves file space a minute ahead, so the filesystem allocates in
+  // large extents instead of on every record.  The file size is kept, so
+  // edflib and readers see no difference.
+  void EDFWriter::Preallocate(u64 record_bytes) {
+#ifdef __linux__
+    if (prealloc_fd < 0 || bytes_written + record_bytes <= prealloc_end) {
+      return;
+    }
+    prealloc_end = bytes_written + prealloc_records * record_bytes;
+    // Margin for the header and annotation records.
+    u64 margin = 1024*1024;
+    if (fallocate(prealloc_fd, FALLOC_FL_KEEP_SIZE, 0,
+          off_t(prealloc_end + margin))) {
+      // Unsupported here, so write without it.
+      close(prealloc_fd);
+      prealloc_fd = -1;
+    }
+#else
+    (void)record_bytes;
+#endif
+  }
+
+
+  // Releases space preallocated beyond the end of a closed file.
+  static void TrimPreallocation(const RC::RStr& filename) {
+#ifdef __linux__
+    int fd = open(filename.c_str(), O_WRONLY);
+    if (fd < 0) {
+      return;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0) {
+      if (ftruncate(fd, st.st_size)) {
+        // Only unused space is lost.
+      }
+    }
+    close(fd);
+#else
+    (void)filename;
+#endif
+  }
+
+
   template<class F, class P>
   void EDFSave::SetChanParam(F func, P p, RC::RStr error_msg) {
     for (size_t i=0; i<channels.size(); i++) {
@@ -19,6 +211,19 @@ namespace CML {
   }
 
 
+  // Adds an annotation, keeping it for the checkpoint journal.
+  void EDFSave::Annotate(i64 onset, const RC::RStr& text,
+      const char* error_msg) {
+    if (edfwrite_annotation_utf8(edf_hdl, onset, -1LL, text.c_str())) {
+      Throw_RC_Type(File, error_msg);
+    }
+    EDFAnnotation annot;
+    annot.onset = onset;
+    annot.text = text;
+    annotations += annot;
+  }
+
+
   void EDFSave::StartFile_Handler(const RC::RStr& filename,
                                   const FullConf& conf) {
     if (conf.elec_config.IsNull()) {
@@ -34,17 +239,15 @@ namespace CML {
     }
 
     StopSaving_Handler();
-    edf_hdl = EDFSynch::OpenWrite(filename.c_str(),
-        EDFLIB_FILETYPE_EDFPLUS, int(channels.size()));
+    // Segments of a prior recording may still be closing.
+    finalizer.Sync();
 
-    if (edf_hdl < 0) {
-      Throw_RC_Type(File,
-          (RC::RStr("Could not open ")+filename+" for edf writing").c_str());
-    }
-    error_triggered = false;
-    current_filename = filename;
+    save_conf = conf;
+    base_filename = filename;
+    segment = EDFSegment();
+    segment.filename = filename;
 
-    int datarecord_scaleby = 1;
+    datarecord_scaleby = 1;
     if (sampling_rate <= 10000) {
       datarecord_len = sampling_rate;
     }
@@ -53,93 +256,339 @@ namespace CML {
       datarecord_len = sampling_rate / datarecord_scaleby;
     }
 
-    // Set only when needed.
-    if (datarecord_scaleby != 1) {
-      // duration input has units of 100us.
-      if (edf_set_datarecord_duration(edf_hdl,
-                                      int(100000 / datarecord_scaleby))) {
-        Throw_RC_Type(File, "Could not set edf data record duration");
-      }
+    OpenSegment();
+    error_triggered = false;
+
+    amount_written = 0;
+    fill_slot = 0;
+    fill_len = 0;
+    slot_held = false;
+    if (ring.IsNull()) {
+      ring = new EDFRing();
     }
+    ring->Resize(ring_records, channels.size(), datarecord_len);
 
-    if (edfwrite_annotation_utf8(edf_hdl, 0LL, -1LL,
-        (RC::RStr("Sampling rate: ")+RC::RStr(sampling_rate)).c_str())) {
-      Throw_RC_Type(File, "Could not mark edf recording start");
+    RC::RStr manifest_file;
+    if (options.rotate_sec > 0 || options.rotate_mb > 0) {
+      manifest_file = RC::File::NoExtension(base_filename) +
+        "_segments.json";
     }
+    finalizer.NewRecording(manifest_file, sampling_rate);
+    finalizer.AddSegment(segment);
+    writer.Begin(edf_hdl, filename, ring, NewCheckpoint(),
+        CheckpointRecords());
 
-    SetChanParam(edf_set_samplefrequency, int(datarecord_len),
-        "Could not set edf sample frequency");
-    SetChanParam(edf_set_digital_maximum, 32767,
-        "Could not set edf digital maximum");
-    SetChanParam(edf_set_digital_minimum, -32768,
-        "Could not set edf digital minimum");
-    SetChanParam(edf_set_physical_maximum, 32767,
-        "Could not set edf physical maximum");
-    SetChanParam(edf_set_physical_minimum, -32768,
-        "Could not set edf physical minimum");
-    SetChanParam(edf_set_physical_dimension, "250nV",
-        "Could not set units");
+    bytes_since_poll = 0;
+    storage_free = StorageAvailable(current_filename);
+    BeStoragePolling();
 
-    for (size_t c=0; c<channels.size(); c++) {
-      if (edf_set_label(edf_hdl, int(c),
-                        conf.elec_config->data[c][0].c_str())) {
-        Throw_RC_Type(File, "Could not set edf label");
+    hndl->eeg_acq.RegisterEEGMonoCallback(callback_ID, SaveData);
+    hndl->eeg_acq.SetEEGMonoCallbackPolicy(callback_ID,
+        EEGCallbackPolicy::Lossless(this));
+  }
+
+
+  // Opens segment.filename and sets edf_hdl to it, with the header and
+  // opening annotations.
+  void EDFSave::OpenSegment() {
+    int new_hdl = EDFSynch::OpenWrite(segment.filename.c_str(),
+        EDFLIB_FILETYPE_EDFPLUS, int(channels.size()));
+
+    if (new_hdl < 0) {
+      Throw_RC_Type(File, (RC::RStr("Could not open ")+segment.filename+
+            " for edf writing").c_str());
+    }
+    edf_hdl = new_hdl;
+    segment.edf_hdl = new_hdl;
+    current_filename = segment.filename;
+    annotations.Clear();
+
+    try {
+      // Set only when needed.
+      if (datarecord_scaleby != 1) {
+        // duration input has units of 100us.
+        if (edf_set_datarecord_duration(edf_hdl,
+                                        int(100000 / datarecord_scaleby))) {
+          Throw_RC_Type(File, "Could not set edf data record duration");
+        }
+      }
+
+      Annotate(0, RC::RStr("Sampling rate: ")+RC::RStr(sampling_rate),
+          "Could not mark edf recording start");
+
+      SetChanParam(edf_set_samplefrequency, int(datarecord_len),
+          "Could not set edf sample frequency");
+      SetChanParam(edf_set_digital_maximum, 32767,
+          "Could not set edf digital maximum");
+      SetChanParam(edf_set_digital_minimum, -32768,
+          "Could not set edf digital minimum");
+      SetChanParam(edf_set_physical_maximum, 32767,
+          "Could not set edf physical maximum");
+      SetChanParam(edf_set_physical_minimum, -32768,
+          "Could not set edf physical minimum");
+      SetChanParam(edf_set_physical_dimension, "250nV",
+          "Could not set units");
+
+      for (size_t c=0; c<channels.size(); c++) {
+        if (edf_set_label(edf_hdl, int(c),
+                          save_conf.elec_config->data[c][0].c_str())) {
+          Throw_RC_Type(File, "Could not set edf label");
+        }
+      }
+
+      if (edf_set_equipment(edf_hdl, "Elemem using Blackrock NeuroPort")) {
+        Throw_RC_Type(File, "Could not set edf equipment");
+      }
+
+      std::string sub_name;
+
+      save_conf.exp_config->Get(sub_name, "subject");
+      if (edf_set_patientname(edf_hdl, sub_name.c_str())) {
+        Throw_RC_Type(File, "Could not set edf subject name");
+      }
+
+      if (segment.index == 0) {
+        Annotate(0, "Recording starts", "Could not mark edf recording start");
+      }
+      else {
+        Annotate(0, "Segment " + RC::RStr(segment.index) + " from sample " +
+            RC::RStr(segment.start_sample),
+            "Could not mark edf segment start");
       }
     }
+    catch (...) {
+      EDFSynch::Close(new_hdl);
+      edf_hdl = -1;
+      throw;
+    }
+
+    // A journal left by an earlier file of this name no longer applies.
+    RC::File::Delete(EDFCheckpoint::JournalFile(segment.filename));
+  }
+
 
-    if (edf_set_equipment(edf_hdl, "Elemem using Blackrock NeuroPort")) {
-      Throw_RC_Type(File, "Could not set edf equipment");
+  EDFCheckpoint EDFSave::NewCheckpoint() const {
+    EDFCheckpoint checkpoint;
+    checkpoint.edf_file = RC::File::Basename(segment.filename);
+    checkpoint.annotations = annotations;
+    return checkpoint;
+  }
+
+
+  u64 EDFSave::CheckpointRecords() const {
+    if (options.checkpoint_sec <= 0) {
+      return 0;
     }
+    // There are datarecord_scaleby data records per second.
+    return std::max(u64(1),
+        u64(std::round(options.checkpoint_sec * datarecord_scaleby)));
+  }
 
-    std::string sub_name;
 
-    conf.exp_config->Get(sub_name, "subject");
-    if (edf_set_patientname(edf_hdl, sub_name.c_str())) {
-      Throw_RC_Type(File, "Could not set edf subject name");
+  RC::RStr EDFSave::SegmentFilename(size_t index) const {
+    if (index == 0) {
+      return base_filename;
     }
+    char suffix[16];
+    snprintf(suffix, sizeof(suffix), "_%03zu.", index);
+    return RC::File::NoExtension(base_filename) + suffix + GetExt();
+  }
+
 
-    if (edfwrite_annotation_utf8(edf_hdl, 0LL, -1LL, "Recording starts")) {
-      Throw_RC_Type(File, "Could not mark edf recording start");
+  // Checked after each complete data record, so segments split between
+  // data records.
+  bool EDFSave::RotationDue() const {
+    if (options.rotate_sec > 0 &&
+        amount_written >= options.rotate_sec * sampling_rate) {
+      return true;
     }
+    u64 data_bytes = u64(amount_written) * channels.size() *
+      sizeof(int16_t);
+    if (options.rotate_mb > 0 &&
+        data_bytes >= options.rotate_mb * 1024 * 1024) {
+      return true;
+    }
+    return false;
+  }
+
 
+  // Continues the recording in a new segment file.  The writer finishes the
+  // queued records of the current one, then hands it to the finalizer.
+  void EDFSave::Rotate() {
+    EDFSegment finished = segment;
+    finished.num_samples = amount_written;
+
+    segment.index++;
+    segment.start_sample += amount_written;
+    segment.filename = SegmentFilename(segment.index);
+    try {
+      OpenSegment();
+    }
+    catch (...) {
+      // Stopping closes the current segment.
+      segment = finished;
+      segment.num_samples = 0;
+      edf_hdl = finished.edf_hdl;
+      current_filename = finished.filename;
+      throw;
+    }
     amount_written = 0;
-    amount_buffered = 0;
-    buffer.data.Clear();
-    hndl->eeg_acq.RegisterEEGMonoCallback(callback_ID, SaveData);
+
+    finalizer.AddSegment(segment);
+    writer.Rotate(edf_hdl, segment.filename, NewCheckpoint(),
+        CheckpointRecords(), finished);
+  }
+
+
+  EDFSave::~EDFSave() {
+    finalizer.Sync();
   }
 
 
   void EDFSave::StopSaving_Handler() {
     hndl->eeg_acq.RemoveEEGMonoCallback(callback_ID);
+    if (storage_timer.IsSet()) {
+      storage_timer->stop();
+    }
 
-    RC::RStr message = "";
     if (edf_hdl >= 0) {
-      if ( ! error_triggered ) {
-        // No error check, can be a destructor cleanup call.
-        edfwrite_annotation_utf8(edf_hdl,
-            static_cast<long long>(amount_written * 10000 / sampling_rate),
-            -1LL, "Recording ends");
+      // Finish queued records before edflib is used from another thread.
+      if (writer.End()) {
+        error_triggered = true;
       }
-      else {
-        message += "  EDF annotations could not be completed due to "
-            "a write error from edflib.";
+      if (slot_held) {
+        ring->free_slots.release();
+        slot_held = false;
       }
 
-      // Due to serious flaws in edflib, we must check for free space
-      // before calling close!
-      if (CheckStorage(current_filename, 512*1024*1024)) {
-        EDFSynch::Close(edf_hdl);
-      }
-      else {
-        message += "  Insufficient free space to properly close EDF file.";
-      }
+      EDFSegment finished = segment;
+      finished.num_samples = amount_written;
+      finished.write_error = error_triggered;
+      finished.last = true;
+      finalizer.Finalize(finished);
+
+      edf_hdl = -1;
+    }
+  }
+
+
+  void EDFFinalizer::NewRecording_Handler(const RC::RStr& new_manifest_file,
+      const size_t& new_sampling_rate) {
+    manifest_file = new_manifest_file;
+    sampling_rate = new_sampling_rate;
+    manifest = JSONFile();
+    manifest.SetFilename(manifest_file);
+    manifest.json["sampling_rate"] = sampling_rate;
+    manifest.json["complete"] = false;
+    manifest.json["segments"] = nlohmann::json::array();
+  }
+
+
+  void EDFFinalizer::AddSegment_Handler(const EDFSegment& segment) {
+    nlohmann::json entry;
+    entry["file"] = RC::File::Basename(segment.filename).Raw();
+    entry["start_sample"] = segment.start_sample;
+    entry["start_sec"] = f64(segment.start_sample) / sampling_rate;
+    manifest.json["segments"].push_back(entry);
+    SetStatus(segment, "recording");
+  }
+
+
+  void EDFFinalizer::Finalize_Handler(const EDFSegment& segment) {
+    if (segment.edf_hdl < 0) {
+      return;
+    }
+
+    RC::RStr message = "";
+    if ( ! segment.write_error ) {
+      // No error check, can be a destructor cleanup call.
+      edfwrite_annotation_utf8(segment.edf_hdl,
+          static_cast<long long>(segment.num_samples * 10000 /
+            sampling_rate), -1LL, "Recording ends");
+    }
+    else {
+      message += "  EDF annotations could not be completed due to "
+          "a write error from edflib.";
+    }
+
+    RC::RStr status = "finalized";
+    // Due to serious flaws in edflib, we must check for free space
+    // before calling close!
+    if (CheckStorage(segment.filename, 512*1024*1024)) {
+      EDFSynch::Close(segment.edf_hdl);
+      TrimPreallocation(segment.filename);
+      RC::File::Delete(EDFCheckpoint::JournalFile(segment.filename));
+    }
+    else {
+      status = "unfinished";
+      message += "  Insufficient free space to properly close EDF file.  "
+          "Once space is freed, File > Recover EDF Recording can repair "
+          "it.";
+    }
+
+    if (segment.last) {
+      manifest.json["complete"] = true;
+    }
+    SetStatus(segment, status);
+
+    if (message.length() > 0) {
+      ErrorWin("Error during EDF write of " + segment.filename + "." +
+               message + "  EDF file will be invalid.");
+    }
+  }
+
 
-      if (message.length() > 0) {
-        ErrorWin("Error during EDF write." + message +
-                 "  EDF file will be invalid.");
+  // Updates the manifest entry of segment, saving it.
+  void EDFFinalizer::SetStatus(const EDFSegment& segment,
+      const RC::RStr& status) {
+    if (manifest_file.empty()) {
+      return;
+    }
+    auto& segments = manifest.json["segments"];
+    for (auto& entry : segments) {
+      if (entry["file"] == RC::File::Basename(segment.filename).Raw()) {
+        entry["num_samples"] = segment.num_samples;
+        entry["duration_sec"] = f64(segment.num_samples) / sampling_rate;
+        entry["status"] = status.Raw();
       }
+    }
+    try {
+      SaveDurably(manifest, manifest_file);
+    }
+    catch (RC::ErrorMsg& err) {
+      ErrorWin(RC::RStr("Could not save EDF segment manifest.  ") +
+          err.GetError());
+    }
+  }
 
-      edf_hdl = -1;
+
+  void EDFSave::BeStoragePolling() {
+    if (DirectCallingMode()) {
+      return;
+    }
+
+    if (storage_timer.IsNull()) {
+      storage_timer = new QTimer();
+      AddToThread(storage_timer);  // For maintenance robustness.
+      // Okay because timer allocated within EDFSave thread here.
+      QObject::connect(storage_timer.Raw(), &QTimer::timeout,
+        RC::MakeCaller(this, &EDFSave::PollStorage));
+    }
+    storage_timer->start(storage_poll_ms);
+  }
+
+
+  void EDFSave::PollStorage() {
+    if (edf_hdl < 0) {
+      return;
+    }
+    try {
+      storage_free = StorageAvailable(current_filename);
+      bytes_since_poll = 0;
+    }
+    catch (...) {
+      // Keep predicting from the last poll.  SaveData polls again itself
+      // before acting on low space, reporting any error there.
     }
   }
 
@@ -151,79 +600,95 @@ namespace CML {
         StopSaving_Handler();
         return;
       }
-      if ( ! CheckStorage(current_filename, 1024*1024*1024)) {
-        ErrorWin("Free disk space below 1GB.  Halting edf save to "
-                 "close file and preserve existing data.  "
-                 "Experiment stop triggered.");
-        StopSaving_Handler();
-        hndl->StopExperiment();
-        return;
+
+      int write_err = writer.WriteError();
+      if (write_err) {
+        error_triggered = true;
+        Throw_RC_Type(File, ("Could not save data to edf file, error code" +
+                      RC::RStr(write_err)).c_str());
       }
 
-      if (buffer.data.size() < datar.size()) {
-        buffer.data.Resize(datar.size());
+      // Predicted from the data queued since the last poll, and confirmed
+      // with a fresh poll before halting.
+      if (storage_free < min_free_bytes + bytes_since_poll) {
+        storage_free = StorageAvailable(current_filename);
+        bytes_since_poll = 0;
+        if (storage_free < min_free_bytes) {
+          ErrorWin("Free disk space below 1GB.  Halting edf save to "
+                   "close file and preserve existing data.  "
+                   "Experiment stop triggered.");
+          StopSaving_Handler();
+          hndl->StopExperiment();
+          return;
+        }
       }
 
-      size_t max_written = 0;
+      size_t block_len = 0;
       for (size_t c=0; c<datar.size(); c++) {
-        buffer.data[c] += datar[c];
-        max_written = std::max(max_written, datar[c].size());
+        block_len = std::max(block_len, datar[c].size());
       }
-      amount_buffered += max_written;
-
-      // Must write data_record_duration at a time.  (sampling_rate by default)
-      while (amount_buffered > datarecord_len) {
-        // Write data in the order of the montage CSV.
-        for (size_t c=0; c<channels.size(); c++) {
-          if (channels[c] >= buffer.data.size()) {
-            error_triggered = true;
-            Throw_RC_Type(File, ("EDF save, configured channel " +
-                  RC::RStr(c+1) + " out of bounds").c_str());
-          }
 
-          if (buffer.data[channels[c]].size() < datarecord_len) {
-            error_triggered = true;
+      for (size_t c=0; c<channels.size(); c++) {
+        if (channels[c] >= datar.size()) {
+          error_triggered = true;
+          Throw_RC_Type(File, ("EDF save, configured channel " +
+                RC::RStr(c+1) + " out of bounds").c_str());
+        }
 
-            RC::RStr deb_msg("Data missing details\n");
-            deb_msg += "sampling_rate = " + RC::RStr(sampling_rate) + ", ";
-            deb_msg += "data_record_duration = " + RC::RStr(datarecord_len) + ", ";
-            deb_msg += "amount_buffered = " + RC::RStr(amount_buffered) + "\n";
-            for (size_t dc=0; dc<channels.size(); dc++) {
-              deb_msg += RC::RStr(buffer.data[channels[dc]].size()) + " elements:  ";
-              deb_msg += RC::RStr::Join(buffer.data[channels[dc]], ", ");
+        if (datar[channels[c]].size() < block_len) {
+          error_triggered = true;
+
+          RC::RStr deb_msg("Data missing details\n");
+          deb_msg += "sampling_rate = " + RC::RStr(sampling_rate) + ", ";
+          deb_msg += "data_record_duration = " + RC::RStr(datarecord_len) + ", ";
+          deb_msg += "block_len = " + RC::RStr(block_len) + "\n";
+          for (size_t dc=0; dc<channels.size(); dc++) {
+            if (channels[dc] < datar.size()) {
+              deb_msg += RC::RStr(datar[channels[dc]].size()) + " elements:  ";
+              deb_msg += RC::RStr::Join(datar[channels[dc]], ", ");
               deb_msg += "\n";
             }
-            DebugLog(deb_msg);
-
-            Throw_RC_Type(File,
-                ("Data missing on edf save, channel " + RC::RStr(channels[c]+1)).c_str());
           }
+          DebugLog(deb_msg);
 
-          int write_err = edfwrite_digital_short_samples(edf_hdl,
-              buffer.data[channels[c]].Raw());
-          if (write_err) {
-            error_triggered = true;
-            Throw_RC_Type(File, ("Could not save data to edf file, error code" +
-                          RC::RStr(write_err)).c_str());
-          }
+          Throw_RC_Type(File,
+              ("Data missing on edf save, channel " + RC::RStr(channels[c]+1)).c_str());
         }
+      }
 
-        // Move remaining data in buffer to beginning and efficiently shrink.
-        for (size_t c=0; c<buffer.data.size(); c++) {
-          if (buffer.data[c].size() < datarecord_len) {
-            continue;
-          }
-          if (buffer.data[c].size() > datarecord_len) {
-            // Not else, can't copy if == data_record_duration.
-            buffer.data[c].CopyData(0, datarecord_len);
+      // Copy into the ring in the order of the montage CSV, handing each
+      // completed data record to the writer.
+      size_t offset = 0;
+      while (offset < block_len) {
+        if ( ! slot_held ) {
+          // Waits only if the writer is a full ring behind.
+          ring->free_slots.acquire();
+          slot_held = true;
+          fill_len = 0;
+        }
+
+        size_t amnt = std::min(block_len - offset, datarecord_len - fill_len);
+        auto& record = ring->records[fill_slot];
+        for (size_t c=0; c<channels.size(); c++) {
+          std::copy_n(datar[channels[c]].Raw() + offset, amnt,
+              record[c].Raw() + fill_len);
+        }
+        fill_len += amnt;
+        offset += amnt;
+
+        if (fill_len == datarecord_len) {
+          writer.WriteRecord(fill_slot);
+          slot_held = false;
+          fill_slot = (fill_slot + 1) % ring->records.size();
+          amount_written += datarecord_len;
+          bytes_since_poll += channels.size() * datarecord_len *
+            sizeof(int16_t);
+
+          if (RotationDue()) {
+            Rotate();
           }
-          buffer.data[c].Resize(buffer.data[c].size()-datarecord_len);
         }
-        amount_buffered -= datarecord_len;
-        amount_written += datarecord_len;
       }
-
-      buffer.sample_len = amount_buffered; // Keep the buffer sample_len in line with the manual editing
     }
     catch (...) {
       StopSaving_Handler();
@@ -3,22 +3,180 @@
 
 #include "EEGFileSave.h"
 #include "EEGData.h"
+#include "EDFRecovery.h"
+#include "ConfigFile.h"
 #include "RC/File.h"
 #include "RC/Ptr.h"
 #include "RCqt/Worker.h"
+#include <QSemaphore>
+#include <QTimer>
+#include <atomic>
 
 namespace CML {
   class Handler;
 
+  /// Settings for EDFSave.
+  class EDFSaveOptions {
+    public:
+    // Seconds of data between durable checkpoints, or 0 for none.
+    f64 checkpoint_sec = 0;
+    // Start a new segment file after this many seconds, or megabytes of
+    // data records, or 0 to not rotate on either.
+    f64 rotate_sec = 0;
+    f64 rotate_mb = 0;
+  };
+
+
+  /// One file of a recording, which rotation splits between data records.
+  class EDFSegment {
+    public:
+    size_t index = 0;
+    RC::RStr filename;
+    int edf_hdl = -1;
+    // Samples per channel in the segments before this one.
+    u64 start_sample = 0;
+    u64 num_samples = 0;
+    bool write_error = false;
+    // No segment follows.
+    bool last = false;
+  };
+
+
+  /// Closes finished EDF segments in the background, and keeps the manifest.
+  /** edflib rewrites every annotation through the file on closing, which
+   *  this keeps off the EDFSave thread, so recording continues into the
+   *  next segment and stopping does not wait.  With rotation the manifest
+   *  lists each segment's samples and whether it closed properly.
+   */
+  class EDFFinalizer : public RCqt::WorkerThread {
+    public:
+    /// Starts a new manifest, or none if manifest_file is empty.
+    RCqt::TaskCaller<const RC::RStr, const size_t> NewRecording =
+      TaskHandler(EDFFinalizer::NewRecording_Handler);
+    /// Lists a segment as recording.
+    RCqt::TaskCaller<const EDFSegment> AddSegment =
+      TaskHandler(EDFFinalizer::AddSegment_Handler);
+    /// Marks the end of a segment and closes it.
+    RCqt::TaskCaller<const EDFSegment> Finalize =
+      TaskHandler(EDFFinalizer::Finalize_Handler);
+    /// Returns once all previously queued segments are closed.
+    RCqt::TaskBlocker<> Sync = TaskHandler(EDFFinalizer::Sync_Handler);
+
+    protected:
+    void NewRecording_Handler(const RC::RStr& new_manifest_file,
+        const size_t& new_sampling_rate);
+    void AddSegment_Handler(const EDFSegment& segment);
+    void Finalize_Handler(const EDFSegment& segment);
+    void Sync_Handler() { }
+
+    void SetStatus(const EDFSegment& segment, const RC::RStr& status);
+
+    RC::RStr manifest_file;
+    size_t sampling_rate = 0;
+    JSONFile manifest;
+  };
+
+
+  /// Preallocated EDF data records, shared by EDFSave and EDFWriter.
+  /** records[slot][channel] holds one data record per channel, in montage
+   *  order.  EDFSave acquires a free slot before filling it, and
+   *  EDFWriter releases it once written.
+   */
+  class EDFRing {
+    public:
+    void Resize(size_t num_slots, size_t channels, size_t record_len);
+
+    RC::Data1D<RC::Data1D<RC::Data1D<int16_t>>> records;
+    QSemaphore free_slots;
+  };
+
+
+  /// Writes whole EDF data records on its own thread.
+  /** This keeps disk stalls off the EDFSave task queue, and so off the
+   *  EEGAcq mono callback chain.  With checkpoints, the file is synced to
+   *  disk every checkpoint_records data records and then the checkpoint
+   *  journal updated, for RecoverEDF should the file never be closed.
+   */
+  class EDFWriter : public RCqt::WorkerThread {
+    public:
+    /** @param finalizer Closes the files this finishes with at Rotate.
+     */
+    EDFWriter(RC::Ptr<EDFFinalizer> finalizer) : finalizer(finalizer) { }
+
+    /// Starts writing to an open edf handle.
+    /** @param edf_hdl The handle from EDFSynch::OpenWrite.
+     *  @param filename The file for preallocation, where supported.
+     *  @param ring The records to write from.
+     *  @param checkpoint The annotations written so far, to journal.
+     *  @param checkpoint_records Data records between checkpoints, or 0 for
+     *  no checkpoints.
+     */
+    RCqt::TaskBlocker<const int, const RC::RStr, const RC::Ptr<EDFRing>,
+      const EDFCheckpoint, const u64>
+      Begin = TaskHandler(EDFWriter::Begin_Handler);
+    /// Writes and then frees one slot of the ring.
+    RCqt::TaskCaller<const size_t> WriteRecord =
+      TaskHandler(EDFWriter::WriteRecord_Handler);
+    /// After the queued records, passes finished to the finalizer and
+    /// continues with the next segment, as for Begin.
+    RCqt::TaskCaller<const int, const RC::RStr, const EDFCheckpoint,
+      const u64, const EDFSegment>
+      Rotate = TaskHandler(EDFWriter::Rotate_Handler);
+    /// Waits for all queued records, and stops using the edf handle.
+    /** @return The first edflib write error code, or 0.
+     */
+    RCqt::TaskGetter<int> End = TaskHandler(EDFWriter::End_Handler);
+
+    /// The first edflib write error code, or 0.  Safe from any thread.
+    int WriteError() const { return write_err.load(); }
+
+    protected:
+    void Begin_Handler(const int& new_edf_hdl, const RC::RStr& filename,
+        const RC::Ptr<EDFRing>& new_ring,
+        const EDFCheckpoint& new_checkpoint,
+        const u64& new_checkpoint_records);
+    void WriteRecord_Handler(const size_t& slot);
+    void Rotate_Handler(const int& new_edf_hdl, const RC::RStr& filename,
+        const EDFCheckpoint& new_checkpoint,
+        const u64& new_checkpoint_records, const EDFSegment& finished);
+    int End_Handler();
+    void Preallocate(u64 record_bytes);
+    void Checkpoint();
+
+    // Data records of file space to reserve ahead of the writes.
+    static constexpr u64 prealloc_records = 60;
+
+    RC::Ptr<EDFFinalizer> finalizer;
+    int edf_hdl = -1;
+    RC::Ptr<EDFRing> ring;
+    std::atomic<int> write_err{0};
+    int prealloc_fd = -1;
+    u64 bytes_written = 0;
+    u64 prealloc_end = 0;
+
+    EDFCheckpoint checkpoint;
+    RC::RStr journal_file;
+    u64 checkpoint_records = 0;
+    u64 records_since_checkpoint = 0;
+    int sync_fd = -1;
+  };
+
+
+  /// Saves EEG to EDF+, optionally rotating through segment files.
+  /** Segments after the first are named with _001, _002, and so on, and
+   *  split between data records so that they are sample-continuous.
+   *  With rotation, the NAME_segments.json manifest lists them.
+   */
   class EDFSave : public EEGFileSave {
     public:
-    EDFSave(RC::Ptr<Handler> hndl, size_t sampling_rate)
-      : EEGFileSave(hndl), buffer(sampling_rate, 0),
-        sampling_rate(sampling_rate) {
+    EDFSave(RC::Ptr<Handler> hndl, size_t sampling_rate,
+        const EDFSaveOptions& options=EDFSaveOptions())
+      : EEGFileSave(hndl), writer(&finalizer),
+        sampling_rate(sampling_rate), options(options) {
       callback_ID = RC::RStr("EDFSave_") + RC::RStr(sampling_rate);
-      buffer.sampling_rate = sampling_rate;
       datarecord_len = sampling_rate;
     }
+    ~EDFSave();
 
     RC::RStr GetExt() const override { return "edf"; }
 
@@ -33,17 +191,49 @@ namespace CML {
 
     template<class F, class P>
     void SetChanParam(F func, P p, RC::RStr error_msg);
+    void Annotate(i64 onset, const RC::RStr& text, const char* error_msg);
+    void OpenSegment();
+    EDFCheckpoint NewCheckpoint() const;
+    u64 CheckpointRecords() const;
+    RC::RStr SegmentFilename(size_t index) const;
+    bool RotationDue() const;
+    void Rotate();
+
+    void BeStoragePolling();
+    void PollStorage();
+
+    // Data records held in memory for the writer thread.
+    static constexpr size_t ring_records = 8;
+    // Free space below which saving halts to preserve the file.
+    static constexpr u64 min_free_bytes = 1024*1024*1024;
+    static constexpr int storage_poll_ms = 10000;
 
     int edf_hdl = -1;
     bool error_triggered = false;
     RC::Data1D<uint16_t> channels;
-    EEGData buffer;
-    size_t amount_buffered = 0;
+    RC::APtr<EDFRing> ring;
+    EDFFinalizer finalizer;
+    EDFWriter writer;
+    size_t fill_slot = 0;
+    size_t fill_len = 0;
+    bool slot_held = false;
     size_t amount_written = 0;
     size_t sampling_rate;
     size_t datarecord_len;
+    int datarecord_scaleby = 1;
+    EDFSaveOptions options;
+    // As journaled at each checkpoint.
+    RC::Data1D<EDFAnnotation> annotations;
     RC::RStr current_filename;
+    RC::RStr base_filename;
+    FullConf save_conf;
+    EDFSegment segment;
     RC::RStr callback_ID;
+
+    // Free space from the last poll, less the data queued since then.
+    u64 storage_free = 0;
+    u64 bytes_since_poll = 0;
+    RC::APtr<QTimer> storage_timer;
   };
 }
 
@@ -5,6 +5,7 @@
 #include "CerebusSim.h" // TODO Remove after moving injection to Handler.
 
 #include "FeatureFilters.h"
+#include "JSONLines.h"
 #include "Utils.h"
 
 namespace CML {
@@ -29,8 +30,30 @@ namespace CML {
       return;
     }
 
+    // Catch up consumers that were behind, even if no new data arrives.
+    for (size_t i=0; i<mono_data_callbacks.size(); i++) {
+      mono_data_callbacks[i].Flush();
+    }
+    for (size_t i=0; i<data_callbacks.size(); i++) {
+      data_callbacks[i].Flush();
+    }
+
     try {
+      if (eeg_source->VirtualClock()) {
+        if (acq_timer.IsSet() && acq_timer->interval() != 0) {
+          acq_timer->setInterval(0);
+        }
+        if (VirtualClockWaiting() || InjectDueEvents()) {
+          return;
+        }
+      }
+      else if (acq_timer.IsSet() &&
+               acq_timer->interval() != polling_interval_ms) {
+        acq_timer->setInterval(polling_interval_ms);
+      }
+
       auto& cereb_chandata = eeg_source->GetData();
+      f64 read_sec = RC::Time::Get();
 
       size_t max_len = 0;
       for (size_t c=0; c<cereb_chandata.size(); c++) {
@@ -42,6 +65,7 @@ namespace CML {
       }
 
       RC::APtr<EEGData> data_aptr = new EEGData(sampling_rate, max_len);
+      data_aptr->read_sec = read_sec;
       auto& data = data_aptr->data;
       data.Resize(cereb_chandata.size());
 
@@ -66,7 +90,7 @@ namespace CML {
 
       // Report Original Data
       for (size_t i=0; i<mono_data_callbacks.size(); i++) {
-        mono_data_callbacks[i].callback(data_captr);
+        mono_data_callbacks[i].Push(data_captr);
       }
 
       // Bin data
@@ -89,24 +113,40 @@ namespace CML {
 
       if (bin_max_len > 0) {
         // Bipolar reference data
-        auto out_data_captr = [&] {
+        auto out_data = [&] {
 #ifdef TESTING_SYS3_R1384J
-          return FeatureFilters::MonoSelector(binned_data_captr).ExtractConst();
+          return FeatureFilters::MonoSelector(binned_data_captr);
 #else
           if (bipolar_channels.IsEmpty()) { // Mono
-            return FeatureFilters::MonoSelector(binned_data_captr).ExtractConst();
+            return FeatureFilters::MonoSelector(binned_data_captr);
           }
           else { // Bipolar
-            return FeatureFilters::BipolarReference(binned_data_captr, bipolar_channels).ExtractConst();
+            return FeatureFilters::BipolarReference(binned_data_captr, bipolar_channels);
           }
 #endif
         }();
 
+        if (artifact_blanker.IsSet()) {
+          // The final binned sample precedes the unbinned leftover data.
+          size_t leftover_len = 0;
+          if (rollover_data.IsSet()) {
+            for (size_t c=0; c<rollover_data->data.size(); c++) {
+              leftover_len = std::max(leftover_len,
+                  rollover_data->data[c].size());
+            }
+          }
+          BlankArtifacts(*out_data,
+              read_sec - f64(leftover_len) / sampling_rate);
+        }
+        auto out_data_captr = out_data.ExtractConst();
+
         // Report bipolar binned data
         for (size_t i=0; i<data_callbacks.size(); i++) {
-          data_callbacks[i].callback(out_data_captr);
+          data_callbacks[i].Push(out_data_captr);
         }
       }
+
+      LogOverloads();
     }
     catch (...) {
       // Stop acquisition timer upon error, and one pop-up only.
@@ -149,7 +189,7 @@ namespace CML {
                                            const EEGCallback& callback) {
     RemoveEEGCallback_Handler(tag);
 
-    data_callbacks += TaggedCallback<EEGCallback>{tag, callback};
+    data_callbacks += DataCallbackQueue(tag, callback);
 
     BePollingIfCallbacks();
   }
@@ -158,6 +198,9 @@ namespace CML {
   void EEGAcq::RemoveEEGCallback_Handler(const RC::RStr& tag) {
     for (size_t i=0; i<data_callbacks.size(); i++) {
       if (data_callbacks[i].tag == tag) {
+        // Held data is discarded with the callback.
+        data_callbacks[i].dropped += data_callbacks[i].Held();
+        LogOverload(data_callbacks[i]);
         data_callbacks.Remove(i);
         i--;
       }
@@ -173,7 +216,7 @@ namespace CML {
                                                const EEGMonoCallback& callback) {
     RemoveEEGMonoCallback_Handler(tag);
 
-    mono_data_callbacks += TaggedCallback<EEGMonoCallback>{tag, callback};
+    mono_data_callbacks += MonoCallbackQueue(tag, callback);
 
     BePollingIfCallbacks();
   }
@@ -182,6 +225,9 @@ namespace CML {
   void EEGAcq::RemoveEEGMonoCallback_Handler(const RC::RStr& tag) {
     for (size_t i=0; i<mono_data_callbacks.size(); i++) {
       if (mono_data_callbacks[i].tag == tag) {
+        // Held data is discarded with the callback.
+        mono_data_callbacks[i].dropped += mono_data_callbacks[i].Held();
+        LogOverload(mono_data_callbacks[i]);
         mono_data_callbacks.Remove(i);
         i--;
       }
@@ -193,6 +239,52 @@ namespace CML {
   }
 
 
+  /// Sets how data is handled when a registered EEGCallback falls behind.
+  /** The policy applies to the registration with this tag, and is reset
+   *  if the callback is registered again.  Until set, every block is
+   *  delivered immediately.
+   *  @param tag The tag the callback was registered with
+   *  @param policy The overload policy and the consumer queue depth bound
+   */
+  void EEGAcq::SetEEGCallbackPolicy_Handler(const RC::RStr& tag,
+      const EEGCallbackPolicy& policy) {
+    for (size_t i=0; i<data_callbacks.size(); i++) {
+      if (data_callbacks[i].tag == tag) {
+        data_callbacks[i].policy = policy;
+      }
+    }
+  }
+
+
+  /// As SetEEGCallbackPolicy, for a registered EEGMonoCallback.
+  void EEGAcq::SetEEGMonoCallbackPolicy_Handler(const RC::RStr& tag,
+      const EEGCallbackPolicy& policy) {
+    for (size_t i=0; i<mono_data_callbacks.size(); i++) {
+      if (mono_data_callbacks[i].tag == tag) {
+        mono_data_callbacks[i].policy = policy;
+      }
+    }
+  }
+
+
+  /// Sets where EEG_CALLBACK_OVERLOAD event log lines are sent.
+  void EEGAcq::SetOverloadLog_Handler(const EEGLogCallback& log_callback) {
+    overload_log = log_callback;
+  }
+
+
+  /// Sets where a virtual clock source's task laptop messages are sent.
+  /** @param sink Receives each message line, as TaskNetWorker's
+   *  ReplayCommand.
+   *  @param sink_worker The Worker running sink, which must finish each
+   *  message before the data following it is read.
+   */
+  void EEGAcq::SetReplaySink_Handler(const EEGLogCallback& sink,
+      const RC::Ptr<RCqt::Worker>& sink_worker) {
+    replay_sink = sink;
+    replay_worker = sink_worker;
+  }
+
 
   void EEGAcq::CloseSource_Handler() {
     if (eeg_source.IsSet()) {
@@ -203,6 +295,144 @@ namespace CML {
   }
 
 
+  /// Starts blanking stimulation artifacts from the EEGCallback data.
+  /** Data reported to EEGMonoCallbacks, which is what gets saved, is never
+   *  modified.
+   *  @param blank_settings The blanking window and mode
+   *  @param log_callback Receives an event log line for each blanked
+   *  stimulation event
+   */
+  void EEGAcq::EnableArtifactBlanking_Handler(
+      const ArtifactBlankerSettings& blank_settings,
+      const EEGLogCallback& log_callback) {
+    artifact_blanker = new ArtifactBlanker(blank_settings);
+    artifact_log = log_callback;
+  }
+
+
+  void EEGAcq::DisableArtifactBlanking_Handler() {
+    artifact_blanker.Delete();
+  }
+
+
+  /// Registers a stimulation event for artifact blanking, if enabled.
+  /** @param onset_sec The RC::Time::Get() time of stimulation onset
+   *  @param duration_sec The duration of the stimulation
+   */
+  void EEGAcq::MarkStimulation_Handler(const f64& onset_sec,
+      const f64& duration_sec) {
+    if (artifact_blanker.IsSet()) {
+      artifact_blanker->AddStim(onset_sec, duration_sec);
+    }
+  }
+
+
+  void EEGAcq::BlankArtifacts(EEGDataDouble& data, f64 read_sec) {
+    RC::Data1D<ArtifactBlankRecord> completed;
+    artifact_blanker->Process(data, read_sec, completed);
+
+    for (size_t i=0; i<completed.size(); i++) {
+      JSONFile event;
+      event.Set(completed[i].onset_sec*1e3, "onset");
+      event.Set(completed[i].window_start_sec*1e3, "window_start");
+      event.Set(completed[i].window_end_sec*1e3, "window_end");
+      event.Set(completed[i].samples_blanked, "samples_blanked");
+      event.Set(completed[i].channels_blanked, "channels_blanked");
+      event.Set(data.sampling_rate, "sampling_rate");
+      artifact_log(MakeResp("ARTIFACT_BLANKED", 0, event).Line());
+    }
+  }
+
+
+  RC::RStr OverloadPolicyName(OverloadPolicy policy) {
+    switch (policy) {
+      case OverloadPolicy::DropOldest: return "drop_oldest";
+      case OverloadPolicy::DropNewest: return "drop_newest";
+      case OverloadPolicy::Decimate: return "decimate";
+      default: return "block";
+    }
+  }
+
+
+  template<class T>
+  void EEGAcq::LogOverload(T& tagged) {
+    if (!overload_log.IsSet() || tagged.dropped == tagged.dropped_logged) {
+      return;
+    }
+
+    JSONFile event;
+    event.Set(tagged.tag.Raw(), "tag");
+    event.Set(OverloadPolicyName(tagged.policy.policy).Raw(), "policy");
+    event.Set(tagged.dropped - tagged.dropped_logged, "dropped");
+    event.Set(tagged.dropped, "total_dropped");
+    event.Set(tagged.delivered, "delivered");
+    event.Set(tagged.Held(), "held");
+    if (tagged.policy.consumer.IsSet()) {
+      event.Set(tagged.policy.consumer->NumTasks(), "consumer_depth");
+    }
+    overload_log(MakeResp("EEG_CALLBACK_OVERLOAD", 0, event).Line());
+    tagged.dropped_logged = tagged.dropped;
+  }
+
+
+  void EEGAcq::LogOverloads() {
+    f64 now = RC::Time::Get();
+    if (now - last_overload_log < overload_log_interval) {
+      return;
+    }
+    last_overload_log = now;
+
+    for (size_t i=0; i<mono_data_callbacks.size(); i++) {
+      LogOverload(mono_data_callbacks[i]);
+    }
+    for (size_t i=0; i<data_callbacks.size(); i++) {
+      LogOverload(data_callbacks[i]);
+    }
+  }
+
+
+  // On a virtual clock nothing may be dropped, so reading waits for every
+  // Block policy consumer, and for the replay sink.  Drop policy consumers
+  // such as the display are not waited for.
+  bool EEGAcq::VirtualClockWaiting() {
+    if (replay_worker.IsSet() && replay_worker->NumTasks() > 0) {
+      return true;
+    }
+    for (size_t i=0; i<mono_data_callbacks.size(); i++) {
+      auto& cb = mono_data_callbacks[i];
+      if (cb.policy.policy == OverloadPolicy::Block &&
+          (cb.Held() > 0 || cb.Behind())) {
+        return true;
+      }
+    }
+    for (size_t i=0; i<data_callbacks.size(); i++) {
+      auto& cb = data_callbacks[i];
+      if (cb.policy.policy == OverloadPolicy::Block &&
+          (cb.Held() > 0 || cb.Behind())) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+
+  // Sends the messages due before the next data, returning true if any
+  // were sent so that reading waits for them to be handled.
+  bool EEGAcq::InjectDueEvents() {
+    due_events.clear();
+    eeg_source->TakeDueEvents(due_events);
+    if (due_events.empty()) {
+      return false;
+    }
+    if (replay_sink.IsSet()) {
+      for (auto& ev : due_events) {
+        replay_sink(RC::RStr(ev));
+      }
+    }
+    return true;
+  }
+
+
   void EEGAcq::StopEverything() {
     if (acq_timer.IsSet()) {
       acq_timer->stop();
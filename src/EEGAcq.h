@@ -4,6 +4,8 @@
 #include "RC/File.h"
 #include "RC/RStr.h"
 #include "RCqt/Worker.h"
+#include "ArtifactBlanker.h"
+#include "EEGCallbackQueue.h"
 #include "EEGData.h"
 #include "EEGSource.h"
 #include "ChannelConf.h"
@@ -11,8 +13,10 @@
 
 namespace CML {
   //using ChannelList = RC::Data1D<uint16_t>;
-  using EEGCallback = RCqt::TaskCaller<RC::APtr<const EEGDataDouble>>;
+  // Any task type taking the data, such as a TaskCaller or TaskCoalescer.
+  using EEGCallback = RC::Caller<void, RC::APtr<const EEGDataDouble>&>;
   using EEGMonoCallback = RCqt::TaskCaller<RC::APtr<const EEGDataRaw>>;
+  using EEGLogCallback = RC::Caller<void, const RC::RStr&>;
 
   class EEGAcq : public RCqt::WorkerThread, public QObject {
     public:
@@ -53,9 +57,33 @@ namespace CML {
     RCqt::TaskBlocker<const RC::RStr> RemoveEEGMonoCallback =
       TaskHandler(EEGAcq::RemoveEEGMonoCallback_Handler);
 
+    RCqt::TaskCaller<const RC::RStr, const EEGCallbackPolicy>
+      SetEEGCallbackPolicy =
+      TaskHandler(EEGAcq::SetEEGCallbackPolicy_Handler);
+
+    RCqt::TaskCaller<const RC::RStr, const EEGCallbackPolicy>
+      SetEEGMonoCallbackPolicy =
+      TaskHandler(EEGAcq::SetEEGMonoCallbackPolicy_Handler);
+
+    RCqt::TaskCaller<const EEGLogCallback> SetOverloadLog =
+      TaskHandler(EEGAcq::SetOverloadLog_Handler);
+
+    RCqt::TaskCaller<const EEGLogCallback, const RC::Ptr<RCqt::Worker>>
+      SetReplaySink = TaskHandler(EEGAcq::SetReplaySink_Handler);
+
     RCqt::TaskBlocker<> CloseSource =
       TaskHandler(EEGAcq::CloseSource_Handler);
 
+    RCqt::TaskCaller<const ArtifactBlankerSettings, const EEGLogCallback>
+      EnableArtifactBlanking =
+      TaskHandler(EEGAcq::EnableArtifactBlanking_Handler);
+
+    RCqt::TaskBlocker<> DisableArtifactBlanking =
+      TaskHandler(EEGAcq::DisableArtifactBlanking_Handler);
+
+    RCqt::TaskCaller<const f64, const f64> MarkStimulation =
+      TaskHandler(EEGAcq::MarkStimulation_Handler);
+
     protected slots:
 
     void GetData_Slot();
@@ -75,12 +103,31 @@ namespace CML {
     void RegisterEEGMonoCallback_Handler(const RC::RStr& tag,
                                          const EEGMonoCallback& callback);
     void RemoveEEGMonoCallback_Handler(const RC::RStr& tag);
+    void SetEEGCallbackPolicy_Handler(const RC::RStr& tag,
+                                      const EEGCallbackPolicy& policy);
+    void SetEEGMonoCallbackPolicy_Handler(const RC::RStr& tag,
+                                          const EEGCallbackPolicy& policy);
+    void SetOverloadLog_Handler(const EEGLogCallback& log_callback);
+    void SetReplaySink_Handler(const EEGLogCallback& sink,
+                               const RC::Ptr<RCqt::Worker>& sink_worker);
     void CloseSource_Handler();
-
+    void EnableArtifactBlanking_Handler(
+        const ArtifactBlankerSettings& blank_settings,
+        const EEGLogCallback& log_callback);
+    void DisableArtifactBlanking_Handler();
+    void MarkStimulation_Handler(const f64& onset_sec,
+        const f64& duration_sec);
+
+    void BlankArtifacts(EEGDataDouble& data, f64 read_sec);
+    template<class T>
+    void LogOverload(T& tagged);
+    void LogOverloads();
     void StopEverything();
 
     void BeAllocatedTimer();
     void BePollingIfCallbacks();
+    bool VirtualClockWaiting();
+    bool InjectDueEvents();
 
     RC::APtr<EEGSource> eeg_source;
     size_t sampling_rate = 1000;
@@ -94,13 +141,29 @@ namespace CML {
 
     RC::Data1D<EEGChan> bipolar_channels;
 
-    template <typename T>
-    struct TaggedCallback {
-      RC::RStr tag;
-      T callback;
-    };
-    RC::Data1D<TaggedCallback<EEGCallback>> data_callbacks;
-    RC::Data1D<TaggedCallback<EEGMonoCallback>> mono_data_callbacks;
+    // Only applied to the referenced data for EEGCallbacks.  Saved data is
+    // left unmodified.
+    RC::APtr<ArtifactBlanker> artifact_blanker;
+    EEGLogCallback artifact_log;
+
+    using DataCallbackQueue =
+      EEGCallbackQueue<EEGCallback, RC::APtr<const EEGDataDouble>>;
+    using MonoCallbackQueue =
+      EEGCallbackQueue<EEGMonoCallback, RC::APtr<const EEGDataRaw>>;
+    RC::Data1D<DataCallbackQueue> data_callbacks;
+    RC::Data1D<MonoCallbackQueue> mono_data_callbacks;
+
+    // Receives EEG_CALLBACK_OVERLOAD lines, at most once per
+    // overload_log_interval seconds for each callback while dropping.
+    EEGLogCallback overload_log;
+    f64 overload_log_interval = 1.0;
+    f64 last_overload_log = 0;
+
+    // Receives the task laptop messages of a virtual clock source, with
+    // sink_worker drained before more data is read.
+    EEGLogCallback replay_sink;
+    RC::Ptr<RCqt::Worker> replay_worker;
+    std::vector<std::string> due_events;
   };
 }
 
@@ -0,0 +1,141 @@
+#ifndef EEGCALLBACKQUEUE_H
+#define EEGCALLBACKQUEUE_H
+
+#include "RC/Ptr.h"
+#include "RC/RStr.h"
+#include "RCqt/Worker.h"
+#include <deque>
+
+namespace CML {
+  /// What EEGAcq does with new data for a consumer that has fallen behind.
+  enum class OverloadPolicy {
+    // Hold blocks, delivering them in order once the consumer catches up.
+    Block,
+    // Hold only the newest block, dropping older held blocks.
+    DropOldest,
+    // Drop new blocks until the consumer catches up.
+    DropNewest,
+    // Deliver one of every decimate blocks until the consumer catches up.
+    Decimate
+  };
+
+  RC::RStr OverloadPolicyName(OverloadPolicy policy);
+
+  class EEGCallbackPolicy {
+    public:
+    OverloadPolicy policy = OverloadPolicy::Block;
+    // The Worker running the callback, whose task queue depth is watched.
+    RC::Ptr<RCqt::Worker> consumer;
+    // Queued tasks on the consumer at which it is behind.  0 delivers every
+    // block immediately regardless.
+    size_t max_depth = 0;
+    // The most blocks held under Block, beyond which the oldest are
+    // dropped, so memory stays bounded.
+    size_t max_held = 2000;
+    size_t decimate = 4;
+
+    /// For consumers that filter continuous data, such as the classifier
+    /// and closed-loop stim.
+    /** Block keeps the data continuous through brief stalls, at the cost
+     *  of latency while the consumer catches up.
+     */
+    static EEGCallbackPolicy Realtime(RC::Ptr<RCqt::Worker> consumer) {
+      EEGCallbackPolicy p;
+      p.consumer = consumer;
+      p.max_depth = 20;
+      return p;
+    }
+
+    /// For consumers that save data, which is never dropped short of
+    /// several minutes of backlog.
+    static EEGCallbackPolicy Lossless(RC::Ptr<RCqt::Worker> consumer) {
+      EEGCallbackPolicy p = Realtime(consumer);
+      p.max_held = 60000;
+      return p;
+    }
+  };
+
+  /// One EEGAcq callback registration, with its overload handling.
+  /** Everything here runs on the EEGAcq thread, and never waits on the
+   *  consumer.
+   */
+  template<class Callback, class Data>
+  class EEGCallbackQueue {
+    public:
+    EEGCallbackQueue() { }
+    EEGCallbackQueue(const RC::RStr& tag, const Callback& callback)
+      : tag(tag), callback(callback) { }
+
+    void Push(Data& data) {
+      Flush();
+      if (held.empty() && !Behind()) {
+        Deliver(data);
+        decimate_count = 0;
+        return;
+      }
+
+      switch (policy.policy) {
+        case OverloadPolicy::Block:
+          held.push_back(data);
+          if (held.size() > policy.max_held) {
+            held.pop_front();
+            dropped++;
+          }
+          break;
+        case OverloadPolicy::DropOldest:
+          dropped += held.size();
+          held.clear();
+          held.push_back(data);
+          break;
+        case OverloadPolicy::DropNewest:
+          dropped++;
+          break;
+        case OverloadPolicy::Decimate:
+          decimate_count++;
+          if (decimate_count >= policy.decimate) {
+            decimate_count = 0;
+            Deliver(data);
+          }
+          else {
+            dropped++;
+          }
+          break;
+      }
+    }
+
+    /// Delivers held blocks while the consumer has room.
+    void Flush() {
+      while (!held.empty() && !Behind()) {
+        Deliver(held.front());
+        held.pop_front();
+      }
+    }
+
+    bool Behind() const {
+      return policy.max_depth > 0 && policy.consumer.IsSet() &&
+        policy.consumer->NumTasks() >= policy.max_depth;
+    }
+
+    size_t Held() const { return held.size(); }
+
+    RC::RStr tag;
+    Callback callback;
+    EEGCallbackPolicy policy;
+
+    u64 delivered = 0;
+    u64 dropped = 0;
+    u64 dropped_logged = 0;
+
+    protected:
+    void Deliver(Data& data) {
+      callback(data);
+      delivered++;
+    }
+
+    std::deque<Data> held;
+    size_t decimate_count = 0;
+  };
+}
+
+#endif // EEGCALLBACKQUEUE_H
+
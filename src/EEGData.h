@@ -54,6 +54,8 @@ namespace CML {
     // TODO - Encapsulate sample_len and data to preserve this invariant.
     size_t sample_len; // Internal Data1D size is either 0 or sample_len
     RC::Data1D<RC::Data1D<T>> data;
+    // RC::Time::Get() when EEGAcq read the final sample, or 0 if unknown.
+    f64 read_sec = 0;
 
     void EnableChan(size_t chan) {
       data[chan].Resize(sample_len);
@@ -193,6 +193,60 @@ namespace CML {
   }
 
 
+  /// Concatenates pending data blocks into one for UpdateData.
+  /** The blocks are shared with other EEG callbacks, so a new block is
+   *  built.  Channels absent from some blocks are zero-filled, matching
+   *  UpdateData_Handler, and blocks before a sampling rate change are
+   *  dropped.
+   */
+  RC::APtr<const EEGDataDouble> EEGDisplay::MergeData(
+      RC::Data1D<RC::APtr<const EEGDataDouble>>& blocks) {
+    size_t first = 0;
+    size_t sampling_rate = blocks[blocks.size()-1]->sampling_rate;
+    for (size_t b=blocks.size(); b>0; b--) {
+      if (blocks[b-1]->sampling_rate != sampling_rate) {
+        first = b;
+        break;
+      }
+    }
+
+    size_t num_chans = 0;
+    size_t total_len = 0;
+    RC::Data1D<size_t> block_lens(blocks.size());
+    block_lens.Zero();
+    for (size_t b=first; b<blocks.size(); b++) {
+      auto& bdata = blocks[b]->data;
+      num_chans = std::max(num_chans, bdata.size());
+      RC_ForIndex(c, bdata) {
+        block_lens[b] = std::max(block_lens[b], bdata[c].size());
+      }
+      total_len += block_lens[b];
+    }
+
+    RC::APtr<EEGDataDouble> merged =
+      new EEGDataDouble(sampling_rate, total_len);
+    merged->data.Resize(num_chans);
+    RC_ForRange(c, 0, num_chans) {
+      size_t offset = 0;
+      for (size_t b=first; b<blocks.size(); b++) {
+        auto& bdata = blocks[b]->data;
+        if (c < bdata.size() && bdata[c].size() > 0) {
+          if (merged->data[c].IsEmpty()) {
+            merged->EnableChan(c);
+            merged->data[c].Zero();
+          }
+          RC_ForIndex(i, bdata[c]) {
+            merged->data[c][offset + i] = bdata[c][i];
+          }
+        }
+        offset += block_lens[b];
+      }
+    }
+
+    return merged.ExtractConst();
+  }
+
+
   void EEGDisplay::SetChannel_Handler(EEGChan& chan) {
     eeg_channels += chan;
   }
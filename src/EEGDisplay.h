@@ -16,8 +16,11 @@ namespace CML {
     EEGDisplay(int width, int height);
     virtual ~EEGDisplay();
 
-    RCqt::TaskCaller<RC::APtr<const EEGDataDouble>> UpdateData =
-      TaskHandler(EEGDisplay::UpdateData_Handler);
+    // Blocks arriving while the GUI is busy are merged into one update.
+    RCqt::TaskCoalescer<RC::APtr<const EEGDataDouble>> UpdateData =
+      {this, RC::MakeCaller(this, &EEGDisplay::UpdateData_Handler),
+       RC::MakeCaller(this, &EEGDisplay::MergeData),
+       "EEGDisplay::UpdateData"};
 
     RCqt::TaskCaller<EEGChan> SetChannel =
       TaskHandler(EEGDisplay::SetChannel_Handler);
@@ -39,6 +42,8 @@ namespace CML {
     protected:
 
     void UpdateData_Handler(RC::APtr<const EEGDataDouble>& new_data);
+    RC::APtr<const EEGDataDouble> MergeData(
+        RC::Data1D<RC::APtr<const EEGDataDouble>>& blocks);
     void SetChannel_Handler(EEGChan& chan);
     void UnsetChannel_Handler(EEGChan& chan);
     void SetAutoScale_Handler(const bool& on);
@@ -10,6 +10,7 @@
 
 #include <cstdint>
 #include <cstddef>
+#include <string>
 #include <vector>
 
 namespace CML {
@@ -30,6 +31,12 @@ namespace CML {
     virtual void ExperimentReady() {}
 
     virtual const std::vector<TrialData>& GetData() = 0;
+
+    // True while the source is paced by its own sample clock rather than
+    // real time, so EEGAcq reads it as fast as its consumers keep up.
+    virtual bool VirtualClock() const { return false; }
+    // Appends task laptop messages due before the next GetData, in order.
+    virtual void TakeDueEvents(std::vector<std::string>& /*events*/) {}
   };
 }
 
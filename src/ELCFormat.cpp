@@ -0,0 +1,642 @@
+#include "ELCFormat.h"
+#include "EDFSynch.h"
+#include "edflib/edflib.h"
+#include <array>
+#include <cstdlib>
+#include <cstring>
+
+namespace CML {
+  namespace ELC {
+    uint32_t CRC32(const uint8_t* data, size_t len) {
+      static const std::array<uint32_t, 256> table = []() {
+        std::array<uint32_t, 256> t;
+        for (uint32_t i=0; i<256; i++) {
+          uint32_t c = i;
+          for (int b=0; b<8; b++) {
+            c = (c & 1) ? (0xEDB88320u ^ (c >> 1)) : (c >> 1);
+          }
+          t[i] = c;
+        }
+        return t;
+      }();
+
+      uint32_t crc = 0xFFFFFFFFu;
+      for (size_t i=0; i<len; i++) {
+        crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+      }
+      return crc ^ 0xFFFFFFFFu;
+    }
+
+
+    void PutU32(RC::Data1D<uint8_t>& out, uint32_t val) {
+      for (int b=0; b<4; b++) {
+        out += uint8_t(val >> (8*b));
+      }
+    }
+
+
+    void PutU64(RC::Data1D<uint8_t>& out, uint64_t val) {
+      for (int b=0; b<8; b++) {
+        out += uint8_t(val >> (8*b));
+      }
+    }
+
+
+    uint32_t GetU32(const uint8_t* in) {
+      uint32_t val = 0;
+      for (int b=0; b<4; b++) {
+        val |= uint32_t(in[b]) << (8*b);
+      }
+      return val;
+    }
+
+
+    uint64_t GetU64(const uint8_t* in) {
+      uint64_t val = 0;
+      for (int b=0; b<8; b++) {
+        val |= uint64_t(in[b]) << (8*b);
+      }
+      return val;
+    }
+
+
+    // The residual of the fixed order predictor at sample i >= order.
+    static inline int32_t Residual(const int16_t* x, size_t i,
+        uint8_t order) {
+      switch (order) {
+        case 0: return x[i];
+        case 1: return int32_t(x[i]) - x[i-1];
+        case 2: return int32_t(x[i]) - 2*int32_t(x[i-1]) + x[i-2];
+        default: return int32_t(x[i]) - 3*int32_t(x[i-1]) +
+                   3*int32_t(x[i-2]) - x[i-3];
+      }
+    }
+
+
+    static inline int32_t Predict(const int16_t* x, size_t i,
+        uint8_t order) {
+      switch (order) {
+        case 0: return 0;
+        case 1: return x[i-1];
+        case 2: return 2*int32_t(x[i-1]) - x[i-2];
+        default: return 3*int32_t(x[i-1]) - 3*int32_t(x[i-2]) + x[i-3];
+      }
+    }
+
+
+    static inline uint32_t ZigZag(int32_t val) {
+      return (uint32_t(val) << 1) ^ uint32_t(val >> 31);
+    }
+
+
+    static inline int32_t UnZigZag(uint32_t val) {
+      return int32_t(val >> 1) ^ -int32_t(val & 1);
+    }
+
+
+    // MSB first bit packing into preallocated storage.
+    class BitWriter {
+      public:
+      BitWriter(uint8_t* out) : out(out) { }
+
+      void Put(uint32_t val, int count) {
+        acc = (acc << count) | val;
+        nbits += count;
+        while (nbits >= 8) {
+          nbits -= 8;
+          out[pos++] = uint8_t(acc >> nbits);
+        }
+      }
+
+      void PutUnary(uint32_t q) {
+        while (q >= 31) {
+          Put(0x7FFFFFFFu, 31);
+          q -= 31;
+        }
+        Put(((1u << q) - 1) << 1, int(q) + 1);
+      }
+
+      size_t Finish() {
+        if (nbits > 0) {
+          out[pos++] = uint8_t(acc << (8 - nbits));
+          nbits = 0;
+        }
+        return pos;
+      }
+
+      protected:
+      uint8_t* out;
+      size_t pos = 0;
+      uint64_t acc = 0;
+      int nbits = 0;
+    };
+
+
+    class BitReader {
+      public:
+      BitReader(const uint8_t* in, size_t len) : in(in), len(len) { }
+
+      uint32_t Get(int count) {
+        while (nbits < count) {
+          if (pos >= len) {
+            Throw_RC_Type(File, "ELC channel data truncated");
+          }
+          acc = (acc << 8) | in[pos++];
+          nbits += 8;
+        }
+        nbits -= count;
+        return uint32_t((acc >> nbits) & ((uint64_t(1) << count) - 1));
+      }
+
+      // Counts and consumes 1 bits through the terminating 0, up to a
+      // byte at a time.
+      uint32_t GetUnary() {
+        static const std::array<uint8_t, 256> lead_ones = []() {
+          std::array<uint8_t, 256> t;
+          for (int i=0; i<256; i++) {
+            uint8_t n = 0;
+            while (n < 8 && (i & (0x80 >> n))) {
+              n++;
+            }
+            t[size_t(i)] = n;
+          }
+          return t;
+        }();
+
+        uint32_t q = 0;
+        while (true) {
+          if (nbits == 0) {
+            if (pos >= len) {
+              Throw_RC_Type(File, "ELC channel data truncated");
+            }
+            acc = (acc << 8) | in[pos++];
+            nbits = 8;
+          }
+          int avail = nbits < 8 ? nbits : 8;
+          uint32_t window = uint32_t(acc >> (nbits - avail)) &
+            ((1u << avail) - 1);
+          int ones = lead_ones[window << (8 - avail)];
+          if (ones < avail) {
+            nbits -= ones + 1;
+            return q + uint32_t(ones);
+          }
+          q += uint32_t(avail);
+          nbits -= avail;
+        }
+      }
+
+      size_t Consumed() const { return pos; }
+
+      protected:
+      const uint8_t* in;
+      size_t len;
+      size_t pos = 0;
+      uint64_t acc = 0;
+      int nbits = 0;
+    };
+
+
+    void EncodeChannel(RC::Data1D<uint8_t>& out, const int16_t* samples,
+        size_t len) {
+      // Choose the predictor order with the least absolute residual,
+      // accumulating all four orders in one pass.
+      uint8_t order = 0;
+      if (len > 3) {
+        uint64_t sums[4] = {0, 0, 0, 0};
+        for (size_t i=3; i<len; i++) {
+          int32_t e0 = samples[i];
+          int32_t e1 = e0 - samples[i-1];
+          int32_t e2 = e1 - (int32_t(samples[i-1]) - samples[i-2]);
+          int32_t e3 = e2 - (int32_t(samples[i-1]) - 2*int32_t(samples[i-2]) +
+              samples[i-3]);
+          sums[0] += uint64_t(std::abs(e0));
+          sums[1] += uint64_t(std::abs(e1));
+          sums[2] += uint64_t(std::abs(e2));
+          sums[3] += uint64_t(std::abs(e3));
+        }
+        for (uint8_t o=1; o<4; o++) {
+          if (sums[o] < sums[order]) {
+            order = o;
+          }
+        }
+      }
+
+      // Residuals are computed once per channel into per-thread scratch.
+      thread_local RC::Data1D<uint32_t> residuals;
+      uint64_t n = (len > order) ? len - order : 0;
+      residuals.Resize(size_t(n));
+      uint32_t* res = residuals.Raw();
+      uint64_t sum_u = 0;
+      for (size_t i=order; i<len; i++) {
+        uint32_t u = ZigZag(Residual(samples, i, order));
+        res[i-order] = u;
+        sum_u += u;
+      }
+
+      // Choose the Rice parameter near the mean, then refine exactly.
+      int k = 0;
+      while (k < 24 && (n << (k+1)) < sum_u) {
+        k++;
+      }
+      auto bits_for = [&](int kk) {
+        uint64_t bits = n * uint64_t(kk+1);
+        for (size_t i=0; i<n; i++) {
+          bits += res[i] >> kk;
+        }
+        return bits;
+      };
+      uint64_t best_bits = bits_for(k);
+      for (int kk : {k-1, k+1}) {
+        if (kk >= 0 && kk <= 24) {
+          uint64_t bits = bits_for(kk);
+          if (bits < best_bits) {
+            best_bits = bits;
+            k = kk;
+          }
+        }
+      }
+
+      size_t start = out.size();
+      size_t rice_len = 2*size_t(order) + size_t((best_bits + 7) / 8);
+      bool raw = (len <= order) || (rice_len >= 2*len);
+      size_t body_len = raw ? 2*len : rice_len;
+      out.Resize(start + 6 + body_len);
+      uint8_t* p = out.Raw() + start;
+
+      uint32_t channel_len = uint32_t(2 + body_len);
+      for (int b=0; b<4; b++) {
+        p[b] = uint8_t(channel_len >> (8*b));
+      }
+      p += 4;
+
+      if (raw) {
+        *p++ = method_raw;
+        *p++ = 0;
+        for (size_t i=0; i<len; i++) {
+          *p++ = uint8_t(uint16_t(samples[i]));
+          *p++ = uint8_t(uint16_t(samples[i]) >> 8);
+        }
+        return;
+      }
+
+      *p++ = order;
+      *p++ = uint8_t(k);
+      for (size_t i=0; i<order; i++) {
+        *p++ = uint8_t(uint16_t(samples[i]));
+        *p++ = uint8_t(uint16_t(samples[i]) >> 8);
+      }
+      BitWriter bw(p);
+      uint32_t mask = (1u << k) - 1;
+      for (size_t i=0; i<n; i++) {
+        uint32_t u = res[i];
+        bw.PutUnary(u >> k);
+        if (k > 0) {
+          bw.Put(u & mask, k);
+        }
+      }
+      bw.Finish();
+    }
+
+
+    size_t DecodeChannel(int16_t* samples, size_t len, const uint8_t* in,
+        size_t in_len) {
+      if (in_len < 6) {
+        Throw_RC_Type(File, "ELC channel header truncated");
+      }
+      size_t channel_len = GetU32(in);
+      if (channel_len < 2 || channel_len > in_len - 4) {
+        Throw_RC_Type(File, "ELC channel length invalid");
+      }
+      const uint8_t* p = in + 4;
+      uint8_t method = p[0];
+      int k = p[1];
+      p += 2;
+      size_t body_len = channel_len - 2;
+
+      if (method == method_raw) {
+        if (body_len < 2*len) {
+          Throw_RC_Type(File, "ELC raw channel truncated");
+        }
+        for (size_t i=0; i<len; i++) {
+          samples[i] = int16_t(uint16_t(p[2*i]) | (uint16_t(p[2*i+1]) << 8));
+        }
+        return 4 + channel_len;
+      }
+
+      if (method > 3 || k > 24 || body_len < 2*size_t(method) ||
+          len < method) {
+        Throw_RC_Type(File, "ELC channel method invalid");
+      }
+      for (size_t i=0; i<method; i++) {
+        samples[i] = int16_t(uint16_t(p[2*i]) | (uint16_t(p[2*i+1]) << 8));
+      }
+      BitReader br(p + 2*method, body_len - 2*method);
+      for (size_t i=method; i<len; i++) {
+        uint32_t u = br.GetUnary() << k;
+        if (k > 0) {
+          u |= br.Get(k);
+        }
+        samples[i] = int16_t(UnZigZag(u) + Predict(samples, i, method));
+      }
+      return 4 + channel_len;
+    }
+  }
+
+
+  void ELCChunk::Encode() {
+    encoded.Resize(0);
+    size_t worst = ELC::chunk_header_len + data.size()*(6 + 2*num_samples);
+    encoded.Reserve(worst);
+
+    for (size_t i=0; i<4; i++) {
+      encoded += uint8_t(ELC::chunk_magic[i]);
+    }
+    ELC::PutU64(encoded, first_sample);
+    ELC::PutU32(encoded, uint32_t(num_samples));
+    ELC::PutU32(encoded, uint32_t(data.size()));
+    ELC::PutU32(encoded, 0);  // payload_len
+    ELC::PutU32(encoded, 0);  // crc32
+
+    for (size_t c=0; c<data.size(); c++) {
+      ELC::EncodeChannel(encoded, data[c].Raw(), num_samples);
+    }
+
+    size_t payload_len = encoded.size() - ELC::chunk_header_len;
+    uint32_t crc = ELC::CRC32(encoded.Raw() + ELC::chunk_header_len,
+        payload_len);
+    for (int b=0; b<4; b++) {
+      encoded[20+b] = uint8_t(payload_len >> (8*b));
+      encoded[24+b] = uint8_t(crc >> (8*b));
+    }
+  }
+
+
+  void ELCChunk::Decode(const uint8_t* in, size_t in_len) {
+    if (in_len < ELC::chunk_header_len ||
+        memcmp(in, ELC::chunk_magic, 4) != 0) {
+      Throw_RC_Type(File, "ELC chunk header invalid");
+    }
+    first_sample = ELC::GetU64(in+4);
+    num_samples = ELC::GetU32(in+12);
+    size_t num_channels = ELC::GetU32(in+16);
+    size_t payload_len = ELC::GetU32(in+20);
+    uint32_t crc = ELC::GetU32(in+24);
+    if (payload_len > in_len - ELC::chunk_header_len) {
+      Throw_RC_Type(File, "ELC chunk truncated");
+    }
+    const uint8_t* p = in + ELC::chunk_header_len;
+    if (ELC::CRC32(p, payload_len) != crc) {
+      Throw_RC_Type(File, ("ELC checksum mismatch in chunk at sample " +
+            RC::RStr(first_sample)).c_str());
+    }
+
+    data.Resize(num_channels);
+    size_t pos = 0;
+    for (size_t c=0; c<num_channels; c++) {
+      data[c].Resize(num_samples);
+      pos += ELC::DecodeChannel(data[c].Raw(), num_samples, p + pos,
+          payload_len - pos);
+    }
+  }
+
+
+  void ELCReader::Open(const RC::RStr& filename) {
+    if ( ! fr.Open(filename) ) {
+      Throw_RC_Type(File, ("Could not open " + filename).c_str());
+    }
+
+    buf.Resize(0);
+    if (fr.Read(buf, 12) != 12 ||
+        memcmp(buf.Raw(), ELC::file_magic, 8) != 0) {
+      Throw_RC_Type(File, (filename + " is not an ELC file").c_str());
+    }
+    size_t json_len = ELC::GetU32(buf.Raw()+8);
+    buf.Resize(0);
+    if (fr.Read(buf, json_len + 4) != json_len + 4) {
+      Throw_RC_Type(File, (filename + " header truncated").c_str());
+    }
+    if (ELC::CRC32(buf.Raw(), json_len) !=
+        ELC::GetU32(buf.Raw()+json_len)) {
+      Throw_RC_Type(File, (filename + " header checksum mismatch").c_str());
+    }
+    metadata.SetFilename(filename);
+    metadata.Parse(RC::RStr(reinterpret_cast<const char*>(buf.Raw()),
+          json_len));
+    metadata.Get(sampling_rate, "sampling_rate");
+    metadata.Get(labels, "channels");
+    data_start = 12 + json_len + 4;
+
+    index.Clear();
+    if ( ! ReadIndex() ) {
+      ScanChunks();
+    }
+  }
+
+
+  u64 ELCReader::NumSamples() const {
+    if (index.size() == 0) {
+      return 0;
+    }
+    return index[index.size()-1].first_sample +
+      index[index.size()-1].num_samples;
+  }
+
+
+  void ELCReader::ReadChunk(ELCChunk& chunk, size_t i) {
+    u64 end = (i+1 < index.size()) ? index[i+1].offset : fr.Size();
+    size_t len = size_t(end - index[i].offset);
+    fr.SetPosition(size_t(index[i].offset));
+    buf.Resize(0);
+    if (fr.Read(buf, len) != len) {
+      Throw_RC_Type(File, "ELC chunk read failed");
+    }
+    chunk.Decode(buf.Raw(), len);
+  }
+
+
+  size_t ELCReader::FindChunk(u64 sample) const {
+    size_t lo = 0;
+    size_t hi = index.size();
+    while (hi - lo > 1) {
+      size_t mid = (lo + hi) / 2;
+      if (index[mid].first_sample <= sample) {
+        lo = mid;
+      }
+      else {
+        hi = mid;
+      }
+    }
+    return lo;
+  }
+
+
+  bool ELCReader::ReadIndex() {
+    size_t size = fr.Size();
+    if (size < data_start + 16) {
+      return false;
+    }
+    fr.SetPosition(size - 16);
+    buf.Resize(0);
+    if (fr.Read(buf, 16) != 16 ||
+        memcmp(buf.Raw()+8, ELC::footer_magic, 8) != 0) {
+      return false;
+    }
+    u64 index_offset = ELC::GetU64(buf.Raw());
+    if (index_offset < data_start || index_offset + 8 > size - 16) {
+      return false;
+    }
+
+    fr.SetPosition(size_t(index_offset));
+    buf.Resize(0);
+    size_t index_len = size - 16 - size_t(index_offset);
+    if (fr.Read(buf, index_len) != index_len ||
+        memcmp(buf.Raw(), ELC::index_magic, 4) != 0) {
+      return false;
+    }
+    size_t count = ELC::GetU32(buf.Raw()+4);
+    const size_t entry_len = 20;
+    if (8 + count*entry_len + 4 != index_len ||
+        ELC::CRC32(buf.Raw()+8, count*entry_len) !=
+        ELC::GetU32(buf.Raw()+8+count*entry_len)) {
+      return false;
+    }
+
+    index.Resize(count);
+    for (size_t i=0; i<count; i++) {
+      const uint8_t* e = buf.Raw() + 8 + i*entry_len;
+      index[i].offset = ELC::GetU64(e);
+      index[i].first_sample = ELC::GetU64(e+8);
+      index[i].num_samples = ELC::GetU32(e+16);
+    }
+    return true;
+  }
+
+
+  // Recovers the chunks of a file that was not closed, stopping at the
+  // first incomplete one.
+  void ELCReader::ScanChunks() {
+    size_t size = fr.Size();
+    u64 offset = data_start;
+    while (offset + ELC::chunk_header_len <= size) {
+      fr.SetPosition(size_t(offset));
+      buf.Resize(0);
+      if (fr.Read(buf, ELC::chunk_header_len) != ELC::chunk_header_len ||
+          memcmp(buf.Raw(), ELC::chunk_magic, 4) != 0) {
+        break;
+      }
+      u64 payload_len = ELC::GetU32(buf.Raw()+20);
+      if (offset + ELC::chunk_header_len + payload_len > size) {
+        break;
+      }
+      Entry entry;
+      entry.offset = offset;
+      entry.first_sample = ELC::GetU64(buf.Raw()+4);
+      entry.num_samples = ELC::GetU32(buf.Raw()+12);
+      index += entry;
+      offset += ELC::chunk_header_len + payload_len;
+    }
+  }
+
+
+  void ConvertELCToEDF(const RC::RStr& elc_file, const RC::RStr& edf_file) {
+    ELCReader reader;
+    reader.Open(elc_file);
+
+    size_t num_chans = reader.labels.size();
+    size_t sampling_rate = size_t(reader.sampling_rate + 0.5);
+    int edf_hdl = EDFSynch::OpenWrite(edf_file.c_str(),
+        EDFLIB_FILETYPE_EDFPLUS, int(num_chans));
+    if (edf_hdl < 0) {
+      Throw_RC_Type(File,
+          (RC::RStr("Could not open ")+edf_file+" for edf writing").c_str());
+    }
+
+    try {
+      // Data record layout as in EDFSave.
+      size_t datarecord_len = sampling_rate;
+      int datarecord_scaleby = 1;
+      if (sampling_rate > 10000) {
+        datarecord_scaleby = 10;
+        datarecord_len = sampling_rate / datarecord_scaleby;
+        if (edf_set_datarecord_duration(edf_hdl,
+              int(100000 / datarecord_scaleby))) {
+          Throw_RC_Type(File, "Could not set edf data record duration");
+        }
+      }
+
+      if (edfwrite_annotation_utf8(edf_hdl, 0LL, -1LL,
+          (RC::RStr("Sampling rate: ")+RC::RStr(sampling_rate)).c_str())) {
+        Throw_RC_Type(File, "Could not mark edf recording start");
+      }
+      for (size_t c=0; c<num_chans; c++) {
+        int ci = int(c);
+        if (edf_set_samplefrequency(edf_hdl, ci, int(datarecord_len)) ||
+            edf_set_digital_maximum(edf_hdl, ci, 32767) ||
+            edf_set_digital_minimum(edf_hdl, ci, -32768) ||
+            edf_set_physical_maximum(edf_hdl, ci, 32767) ||
+            edf_set_physical_minimum(edf_hdl, ci, -32768) ||
+            edf_set_physical_dimension(edf_hdl, ci, "250nV") ||
+            edf_set_label(edf_hdl, ci, reader.labels[c].c_str())) {
+          Throw_RC_Type(File, "Could not set edf channel parameters");
+        }
+      }
+      if (edf_set_equipment(edf_hdl, "Elemem using Blackrock NeuroPort")) {
+        Throw_RC_Type(File, "Could not set edf equipment");
+      }
+      std::string sub_name;
+      if (reader.metadata.TryGet(sub_name, "subject")) {
+        if (edf_set_patientname(edf_hdl, sub_name.c_str())) {
+          Throw_RC_Type(File, "Could not set edf subject name");
+        }
+      }
+      if (edfwrite_annotation_utf8(edf_hdl, 0LL, -1LL, "Recording starts")) {
+        Throw_RC_Type(File, "Could not mark edf recording start");
+      }
+
+      RC::Data1D<RC::Data1D<int16_t>> record(num_chans);
+      for (size_t c=0; c<num_chans; c++) {
+        record[c].Resize(datarecord_len);
+      }
+      size_t fill_len = 0;
+      u64 amount_written = 0;
+
+      ELCChunk chunk;
+      for (size_t i=0; i<reader.NumChunks(); i++) {
+        reader.ReadChunk(chunk, i);
+        if (chunk.data.size() != num_chans) {
+          Throw_RC_Type(File, "ELC chunk channel count mismatch");
+        }
+        size_t offset = 0;
+        while (offset < chunk.num_samples) {
+          size_t amnt = std::min(chunk.num_samples - offset,
+              datarecord_len - fill_len);
+          for (size_t c=0; c<num_chans; c++) {
+            std::copy_n(chunk.data[c].Raw() + offset, amnt,
+                record[c].Raw() + fill_len);
+          }
+          fill_len += amnt;
+          offset += amnt;
+          if (fill_len == datarecord_len) {
+            for (size_t c=0; c<num_chans; c++) {
+              if (edfwrite_digital_short_samples(edf_hdl, record[c].Raw())) {
+                Throw_RC_Type(File, "Could not save data to edf file");
+              }
+            }
+            fill_len = 0;
+            amount_written += datarecord_len;
+          }
+        }
+      }
+
+      edfwrite_annotation_utf8(edf_hdl,
+          static_cast<long long>(amount_written * 10000 / sampling_rate),
+          -1LL, "Recording ends");
+    }
+    catch (...) {
+      EDFSynch::Close(edf_hdl);
+      throw;
+    }
+    EDFSynch::Close(edf_hdl);
+  }
+}
+
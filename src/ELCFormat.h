@@ -0,0 +1,110 @@
+#ifndef ELCFORMAT_H
+#define ELCFORMAT_H
+
+#include "ConfigFile.h"
+#include "RC/Data1D.h"
+#include "RC/File.h"
+#include "RC/RStr.h"
+#include "RC/Types.h"
+
+namespace CML {
+  /// The Elemem lossless chunked EEG format, ".elc".
+  /** All integers are little-endian.  A file is:
+   *    Header:  "ELCEEG01", u32 json_len, json_len bytes of JSON metadata,
+   *             u32 crc32 of the JSON.
+   *    Chunks:  "ELCC", u64 first_sample, u32 num_samples,
+   *             u32 num_channels, u32 payload_len, u32 crc32 of payload,
+   *             then the payload of each channel in montage order.
+   *    Index:   "ELCI", u32 count, count entries of
+   *             {u64 offset, u64 first_sample, u32 num_samples},
+   *             u32 crc32 of the entries.
+   *    Footer:  u64 index offset, "ELCEND01".
+   *  Each channel payload is u32 channel_len, u8 method, u8 rice_k, then
+   *  for a fixed linear predictor of order method (0 to 3), method raw
+   *  int16 warm-up samples followed by Rice coded zig-zag residuals, as in
+   *  FLAC.  Method 255 stores raw int16 samples.  A file without a valid
+   *  index and footer, as after a crash, is read by scanning its chunks.
+   */
+  namespace ELC {
+    constexpr const char* file_magic = "ELCEEG01";
+    constexpr const char* chunk_magic = "ELCC";
+    constexpr const char* index_magic = "ELCI";
+    constexpr const char* footer_magic = "ELCEND01";
+    constexpr uint8_t method_raw = 255;
+    constexpr size_t chunk_header_len = 28;
+
+    uint32_t CRC32(const uint8_t* data, size_t len);
+
+    /// Appends the compressed form of one channel to out.
+    void EncodeChannel(RC::Data1D<uint8_t>& out, const int16_t* samples,
+        size_t len);
+    /// Decodes one channel from the start of in.
+    /** @return The bytes of in consumed.
+     */
+    size_t DecodeChannel(int16_t* samples, size_t len, const uint8_t* in,
+        size_t in_len);
+
+    void PutU32(RC::Data1D<uint8_t>& out, uint32_t val);
+    void PutU64(RC::Data1D<uint8_t>& out, uint64_t val);
+    uint32_t GetU32(const uint8_t* in);
+    uint64_t GetU64(const uint8_t* in);
+  }
+
+
+  /// Montage ordered samples for one chunk of an ELC file.
+  class ELCChunk {
+    public:
+    /// Compresses data into encoded, with the chunk header.
+    void Encode();
+    /// Decodes a chunk with header from raw bytes, verifying the checksum.
+    void Decode(const uint8_t* in, size_t in_len);
+
+    u64 first_sample = 0;
+    size_t num_samples = 0;
+    // data[channel][sample], with each channel at least num_samples long.
+    RC::Data1D<RC::Data1D<int16_t>> data;
+    RC::Data1D<uint8_t> encoded;
+  };
+
+
+  /// Random access reading of an ELC file.
+  class ELCReader {
+    public:
+    /// Opens an ELC file, reading its index or scanning for chunks.
+    void Open(const RC::RStr& filename);
+
+    size_t NumChunks() const { return index.size(); }
+    u64 NumSamples() const;
+    /// Reads and decodes chunk i, verifying its checksum.
+    void ReadChunk(ELCChunk& chunk, size_t i);
+    /// The chunk holding sample, for seeking.
+    size_t FindChunk(u64 sample) const;
+
+    JSONFile metadata;
+    f64 sampling_rate = 0;
+    RC::Data1D<RC::RStr> labels;
+
+    protected:
+    bool ReadIndex();
+    void ScanChunks();
+
+    class Entry {
+      public:
+      u64 offset;
+      u64 first_sample;
+      u32 num_samples;
+    };
+
+    RC::FileRead fr;
+    u64 data_start = 0;
+    RC::Data1D<Entry> index;
+    RC::Data1D<uint8_t> buf;
+  };
+
+
+  /// Converts an ELC file to EDF with the EDFSave header conventions.
+  void ConvertELCToEDF(const RC::RStr& elc_file, const RC::RStr& edf_file);
+}
+
+#endif // ELCFORMAT_H
+
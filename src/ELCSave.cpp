@@ -0,0 +1,269 @@
+#include "ELCSave.h"
+#include "EEGAcq.h"
+#include "Handler.h"
+#include "ConfigFile.h"
+#include "Popup.h"
+#include "Utils.h"
+
+namespace CML {
+  void ELCEncoder::Encode_Handler(const u64& seq, RC::APtr<ELCChunk>& chunk) {
+    chunk->Encode();
+    writer->WriteChunk(seq, chunk);
+  }
+
+
+  bool ELCWriter::Begin_Handler(const RC::RStr& filename,
+      const RC::RStr& metadata, const RC::Ptr<QSemaphore>& new_in_flight) {
+    in_flight = new_in_flight;
+    pending.clear();
+    next_seq = 0;
+    index.Clear();
+    index_count = 0;
+    failed = false;
+
+    if ( ! fw.Open(filename) ) {
+      failed = true;
+      return false;
+    }
+
+    RC::Data1D<uint8_t> header;
+    for (size_t i=0; i<8; i++) {
+      header += uint8_t(ELC::file_magic[i]);
+    }
+    ELC::PutU32(header, uint32_t(metadata.size()));
+    for (size_t i=0; i<metadata.size(); i++) {
+      header += uint8_t(metadata[i]);
+    }
+    ELC::PutU32(header, ELC::CRC32(header.Raw()+12, metadata.size()));
+    fw.Write(header);
+    offset = header.size();
+    return true;
+  }
+
+
+  void ELCWriter::WriteChunk_Handler(const u64& seq,
+      RC::APtr<ELCChunk>& chunk) {
+    pending[seq] = chunk;
+
+    while ( ! pending.empty() && pending.begin()->first == next_seq ) {
+      RC::APtr<ELCChunk> next = pending.begin()->second;
+      pending.erase(pending.begin());
+      next_seq++;
+
+      if ( ! failed && fw.IsOpen() ) {
+        try {
+          fw.Write(next->encoded);
+          ELC::PutU64(index, offset);
+          ELC::PutU64(index, next->first_sample);
+          ELC::PutU32(index, uint32_t(next->num_samples));
+          index_count++;
+          offset += next->encoded.size();
+        }
+        catch (...) {
+          failed = true;
+        }
+      }
+      in_flight->release();
+    }
+  }
+
+
+  bool ELCWriter::End_Handler() {
+    if ( ! fw.IsOpen() ) {
+      return ! failed;
+    }
+
+    try {
+      RC::Data1D<uint8_t> tail;
+      for (size_t i=0; i<4; i++) {
+        tail += uint8_t(ELC::index_magic[i]);
+      }
+      ELC::PutU32(tail, index_count);
+      tail += index;
+      ELC::PutU32(tail, ELC::CRC32(index.Raw(), index.size()));
+      ELC::PutU64(tail, offset);
+      for (size_t i=0; i<8; i++) {
+        tail += uint8_t(ELC::footer_magic[i]);
+      }
+      fw.Write(tail);
+      fw.Close();
+    }
+    catch (...) {
+      failed = true;
+      fw.Close();
+    }
+    return ! failed;
+  }
+
+
+  ELCSave::ELCSave(RC::Ptr<Handler> hndl, size_t sampling_rate,
+      size_t encode_threads)
+    : EEGFileSave(hndl), sampling_rate(sampling_rate),
+      chunk_len(sampling_rate * chunk_sec) {
+    callback_ID = RC::RStr("ELCSave_") + RC::RStr(sampling_rate);
+    encode_threads = std::max(size_t(1), encode_threads);
+    for (size_t i=0; i<encode_threads; i++) {
+      encoders += RC::MakeAPtr<ELCEncoder>(&writer);
+    }
+  }
+
+
+  void ELCSave::StartFile_Handler(const RC::RStr& filename,
+                                  const FullConf& conf) {
+    if (conf.elec_config.IsNull()) {
+      Throw_RC_Error("Cannot save data with no channels set");
+    }
+    if (conf.exp_config.IsNull()) {
+      Throw_RC_Error("Cannot save data with no experiment config");
+    }
+
+    StopSaving_Handler();
+
+    channels.Resize(conf.elec_config->data.size2());
+    std::vector<std::string> labels;
+    for (size_t c=0; c<channels.size(); c++) {
+      channels[c] = uint16_t(conf.elec_config->data[c][1].Get_u32() - 1); // Subtract 1 to convert to 0-indexing
+      labels.push_back(conf.elec_config->data[c][0].Raw());
+    }
+
+    std::string sub_name;
+    conf.exp_config->Get(sub_name, "subject");
+
+    JSONFile metadata;
+    metadata.Set("ELC", "format");
+    metadata.Set(1, "version");
+    metadata.Set(f64(sampling_rate), "sampling_rate");
+    metadata.Set(chunk_len, "chunk_samples");
+    metadata.Set(labels, "channels");
+    metadata.Set("250nV", "units");
+    metadata.Set(sub_name, "subject");
+    metadata.Set(RC::Time::Get()*1e3, "start_time_ms");
+    metadata.Set("Elemem using Blackrock NeuroPort", "equipment");
+
+    // Fresh permits for this file.
+    while (in_flight.tryAcquire()) { }
+    in_flight.release(max_in_flight);
+    if ( ! writer.Begin(filename, metadata.Line(), &in_flight) ) {
+      Throw_RC_Type(File,
+          (RC::RStr("Could not open ")+filename+" for elc writing").c_str());
+    }
+
+    current_filename = filename;
+    saving = true;
+    samples_saved = 0;
+    seq = 0;
+    NewChunk();
+
+    hndl->eeg_acq.RegisterEEGMonoCallback(callback_ID, SaveData);
+    hndl->eeg_acq.SetEEGMonoCallbackPolicy(callback_ID,
+        EEGCallbackPolicy::Lossless(this));
+  }
+
+
+  void ELCSave::StopSaving_Handler() {
+    hndl->eeg_acq.RemoveEEGMonoCallback(callback_ID);
+
+    if ( ! saving ) {
+      return;
+    }
+    saving = false;
+
+    // Keep the final partial chunk.
+    if (chunk.IsSet() && chunk->num_samples > 0) {
+      DispatchChunk();
+    }
+    // Not Delete, which would null the copy held by an encoder.
+    chunk = RC::APtr<ELCChunk>();
+
+    // Encoders pass every chunk to the writer before Sync returns, so End
+    // is queued after all of them.
+    for (size_t i=0; i<encoders.size(); i++) {
+      encoders[i]->Sync();
+    }
+    if ( ! writer.End() ) {
+      ErrorWin("Error during ELC write.  Chunks written before the error "
+               "can still be converted to EDF.");
+    }
+  }
+
+
+  void ELCSave::NewChunk() {
+    chunk = new ELCChunk();
+    chunk->first_sample = samples_saved;
+    chunk->num_samples = 0;
+    chunk->data.Resize(channels.size());
+    for (size_t c=0; c<channels.size(); c++) {
+      chunk->data[c].Resize(chunk_len);
+    }
+  }
+
+
+  void ELCSave::DispatchChunk() {
+    // Waits only if encoding or writing is max_in_flight chunks behind.
+    in_flight.acquire();
+    encoders[seq % encoders.size()]->Encode(seq, chunk);
+    seq++;
+  }
+
+
+  void ELCSave::SaveData_Handler(RC::APtr<const EEGData>& data) {
+    try {
+      auto& datar = data->data;
+      if ( ! saving ) {
+        StopSaving_Handler();
+        return;
+      }
+      if (writer.Failed()) {
+        Throw_RC_Type(File, "Could not save data to elc file");
+      }
+
+      size_t block_len = 0;
+      for (size_t c=0; c<datar.size(); c++) {
+        block_len = std::max(block_len, datar[c].size());
+      }
+      for (size_t c=0; c<channels.size(); c++) {
+        if (channels[c] >= datar.size()) {
+          Throw_RC_Type(File, ("ELC save, configured channel " +
+                RC::RStr(c+1) + " out of bounds").c_str());
+        }
+        if (datar[channels[c]].size() < block_len) {
+          Throw_RC_Type(File, ("Data missing on elc save, channel " +
+                RC::RStr(channels[c]+1)).c_str());
+        }
+      }
+
+      // Copy in the order of the montage CSV.
+      size_t offset = 0;
+      while (offset < block_len) {
+        size_t amnt = std::min(block_len - offset,
+            chunk_len - chunk->num_samples);
+        for (size_t c=0; c<channels.size(); c++) {
+          std::copy_n(datar[channels[c]].Raw() + offset, amnt,
+              chunk->data[c].Raw() + chunk->num_samples);
+        }
+        chunk->num_samples += amnt;
+        samples_saved += amnt;
+        offset += amnt;
+
+        if (chunk->num_samples == chunk_len) {
+          if ( ! CheckStorage(current_filename, 1024*1024*1024) ) {
+            ErrorWin("Free disk space below 1GB.  Halting elc save to "
+                     "close file and preserve existing data.  "
+                     "Experiment stop triggered.");
+            StopSaving_Handler();
+            hndl->StopExperiment();
+            return;
+          }
+          DispatchChunk();
+          NewChunk();
+        }
+      }
+    }
+    catch (...) {
+      StopSaving_Handler();
+      ErrorWin("ELC saving halted.");
+      throw;
+    }
+  }
+}
+
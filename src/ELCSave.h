@@ -0,0 +1,119 @@
+#ifndef ELCSAVE_H
+#define ELCSAVE_H
+
+#include "EEGFileSave.h"
+#include "ELCFormat.h"
+#include "RC/File.h"
+#include "RC/Ptr.h"
+#include "RCqt/Worker.h"
+#include <QSemaphore>
+#include <atomic>
+#include <map>
+
+namespace CML {
+  class Handler;
+  class ELCWriter;
+
+  /// Compresses ELC chunks, as one thread of the ELCSave encoding pool.
+  class ELCEncoder : public RCqt::WorkerThread {
+    public:
+    ELCEncoder(RC::Ptr<ELCWriter> writer) : writer(writer) { }
+
+    /// Encodes a chunk, passing it on to the writer with its sequence.
+    RCqt::TaskCaller<const u64, RC::APtr<ELCChunk>> Encode =
+      TaskHandler(ELCEncoder::Encode_Handler);
+    /// Returns once all previously queued chunks are passed on.
+    RCqt::TaskBlocker<> Sync = TaskHandler(ELCEncoder::Sync_Handler);
+
+    protected:
+    void Encode_Handler(const u64& seq, RC::APtr<ELCChunk>& chunk);
+    void Sync_Handler() { }
+
+    RC::Ptr<ELCWriter> writer;
+  };
+
+
+  /// Writes encoded ELC chunks in sequence, then the index and footer.
+  class ELCWriter : public RCqt::WorkerThread {
+    public:
+    /// Opens filename and writes the header with the given metadata.
+    /** @param in_flight Released once per chunk written.
+     *  @return True if the file could be opened.
+     */
+    RCqt::TaskGetter<bool, const RC::RStr, const RC::RStr,
+      const RC::Ptr<QSemaphore>> Begin = TaskHandler(ELCWriter::Begin_Handler);
+    /// Writes chunks in seq order, holding any that arrive early.
+    RCqt::TaskCaller<const u64, RC::APtr<ELCChunk>> WriteChunk =
+      TaskHandler(ELCWriter::WriteChunk_Handler);
+    /// Writes the index and footer, and closes the file.
+    /** @return False if any write failed.
+     */
+    RCqt::TaskGetter<bool> End = TaskHandler(ELCWriter::End_Handler);
+
+    /// True if a write has failed.  Safe from any thread.
+    bool Failed() const { return failed.load(); }
+
+    protected:
+    bool Begin_Handler(const RC::RStr& filename, const RC::RStr& metadata,
+        const RC::Ptr<QSemaphore>& new_in_flight);
+    void WriteChunk_Handler(const u64& seq, RC::APtr<ELCChunk>& chunk);
+    bool End_Handler();
+
+    RC::FileWrite fw;
+    RC::Ptr<QSemaphore> in_flight;
+    std::map<u64, RC::APtr<ELCChunk>> pending;
+    u64 next_seq = 0;
+    u64 offset = 0;
+    RC::Data1D<uint8_t> index;
+    u32 index_count = 0;
+    std::atomic<bool> failed{false};
+  };
+
+
+  /// Saves EEG in the lossless compressed ELC format.
+  /** Chunks of chunk_sec are encoded on a pool of ELCEncoder threads and
+   *  written in order by an ELCWriter thread, so neither compression nor
+   *  disk I/O runs on this worker.  ConvertELCToEDF produces an EDF file
+   *  equivalent to that of EDFSave.
+   */
+  class ELCSave : public EEGFileSave {
+    public:
+    ELCSave(RC::Ptr<Handler> hndl, size_t sampling_rate,
+        size_t encode_threads=2);
+
+    RC::RStr GetExt() const override { return "elc"; }
+
+    protected:
+    void StartFile_Handler(const RC::RStr& filename,
+                           const FullConf& conf) override;
+    // Thread ordering constraint:
+    // Must call Stop after Start, before this destructor, and before
+    // hndl->eeg_acq is deleted.
+    void StopSaving_Handler() override;
+    void SaveData_Handler(RC::APtr<const EEGData>& data) override;
+
+    void NewChunk();
+    void DispatchChunk();
+
+    static constexpr size_t chunk_sec = 1;
+    // Chunks queued or encoding before SaveData waits for the writer.
+    static constexpr int max_in_flight = 8;
+
+    size_t sampling_rate;
+    size_t chunk_len;
+    RC::Data1D<uint16_t> channels;
+    RC::RStr current_filename;
+    RC::RStr callback_ID;
+    bool saving = false;
+    u64 samples_saved = 0;
+    u64 seq = 0;
+    RC::APtr<ELCChunk> chunk;
+
+    ELCWriter writer;
+    RC::Data1D<RC::APtr<ELCEncoder>> encoders;
+    QSemaphore in_flight;
+  };
+}
+
+#endif // ELCSAVE_H
+
@@ -7,6 +7,7 @@
 #include "RC/Errors.h"
 #include "RCQApplication.h"
 #include "QtStyle.h"
+#include "Resimulation.h"
 
 #include <iostream>
 #include <stdlib.h>
@@ -18,6 +19,15 @@ int main (int argc, char *argv[]) {
   RC::Segfault::SetHandler();
 
   try {
+    // elemem --resim <session_dir> replays a recorded session headless.
+    CML::ResimSettings resim;
+    resim.ParseArgs(argc, argv);
+    if (resim.IsSet()) {
+      if (qgetenv("QT_QPA_PLATFORM").isEmpty()) {
+        qputenv("QT_QPA_PLATFORM", "offscreen");
+      }
+    }
+
     RCQApplication app(argc, argv);
     app.setStyleSheet(Resource::QtStyle_css.c_str());
 
@@ -39,6 +49,10 @@ int main (int argc, char *argv[]) {
 #endif
 
       hndl->SetMainWindow(&main_window);
+      if (resim.IsSet()) {
+        CML::PopupManager::GetManager()->SetHeadless(true);
+        hndl->SetResimulation(resim);
+      }
 
       hndl->LoadSysConfig();  // Must come before RegisterEEGDisplay.
       // TODO Catch and handle LoadSys errors, and still do initialize.
@@ -75,10 +89,18 @@ int main (int argc, char *argv[]) {
       CML::ErrorWin(errormsg);
     }
 
-    main_window.RegisterEEGDisplay();
-    main_window.show();
+    if (resim.IsSet()) {
+      hndl->StartResimulation();
+    }
+    else {
+      main_window.RegisterEEGDisplay();
+      main_window.show();
+    }
 
     retval = app.exec();
+    if (resim.IsSet()) {
+      retval = hndl->ResimExitCode();
+    }
   }
   catch (RC::ErrorMsgFatal& err) {
     std::cerr << "Fatal Error:  " << err.what() << std::endl;
@@ -1,22 +1,213 @@
 #include "EventLog.h"
+#include "Popup.h"
+#include <QTimer>
+
+#ifdef WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
 
 namespace CML {
-  void EventLog::StartFile_Handler(const RC::RStr& filename) {
-    fw = RC::FileWrite(filename);
+  EventLog::EventLog()
+    : pending(queue_capacity),
+      free_records(queue_capacity) {
   }
 
-  void EventLog::Log_Handler(const RC::RStr& event) {
-    if (fw.IsOpen()) {
-      fw.Put(event);
-      if (last_flush.SinceStart() > 5) {
-        fw.Flush();
-        last_flush.Start();
+  EventLog::~EventLog() {
+    EventRecord* record;
+    while ((record = pending.Pop())) {
+      delete record;
+    }
+    while ((record = free_records.Pop())) {
+      delete record;
+    }
+  }
+
+
+  void EventLog::Log(const RC::RStr& event) {
+    if (event.empty()) {
+      return;
+    }
+    RC::Ptr<EventRecord> record = NewRecord("");
+    record->line = event.Raw();
+    if ( ! pending.Push(record.Raw()) ) {
+      overflowed++;
+      LogLine(event);
+      if ( ! free_records.Push(record.Raw()) ) {
+        delete record.Raw();
+      }
+      return;
+    }
+    WriteQueued();
+  }
+
+
+  RC::Ptr<EventRecord> EventLog::NewRecord(const char* type, uint64_t id) {
+    EventRecord* record = free_records.Pop();
+    if (record == nullptr) {
+      record = new EventRecord();
+    }
+    record->Reset(type, id);
+    return record;
+  }
+
+
+  void EventLog::Submit(RC::Ptr<EventRecord> record) {
+    if ( ! pending.Push(record.Raw()) ) {
+      // Full, so write it as a line rather than lose it.
+      overflowed++;
+      LogLine(record->ToJSON().Line());
+      if ( ! free_records.Push(record.Raw()) ) {
+        delete record.Raw();
       }
     }
   }
 
+
+  void EventLog::SetOptions_Handler(const EventLogOptions& new_options) {
+    options = new_options;
+    if (batch_timer.IsSet()) {
+      batch_timer->setInterval(int(options.batch_sec*1000));
+    }
+  }
+
+
+  void EventLog::StartFile_Handler(const RC::RStr& filename) {
+    CloseFile_Handler();
+    BeBatching();
+
+    json_filename = filename;
+    if (options.binary) {
+      binary_filename = RC::File::NoExtension(filename) + ".evb";
+      fw = RC::FileWrite(binary_filename);
+      binary_buf.clear();
+      EventLogBinary::AppendHeader(binary_buf);
+    }
+    else {
+      binary_filename.clear();
+      fw = RC::FileWrite(filename);
+    }
+    overflowed = 0;
+    last_flush.Start();
+  }
+
+
+  void EventLog::Log_Handler(const RC::RStr& event) {
+    // Entries queued before this overflowed one go first.
+    WriteRecords();
+    WriteLine(event);
+    WriteBuffer();
+    Flush(false);
+  }
+
+
   void EventLog::CloseFile_Handler() {
+    if ( ! fw.IsOpen() ) {
+      return;
+    }
+    WriteRecords();
+    WriteBuffer();
+    Flush(true);
     fw.Close();
+
+    if (overflowed > 0) {
+      DebugLog(RC::RStr("EventLog queue overflowed ") +
+          RC::RStr(u64(overflowed)) + " times, logged by task instead.");
+    }
+
+    if ( ! binary_filename.empty() ) {
+      ExportEventLogJSON(binary_filename, json_filename);
+    }
+  }
+
+
+  void EventLog::WriteRecords() {
+    EventRecord* record;
+    while ((record = pending.Pop())) {
+      if ( ! record->line.empty() ) {
+        WriteLine(record->line);
+      }
+      else if (fw.IsOpen()) {
+        if (options.binary) {
+          EventLogBinary::AppendRecord(binary_buf, *record);
+        }
+        else {
+          fw.Put(record->ToJSON().Line());
+        }
+      }
+      if ( ! free_records.Push(record) ) {
+        delete record;
+      }
+    }
+  }
+
+
+  void EventLog::WriteLine(const RC::RStr& line) {
+    if ( ! fw.IsOpen() ) {
+      return;
+    }
+    if (options.binary) {
+      EventLogBinary::AppendLine(binary_buf, line);
+    }
+    else {
+      fw.Put(line);
+    }
+  }
+
+
+  void EventLog::WriteBatch() {
+    WriteRecords();
+    WriteBuffer();
+    Flush(false);
+  }
+
+
+  // Passes encoded binary entries on to the file.
+  void EventLog::WriteBuffer() {
+    if (binary_buf.empty() || ! fw.IsOpen()) {
+      return;
+    }
+    RC::Data1D<uint8_t> buf_view(binary_buf.size(), binary_buf.data());
+    fw.Write(buf_view);
+    binary_buf.clear();
+  }
+
+
+  void EventLog::Flush(bool force) {
+    if ( ! fw.IsOpen() ) {
+      return;
+    }
+    if ( ! force && last_flush.SinceStart() <= options.flush_sec ) {
+      return;
+    }
+
+    fw.Flush();
+    if (options.fsync) {
+#ifdef WIN32
+      _commit(_fileno(fw.Raw()));
+#else
+      fsync(fileno(fw.Raw()));
+#endif
+    }
+    last_flush.Start();
+  }
+
+
+  void EventLog::BeBatching() {
+    if (DirectCallingMode()) {
+      return;
+    }
+    if (batch_timer.IsNull()) {
+      batch_timer = new QTimer();
+      AddToThread(batch_timer);  // For maintenance robustness.
+      // Okay because timer allocated within EventLog thread here.
+      QObject::connect(batch_timer.Raw(), &QTimer::timeout,
+          RC::MakeCaller(this, &EventLog::WriteBatch));
+    }
+    if ( ! batch_timer->isActive() ) {
+      batch_timer->start(int(options.batch_sec*1000));
+    }
   }
 }
 
@@ -1,29 +1,93 @@
 #ifndef EVENTLOG_H
 #define EVENTLOG_H
 
+#include "EventRecord.h"
 #include "RC/RStr.h"
 #include "RC/File.h"
+#include "RC/Ptr.h"
+#include "RCqt/TaskQueue.h"
 #include "RCqt/Worker.h"
+#include <atomic>
+#include <vector>
+
+class QTimer;
 
 namespace CML {
+  class EventLogOptions {
+    public:
+    // Writes the binary event log, exported to JSON lines on close.
+    bool binary = false;
+    // Seconds between flushes to the operating system.
+    f64 flush_sec = 5;
+    // Also fsync at each flush and on close.
+    bool fsync = false;
+    // Seconds between writes of batched EventRecords.
+    f64 batch_sec = 0.05;
+  };
+
   class EventLog : public RCqt::WorkerThread {
     public:
-    EventLog() { }
+    EventLog();
+    ~EventLog();
 
+    RCqt::TaskCaller<const EventLogOptions> SetOptions =
+      TaskHandler(EventLog::SetOptions_Handler);
     RCqt::TaskCaller<const RC::RStr> StartFile =
       TaskHandler(EventLog::StartFile_Handler);
-    RCqt::TaskCaller<const RC::RStr> Log =
-      TaskHandler(EventLog::Log_Handler);
     RCqt::TaskCaller<> CloseFile =
       TaskHandler(EventLog::CloseFile_Handler);
+    /// Returns once all previously queued tasks have run.
+    RCqt::TaskBlocker<> Sync = TaskHandler(EventLog::Sync_Handler);
+
+    /// Logs a JSON line.
+    /** Safe from any thread.  The line passes through the same queue as
+     *  Submit, so it stays in order with the calling thread's records.
+     */
+    void Log(const RC::RStr& event);
+
+    /// Returns a pooled record to fill, then pass to Submit.
+    /** Together with Submit this is safe from any thread, and takes no
+     *  lock and queues no task, for logging on the classification path.
+     */
+    RC::Ptr<EventRecord> NewRecord(const char* type,
+        uint64_t id=uint64_t(-1));
+    /// Queues a record from NewRecord to be written with the next batch.
+    void Submit(RC::Ptr<EventRecord> record);
 
     protected:
+    // Writes queued lines and records soon after a Log.
+    RCqt::TaskCaller<> WriteQueued = TaskHandler(EventLog::WriteBatch);
+    // For lines that did not fit in pending.
+    RCqt::TaskCaller<const RC::RStr> LogLine =
+      TaskHandler(EventLog::Log_Handler);
+
+    void SetOptions_Handler(const EventLogOptions& new_options);
     void StartFile_Handler(const RC::RStr& filename);
     void Log_Handler(const RC::RStr& event);
     void CloseFile_Handler();
+    void Sync_Handler() { }
 
+    void WriteBatch();
+    void WriteRecords();
+    void WriteLine(const RC::RStr& line);
+    void WriteBuffer();
+    void Flush(bool force);
+    void BeBatching();
+
+    EventLogOptions options;
     RC::FileWrite fw;
+    RC::RStr json_filename;
+    RC::RStr binary_filename;
     RC::Time last_flush;
+    std::vector<uint8_t> binary_buf;
+    RC::APtr<QTimer> batch_timer;
+
+    static const size_t queue_capacity = 4096;
+    RCqt::BoundedQueue<EventRecord> pending;
+    RCqt::BoundedQueue<EventRecord> free_records;
+    // Lines and records that did not fit in pending, and were queued as
+    // LogLine tasks instead.
+    std::atomic<u64> overflowed{0};
   };
 }
 
@@ -0,0 +1,284 @@
+#include "EventRecord.h"
+#include "RC/Errors.h"
+#include "RC/RTime.h"
+#include <cstring>
+
+namespace CML {
+  static const char event_log_magic[8] = {'E','L','M','E','V','L','O','G'};
+  static const uint32_t event_log_version = 1;
+  enum class EventEntry : uint8_t { Line=0, Record=1 };
+
+
+  void EventRecord::Reset(const char* new_type, uint64_t new_id) {
+    type = new_type;
+    id = new_id;
+    time_ms = RC::Time::Get()*1e3;  // ms from 1970-01-01 00:00:00 UTC
+    num_fields = 0;
+    line.clear();
+  }
+
+
+  EventRecord::Field& EventRecord::NewField(const char* name, Kind kind,
+      uint8_t depth) {
+    if (num_fields == fields.size()) {
+      fields.emplace_back();
+    }
+    Field& field = fields[num_fields];
+    num_fields++;
+    field.name = name;
+    field.kind = kind;
+    field.depth = depth;
+    field.sizes.clear();
+    field.values.clear();
+    return field;
+  }
+
+
+  static nlohmann::json FieldValue(EventRecord::Kind kind, f64 value) {
+    switch (kind) {
+      case EventRecord::Kind::Bool: return value != 0;
+      case EventRecord::Kind::Int:
+        if (value < 0) { return int64_t(value); }
+        return uint64_t(value);
+      default: return value;
+    }
+  }
+
+
+  // Rebuilds nested lists from the depth-first sizes.
+  static nlohmann::json FieldJSON(EventRecord::Kind kind, uint8_t depth,
+      const std::vector<uint32_t>& sizes, const std::vector<f64>& values,
+      size_t& size_pos, size_t& value_pos) {
+    if (depth == 0) {
+      if (value_pos >= values.size()) {
+        Throw_RC_Type(Bounds, "Event record field has too few values");
+      }
+      return FieldValue(kind, values[value_pos++]);
+    }
+    if (size_pos >= sizes.size()) {
+      Throw_RC_Type(Bounds, "Event record field has too few sizes");
+    }
+    nlohmann::json list = nlohmann::json::array();
+    uint32_t len = sizes[size_pos++];
+    for (uint32_t i=0; i<len; i++) {
+      list.push_back(FieldJSON(kind, depth-1, sizes, values, size_pos,
+            value_pos));
+    }
+    return list;
+  }
+
+
+  static nlohmann::json MakeRespJSON(const std::string& type, uint64_t id,
+      f64 time_ms, nlohmann::json data) {
+    nlohmann::json resp;
+    resp["type"] = type;
+    resp["data"] = std::move(data);
+    if (id != uint64_t(-1)) {
+      resp["id"] = id;
+    }
+    resp["time"] = time_ms;
+    return resp;
+  }
+
+
+  JSONFile EventRecord::ToJSON() const {
+    nlohmann::json data = nlohmann::json::object();
+    for (size_t f=0; f<num_fields; f++) {
+      size_t size_pos = 0;
+      size_t value_pos = 0;
+      data[fields[f].name] = FieldJSON(fields[f].kind, fields[f].depth,
+          fields[f].sizes, fields[f].values, size_pos, value_pos);
+    }
+
+    JSONFile resp;
+    resp.SetFilename("HostResponse");
+    resp.json = MakeRespJSON(type, id, time_ms, std::move(data));
+    return resp;
+  }
+
+
+  template<class T>
+  static void Put(std::vector<uint8_t>& out, const T& val) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&val);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+  }
+
+  static void PutStr(std::vector<uint8_t>& out, const char* str) {
+    uint16_t len = uint16_t(std::min(std::strlen(str), size_t(0xffff)));
+    Put(out, len);
+    out.insert(out.end(), str, str + len);
+  }
+
+  // Starts an entry and returns the offset of its length to fill in.
+  static size_t BeginEntry(std::vector<uint8_t>& out, EventEntry kind) {
+    size_t len_pos = out.size();
+    Put(out, uint32_t(0));
+    Put(out, uint8_t(kind));
+    return len_pos;
+  }
+
+  static void EndEntry(std::vector<uint8_t>& out, size_t len_pos) {
+    uint32_t len = uint32_t(out.size() - len_pos - sizeof(uint32_t));
+    std::memcpy(out.data() + len_pos, &len, sizeof(len));
+  }
+
+
+  void EventLogBinary::AppendHeader(std::vector<uint8_t>& out) {
+    out.insert(out.end(), event_log_magic,
+        event_log_magic + sizeof(event_log_magic));
+    Put(out, event_log_version);
+  }
+
+
+  void EventLogBinary::AppendLine(std::vector<uint8_t>& out,
+      const RC::RStr& line) {
+    size_t len_pos = BeginEntry(out, EventEntry::Line);
+    out.insert(out.end(), line.c_str(), line.c_str() + line.size());
+    EndEntry(out, len_pos);
+  }
+
+
+  void EventLogBinary::AppendRecord(std::vector<uint8_t>& out,
+      const EventRecord& record) {
+    size_t len_pos = BeginEntry(out, EventEntry::Record);
+    Put(out, record.time_ms);
+    Put(out, record.id);
+    PutStr(out, record.type);
+    Put(out, uint16_t(record.num_fields));
+    for (size_t f=0; f<record.num_fields; f++) {
+      const EventRecord::Field& field = record.fields[f];
+      PutStr(out, field.name);
+      Put(out, uint8_t(field.kind));
+      Put(out, field.depth);
+      Put(out, uint32_t(field.sizes.size()));
+      for (uint32_t s : field.sizes) {
+        Put(out, s);
+      }
+      Put(out, uint32_t(field.values.size()));
+      for (f64 v : field.values) {
+        Put(out, v);
+      }
+    }
+    EndEntry(out, len_pos);
+  }
+
+
+  namespace {
+    class EntryReader {
+      public:
+      EntryReader(const uint8_t* data, size_t len)
+        : pos(data), end(data + len) { }
+
+      template<class T>
+      T Get() {
+        T val;
+        Need(sizeof(T));
+        std::memcpy(&val, pos, sizeof(T));
+        pos += sizeof(T);
+        return val;
+      }
+
+      std::string GetStr() {
+        uint16_t len = Get<uint16_t>();
+        Need(len);
+        std::string str(reinterpret_cast<const char*>(pos), len);
+        pos += len;
+        return str;
+      }
+
+      protected:
+      void Need(size_t amnt) {
+        if (size_t(end - pos) < amnt) {
+          Throw_RC_Type(Bounds, "Corrupt event record");
+        }
+      }
+
+      const uint8_t* pos;
+      const uint8_t* end;
+    };
+  }
+
+
+  static nlohmann::json DecodeRecord(const uint8_t* data, size_t len) {
+    EntryReader rd(data, len);
+    f64 time_ms = rd.Get<f64>();
+    uint64_t id = rd.Get<uint64_t>();
+    std::string type = rd.GetStr();
+    uint16_t num_fields = rd.Get<uint16_t>();
+
+    nlohmann::json fields = nlohmann::json::object();
+    std::vector<uint32_t> sizes;
+    std::vector<f64> values;
+    for (uint16_t f=0; f<num_fields; f++) {
+      std::string name = rd.GetStr();
+      auto kind = EventRecord::Kind(rd.Get<uint8_t>());
+      uint8_t depth = rd.Get<uint8_t>();
+      sizes.resize(rd.Get<uint32_t>());
+      for (auto& s : sizes) {
+        s = rd.Get<uint32_t>();
+      }
+      values.resize(rd.Get<uint32_t>());
+      for (auto& v : values) {
+        v = rd.Get<f64>();
+      }
+      size_t size_pos = 0;
+      size_t value_pos = 0;
+      fields[name] = FieldJSON(kind, depth, sizes, values, size_pos,
+          value_pos);
+    }
+
+    return MakeRespJSON(type, id, time_ms, std::move(fields));
+  }
+
+
+  size_t ExportEventLogJSON(const RC::RStr& binary_file,
+      const RC::RStr& json_file) {
+    RC::FileRead fr(binary_file);
+    RC::Data1D<uint8_t> bin;
+    fr.ReadAll(bin);
+    fr.Close();
+
+    size_t header_len = sizeof(event_log_magic) + sizeof(uint32_t);
+    if (bin.size() < header_len ||
+        std::memcmp(bin.Raw(), event_log_magic, sizeof(event_log_magic))) {
+      Throw_RC_Type(File, ("Not a binary event log: " + binary_file).c_str());
+    }
+    uint32_t file_version;
+    std::memcpy(&file_version, bin.Raw() + sizeof(event_log_magic),
+        sizeof(file_version));
+    if (file_version > event_log_version) {
+      Throw_RC_Type(File, ("Unsupported binary event log version in " +
+            binary_file).c_str());
+    }
+
+    RC::FileWrite fw(json_file);
+    size_t count = 0;
+    size_t pos = header_len;
+    while (bin.size() - pos >= sizeof(uint32_t) + 1) {
+      uint32_t len;
+      std::memcpy(&len, bin.Raw() + pos, sizeof(len));
+      if (len < 1 || bin.size() - pos - sizeof(uint32_t) < len) {
+        break;  // Truncated by an interrupted write.
+      }
+      const uint8_t* entry = bin.Raw() + pos + sizeof(uint32_t);
+      pos += sizeof(uint32_t) + len;
+
+      auto kind = EventEntry(entry[0]);
+      if (kind == EventEntry::Line) {
+        fw.Put(RC::RStr(reinterpret_cast<const char*>(entry+1), len-1));
+      }
+      else if (kind == EventEntry::Record) {
+        JSONFile line;
+        line.json = DecodeRecord(entry+1, len-1);
+        fw.Put(line.Line());
+      }
+      else {
+        continue;
+      }
+      count++;
+    }
+    fw.Close();
+    return count;
+  }
+}
+
@@ -0,0 +1,130 @@
+#ifndef EVENTRECORD_H
+#define EVENTRECORD_H
+
+#include "ConfigFile.h"
+#include "RC/Data1D.h"
+#include "RC/File.h"
+#include "RC/RStr.h"
+#include "RC/Types.h"
+#include <cstdint>
+#include <type_traits>
+#include <vector>
+
+namespace CML {
+  template<class T>
+  struct EventFieldTraits {
+    using Elem = T;
+    static constexpr uint8_t depth = 0;
+  };
+  template<class T>
+  struct EventFieldTraits<RC::Data1D<T>> {
+    using Elem = typename EventFieldTraits<T>::Elem;
+    static constexpr uint8_t depth = 1 + EventFieldTraits<T>::depth;
+  };
+
+
+  /// A typed event log entry, serialized on the EventLog thread.
+  /** Filled with numbers and nested arrays instead of JSON text, so the
+   *  caller only copies values.  Records are pooled by EventLog and reused,
+   *  keeping their allocations.  The type and field names must be string
+   *  literals.  ToJSON gives the same line as MakeResp(type, id, data).
+   */
+  class EventRecord {
+    public:
+    enum class Kind : uint8_t { Real=0, Int=1, Bool=2 };
+
+    class Field {
+      public:
+      const char* name;
+      Kind kind;
+      // Nesting depth, 0 for a scalar.
+      uint8_t depth;
+      // The length of every list, in depth-first order.
+      std::vector<uint32_t> sizes;
+      std::vector<f64> values;
+    };
+
+    /// Clears the fields and stamps the current time.
+    void Reset(const char* new_type, uint64_t new_id=uint64_t(-1));
+
+    void Add(const char* name, f64 value) {
+      NewField(name, Kind::Real, 0).values.push_back(value);
+    }
+    void Add(const char* name, bool value) {
+      NewField(name, Kind::Bool, 0).values.push_back(value);
+    }
+    template<class T>
+    std::enable_if_t<std::is_integral_v<T>> Add(const char* name, T value) {
+      NewField(name, Kind::Int, 0).values.push_back(f64(value));
+    }
+    /// Adds a Data1D of numbers, nested to any depth, which may be ragged.
+    template<class T>
+    void Add(const char* name, const RC::Data1D<T>& values) {
+      using Traits = EventFieldTraits<RC::Data1D<T>>;
+      Field& field = NewField(name, KindOf<typename Traits::Elem>(),
+          Traits::depth);
+      Append(field, values);
+    }
+
+    /// The record as MakeResp(type, id, data) would give it.
+    JSONFile ToJSON() const;
+
+    const char* type = "";
+    uint64_t id = uint64_t(-1);
+    f64 time_ms = 0;
+    // If set, a complete JSON line from EventLog::Log, which is written
+    // instead of the fields.
+    std::string line;
+    // Only the first num_fields are in use.
+    std::vector<Field> fields;
+    size_t num_fields = 0;
+
+    protected:
+    Field& NewField(const char* name, Kind kind, uint8_t depth);
+
+    template<class T> static constexpr Kind KindOf() {
+      if constexpr (std::is_same_v<T, bool>) { return Kind::Bool; }
+      else if constexpr (std::is_integral_v<T>) { return Kind::Int; }
+      else { return Kind::Real; }
+    }
+
+    template<class T>
+    static void Append(Field& field, const RC::Data1D<T>& list) {
+      field.sizes.push_back(uint32_t(list.size()));
+      for (size_t i=0; i<list.size(); i++) {
+        if constexpr (std::is_arithmetic_v<T>) {
+          field.values.push_back(f64(list[i]));
+        }
+        else {
+          Append(field, list[i]);
+        }
+      }
+    }
+  };
+
+
+  /// Encodes the binary event log, a header then length-prefixed entries.
+  /** Each entry holds either a line logged as JSON text, or an
+   *  EventRecord, in the order they were logged.  Values are little-endian.
+   */
+  class EventLogBinary {
+    public:
+    static void AppendHeader(std::vector<uint8_t>& out);
+    static void AppendLine(std::vector<uint8_t>& out, const RC::RStr& line);
+    static void AppendRecord(std::vector<uint8_t>& out,
+        const EventRecord& record);
+  };
+
+
+  /// Writes the JSON lines event log equivalent of a binary event log.
+  /** A truncated final entry, as from a crash, is skipped.
+   *  @param binary_file The binary event log.
+   *  @param json_file The event.log file to write.
+   *  @return The number of entries exported.
+   */
+  size_t ExportEventLogJSON(const RC::RStr& binary_file,
+      const RC::RStr& json_file);
+}
+
+#endif // EVENTRECORD_H
+
@@ -648,6 +648,8 @@ namespace CML {
 
     Stop_Handler();
     JSONFile stoplog = MakeResp("EXIT");
+    // Distinguishes this from a task laptop EXIT, for replay.
+    stoplog.Set("elemem", "data", "source");
     hndl->event_log.Log(stoplog.Line());
     hndl->StopExperiment();
 
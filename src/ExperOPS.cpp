@@ -20,6 +20,7 @@ namespace CML {
   void ExperOPS::SetStimProfiles_Handler(
         const RC::Data1D<StimProfile>& new_stim_profiles) {
     stim_profiles = new_stim_profiles;
+    hndl->stim_worker.PreloadStimProfiles(stim_profiles);
 
     // Build all the stim grid events with ISI between.
     exp_events.Clear();
@@ -125,6 +126,8 @@ namespace CML {
 
   void ExperOPS::InternalStop() {
     JSONFile stoplog = MakeResp("EXIT");
+    // Distinguishes this from a task laptop EXIT, for replay.
+    stoplog.Set("elemem", "data", "source");
     hndl->event_log.Log(stoplog.Line());
 
     Stop_Handler();
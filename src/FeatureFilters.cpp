@@ -3,7 +3,6 @@
 #include "Utils.h"
 #include <cmath>
 #include "Handler.h"
-#include "JSONLines.h"
 #include "Ptr.h"
 
 
@@ -25,6 +24,7 @@ namespace CML {
     normalize_powers(np_set) {
     butterworth_transformer.Setup(butterworth_settings);
     morlet_transformer.Setup(morlet_settings);
+    kernels = FeatureKernelSet::Select(morlet_settings.frequencies.size());
   }
 
 
@@ -280,9 +280,9 @@ namespace CML {
     }
 
     if (event_log.IsSet()) {
-      JSONFile selected_channels;
-      selected_channels.Set(indices, "channels");
-      event_log->Log(MakeResp("MONO_SELECTED_CHANNELS", 0, selected_channels).Line());
+      auto selected_channels = event_log->NewRecord("MONO_SELECTED_CHANNELS", 0);
+      selected_channels->Add("channels", indices);
+      event_log->Submit(selected_channels);
     }
 
     return out_data;
@@ -316,9 +316,9 @@ namespace CML {
     }
 
     if (event_log.IsSet()) {
-      JSONFile selected_channels;
-      selected_channels.Set(indices, "channels");
-      event_log->Log(MakeResp("SELECTED_CHANNELS", 0, selected_channels).Line());
+      auto selected_channels = event_log->NewRecord("SELECTED_CHANNELS", 0);
+      selected_channels->Add("channels", indices);
+      event_log->Submit(selected_channels);
     }
 
     return out_data;
@@ -533,9 +533,9 @@ namespace CML {
     }
 
     if (event_log.IsSet()) {
-      JSONFile artifact_channels;
-      artifact_channels.Set(zeroed_channels, "channels");
-      event_log->Log(MakeResp("ZEROED_ARTIFACT_CHANNELS", 0, artifact_channels).Line());
+      auto artifact_channels = event_log->NewRecord("ZEROED_ARTIFACT_CHANNELS", 0);
+      artifact_channels->Add("channels", zeroed_channels);
+      event_log->Submit(artifact_channels);
     }
 
     return out_data;
@@ -675,27 +675,30 @@ namespace CML {
     * @param The data to be averaged
     * @return The time averaged EEGPowers
     */
-  RC::APtr<EEGPowers> FeatureFilters::AvgOverTime(RC::APtr<const EEGPowers>& in_data, bool ignore_inf_and_nan) {
+  RC::APtr<EEGPowers> FeatureFilters::AvgOverTime(RC::APtr<const EEGPowers>& in_data, bool ignore_inf_and_nan,
+      const FeatureKernelSet& kernels) {
     auto& in_datar = in_data->data;
     size_t freqlen = in_datar.size3();
     size_t chanlen = in_datar.size2();
-    size_t in_eventlen = in_datar.size1();
     size_t out_eventlen = 1;
 
     auto out_data = RC::MakeAPtr<EEGPowers>(in_data->sampling_rate, out_eventlen, chanlen, freqlen);
     auto& out_datar = out_data->data;
 
-    // Separate accum lambda created for move sematics optimization
-    auto accum_plus = [](double sum, double val) {
-      return std::move(sum) + val;
-    };
+    if (kernels.freqlen != 0 && kernels.freqlen != freqlen) {
+      Throw_RC_Error((RC::RStr("AvgOverTime kernel frequency count (") +
+            kernels.freqlen + ") does not match data (" + freqlen + ")").c_str());
+    }
+    kernels.AvgOverTime(in_datar, out_datar);
+
+    if ( ! ignore_inf_and_nan ) {
+      return out_data;
+    }
+
     RC_ForRange(i, 0, freqlen) { // Iterate over frequencies
       RC_ForRange(j, 0, chanlen) { // Iterate over channels
-        auto& in_events = in_datar[i][j];
         auto& out_events = out_datar[i][j];
-        out_events[0] = std::accumulate(in_events.begin(), in_events.end(),
-                          0.0, accum_plus) / static_cast<double>(in_eventlen);
-        if (ignore_inf_and_nan && !std::isfinite(out_events[0])) {
+        if (!std::isfinite(out_events[0])) {
           out_events[0] = 0;
           RC::RStr inf_nan_error = RC::RStr("The value at frequency ") + i + " and channel " + j + " is not finite";
           DEBLOG_OUT(inf_nan_error);
@@ -773,7 +776,7 @@ namespace CML {
     auto unmirrored_data = RemoveMirrorEnds(morlet_data, mirroring_duration_ms).ExtractConst();
 
     auto log_data = Log10Transform(unmirrored_data, log_min_power_clamp, false).ExtractConst();
-    auto avg_data = AvgOverTime(log_data, true).ExtractConst();
+    auto avg_data = AvgOverTime(log_data, true, kernels).ExtractConst();
 
     //data->Print(2);
     //bipolar_ref_data->Print(2);
@@ -783,6 +786,10 @@ namespace CML {
     //log_data->Print(1, 2);
     //avg_data->Print(1, 10);
 
+    for (size_t i=0; i<raw_callbacks.size(); i++) {
+      raw_callbacks[i].callback(avg_data, task_classifier_settings);
+    }
+
     // Normalize Powers
     switch (task_classifier_settings.cl_type) {
       case ClassificationType::NORMALIZE:
@@ -824,6 +831,17 @@ namespace CML {
     data_callbacks += TaggedCallback{tag, callback};
   }
 
+  /// Handler that registers a callback on the features of every event
+  /// before normalization.
+  /** @param A (preferably unique) tag/name for the callback
+   *  @param The callback on the log powers averaged over time
+   */
+  void FeatureFilters::RegisterRawCallback_Handler(const RC::RStr& tag,
+                                            const FeatureCallback& callback) {
+    RemoveCallback_Handler(tag);
+    raw_callbacks += TaggedCallback{tag, callback};
+  }
+
   /// Handler that removes a callback on the classifier results.
   /** @param The tag to be removed from the list of callbacks
    *  Note: All tags of the same name will be removed (even if there is more than one)
@@ -835,6 +853,12 @@ namespace CML {
         i--;
       }
     }
+    for (size_t i=0; i<raw_callbacks.size(); i++) {
+      if (raw_callbacks[i].tag == tag) {
+        raw_callbacks.Remove(i);
+        i--;
+      }
+    }
   }
 
   void FeatureFilters::ExecuteCallbacks(RC::APtr<const EEGPowers> data, const TaskClassifierSettings& task_classifier_settings) {
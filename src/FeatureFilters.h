@@ -8,6 +8,7 @@
 #include "MorletTransformer.h"
 #include "ButterworthTransformer.h"
 #include "NormalizePowers.h"
+#include "FeatureKernels.h"
 #include "RC/APtr.h"
 #include "RCqt/Worker.h"
 #include "ChannelConf.h"
@@ -40,6 +41,10 @@ namespace CML {
     RCqt::TaskCaller<const RC::RStr, const FeatureCallback> RegisterCallback =
       TaskHandler(FeatureFilters::RegisterCallback_Handler);
 
+    /// Registers a callback on every event's features before normalization.
+    RCqt::TaskCaller<const RC::RStr, const FeatureCallback> RegisterRawCallback =
+      TaskHandler(FeatureFilters::RegisterRawCallback_Handler);
+
     RCqt::TaskBlocker<const RC::RStr> RemoveCallback =
       TaskHandler(FeatureFilters::RemoveCallback_Handler);
 
@@ -57,7 +62,8 @@ namespace CML {
 
     static RC::APtr<EEGPowers> Log10Transform(RC::APtr<const EEGPowers>& in_data, double epsilon);
     static RC::APtr<EEGPowers> Log10Transform(RC::APtr<const EEGPowers>& in_data, double epsilon, bool min_clamp_as_epsilon);
-    static RC::APtr<EEGPowers> AvgOverTime(RC::APtr<const EEGPowers>& in_data, bool ignore_inf_and_nan);
+    static RC::APtr<EEGPowers> AvgOverTime(RC::APtr<const EEGPowers>& in_data, bool ignore_inf_and_nan,
+        const FeatureKernelSet& kernels=FeatureKernelSet());
 
     static RC::APtr<RC::Data1D<bool>> FindArtifactChannels(RC::APtr<const EEGDataDouble>& in_data, size_t threshold, size_t order);
     static RC::APtr<EEGPowers> ZeroArtifactChannels(RC::APtr<const EEGPowers>& in_data, RC::APtr<const RC::Data1D<bool>>& artifact_channel_mask, RC::Ptr<EventLog> event_log=nullptr);
@@ -72,6 +78,8 @@ namespace CML {
     void Process_Handler(RC::APtr<const EEGDataDouble>&, const TaskClassifierSettings&);
     void RegisterCallback_Handler(const RC::RStr& tag,
                                   const FeatureCallback& callback);
+    void RegisterRawCallback_Handler(const RC::RStr& tag,
+                                     const FeatureCallback& callback);
     void RemoveCallback_Handler(const RC::RStr& tag);
 
     struct TaggedCallback {
@@ -79,6 +87,7 @@ namespace CML {
       FeatureCallback callback;
     };
     RC::Data1D<TaggedCallback> data_callbacks;
+    RC::Data1D<TaggedCallback> raw_callbacks;
 
     RC::Ptr<Handler> hndl;
     
@@ -86,6 +95,7 @@ namespace CML {
     ButterworthTransformer butterworth_transformer;
     RC::Data1D<BipolarPair> bipolar_reference_channels;
     NormalizePowers normalize_powers;
+    FeatureKernelSet kernels;
 
     // Minimum power clamp (just before taking log) to avoid log singularity in case we get zero power
     // A power could be zero due to constant signal across two electrodes that are part of bipolar pair
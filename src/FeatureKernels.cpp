@@ -0,0 +1,27 @@
+#include "FeatureKernels.h"
+
+namespace CML {
+  template<size_t FreqLen>
+  static FeatureKernelSet MakeKernelSet() {
+    FeatureKernelSet kernels;
+    kernels.LogOdds = FeatureKernels<FreqLen>::LogOdds;
+    kernels.ZScore = FeatureKernels<FreqLen>::ZScore;
+    kernels.AvgOverTime = FeatureKernels<FreqLen>::AvgOverTime;
+    kernels.freqlen = FreqLen;
+    return kernels;
+  }
+
+  FeatureKernelSet FeatureKernelSet::Select(size_t freqlen) {
+    // Frequency counts used by our deployed classifiers.  The standard
+    // classifier uses 8 log-spaced frequencies from 6 to 180 Hz.
+    switch (freqlen) {
+      case 4: return MakeKernelSet<4>();
+      case 6: return MakeKernelSet<6>();
+      case 8: return MakeKernelSet<8>();
+      case 10: return MakeKernelSet<10>();
+      case 12: return MakeKernelSet<12>();
+      case 16: return MakeKernelSet<16>();
+      default: return MakeKernelSet<0>();
+    }
+  }
+}
@@ -0,0 +1,115 @@
+#ifndef FEATUREKERNELS_H
+#define FEATUREKERNELS_H
+
+#include "RC/Data1D.h"
+#include "RC/Data2D.h"
+#include "RC/Data3D.h"
+#include <cstddef>
+
+namespace CML {
+  /// Decision path kernels over [frequency][channel][event] powers, with the
+  /// frequency count fixed at compile time.
+  /** FreqLen of 0 produces the runtime-sized kernels.  Dimensions must be
+   *  validated by the caller, as these index through raw pointers without
+   *  bounds checks.  Summation order matches the original Data3D loops, so
+   *  results are bit-identical across specializations.
+   */
+  template<size_t FreqLen>
+  class FeatureKernels {
+    public:
+    /// Logistic regression log odds for single-event powers.
+    /** @param data Powers with dimensions (freqlen, coef.size1(), 1)
+     *  @param coef Weights with frequencies outer and channels inner
+     *  @param intercept The model intercept
+     *  @return The log odds
+     */
+    static double LogOdds(const RC::Data3D<double>& data,
+        const RC::Data2D<double>& coef, double intercept) {
+      const size_t freqlen = FreqLen ? FreqLen : data.size3();
+      const size_t chanlen = coef.size1();
+      double logodds = intercept;
+      for (size_t i=0; i<freqlen; i++) { // Iterate over frequencies
+        const auto& freq_data = data[i];
+        const double* freq_coef = coef[i].Raw();
+        for (size_t j=0; j<chanlen; j++) { // Iterate over channels
+          logodds += *freq_data[j].Raw() * freq_coef[j];
+        }
+      }
+      return logodds;
+    }
+
+    /// Z-score single-event powers against flattened statistics.
+    /** @param in_data Powers with dimensions (freqlen, chanlen, 1)
+     *  @param out_data Output powers with the same dimensions
+     *  @param means Means flattened with frequencies outer
+     *  @param std_devs Sample standard deviations flattened the same way
+     *  @param div_by_zero_eq_zero Output 0 where the std dev is 0
+     */
+    static void ZScore(const RC::Data3D<double>& in_data,
+        RC::Data3D<double>& out_data, const RC::Data1D<double>& means,
+        const RC::Data1D<double>& std_devs, bool div_by_zero_eq_zero) {
+      const size_t freqlen = FreqLen ? FreqLen : in_data.size3();
+      const size_t chanlen = in_data.size2();
+      const double* meansr = means.Raw();
+      const double* std_devsr = std_devs.Raw();
+      for (size_t i=0; i<freqlen; i++) { // Iterate over frequencies
+        const auto& in_freq = in_data[i];
+        auto& out_freq = out_data[i];
+        const size_t offset = i*chanlen;
+        for (size_t j=0; j<chanlen; j++) { // Iterate over channels
+          const double std_dev = std_devsr[offset + j];
+          *out_freq[j].Raw() = (div_by_zero_eq_zero && std_dev == 0) ? 0 :
+            (*in_freq[j].Raw() - meansr[offset + j]) / std_dev;
+        }
+      }
+    }
+
+    /// Average powers over events.
+    /** @param in_data Powers with dimensions (freqlen, chanlen, eventlen)
+     *  @param out_data Output powers with dimensions (freqlen, chanlen, 1)
+     */
+    static void AvgOverTime(const RC::Data3D<double>& in_data,
+        RC::Data3D<double>& out_data) {
+      const size_t freqlen = FreqLen ? FreqLen : in_data.size3();
+      const size_t chanlen = in_data.size2();
+      const size_t eventlen = in_data.size1();
+      for (size_t i=0; i<freqlen; i++) { // Iterate over frequencies
+        const auto& in_freq = in_data[i];
+        auto& out_freq = out_data[i];
+        for (size_t j=0; j<chanlen; j++) { // Iterate over channels
+          const double* events = in_freq[j].Raw();
+          double sum = 0.0;
+          for (size_t k=0; k<eventlen; k++) {
+            sum += events[k];
+          }
+          *out_freq[j].Raw() = sum / static_cast<double>(eventlen);
+        }
+      }
+    }
+  };
+
+  /// The set of kernels selected at setup for a given frequency count.
+  class FeatureKernelSet {
+    public:
+    using LogOddsFunc = double (*)(const RC::Data3D<double>&,
+        const RC::Data2D<double>&, double);
+    using ZScoreFunc = void (*)(const RC::Data3D<double>&,
+        RC::Data3D<double>&, const RC::Data1D<double>&,
+        const RC::Data1D<double>&, bool);
+    using AvgOverTimeFunc = void (*)(const RC::Data3D<double>&,
+        RC::Data3D<double>&);
+
+    LogOddsFunc LogOdds = FeatureKernels<0>::LogOdds;
+    ZScoreFunc ZScore = FeatureKernels<0>::ZScore;
+    AvgOverTimeFunc AvgOverTime = FeatureKernels<0>::AvgOverTime;
+
+    // The compiled frequency count, or 0 for the runtime-sized kernels.
+    size_t freqlen = 0;
+
+    /// Returns the specialized kernels for freqlen if one was compiled in,
+    /// and the runtime-sized kernels otherwise.
+    static FeatureKernelSet Select(size_t freqlen);
+  };
+}
+
+#endif // FEATUREKERNELS_H
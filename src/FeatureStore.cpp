@@ -0,0 +1,382 @@
+#include "FeatureStore.h"
+#include "Popup.h"
+#include "RC/Errors.h"
+#include "RC/RTime.h"
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+
+namespace CML {
+  static const char feature_store_magic[8] = {'E','L','M','F','E','A','T','S'};
+  static const uint32_t feature_store_version = 1;
+  enum class FeatureBlock : uint8_t { Features=0, Results=1 };
+  enum FeatureFlags : uint8_t { HasRaw=1, HasZScored=2 };
+
+
+  template<class T>
+  static void Put(std::vector<uint8_t>& out, const T& val) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(&val);
+    out.insert(out.end(), bytes, bytes + sizeof(T));
+  }
+
+  // Appends the first count values of col.
+  template<class T>
+  static void PutColumn(std::vector<uint8_t>& out, const std::vector<T>& col,
+      size_t count) {
+    const uint8_t* bytes = reinterpret_cast<const uint8_t*>(col.data());
+    out.insert(out.end(), bytes, bytes + count*sizeof(T));
+  }
+
+  // Removes the first count values of col.
+  template<class T>
+  static void EraseFront(std::vector<T>& col, size_t count) {
+    col.erase(col.begin(), col.begin() + long(count));
+  }
+
+  // Starts a block and returns the offset of its length to fill in.
+  static size_t BeginBlock(std::vector<uint8_t>& out, FeatureBlock kind,
+      size_t rows) {
+    size_t len_pos = out.size();
+    Put(out, uint32_t(0));
+    Put(out, uint8_t(kind));
+    Put(out, uint32_t(rows));
+    return len_pos;
+  }
+
+  static void EndBlock(std::vector<uint8_t>& out, size_t len_pos) {
+    uint32_t len = uint32_t(out.size() - len_pos - sizeof(uint32_t));
+    std::memcpy(out.data() + len_pos, &len, sizeof(len));
+  }
+
+
+  void FeatureStore::StartFile_Handler(const RC::RStr& filename,
+      const JSONFile& metadata, const size_t& new_num_features) {
+    CloseFile_Handler();
+
+    fw = RC::FileWrite(filename);
+    num_features = new_num_features;
+    mismatched = 0;
+
+    RC::RStr meta = metadata.Line();
+    buf.clear();
+    buf.insert(buf.end(), feature_store_magic,
+        feature_store_magic + sizeof(feature_store_magic));
+    Put(buf, feature_store_version);
+    Put(buf, uint32_t(num_features));
+    Put(buf, uint32_t(meta.size()));
+    buf.insert(buf.end(), meta.c_str(), meta.c_str() + meta.size());
+    WriteBlocks(false);
+  }
+
+
+  void FeatureStore::CloseFile_Handler() {
+    if ( ! fw.IsOpen() ) {
+      return;
+    }
+    WriteBlocks(false);
+    fw.Close();
+
+    if (mismatched > 0) {
+      DebugLog(RC::RStr("FeatureStore skipped ") + RC::RStr(mismatched) +
+          " feature sets not matching " + RC::RStr(num_features) +
+          " features.");
+    }
+  }
+
+
+  /// Handler that stores the features of each event before normalization.
+  /** @param data The log powers averaged over time
+   *  @param task_classifier_settings The classification event settings
+   */
+  void FeatureStore::AddRaw_Handler(RC::APtr<const EEGPowers>& data,
+      const TaskClassifierSettings& task_classifier_settings) {
+    if ( ! fw.IsOpen() ) {
+      return;
+    }
+    if (classif_ids.size() >= block_rows) {
+      WriteBlocks(true);
+    }
+
+    NewRow(task_classifier_settings);
+    if (Flatten(*data, raw.data() + raw.size() - num_features)) {
+      flags.back() |= HasRaw;
+    }
+  }
+
+
+  /// Handler that stores the z-scored features sent to the classifier.
+  /** These are joined with the raw features of the same event.
+   *  @param data The normalized features
+   *  @param task_classifier_settings The classification event settings
+   */
+  void FeatureStore::AddZScored_Handler(RC::APtr<const EEGPowers>& data,
+      const TaskClassifierSettings& task_classifier_settings) {
+    // Normalization events pass on the raw features unchanged.
+    if ( ! fw.IsOpen() ||
+        task_classifier_settings.cl_type == ClassificationType::NORMALIZE ) {
+      return;
+    }
+
+    // Raw features are queued first by FeatureFilters, so search back.
+    size_t row = classif_ids.size();
+    for (size_t r=classif_ids.size(); r>0; r--) {
+      if (classif_ids[r-1] == task_classifier_settings.classif_id &&
+          ! (flags[r-1] & HasZScored)) {
+        row = r-1;
+        break;
+      }
+    }
+    if (row == classif_ids.size()) {
+      NewRow(task_classifier_settings);
+    }
+
+    if (Flatten(*data, zscored.data() + row*num_features)) {
+      flags[row] |= HasZScored;
+    }
+  }
+
+
+  /// Handler that stores each classifier result.
+  /** @param result The classifier probability
+   *  @param task_classifier_settings The classification event settings
+   */
+  void FeatureStore::AddResult_Handler(const double& result,
+      const TaskClassifierSettings& task_classifier_settings) {
+    if ( ! fw.IsOpen() ) {
+      return;
+    }
+    result_ids.push_back(task_classifier_settings.classif_id);
+    result_times_ms.push_back(RC::Time::Get()*1e3);
+    results.push_back(result);
+  }
+
+
+  // Frequencies outer, channels inner.
+  bool FeatureStore::Flatten(const EEGPowers& data, f32* out) {
+    auto& datar = data.data;
+    if (datar.size1() != 1 || datar.size3()*datar.size2() != num_features) {
+      mismatched++;
+      return false;
+    }
+    RC_ForRange(i, 0, datar.size3()) { // Iterate over frequencies
+      RC_ForRange(j, 0, datar.size2()) { // Iterate over channels
+        out[i*datar.size2() + j] = f32(datar[i][j][0]);
+      }
+    }
+    return true;
+  }
+
+
+  void FeatureStore::NewRow(
+      const TaskClassifierSettings& task_classifier_settings) {
+    classif_ids.push_back(task_classifier_settings.classif_id);
+    cl_types.push_back(uint8_t(task_classifier_settings.cl_type));
+    durations_ms.push_back(task_classifier_settings.duration_ms);
+    times_ms.push_back(RC::Time::Get()*1e3);  // ms from 1970-01-01 UTC
+    flags.push_back(0);
+    raw.resize(raw.size() + num_features, 0);
+    zscored.resize(zscored.size() + num_features, 0);
+  }
+
+
+  // Appends the buffered rows and results to the file as column blocks.
+  // With carry, trailing rows still awaiting their z-scored features are
+  // held for the next block, once, so they are not split into two rows.
+  void FeatureStore::WriteBlocks(bool carry) {
+    size_t rows = classif_ids.size();
+    if (carry) {
+      while (rows > carried && (flags[rows-1] & HasRaw) &&
+          ! (flags[rows-1] & HasZScored) &&
+          cl_types[rows-1] != uint8_t(ClassificationType::NORMALIZE)) {
+        rows--;
+      }
+    }
+
+    if (rows > 0) {
+      size_t len_pos = BeginBlock(buf, FeatureBlock::Features, rows);
+      PutColumn(buf, classif_ids, rows);
+      PutColumn(buf, cl_types, rows);
+      PutColumn(buf, durations_ms, rows);
+      PutColumn(buf, times_ms, rows);
+      PutColumn(buf, flags, rows);
+      PutColumn(buf, raw, rows*num_features);
+      PutColumn(buf, zscored, rows*num_features);
+      EndBlock(buf, len_pos);
+    }
+    if ( ! result_ids.empty() ) {
+      size_t len_pos = BeginBlock(buf, FeatureBlock::Results,
+          result_ids.size());
+      PutColumn(buf, result_ids, result_ids.size());
+      PutColumn(buf, result_times_ms, result_times_ms.size());
+      PutColumn(buf, results, results.size());
+      EndBlock(buf, len_pos);
+    }
+
+    if ( ! buf.empty() ) {
+      RC::Data1D<uint8_t> buf_view(buf.size(), buf.data());
+      fw.Write(buf_view);
+      fw.Flush();
+    }
+
+    buf.clear();
+    EraseFront(classif_ids, rows);
+    EraseFront(cl_types, rows);
+    EraseFront(durations_ms, rows);
+    EraseFront(times_ms, rows);
+    EraseFront(flags, rows);
+    EraseFront(raw, rows*num_features);
+    EraseFront(zscored, rows*num_features);
+    carried = classif_ids.size();
+    result_ids.clear();
+    result_times_ms.clear();
+    results.clear();
+  }
+
+
+  namespace {
+    class ColumnReader {
+      public:
+      ColumnReader(const uint8_t* data, size_t len)
+        : pos(data), end(data + len) { }
+
+      template<class T>
+      T Get() {
+        T val;
+        Need(sizeof(T));
+        std::memcpy(&val, pos, sizeof(T));
+        pos += sizeof(T);
+        return val;
+      }
+
+      // Copies count values into out at offset.
+      template<class T>
+      void GetColumn(RC::Data1D<T>& out, size_t offset, size_t count) {
+        Need(count*sizeof(T));
+        std::memcpy(out.Raw() + offset, pos, count*sizeof(T));
+        pos += count*sizeof(T);
+      }
+
+      template<class T>
+      const uint8_t* Skip(size_t count) {
+        const uint8_t* start = pos;
+        Need(count*sizeof(T));
+        pos += count*sizeof(T);
+        return start;
+      }
+
+      protected:
+      void Need(size_t amnt) {
+        if (size_t(end - pos) < amnt) {
+          Throw_RC_Type(Bounds, "Corrupt feature store block");
+        }
+      }
+
+      const uint8_t* pos;
+      const uint8_t* end;
+    };
+  }
+
+
+  void FeatureStoreReader::Open(const RC::RStr& filename) {
+    RC::FileRead fr(filename);
+    RC::Data1D<uint8_t> bin;
+    fr.ReadAll(bin);
+    fr.Close();
+
+    size_t header_len = sizeof(feature_store_magic) + 3*sizeof(uint32_t);
+    if (bin.size() < header_len ||
+        std::memcmp(bin.Raw(), feature_store_magic,
+          sizeof(feature_store_magic))) {
+      Throw_RC_Type(File, ("Not a feature store: " + filename).c_str());
+    }
+    ColumnReader header(bin.Raw() + sizeof(feature_store_magic),
+        bin.size() - sizeof(feature_store_magic));
+    if (header.Get<uint32_t>() > feature_store_version) {
+      Throw_RC_Type(File, ("Unsupported feature store version in " +
+            filename).c_str());
+    }
+    num_features = header.Get<uint32_t>();
+    uint32_t meta_len = header.Get<uint32_t>();
+    const uint8_t* meta = header.Skip<uint8_t>(meta_len);
+    metadata.SetFilename(filename);
+    metadata.Parse(RC::RStr(reinterpret_cast<const char*>(meta), meta_len));
+
+    struct Result {
+      u64 classif_id;
+      f64 result;
+    };
+    std::vector<Result> read_results;
+
+    size_t rows = 0;
+    auto resize = [&](size_t new_rows) {
+      classif_id.Resize(new_rows);
+      cl_type.Resize(new_rows);
+      duration_ms.Resize(new_rows);
+      time_ms.Resize(new_rows);
+      has_raw.Resize(new_rows);
+      has_zscored.Resize(new_rows);
+      raw.Resize(new_rows*num_features);
+      zscored.Resize(new_rows*num_features);
+    };
+    resize(0);
+
+    size_t pos = header_len + meta_len;
+    while (bin.size() - pos >= sizeof(uint32_t) + 1 + sizeof(uint32_t)) {
+      uint32_t len;
+      std::memcpy(&len, bin.Raw() + pos, sizeof(len));
+      if (len < 1 + sizeof(uint32_t) ||
+          bin.size() - pos - sizeof(uint32_t) < len) {
+        break;  // Truncated by an interrupted write.
+      }
+      ColumnReader block(bin.Raw() + pos + sizeof(uint32_t), len);
+      pos += sizeof(uint32_t) + len;
+
+      auto kind = FeatureBlock(block.Get<uint8_t>());
+      size_t count = block.Get<uint32_t>();
+      if (kind == FeatureBlock::Features) {
+        resize(rows + count);
+        block.GetColumn(classif_id, rows, count);
+        const uint8_t* types = block.Skip<uint8_t>(count);
+        block.GetColumn(duration_ms, rows, count);
+        block.GetColumn(time_ms, rows, count);
+        const uint8_t* row_flags = block.Skip<uint8_t>(count);
+        block.GetColumn(raw, rows*num_features, count*num_features);
+        block.GetColumn(zscored, rows*num_features, count*num_features);
+        for (size_t r=0; r<count; r++) {
+          cl_type[rows+r] = ClassificationType(types[r]);
+          has_raw[rows+r] = row_flags[r] & HasRaw;
+          has_zscored[rows+r] = row_flags[r] & HasZScored;
+        }
+        rows += count;
+      }
+      else if (kind == FeatureBlock::Results) {
+        const uint8_t* ids = block.Skip<u64>(count);
+        block.Skip<f64>(count);  // Result times
+        const uint8_t* vals = block.Skip<f64>(count);
+        for (size_t r=0; r<count; r++) {
+          Result res;
+          std::memcpy(&res.classif_id, ids + r*sizeof(u64), sizeof(u64));
+          std::memcpy(&res.result, vals + r*sizeof(f64), sizeof(f64));
+          read_results.push_back(res);
+        }
+      }
+    }
+
+    std::unordered_map<u64, size_t> latest_row;
+    for (size_t r=0; r<rows; r++) {
+      latest_row[classif_id[r]] = r;
+    }
+    result.Resize(rows);
+    for (size_t r=0; r<rows; r++) {
+      result[r] = std::numeric_limits<f64>::quiet_NaN();
+    }
+    for (auto& res : read_results) {
+      auto found = latest_row.find(res.classif_id);
+      if (found != latest_row.end()) {
+        result[found->second] = res.result;
+      }
+    }
+  }
+}
+
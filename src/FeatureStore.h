@@ -0,0 +1,122 @@
+#ifndef FEATURESTORE_H
+#define FEATURESTORE_H
+
+#include "ConfigFile.h"
+#include "EEGPowers.h"
+#include "TaskClassifierSettings.h"
+#include "RC/APtr.h"
+#include "RC/Data1D.h"
+#include "RC/File.h"
+#include "RC/RStr.h"
+#include "RCqt/Worker.h"
+#include <vector>
+
+namespace CML {
+  using FeatureCallback = RCqt::TaskCaller<RC::APtr<const EEGPowers>, const TaskClassifierSettings>;
+  using ClassifierCallback = RCqt::TaskCaller<const double, const TaskClassifierSettings>;
+
+  /// Records the classifier features and results of a session to a file.
+  /** Every event's features are kept as computed before normalization, and
+   *  z-scored as sent to the classifier for all but NORMALIZE events.
+   *  Rows are buffered here and appended as column blocks, so the
+   *  classification path only queues tasks.  The file starts with the
+   *  "ELMFEATS" magic, a u32 version, a u32 feature count, and a u32 length
+   *  of the metadata JSON which follows.  Each block is a u32 length, a u8
+   *  kind, a u32 row count, and then each column in turn.  Features are
+   *  flattened with frequencies outer and channels inner, as f32.
+   */
+  class FeatureStore : public RCqt::WorkerThread {
+    public:
+    /// Rows buffered before a feature block is written.
+    static const size_t block_rows = 64;
+
+    RCqt::TaskCaller<const RC::RStr, const JSONFile, const size_t>
+      StartFile = TaskHandler(FeatureStore::StartFile_Handler);
+    /// Writes the buffered rows and closes the file.
+    RCqt::TaskBlocker<> CloseFile =
+      TaskHandler(FeatureStore::CloseFile_Handler);
+
+    /// For FeatureFilters::RegisterRawCallback.
+    FeatureCallback AddRaw = TaskHandler(FeatureStore::AddRaw_Handler);
+    /// For FeatureFilters::RegisterCallback.
+    FeatureCallback AddZScored = TaskHandler(FeatureStore::AddZScored_Handler);
+    /// For Classifier::RegisterCallback.
+    ClassifierCallback AddResult =
+      TaskHandler(FeatureStore::AddResult_Handler);
+
+    protected:
+    void StartFile_Handler(const RC::RStr& filename, const JSONFile& metadata,
+        const size_t& new_num_features);
+    void CloseFile_Handler();
+    void AddRaw_Handler(RC::APtr<const EEGPowers>& data,
+        const TaskClassifierSettings& task_classifier_settings);
+    void AddZScored_Handler(RC::APtr<const EEGPowers>& data,
+        const TaskClassifierSettings& task_classifier_settings);
+    void AddResult_Handler(const double& result,
+        const TaskClassifierSettings& task_classifier_settings);
+
+    bool Flatten(const EEGPowers& data, f32* out);
+    void NewRow(const TaskClassifierSettings& task_classifier_settings);
+    void WriteBlocks(bool carry);
+
+    RC::FileWrite fw;
+    size_t num_features = 0;
+    u64 mismatched = 0;
+    std::vector<uint8_t> buf;
+
+    // Feature block columns
+    // Leading rows held over from the previous block.
+    size_t carried = 0;
+    std::vector<u64> classif_ids;
+    std::vector<uint8_t> cl_types;
+    std::vector<u64> durations_ms;
+    std::vector<f64> times_ms;
+    std::vector<uint8_t> flags;
+    std::vector<f32> raw;
+    std::vector<f32> zscored;
+
+    // Result block columns
+    std::vector<u64> result_ids;
+    std::vector<f64> result_times_ms;
+    std::vector<f64> results;
+  };
+
+
+  /// Loads a file written by FeatureStore, one entry per row.
+  /** Blocks cut off by an interrupted write are ignored.  Each classifier
+   *  result is joined to the latest row with its classif_id, and is NaN for
+   *  rows without one.
+   */
+  class FeatureStoreReader {
+    public:
+    FeatureStoreReader() { }
+    FeatureStoreReader(const RC::RStr& filename) { Open(filename); }
+
+    void Open(const RC::RStr& filename);
+
+    size_t NumRows() const { return classif_id.size(); }
+    const f32* RawRow(size_t row) const {
+      return raw.Raw() + row*num_features;
+    }
+    const f32* ZScoredRow(size_t row) const {
+      return zscored.Raw() + row*num_features;
+    }
+
+    JSONFile metadata;
+    size_t num_features = 0;
+
+    RC::Data1D<u64> classif_id;
+    RC::Data1D<ClassificationType> cl_type;
+    RC::Data1D<u64> duration_ms;
+    // ms from 1970-01-01 00:00:00 UTC
+    RC::Data1D<f64> time_ms;
+    RC::Data1D<bool> has_raw;
+    RC::Data1D<bool> has_zscored;
+    // Rows by num_features, zero where absent.
+    RC::Data1D<f32> raw;
+    RC::Data1D<f32> zscored;
+    RC::Data1D<f64> result;
+  };
+}
+
+#endif // FEATURESTORE_H
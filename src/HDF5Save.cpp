@@ -7,12 +7,198 @@
 #include "EEGAcq.h"
 #include "Handler.h"
 #include "ConfigFile.h"
+#include "Popup.h"
+#include "Utils.h"
+#include <algorithm>
+#include <vector>
 
 
 namespace CML {
-  void HDF5Save::StartFile_Handler(const RC::RStr& filename) {
-    auto conf = hndl->GetConfig();
+  H5::DSetCreatPropList HDF5Writer::MakeProps(const HDF5SaveOptions& options,
+      int rank, const hsize_t* chunk_dims) {
+    H5::DSetCreatPropList prop_list;
+    prop_list.setChunk(rank, chunk_dims);
+
+    // Shuffle must precede compression in the filter pipeline.
+    if (options.shuffle) {
+      prop_list.setShuffle();
+    }
+
+    if (options.compression == "lz4") {
+      if (H5Zfilter_avail(lz4_filter) > 0) {
+        prop_list.setFilter(lz4_filter, H5Z_FLAG_OPTIONAL);
+      }
+      else {
+        DebugLog("HDF5 LZ4 filter plugin not found, using deflate.");
+        prop_list.setDeflate(options.deflate_level);
+      }
+    }
+    else if (options.compression == "deflate") {
+      prop_list.setDeflate(options.deflate_level);
+    }
+    else if (options.compression != "none") {
+      Throw_RC_Type(File, ("Unknown hdf5_compression \"" +
+            options.compression + "\"").c_str());
+    }
+
+    return prop_list;
+  }
+
+
+  void HDF5Writer::WriteMontage(const HDF5Layout& layout) {
+    hsize_t dims[1] = {layout.labels.size()};
+    H5::DataSpace montage_space(1, dims);
+
+    H5::StrType str_type(H5::PredType::C_S1, H5T_VARIABLE);
+    std::vector<const char*> label_ptrs;
+    for (size_t c=0; c<layout.labels.size(); c++) {
+      label_ptrs.push_back(layout.labels[c].c_str());
+    }
+    H5::DataSet labels = hdf_hdl->createDataSet("channel_labels", str_type,
+        montage_space);
+    labels.write(label_ptrs.data(), str_type);
+
+    H5::DataSet numbers = hdf_hdl->createDataSet("channel_numbers",
+        H5::PredType::NATIVE_UINT16, montage_space);
+    numbers.write(layout.channel_numbers.Raw(), H5::PredType::NATIVE_UINT16);
+
+    H5::StrType attr_type(H5::PredType::C_S1, H5T_VARIABLE);
+    H5::Attribute subject = hdf_hdl->createAttribute("subject", attr_type,
+        H5::DataSpace(H5S_SCALAR));
+    subject.write(attr_type, std::string(layout.subject.Raw()));
+  }
+
+
+  RC::RStr HDF5Writer::Begin_Handler(const RC::RStr& filename,
+      const RC::Ptr<const HDF5Layout>& layout,
+      const RC::Ptr<QSemaphore>& new_in_flight) {
+    Close();
+    in_flight = new_in_flight;
+    num_channels = layout->labels.size();
+    samples_written = 0;
+    failed = false;
+
+    try {
+      const HDF5SaveOptions& options = layout->options;
+      hdf_hdl = new H5::H5File(filename.c_str(), H5F_ACC_TRUNC);
+
+      const size_t num_dims = 2;
+      hsize_t cur_dims[num_dims] = {num_channels, 0};
+      hsize_t max_dims[num_dims] = {num_channels, H5S_UNLIMITED};
+      hsize_t chunk_dims[num_dims] = {options.chunk_channels,
+        options.chunk_samples};
+      H5::DataSpace data_space(num_dims, cur_dims, max_dims);
+      H5::DSetCreatPropList data_props =
+        MakeProps(options, num_dims, chunk_dims);
+      int16_t fill_value = 0;
+      data_props.setFillValue(H5::PredType::NATIVE_INT16, &fill_value);
+      hdf_data = new H5::DataSet(hdf_hdl->createDataSet("data",
+            H5::PredType::NATIVE_INT16, data_space, data_props));
+
+      H5::Attribute sr_attr = hdf_data->createAttribute("samplerate",
+          H5::PredType::NATIVE_DOUBLE, H5::DataSpace(H5S_SCALAR));
+      sr_attr.write(H5::PredType::NATIVE_DOUBLE, &layout->sampling_rate);
+      H5::StrType str_type(H5::PredType::C_S1, H5T_VARIABLE);
+      H5::Attribute units_attr = hdf_data->createAttribute("units",
+          str_type, H5::DataSpace(H5S_SCALAR));
+      units_attr.write(str_type, std::string("250nV"));
+
+      hsize_t time_cur[1] = {0};
+      hsize_t time_max[1] = {H5S_UNLIMITED};
+      hsize_t time_chunk[1] = {options.chunk_samples};
+      H5::DataSpace time_space(1, time_cur, time_max);
+      hdf_times = new H5::DataSet(hdf_hdl->createDataSet("timestamps",
+            H5::PredType::NATIVE_DOUBLE, time_space,
+            MakeProps(options, 1, time_chunk)));
+      H5::Attribute time_units = hdf_times->createAttribute("units",
+          str_type, H5::DataSpace(H5S_SCALAR));
+      time_units.write(str_type, std::string("ms"));
+
+      WriteMontage(*layout);
+      hdf_hdl->flush(H5F_SCOPE_GLOBAL);
+    }
+    catch (H5::Exception& ex) {
+      Close();
+      return RC::RStr("Could not create ") + filename + ": " +
+        ex.getDetailMsg();
+    }
+    catch (RC::ErrorMsg& ex) {
+      Close();
+      return ex.GetError();
+    }
+
+    return "";
+  }
+
+
+  void HDF5Writer::WriteBlock_Handler(RC::APtr<HDF5Block>& block) {
+    if ( ! failed && hdf_hdl.IsSet() && block->num_samples > 0 ) {
+      try {
+        hsize_t n = block->num_samples;
+
+        const size_t num_dims = 2;
+        hsize_t new_dims[num_dims] = {num_channels, samples_written + n};
+        hdf_data->extend(new_dims);
+        H5::DataSpace file_space = hdf_data->getSpace();
+        hsize_t start[num_dims] = {0, samples_written};
+        hsize_t count[num_dims] = {num_channels, n};
+        file_space.selectHyperslab(H5S_SELECT_SET, count, start);
+        // The block is allocated at capacity, so select its first n.
+        hsize_t mem_dims[num_dims] = {num_channels, block->capacity};
+        H5::DataSpace mem_space(num_dims, mem_dims);
+        hsize_t mem_start[num_dims] = {0, 0};
+        mem_space.selectHyperslab(H5S_SELECT_SET, count, mem_start);
+        hdf_data->write(block->data.Raw(), H5::PredType::NATIVE_INT16,
+            mem_space, file_space);
+
+        hsize_t time_dims[1] = {samples_written + n};
+        hdf_times->extend(time_dims);
+        H5::DataSpace time_file = hdf_times->getSpace();
+        hsize_t time_start[1] = {samples_written};
+        hsize_t time_count[1] = {n};
+        time_file.selectHyperslab(H5S_SELECT_SET, time_count, time_start);
+        H5::DataSpace time_mem(1, time_count);
+        hdf_times->write(block->timestamps.Raw(),
+            H5::PredType::NATIVE_DOUBLE, time_mem, time_file);
+
+        samples_written += n;
+      }
+      catch (H5::Exception&) {
+        failed = true;
+      }
+    }
+    in_flight->release();
+  }
+
+
+  bool HDF5Writer::End_Handler() {
+    try {
+      if (hdf_hdl.IsSet()) {
+        hdf_hdl->flush(H5F_SCOPE_GLOBAL);
+      }
+    }
+    catch (H5::Exception&) {
+      failed = true;
+    }
+    Close();
+    return ! failed;
+  }
 
+
+  void HDF5Writer::Close() {
+    try {
+      hdf_times.Delete();
+      hdf_data.Delete();
+      hdf_hdl.Delete();
+    }
+    catch (H5::Exception&) {
+      failed = true;
+    }
+  }
+
+
+  void HDF5Save::StartFile_Handler(const RC::RStr& filename,
+                                   const FullConf& conf) {
     if (conf.elec_config.IsNull()) {
       Throw_RC_Error("Cannot save data with no channels set");
     }
@@ -20,86 +206,169 @@ namespace CML {
       Throw_RC_Error("Cannot save data with no experiment config");
     }
 
+    StopSaving_Handler();
+    last_time_ms = 0;
+
     channels.Resize(conf.elec_config->data.size2());
+    layout.labels.Resize(channels.size());
+    layout.channel_numbers.Resize(channels.size());
     for (size_t c=0; c<channels.size(); c++) {
-      channels[c] = uint16_t(conf.elec_config->data[c][1].Get_u32() - 1); // Subtract 1 to convert to 0-indexin
+      layout.channel_numbers[c] =
+        uint16_t(conf.elec_config->data[c][1].Get_u32());
+      channels[c] = layout.channel_numbers[c] - 1; // Subtract 1 to convert to 0-indexing
+      layout.labels[c] = conf.elec_config->data[c][0];
+    }
+    if (channels.size() == 0) {
+      Throw_RC_Error("Cannot save data with no channels set");
     }
 
-    StopSaving_Handler();
-
-    hdf_hdl = new H5::H5File(filename.c_str(), H5F_ACC_TRUNC);
-
-    int fill_value = 0;
-    H5::DSetCreatPropList prop_list;
-    prop_list.setFillValue(H5::PredType::NATIVE_INT16, &fill_value);
+    conf.exp_config->Get(layout.subject.Raw(), "subject");
+    layout.sampling_rate = sampling_rate;
+    layout.options = options;
+    if (layout.options.chunk_samples == 0) {
+      layout.options.chunk_samples = std::max(size_t(1), sampling_rate);
+    }
+    if (layout.options.chunk_channels == 0 ||
+        layout.options.chunk_channels > channels.size()) {
+      layout.options.chunk_channels = channels.size();
+    }
+    block_len = layout.options.chunk_samples;
 
-    const size_t num_dims = 2;
-    hsize_t cur_dims[num_dims] = {channels.size(), 0};
-    hsize_t max_dims[num_dims] = {channels.size(), H5S_UNLIMITED};
+    // Fresh permits for this file.
+    while (in_flight.tryAcquire()) { }
+    in_flight.release(max_in_flight);
+    RC::RStr err = writer.Begin(filename, &layout, &in_flight);
+    if ( ! err.empty() ) {
+      Throw_RC_Type(File, err.c_str());
+    }
 
-    hdf_dataspace = new H5::DataSpace(num_dims, cur_dims, max_dims);
-    hdf_data = new H5::DataSet(hdf_hdl->createDataSet("data",
-          H5::PredType::NATIVE_INT16, *hdf_dataspace, prop_list));
-    H5::Attribute sr_attr = hdf_data->createAttribute("samplerate",
-        H5::PredType::NATIVE_DOUBLE, H5::DataSpace(H5S_SCALAR));
-    f64 sr_f64 = sampling_rate;
-    sr_attr.write(H5::PredType::NATIVE_DOUBLE, &sr_f64);
+    current_filename = filename;
+    saving = true;
+    NewBlock();
 
-    hndl->eeg_acq.RegisterCallback(callback_ID, SaveData);
+    hndl->eeg_acq.RegisterEEGMonoCallback(callback_ID, SaveData);
+    hndl->eeg_acq.SetEEGMonoCallbackPolicy(callback_ID,
+        EEGCallbackPolicy::Lossless(this));
   }
 
 
   void HDF5Save::StopSaving_Handler() {
-    hndl->eeg_acq.RemoveCallback(callback_ID);
+    hndl->eeg_acq.RemoveEEGMonoCallback(callback_ID);
 
-    if (hdf_hdl.IsSet()) {
-      hdf_data.Delete();
-      hdf_dataspace.Delete();
-      hdf_hdl.Delete();
+    if ( ! saving ) {
+      return;
     }
-  }
+    saving = false;
 
+    if (block.IsSet() && block->num_samples > 0) {
+      DispatchBlock();
+    }
+    // Not Delete, which would null the copy queued on the writer.
+    block = RC::APtr<HDF5Block>();
 
-  void HDF5Save::SaveData_Handler(RC::APtr<const EEGData>& data) {
-    auto& datar = data->data;
-    if (hdf_hdl < 0) {
-      StopSaving_Handler();
-      return;
+    if ( ! writer.End() ) {
+      ErrorWin("Error during HDF5 write.  Some data may not have been "
+               "saved.");
     }
+  }
 
-    size_t amnt_avail = 0;
-    for (size_t c=0; c<channels.size(); c++) {
-      if (amnt_avail == 0) {
-        amnt_avail = datar[channels[c]].size();
+
+  void HDF5Save::NewBlock() {
+    block = new HDF5Block();
+    block->capacity = block_len;
+    block->num_samples = 0;
+    block->data.Resize(channels.size() * block_len);
+    block->timestamps.Resize(block_len);
+  }
+
+
+  void HDF5Save::DispatchBlock() {
+    // Waits only if the writer is max_in_flight blocks behind.
+    in_flight.acquire();
+    writer.WriteBlock(block);
+  }
+
+
+  void HDF5Save::SaveData_Handler(RC::APtr<const EEGData>& data) {
+    try {
+      auto& datar = data->data;
+      if ( ! saving ) {
+        StopSaving_Handler();
+        return;
       }
-      else {
-        if (amnt_avail != datar[channels[c]].size()) {
-          Throw_RC_Type(File,
-              ("Data missing on hdf save, channel " + RC::RStr(c+1)).c_str());
+      if (writer.Failed()) {
+        Throw_RC_Type(File, "Could not save data to hdf5 file");
+      }
+
+      size_t amnt_avail = 0;
+      for (size_t c=0; c<channels.size(); c++) {
+        if (channels[c] >= datar.size()) {
+          Throw_RC_Type(File, ("HDF5 save, configured channel " +
+                RC::RStr(c+1) + " out of bounds").c_str());
+        }
+        if (amnt_avail == 0) {
+          amnt_avail = datar[channels[c]].size();
+        }
+        else {
+          if (amnt_avail != datar[channels[c]].size()) {
+            Throw_RC_Type(File,
+                ("Data missing on hdf save, channel " + RC::RStr(c+1)).c_str());
+          }
         }
       }
-    }
 
-    if (amnt_avail == 0) {
-      return;
-    }
+      if (amnt_avail == 0) {
+        return;
+      }
 
-    serialize.Resize(amnt_avail*channels.size());
-    size_t si=0;
-    // Write data in the order of the montage CSV.
-    for (size_t c=0; c<channels.size(); c++) {
-      for (size_t i=0; i<amnt_avail; i++) {
-        serialize[si++] = datar[channels[c]][i];
+      // Samples are spaced back from when EEGAcq read their block, not
+      // from now, as this worker can be far behind.  Read jitter is kept
+      // from stepping back over the previous block.
+      f64 read_ms = ((data->read_sec > 0) ? data->read_sec :
+          RC::Time::Get())*1e3;
+      f64 sample_ms = 1e3 / sampling_rate;
+      f64 first_ms = read_ms - sample_ms*(amnt_avail-1);
+      if (last_time_ms > 0) {
+        first_ms = std::max(first_ms, last_time_ms + sample_ms);
       }
-    }
+      last_time_ms = first_ms + sample_ms*(amnt_avail-1);
 
-    const size_t num_dims = 2;
-    hsize_t cur_dims[num_dims] = {channels.size(), amnt_avail};
-    hsize_t max_dims[num_dims] = {channels.size(), amnt_avail};
+      // Copy in the order of the montage CSV.
+      size_t offset = 0;
+      while (offset < amnt_avail) {
+        size_t amnt = std::min(amnt_avail - offset,
+            block_len - block->num_samples);
+        int16_t* dest = block->data.Raw() + block->num_samples;
+        for (size_t c=0; c<channels.size(); c++) {
+          std::copy_n(datar[channels[c]].Raw() + offset, amnt,
+              dest + c*block_len);
+        }
+        f64* times = block->timestamps.Raw() + block->num_samples;
+        for (size_t i=0; i<amnt; i++) {
+          times[i] = first_ms + sample_ms*(offset+i);
+        }
+        block->num_samples += amnt;
+        offset += amnt;
 
-    H5::DataSpace mem_space(num_dims, cur_dims, max_dims);
-    hdf_data->write(serialize.Raw(), H5::PredType::NATIVE_INT16, mem_space,
-        *hdf_dataspace);
+        if (block->num_samples == block_len) {
+          if ( ! CheckStorage(current_filename, 1024*1024*1024) ) {
+            ErrorWin("Free disk space below 1GB.  Halting hdf5 save to "
+                     "close file and preserve existing data.  "
+                     "Experiment stop triggered.");
+            StopSaving_Handler();
+            hndl->StopExperiment();
+            return;
+          }
+          DispatchBlock();
+          NewBlock();
+        }
+      }
+    }
+    catch (...) {
+      StopSaving_Handler();
+      ErrorWin("HDF5 saving halted.");
+      throw;
+    }
   }
 }
 
@@ -3,20 +3,117 @@
 #ifndef NO_HDF5
 
 #include "EEGFileSave.h"
+#include "RC/Ptr.h"
+#include "RCqt/Worker.h"
 #include <H5Cpp.h>
+#include <QSemaphore>
+#include <atomic>
 
 
 namespace CML {
   class Handler;
 
+  /// Dataset layout and filter settings for HDF5Save.
+  class HDF5SaveOptions {
+    public:
+    // Samples per chunk, and per write.  0 for one second.
+    size_t chunk_samples = 0;
+    // Channels per chunk.  0 for all channels.
+    size_t chunk_channels = 0;
+    // "none", "deflate", or "lz4".  lz4 needs the registered HDF5 plugin,
+    // and falls back to deflate without it.
+    RC::RStr compression = "none";
+    int deflate_level = 4;
+    bool shuffle = false;
+  };
+
+
+  /// Everything HDF5Writer needs to create a file.
+  class HDF5Layout {
+    public:
+    HDF5SaveOptions options;
+    f64 sampling_rate = 0;
+    RC::Data1D<RC::RStr> labels;
+    // 1-indexed recording channel of each montage entry.
+    RC::Data1D<uint16_t> channel_numbers;
+    RC::RStr subject;
+  };
+
+
+  /// Montage ordered samples for one write of HDF5Writer.
+  class HDF5Block {
+    public:
+    // Channel major, data[c*capacity + i] for sample i of channel c.
+    RC::Data1D<int16_t> data;
+    // Host time in ms of each sample.
+    RC::Data1D<f64> timestamps;
+    size_t capacity = 0;
+    size_t num_samples = 0;
+  };
+
+
+  /// Performs all HDF5 library calls for HDF5Save on its own thread.
+  class HDF5Writer : public RCqt::WorkerThread {
+    public:
+    /// Creates filename with the data, timestamps, and montage datasets.
+    /** @param in_flight Released once per block written.
+     *  @return An error message, or an empty string on success.
+     */
+    RCqt::TaskGetter<RC::RStr, const RC::RStr, const RC::Ptr<const HDF5Layout>,
+      const RC::Ptr<QSemaphore>> Begin = TaskHandler(HDF5Writer::Begin_Handler);
+    /// Appends a block to the data and timestamps datasets.
+    RCqt::TaskCaller<RC::APtr<HDF5Block>> WriteBlock =
+      TaskHandler(HDF5Writer::WriteBlock_Handler);
+    /// Closes the file after all queued blocks.
+    /** @return False if any write failed.
+     */
+    RCqt::TaskGetter<bool> End = TaskHandler(HDF5Writer::End_Handler);
+
+    /// True if a write has failed.  Safe from any thread.
+    bool Failed() const { return failed.load(); }
+
+    protected:
+    RC::RStr Begin_Handler(const RC::RStr& filename,
+        const RC::Ptr<const HDF5Layout>& layout,
+        const RC::Ptr<QSemaphore>& new_in_flight);
+    void WriteBlock_Handler(RC::APtr<HDF5Block>& block);
+    bool End_Handler();
+
+    H5::DSetCreatPropList MakeProps(const HDF5SaveOptions& options,
+        int rank, const hsize_t* chunk_dims);
+    void WriteMontage(const HDF5Layout& layout);
+    void Close();
+
+    // The registered HDF5 filter ID for LZ4.
+    static constexpr H5Z_filter_t lz4_filter = 32004;
+
+    RC::APtr<H5::H5File> hdf_hdl;
+    RC::APtr<H5::DataSet> hdf_data;
+    RC::APtr<H5::DataSet> hdf_times;
+    RC::Ptr<QSemaphore> in_flight;
+    size_t num_channels = 0;
+    hsize_t samples_written = 0;
+    std::atomic<bool> failed{false};
+  };
+
+
+  /// Saves EEG to HDF5 with chunked, optionally compressed datasets.
+  /** Samples are gathered into chunk aligned blocks on this worker, and
+   *  written by an HDF5Writer thread, so HDF5 I/O and compression never
+   *  delay the EEGAcq callback chain.  A file holds "data" as int16
+   *  [channel][sample] in montage order, "timestamps" as the host time in
+   *  ms of each sample, and "channel_labels" and "channel_numbers" for
+   *  the montage.
+   */
   class HDF5Save : public EEGFileSave {
     public:
-    HDF5Save(RC::Ptr<Handler> hndl, size_t sampling_rate)
-      : EEGFileSave(hndl), sampling_rate(sampling_rate) {
+    HDF5Save(RC::Ptr<Handler> hndl, size_t sampling_rate,
+        const HDF5SaveOptions& options=HDF5SaveOptions())
+      : EEGFileSave(hndl), sampling_rate(sampling_rate), options(options) {
       callback_ID = RC::RStr("HDF5Save_") + RC::RStr(sampling_rate);
     }
 
-    RC::RStr GetExt() const { return "h5"; }
+    RC::RStr GetExt() const override { return "h5"; }
 
     protected:
     void StartFile_Handler(const RC::RStr& filename,
@@ -27,12 +124,26 @@ namespace CML {
     void StopSaving_Handler() override;
     void SaveData_Handler(RC::APtr<const EEGData>& data) override;
 
-    RC::APtr<H5::H5File> hdf_hdl;
-    RC::APtr<H5::DataSet> hdf_data;
-    RC::APtr<H5::DataSpace> hdf_dataspace;
-    RC::Data1D<uint16_t> channels;
-    RC::Data1D<int16_t> serialize;
+    void NewBlock();
+    void DispatchBlock();
+
+    // Blocks queued for the writer before SaveData waits on it.
+    static constexpr int max_in_flight = 8;
+
     size_t sampling_rate;
+    HDF5SaveOptions options;
+    size_t block_len = 0;
+    RC::Data1D<uint16_t> channels;
+    RC::RStr current_filename;
+    RC::RStr callback_ID;
+    bool saving = false;
+    RC::APtr<HDF5Block> block;
+    // Timestamp of the last sample saved, in ms.
+    f64 last_time_ms = 0;
+
+    HDF5Layout layout;
+    HDF5Writer writer;
+    QSemaphore in_flight;
   };
 }
 
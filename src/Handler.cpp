@@ -6,12 +6,14 @@
 #else
 #include "HDF5Save.h"
 #endif
+#include "ELCSave.h"
 #ifdef CEREBUS_HW
 #include "Cerebus.h"
 #endif
 #include "CerebusSim.h"
 #include "StimNetWorker.h"
 #include "ClassifierLogReg.h"
+#include "EDFRecovery.h"
 #include "EDFReplay.h"
 #include "EDFSynch.h"
 #include "JSONLines.h"
@@ -20,6 +22,7 @@
 #include "Popup.h"
 #include "Utils.h"
 #include "RC/RC.h"
+#include <QCoreApplication>
 #include <QDir>
 #include <QObject>
 #include <type_traits>
@@ -67,6 +70,17 @@ namespace CML {
     exper_cps.SetStatusPanel(main_window->GetStatusPanel());
   }
 
+  void Handler::SetResimulation(const ResimSettings& new_resim) {
+#ifndef CERESTIM_SIMULATOR
+    Throw_RC_Error("Re-simulation requires a CERESTIM_STUB build, so that "
+        "no stimulation can be delivered.");
+#endif
+    resim = new_resim;
+    APtr<JSONFile> overrides = new JSONFile();
+    overrides->json = resim.SysConfigOverrides().json;
+    settings.sys_config_overrides = overrides.ExtractConst();
+  }
+
   void Handler::LoadSysConfig_Handler() {
     if (experiment_running) {
       Throw_RC_Error("Attempted to load system config while experiment "
@@ -76,6 +90,7 @@ namespace CML {
     settings.LoadSystemConfig();
 
     // EEG System
+    replay_task_events = false;
     RC::RStr eeg_system;
     settings.sys_config->Get(eeg_system, "eeg_system");
     RC::APtr<EEGSource> eeg_source;
@@ -99,12 +114,41 @@ namespace CML {
     else if (eeg_system == "EDFReplay") {
       RC::RStr edfreplay_file =
         settings.sys_config->GetPath("replay_file");
-      eeg_source = new EDFReplay(edfreplay_file);
+      EDFReplay* replay = new EDFReplay(edfreplay_file);
+      eeg_source = replay;
+      RC::Data1D<uint16_t> replay_channels;
+      if (settings.sys_config->TryGet(replay_channels, "replay_channels")) {
+        for (size_t c=0; c<replay_channels.size(); c++) {
+          if (replay_channels[c] < 1) {
+            Throw_RC_Type(File, "sys_config.json replay_channels are "
+                "1-indexed");
+          }
+          replay_channels[c]--;
+        }
+        replay->SetChannels(replay_channels);
+      }
+      f64 replay_start_sec = 0;
+      if (settings.sys_config->TryGet(replay_start_sec, "replay_start_sec")) {
+        replay->Seek(replay_start_sec);
+      }
+      bool replay_virtual_clock = false;
+      settings.sys_config->TryGet(replay_virtual_clock,
+          "replay_virtual_clock");
+      replay->SetVirtualClock(replay_virtual_clock);
+      std::string replay_events;
+      if (replay_virtual_clock &&
+          settings.sys_config->TryGet(replay_events, "replay_events")) {
+        replay->LoadEvents(settings.sys_config->GetPath("replay_events"));
+        eeg_acq.SetReplaySink(task_net_worker.ReplayCommand,
+            &task_net_worker);
+        replay_task_events = true;
+      }
     }
     else {
       Throw_RC_Type(File, "Unknown sys_config.json eeg_system value");
     }
     eeg_acq.SetSource(eeg_source);
+    eeg_acq.SetOverloadLog(RC::MakeCaller(&event_log, &EventLog::Log));
     InitializeChannels_Handler();
     double uV_per_unit;
     settings.sys_config->Get(uV_per_unit, "eeg_uV_per_unit");
@@ -137,6 +181,23 @@ namespace CML {
     stim_worker.SetStimInterface(stim_interface);
     stim_worker.Open();
 
+    telemetry_log_sec = 0;
+    settings.sys_config->TryGet(telemetry_log_sec,
+        "worker_telemetry_log_sec");
+
+    EventLogOptions event_log_options;
+    RC::RStr event_log_format = "json";
+    settings.sys_config->TryGet(event_log_format, "event_log_format");
+    if (event_log_format != RC::OneOf("json", "binary")) {
+      Throw_RC_Type(File, "sys_config.json event_log_format must be "
+          "\"json\" or \"binary\"");
+    }
+    event_log_options.binary = (event_log_format == "binary");
+    settings.sys_config->TryGet(event_log_options.flush_sec,
+        "event_log_flush_sec");
+    settings.sys_config->TryGet(event_log_options.fsync, "event_log_fsync");
+    event_log.SetOptions(event_log_options);
+
     u64 chan_count;
     settings.sys_config->Get(chan_count, "channel_count");
     Data1D<EEGChan> sys_chans;
@@ -495,12 +556,44 @@ namespace CML {
         }
       }
 
+      // Preload every stim tag selection along with the default, so
+      // STIMSELECT only switches between them.
+      RC::Data1D<RC::RStr> stimtags;
+      for (size_t c=0; c<settings.stimconf.size(); c++) {
+        const RC::RStr& tag = settings.stimconf[c].stimtag;
+        if (settings.stimconf[c].approved && !tag.empty() &&
+            !stimtags.Contains(tag)) {
+          stimtags += tag;
+        }
+      }
+      if (stimtags.size() > 0) {
+        RC::Data1D<StimProfile> bank;
+        bank += profile;
+        for (size_t t=0; t<stimtags.size(); t++) {
+          StimProfile tag_profile;
+          for (size_t c=0; c<settings.stimconf.size(); c++) {
+            if (settings.stimconf[c].approved &&
+                settings.stimconf[c].stimtag == stimtags[t]) {
+              tag_profile += settings.stimconf[c].params;
+            }
+          }
+          bank += tag_profile;
+        }
+        stim_worker.PreloadStimProfiles(bank);
+      }
+
       stim_worker.ConfigureStimulation(profile);
     }
 
+    SetupThreadScheduling();
     if (stim_mode == StimMode::CLOSED) {
       SetupClassifier();
     }
+    if (stim_mode != StimMode::NONE) {
+      SetupArtifactBlanking();
+      SetupStimTriggers();
+      SetupStimFastLane();
+    }
 
     experiment_running = true;
     main_window->SetReadyToStart(false);
@@ -563,10 +656,21 @@ namespace CML {
 
     eeg_acq.StartingExperiment();  // notify, replay needs this.
     event_log.StartFile(File::FullPath(session_dir, "event.log"));
+    if (feature_store.IsSet()) {
+      StartFeatureStore();
+    }
 
     JSONFile version_info;
     version_info.Set(ElememVersion(), "version");
     event_log.Log(MakeResp("ELEMEM", 0, version_info).Line());
+    if (!thread_sched_report.json.empty()) {
+      event_log.Log(MakeResp("THREAD_SCHEDULING", 0,
+            thread_sched_report).Line());
+    }
+    if (telemetry_log_sec > 0) {
+      telemetry_log_time.Start();
+      BeTelemetryPolling();
+    }
 
     RC::RStr eeg_file = File::FullPath(session_dir,
         RC::RStr("eeg_data.") + eeg_save->GetExt());
@@ -684,7 +788,11 @@ namespace CML {
       settings.sys_config->Get(ipaddress, "taskcom_ip");
       settings.sys_config->Get(port, "taskcom_port");
 
-      task_net_worker.Listen(ipaddress, port);
+      // Replayed task events need no connection, and not binding the port
+      // lets replays run in parallel.
+      if ( ! replay_task_events ) {
+        task_net_worker.Listen(ipaddress, port);
+      }
       main_window->GetStatusPanel()->SetEvent("WAITING");
     };
 
@@ -712,6 +820,10 @@ namespace CML {
 
   void Handler::StopExperiment_Handler() {
     stim_worker.Abort();
+    stim_worker.CancelScheduledStimulation();
+    if (experiment_running && telemetry_log_sec > 0) {
+      LogWorkerTelemetry(GetWorkerTelemetry_Handler());
+    }
     CloseExperimentComponents();
     stim_worker.Abort();
 
@@ -729,10 +841,20 @@ namespace CML {
       experiment_running = false;
       main_window->SetReadyToStart(true);
       main_window->GetStatusPanel()->SetEvent("RECORDING");
+      if (resim.IsSet()) {
+        ReportResimulation();
+      }
     }
   }
 
   void Handler::ExperimentExit_Handler() {
+    // No triggered stimulation in the wait for the task to finish.
+    if (phase_stim.IsSet()) {
+      phase_stim->SetArmed(false);
+    }
+    if (band_power_stim.IsSet()) {
+      band_power_stim->SetArmed(false);
+    }
     if (exit_timer.IsNull()) {
       exit_timer = new QTimer();
       AddToThread(exit_timer);  // For maintenance robustness.
@@ -753,6 +875,62 @@ namespace CML {
     }
   }
 
+  void Handler::StartResimulation_Handler() {
+    if ( ! resim.IsSet() ) {
+      ErrorWin("Re-simulation was not configured.");
+      FinishResimulation(2);
+      return;
+    }
+
+    try {
+      RC::FileRead fr(resim.StageConfig());
+      OpenConfig_Handler(fr);
+      StartExperiment_Handler();
+    }
+    CatchErrors()
+
+    // Any refusal to start was already logged.
+    if ( ! experiment_running ) {
+      FinishResimulation(2);
+    }
+  }
+
+  void Handler::ReportResimulation() {
+    int exit_code = 2;
+    try {
+      // The event log file is closed once its queued tasks have run.
+      event_log.Sync();
+      RStr resim_log = File::FullPath(session_dir, "event.log");
+      JSONFile report = DiffClassifierLogs(resim.LoggedEventLog(),
+          resim_log, resim.tolerance);
+      report.Save(File::FullPath(session_dir, "resim_diff.json"));
+
+      bool match;
+      size_t logged_count, matched;
+      report.Get(match, "match");
+      report.Get(logged_count, "logged_count");
+      report.Get(matched, "matched");
+      DebugLog("Re-simulation of " + resim.session_dir + " " +
+          (match ? "matched" : "differed") + ", " + RStr(matched) + " of " +
+          RStr(logged_count) + " classifier results matched.  See " +
+          File::FullPath(session_dir, "resim_diff.json"));
+      exit_code = match ? 0 : 1;
+    }
+    CatchErrors()
+
+    FinishResimulation(exit_code);
+  }
+
+  void Handler::FinishResimulation(int exit_code) {
+    resim_exit_code = exit_code;
+    // Closing the main window shuts down the workers.  It was never shown,
+    // so the event loop must also be told to quit.
+    QMetaObject::invokeMethod(main_window.Raw(), "close",
+        Qt::QueuedConnection);
+    QMetaObject::invokeMethod(QCoreApplication::instance(), "quit",
+        Qt::QueuedConnection);
+  }
+
   void Handler::OpenConfig_Handler(RC::FileRead& fr) {
     if (experiment_running) {
       ErrorWin("You must stop the experiment before opening a new "
@@ -935,16 +1113,175 @@ namespace CML {
     main_window->SetReadyToStart(true);
   }
 
+  void Handler::ConvertELCRecording_Handler(const RC::RStr& elc_file) {
+    if (experiment_running) {
+      ErrorWin("Recordings cannot be converted while an experiment is "
+               "running.");
+      return;
+    }
+
+    RC::RStr edf_file = File::NoExtension(elc_file) + ".edf";
+    if (File::Exists(edf_file)) {
+      if (!ConfirmWin(edf_file + " exists.  Overwrite it?")) {
+        return;
+      }
+    }
+    ConvertELCToEDF(elc_file, edf_file);
+    PopupWin("Converted to " + edf_file);
+  }
+
+  void Handler::RecoverEDFRecording_Handler(const RC::RStr& edf_file) {
+    if (experiment_running) {
+      ErrorWin("Recordings cannot be recovered while an experiment is "
+               "running.");
+      return;
+    }
+
+    if (!ConfirmWin("Recover " + edf_file + " in place?  Data after the "
+          "last complete data record is removed.")) {
+      return;
+    }
+    EDFRecoveryResult result = RecoverEDF(edf_file);
+    RC::RStr message = "Recovered " + RC::RStr(result.records) +
+      " data records, " + RC::RStr(result.duration_sec) + " seconds, of " +
+      edf_file + ".";
+    if (result.journaled && result.checkpoint_intact) {
+      message += "  " + RC::RStr(result.checkpoint_records) +
+        " were checkpointed.";
+    }
+    else if (result.journaled) {
+      message += "  The checkpoint journal counted " +
+        RC::RStr(result.checkpoint_records) + " data records, more than "
+        "were intact, so it may not match this file.";
+    }
+    else {
+      message += "  No checkpoint journal was found, so the session's "
+        "annotations could not be restored.";
+    }
+    if (result.dropped_bytes > 0) {
+      message += "  Removed " + RC::RStr(result.dropped_bytes) +
+        " bytes of incomplete data.";
+    }
+    PopupWin(message);
+  }
+
   void Handler::Shutdown_Handler() {
     eeg_acq.CloseSource();
     CloseExperimentComponents();
   }
 
+  /// Snapshots the task statistics of every worker.
+  /** Workers not currently allocated are omitted.
+   */
+  WorkerTelemetryList Handler::GetWorkerTelemetry_Handler() {
+    WorkerTelemetryList list;
+    AddWorkerTelemetry(list, "Handler", this);
+    AddWorkerTelemetry(list, "EEGAcq", &eeg_acq);
+    AddWorkerTelemetry(list, "StimWorker", &stim_worker);
+    AddWorkerTelemetry(list, "TaskNetWorker", &task_net_worker);
+    AddWorkerTelemetry(list, "EventLog", &event_log);
+    AddWorkerTelemetry(list, "EEGFileSave", eeg_save.Raw());
+    AddWorkerTelemetry(list, "TaskClassifierManager",
+        task_classifier_manager.Raw());
+    AddWorkerTelemetry(list, "FeatureFilters", feature_filters.Raw());
+    AddWorkerTelemetry(list, "Classifier", classifier.Raw());
+    AddWorkerTelemetry(list, "TaskStimManager", task_stim_manager.Raw());
+    AddWorkerTelemetry(list, "OnlineLogReg", online_learner.Raw());
+    AddWorkerTelemetry(list, "FeatureStore", feature_store.Raw());
+    AddWorkerTelemetry(list, "PhaseStim", phase_stim.Raw());
+    AddWorkerTelemetry(list, "BandPowerStim", band_power_stim.Raw());
+    AddWorkerTelemetry(list, "SigQuality", &sig_quality);
+    AddWorkerTelemetry(list, "ExperCPS", &exper_cps);
+    AddWorkerTelemetry(list, "ExperOPS", &exper_ops);
+    if (main_window.IsSet()) {
+      AddWorkerTelemetry(list, "MainWindow", main_window.Raw());
+      AddWorkerTelemetry(list, "StatusPanel",
+          main_window->GetStatusPanel().Raw());
+      AddWorkerTelemetry(list, "EEGDisplay",
+          main_window->GetEEGDisplay().Raw());
+    }
+    return list;
+  }
+
+  void Handler::WatchWorkerTelemetry_Handler(
+      const WorkerTelemetryCallback& callback) {
+    telemetry_callback = callback;
+    if (telemetry_callback.IsSet()) {
+      BeTelemetryPolling();
+    }
+  }
+
+  void Handler::BeTelemetryPolling() {
+    if (DirectCallingMode()) {
+      return;
+    }
+    if (telemetry_timer.IsNull()) {
+      telemetry_timer = new QTimer();
+      AddToThread(telemetry_timer);  // For maintenance robustness.
+      // Okay because timer allocated within Handler thread here.
+      QObject::connect(telemetry_timer, &QTimer::timeout,
+        RC::MakeCaller(this, &Handler::TelemetryTick));
+    }
+    if (!telemetry_timer->isActive()) {
+      telemetry_timer->start(1000);
+    }
+  }
+
+  void Handler::TelemetryTick() {
+    bool log_due = experiment_running && telemetry_log_sec > 0 &&
+      telemetry_log_time.SinceStart() >= telemetry_log_sec;
+    if (!telemetry_callback.IsSet() && !log_due) {
+      return;
+    }
+
+    WorkerTelemetryList list = GetWorkerTelemetry_Handler();
+    if (telemetry_callback.IsSet()) {
+      telemetry_callback(list);
+    }
+    if (log_due) {
+      telemetry_log_time.Start();
+      LogWorkerTelemetry(list);
+    }
+  }
+
+  void Handler::LogWorkerTelemetry(const WorkerTelemetryList& list) {
+    event_log.Log(MakeResp("WORKER_TELEMETRY", 0,
+          TelemetryJSON(list)).Line());
+  }
+
   void Handler::NewEEGSave() {
+    std::string save_format;
+    if (settings.sys_config.IsSet() &&
+        settings.sys_config->TryGet(save_format, "eeg_save_format") &&
+        save_format == "elc") {
+      size_t encode_threads = 2;
+      settings.sys_config->TryGet(encode_threads, "elc_encode_threads");
+      eeg_save = new ELCSave(this, settings.sampling_rate, encode_threads);
+      return;
+    }
+
 #ifdef NO_HDF5
-    eeg_save = new EDFSave(this, settings.sampling_rate);
+    EDFSaveOptions options;
+    if (settings.sys_config.IsSet()) {
+      settings.sys_config->TryGet(options.checkpoint_sec,
+          "eeg_checkpoint_sec");
+      settings.sys_config->TryGet(options.rotate_sec, "eeg_rotate_sec");
+      settings.sys_config->TryGet(options.rotate_mb, "eeg_rotate_mb");
+    }
+    eeg_save = new EDFSave(this, settings.sampling_rate, options);
 #else
-    eeg_save = new HDF5Save(this, settings.sampling_rate);
+    HDF5SaveOptions options;
+    if (settings.sys_config.IsSet()) {
+      settings.sys_config->TryGet(options.chunk_samples,
+          "hdf5_chunk_samples");
+      settings.sys_config->TryGet(options.chunk_channels,
+          "hdf5_chunk_channels");
+      settings.sys_config->TryGet(options.compression, "hdf5_compression");
+      settings.sys_config->TryGet(options.deflate_level,
+          "hdf5_deflate_level");
+      settings.sys_config->TryGet(options.shuffle, "hdf5_shuffle");
+    }
+    eeg_save = new HDF5Save(this, settings.sampling_rate, options);
 #endif
   }
 
@@ -1082,6 +1419,28 @@ namespace CML {
 
     ClassifierLogRegSettings classifier_settings;
 
+    bool online_learning = false;
+    OnlineLogRegSettings online_settings;
+    settings.exp_config->TryGet(online_learning, "experiment", "classifier",
+        "online_learning", "enabled");
+    if (online_learning) {
+      auto& conf = settings.exp_config;
+      conf->TryGet(online_settings.learning_rate, "experiment", "classifier",
+          "online_learning", "learning_rate");
+      conf->TryGet(online_settings.l2_penalty, "experiment", "classifier",
+          "online_learning", "l2_penalty");
+      conf->TryGet(online_settings.epochs, "experiment", "classifier",
+          "online_learning", "epochs");
+      conf->TryGet(online_settings.min_labelled_events, "experiment",
+          "classifier", "online_learning", "min_labelled_events");
+      conf->TryGet(online_settings.update_interval, "experiment",
+          "classifier", "online_learning", "update_interval");
+      conf->TryGet(online_settings.max_labelled_events, "experiment",
+          "classifier", "online_learning", "max_labelled_events");
+      conf->TryGet(online_settings.validation_stride, "experiment",
+          "classifier", "online_learning", "validation_stride");
+    }
+
     // Allocate components.
     task_classifier_manager = new TaskClassifierManager(this,
         settings.binned_sampling_rate, circ_buf_duration_ms);
@@ -1094,12 +1453,41 @@ namespace CML {
 
     task_stim_manager = new TaskStimManager(this);
 
+    ApplyThreadScheduling("TaskClassifierManager", *task_classifier_manager);
+    ApplyThreadScheduling("FeatureFilters", *feature_filters);
+    ApplyThreadScheduling("Classifier", *classifier);
+    ApplyThreadScheduling("TaskStimManager", *task_stim_manager);
+
+    if (online_learning) {
+      online_learner = new OnlineLogReg(this, online_settings,
+          settings.weight_manager->weights);
+    }
+
+    bool store_features = false;
+    settings.sys_config->TryGet(store_features, "feature_store");
+    if (store_features) {
+      feature_store = new FeatureStore();
+    }
+
     // Register the callbacks.
     task_classifier_manager->SetCallback(feature_filters->Process);
     feature_filters->RegisterCallback("ClassifierClassify",
         classifier->Classify);
     classifier->RegisterCallback("ClassifierDecision",
         task_stim_manager->StimDecision);
+    if (online_learner.IsSet()) {
+      feature_filters->RegisterCallback("OnlineLearnerFeatures",
+          online_learner->AddFeatures);
+      online_learner->SetCallback(classifier->SetWeights);
+    }
+    if (feature_store.IsSet()) {
+      feature_filters->RegisterRawCallback("FeatureStoreRaw",
+          feature_store->AddRaw);
+      feature_filters->RegisterCallback("FeatureStoreZScored",
+          feature_store->AddZScored);
+      classifier->RegisterCallback("FeatureStoreResult",
+          feature_store->AddResult);
+    }
 
     classifier_running = true;
   }
@@ -1128,17 +1516,213 @@ namespace CML {
     if (task_stim_manager.IsSet()) {
       task_stim_manager->ExitWait();
     }
+    if (online_learner.IsSet()) {
+      online_learner->ExitWait();
+    }
+    if (feature_store.IsSet()) {
+      // Only after its sources have stopped.
+      feature_store->CloseFile();
+      feature_store->ExitWait();
+    }
 
     // Clean up data.
     task_classifier_manager.Delete();
     feature_filters.Delete();
     classifier.Delete();
     task_stim_manager.Delete();
+    online_learner.Delete();
+    feature_store.Delete();
 
     classifier_running = false;
   }
 
+
+  void Handler::StartFeatureStore() {
+    auto& weights = settings.weight_manager->weights;
+    JSONFile metadata;
+    metadata.json["subject"] = settings.sub.Raw();
+    metadata.json["experiment"] = settings.exper.Raw();
+    metadata.json["frequencies"] = nlohmann::json::array();
+    for (size_t i=0; i<weights->freqs.size(); i++) {
+      metadata.json["frequencies"].push_back(weights->freqs[i]);
+    }
+    metadata.json["channels"] = nlohmann::json::array();
+    for (size_t i=0; i<weights->chans.size(); i++) {
+      metadata.json["channels"].push_back({weights->chans[i].pos,
+          weights->chans[i].neg});
+    }
+    feature_store->StartFile(File::FullPath(session_dir, "features.efs"),
+        metadata, weights->freqs.size() * weights->chans.size());
+  }
+
+
+  void Handler::SetupStimTriggers() {
+    // The longest stimulation event the approved channels can produce.
+    uint32_t max_duration_us = 0;
+    for (auto stim_sets : {&settings.stimconf, &settings.max_stimconf_range}) {
+      for (size_t c=0; c<stim_sets->size(); c++) {
+        if ((*stim_sets)[c].approved) {
+          max_duration_us = std::max(max_duration_us,
+              (*stim_sets)[c].params.duration);
+        }
+      }
+    }
+    f64 stim_duration_sec = max_duration_us * 1e-6;
+
+    bool phase_stim_enabled = false;
+    settings.exp_config->TryGet(phase_stim_enabled, "experiment",
+        "phase_stim", "enabled");
+    if (phase_stim_enabled) {
+      auto& conf = settings.exp_config;
+      PhaseStimSettings ps_set;
+      conf->Get(ps_set.channels, "experiment", "phase_stim", "channels");
+      conf->Get(ps_set.low_freq, "experiment", "phase_stim", "low_freq");
+      conf->Get(ps_set.high_freq, "experiment", "phase_stim", "high_freq");
+      conf->Get(ps_set.target_phase_deg, "experiment", "phase_stim",
+          "target_phase_deg");
+      conf->TryGet(ps_set.window_ms, "experiment", "phase_stim", "window_ms");
+      conf->TryGet(ps_set.amplitude_threshold, "experiment", "phase_stim",
+          "amplitude_threshold");
+      conf->TryGet(ps_set.latency_ms, "experiment", "phase_stim",
+          "latency_ms");
+      conf->TryGet(ps_set.max_wait_ms, "experiment", "phase_stim",
+          "max_wait_ms");
+      conf->TryGet(ps_set.trigger.refractory_sec, "experiment", "phase_stim",
+          "refractory_sec");
+      ps_set.trigger.stim_duration_sec = stim_duration_sec;
+
+      phase_stim = new PhaseStim(this, ps_set,
+          settings.binned_sampling_rate);
+    }
+
+    bool band_power_stim_enabled = false;
+    settings.exp_config->TryGet(band_power_stim_enabled, "experiment",
+        "band_power_stim", "enabled");
+    if (band_power_stim_enabled) {
+      auto& conf = settings.exp_config;
+      BandPowerStimSettings bp_set;
+      conf->TryGet(bp_set.channels, "experiment", "band_power_stim",
+          "channels");
+      conf->Get(bp_set.tracker.low_freq, "experiment", "band_power_stim",
+          "low_freq");
+      conf->Get(bp_set.tracker.high_freq, "experiment", "band_power_stim",
+          "high_freq");
+      conf->Get(bp_set.threshold_sd, "experiment", "band_power_stim",
+          "threshold_sd");
+      conf->TryGet(bp_set.tracker.filter_order, "experiment",
+          "band_power_stim", "filter_order");
+      conf->TryGet(bp_set.tracker.smoothing_ms, "experiment",
+          "band_power_stim", "smoothing_ms");
+      conf->TryGet(bp_set.tracker.baseline_sec, "experiment",
+          "band_power_stim", "baseline_sec");
+      conf->TryGet(bp_set.tracker.baseline_clip_sd, "experiment",
+          "band_power_stim", "baseline_clip_sd");
+      conf->TryGet(bp_set.min_channels, "experiment", "band_power_stim",
+          "min_channels");
+      conf->TryGet(bp_set.min_duration_ms, "experiment", "band_power_stim",
+          "min_duration_ms");
+      conf->TryGet(bp_set.trigger.refractory_sec, "experiment",
+          "band_power_stim", "refractory_sec");
+      bp_set.trigger.stim_duration_sec = stim_duration_sec;
+
+      band_power_stim = new BandPowerStim(this, bp_set,
+          settings.binned_sampling_rate);
+    }
+  }
+
+  /// Applies the sys_config.json thread_scheduling settings.
+  /** Workers which exist for the whole run are set here, and the
+   *  classifier workers as they are created.  The effective settings are
+   *  logged as THREAD_SCHEDULING when the session event log starts.
+   */
+  void Handler::SetupThreadScheduling() {
+    thread_sched_report.json.clear();
+
+    bool lock_memory = false;
+    settings.sys_config->TryGet(lock_memory, "thread_scheduling",
+        "mlockall");
+    if (lock_memory) {
+      thread_sched_report.Set(LockProcessMemory().json, "mlockall");
+    }
+
+    ApplyThreadScheduling("EEGAcq", eeg_acq);
+    ApplyThreadScheduling("StimWorker", stim_worker);
+  }
+
+  void Handler::ApplyThreadScheduling(const RC::RStr& name,
+      RCqt::Worker& worker) {
+    ThreadSchedSettings sched;
+    if (LoadThreadSched(*settings.sys_config, name, sched)) {
+      thread_sched_report.Set(ApplyWorkerSched(worker, sched).json,
+          name.Raw());
+    }
+  }
+
+  /// Starts the StimWorker fast lane if sys_config.json stim_fast_lane is
+  /// true, so task laptop stimulation triggers bypass the task queues.
+  void Handler::SetupStimFastLane() {
+    bool fast_lane = false;
+    settings.sys_config->TryGet(fast_lane, "stim_fast_lane");
+    if (!fast_lane) {
+      return;
+    }
+
+    ThreadSchedSettings sched;
+    LoadThreadSched(*settings.sys_config, "StimFastLane", sched);
+    thread_sched_report.Set(stim_worker.StartFastLane(sched).json,
+        "StimFastLane");
+  }
+
+  void Handler::SetupArtifactBlanking() {
+    bool blanking_enabled = false;
+    settings.exp_config->TryGet(blanking_enabled, "experiment",
+        "artifact_blanking", "enabled");
+    if (blanking_enabled) {
+      auto& conf = settings.exp_config;
+      ArtifactBlankerSettings ab_set;
+      conf->TryGet(ab_set.pre_ms, "experiment", "artifact_blanking",
+          "pre_ms");
+      conf->TryGet(ab_set.post_ms, "experiment", "artifact_blanking",
+          "post_ms");
+      conf->TryGet(ab_set.latency_ms, "experiment", "artifact_blanking",
+          "latency_ms");
+      RC::RStr mode = "hold";
+      conf->TryGet(mode, "experiment", "artifact_blanking", "mode");
+      if (mode == "hold") {
+        ab_set.mode = BlankMode::Hold;
+      }
+      else if (mode == "zero") {
+        ab_set.mode = BlankMode::Zero;
+      }
+      else {
+        Throw_RC_Error(("Unknown experiment:artifact_blanking:mode \"" +
+              mode + "\", expected \"hold\" or \"zero\".").c_str());
+      }
+
+      eeg_acq.EnableArtifactBlanking(ab_set,
+          RC::MakeCaller(&event_log, &EventLog::Log));
+    }
+  }
+
+  void Handler::ShutdownStimTriggers() {
+    // Shutdown disarms, logged while the event log is still open.
+    if (phase_stim.IsSet()) {
+      phase_stim->Shutdown();
+      phase_stim->ExitWait();
+      phase_stim.Delete();
+    }
+    if (band_power_stim.IsSet()) {
+      band_power_stim->Shutdown();
+      band_power_stim->ExitWait();
+      band_power_stim.Delete();
+    }
+  }
+
+
   void Handler::CloseExperimentComponents() {
+    ShutdownStimTriggers();
+    stim_worker.StopFastLane();
+    eeg_acq.DisableArtifactBlanking();
     ShutdownClassifier();
     task_net_worker.Close();
     exper_ops.Stop();
@@ -9,17 +9,25 @@
 #include "TaskClassifierManager.h"
 #include "TaskStimManager.h"
 #include "FeatureFilters.h"
+#include "FeatureStore.h"
 #include "Classifier.h"
+#include "OnlineLogReg.h"
+#include "PhaseStim.h"
+#include "Resimulation.h"
+#include "BandPowerStim.h"
 #include "EventLog.h"
 #include "ExperCPS.h"
 #include "ExperOPS.h"
 #include "TaskNetWorker.h"
+#include "ThreadSched.h"
+#include "WorkerTelemetry.h"
 #include "Settings.h"
 #include "SigQuality.h"
 #include "StimWorker.h"
 #include "LocGUIConfig.h"
 #include "StimGUIConfig.h"
 #include <QObject>
+#include <atomic>
 
 
 namespace CML {
@@ -40,6 +48,14 @@ namespace CML {
     Handler& operator=(const Handler&) = delete;
 
     void SetMainWindow(RC::Ptr<MainWindow> new_main);
+    /// Replays a recorded session headless instead of running live.
+    /** Must be called before LoadSysConfig.  StartResimulation then runs
+     *  the session, writes resim_diff.json, and closes the main window.
+     */
+    void SetResimulation(const ResimSettings& new_resim);
+    /// 0 if the re-simulation matched the session, 1 if it differed, or 2
+    /// if it could not run.
+    int ResimExitCode() const { return resim_exit_code; }
 
     RCqt::TaskBlocker<> LoadSysConfig =
       TaskHandler(Handler::LoadSysConfig_Handler);
@@ -101,15 +117,32 @@ namespace CML {
     RCqt::TaskCaller<> ExperimentExit =
       TaskHandler(Handler::ExperimentExit_Handler);
 
+    RCqt::TaskCaller<> StartResimulation =
+      TaskHandler(Handler::StartResimulation_Handler);
+
     RCqt::TaskCaller<RC::FileRead> OpenConfig =
       TaskHandler(Handler::OpenConfig_Handler);
 
     RCqt::TaskGetter<FullConf> GetConfig =
       TaskHandler(Handler::GetConfig_Handler);
 
+    // Writes an EDF file beside an ELC recording.
+    RCqt::TaskCaller<const RC::RStr> ConvertELCRecording =
+      TaskHandler(Handler::ConvertELCRecording_Handler);
+    // Repairs an EDF recording which was not closed, as after a crash.
+    RCqt::TaskCaller<const RC::RStr> RecoverEDFRecording =
+      TaskHandler(Handler::RecoverEDFRecording_Handler);
+
     RCqt::TaskBlocker<> Shutdown =
       TaskHandler(Handler::Shutdown_Handler);
 
+    RCqt::TaskGetter<WorkerTelemetryList> GetWorkerTelemetry =
+      TaskHandler(Handler::GetWorkerTelemetry_Handler);
+    // Sends a snapshot to the callback every second, until an unset
+    // callback is given.
+    RCqt::TaskCaller<const WorkerTelemetryCallback> WatchWorkerTelemetry =
+      TaskHandler(Handler::WatchWorkerTelemetry_Handler);
+
     StimWorker stim_worker;
     EEGAcq eeg_acq;
     RC::APtr<EEGFileSave> eeg_save;
@@ -117,6 +150,10 @@ namespace CML {
     RC::APtr<FeatureFilters> feature_filters;
     RC::APtr<Classifier> classifier;
     RC::APtr<TaskStimManager> task_stim_manager;
+    RC::APtr<OnlineLogReg> online_learner;
+    RC::APtr<FeatureStore> feature_store;
+    RC::APtr<PhaseStim> phase_stim;
+    RC::APtr<BandPowerStim> band_power_stim;
     TaskNetWorker task_net_worker;
     EventLog event_log;
     SigQuality sig_quality;
@@ -160,20 +197,39 @@ namespace CML {
     void StopExperiment_Handler();
     void ExperimentExit_Handler();
     void HandleExit();
+    void StartResimulation_Handler();
+    void ReportResimulation();
+    void FinishResimulation(int exit_code);
 
     void OpenConfig_Handler(RC::FileRead& fr);
     FullConf GetConfig_Handler() {
       return {settings.exp_config, settings.elec_config,
         settings.bipolar_config};
     }
+    void ConvertELCRecording_Handler(const RC::RStr& elc_file);
+    void RecoverEDFRecording_Handler(const RC::RStr& edf_file);
     void Shutdown_Handler();
 
+    WorkerTelemetryList GetWorkerTelemetry_Handler();
+    void WatchWorkerTelemetry_Handler(
+        const WorkerTelemetryCallback& callback);
+    void BeTelemetryPolling();
+    void TelemetryTick();
+    void LogWorkerTelemetry(const WorkerTelemetryList& list);
+
     void NewEEGSave();
     void SaveDefaultEEG();
     RC::Data1D<StimProfile> CreateGridProfiles();
     RC::Data1D<StimProfile> CreateDiscreteStimProfiles();
     void SetupClassifier();
     void ShutdownClassifier();
+    void StartFeatureStore();
+    void SetupThreadScheduling();
+    void ApplyThreadScheduling(const RC::RStr& name, RCqt::Worker& worker);
+    void SetupArtifactBlanking();
+    void SetupStimTriggers();
+    void SetupStimFastLane();
+    void ShutdownStimTriggers();
 
     void CloseExperimentComponents();
 
@@ -192,9 +248,23 @@ namespace CML {
       RC::Data1D<RC::RStr> prev_sessions;
     } cps_setup;
 
+    // Effective scheduling of each configured worker, for the event log.
+    JSONFile thread_sched_report;
+
     RC::APtr<QTimer> exit_timer;
+
+    RC::APtr<QTimer> telemetry_timer;
+    WorkerTelemetryCallback telemetry_callback;
+    // From sys_config.json worker_telemetry_log_sec.  0 disables logging.
+    f64 telemetry_log_sec = 0;
+    RC::Time telemetry_log_time;
     bool do_exit = false;
 
+    ResimSettings resim;
+    std::atomic<int> resim_exit_code{2};
+    // Task messages come from the replayed event log, not the network.
+    bool replay_task_events = false;
+
     bool experiment_running = false;
     bool sigqual_running = false;
     bool classifier_running = false;
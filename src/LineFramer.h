@@ -0,0 +1,76 @@
+#ifndef LINEFRAMER_H
+#define LINEFRAMER_H
+
+#include "RC/Types.h"
+#include <string>
+#include <string_view>
+
+namespace CML {
+  /// Splits a byte stream into "\n" terminated lines.
+  /** Each Append scans only the newly arrived bytes, and the consumed
+   *  lines are discarded together once per call, so a burst of n lines
+   *  costs O(n) instead of copying the remainder once per line.
+   */
+  class LineFramer {
+    public:
+    /// Appends data, calling on_line for each line it completes.
+    /** @param on_line Called with each line, without the "\n".  The view
+     *  is only valid during the call.  Calling Clear from on_line stops
+     *  the framing of the remaining data.  If on_line throws, its line
+     *  and those before it are still consumed, and the rest are framed
+     *  by the next Append.
+     */
+    template<class F>
+    void Append(const char* data, size_t len, F on_line) {
+      buffer.append(data, len);
+      u64 gen = generation;
+      size_t start = 0;
+      while (true) {
+        size_t end = buffer.find('\n', scanned);
+        if (end == std::string::npos) {
+          scanned = buffer.size();
+          break;
+        }
+        scanned = end + 1;
+        std::string_view line(buffer.data() + start, end - start);
+        start = end + 1;
+        try {
+          on_line(line);
+        }
+        catch (...) {
+          if (generation == gen) {
+            Consume(start);
+          }
+          throw;
+        }
+        if (generation != gen) {
+          return;
+        }
+      }
+      Consume(start);
+    }
+
+    void Clear() {
+      buffer.clear();
+      scanned = 0;
+      generation++;
+    }
+
+    /// Bytes held of an incomplete line.
+    size_t Pending() const { return buffer.size(); }
+
+    protected:
+    void Consume(size_t len) {
+      buffer.erase(0, len);
+      scanned -= len;
+    }
+
+    std::string buffer;
+    // Bytes of buffer already searched for "\n".
+    size_t scanned = 0;
+    u64 generation = 0;
+  };
+}
+
+#endif // LINEFRAMER_H
+
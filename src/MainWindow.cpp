@@ -10,6 +10,7 @@
 #include <QAction>
 #include <QCloseEvent>
 #include <QDir>
+#include <QFileDialog>
 #include <QPushButton>
 #include <QHBoxLayout>
 #include <QVBoxLayout>
@@ -27,7 +28,8 @@ using namespace std;
 namespace CML {
   MainWindow::MainWindow(RC::Ptr<Handler> hndl)
     : hndl (hndl),
-      open_config_dialog (new OpenConfigDialog(this)) {
+      open_config_dialog (new OpenConfigDialog(this)),
+      telemetry_window (new TelemetryWindow(hndl)) {
 
     UnusedVar(PopupManager::GetManager());  // Initialize singleton.
 
@@ -57,12 +59,21 @@ namespace CML {
 
     SubMenuEntry(file_menu, "&Open Config", "Open a configuration file",
                  &MainWindow::FileOpenClicked, QKeySequence::Open);
+    SubMenuEntry(file_menu, "&Convert ELC to EDF",
+                 "Convert a compressed ELC recording to EDF",
+                 &MainWindow::ConvertELCClicked);
+    SubMenuEntry(file_menu, "&Recover EDF Recording",
+                 "Repair an EDF recording left unfinished by a crash",
+                 &MainWindow::RecoverEDFClicked);
     SubMenuEntry(file_menu, "&Quit", "Exit the application",
                  &MainWindow::close, QKeySequence::Quit);
 
     Ptr<QMenu> setup_menu = menuBar()->addMenu(tr("&Setup"));
     SubMenuEntry(setup_menu, "Signal &Quality", "Signal quality check",
                  &MainWindow::SignalQualityClicked, Qt::Key_Q);
+    SubMenuEntry(setup_menu, "Worker &Telemetry",
+                 "Show task queue and timing statistics",
+                 &MainWindow::TelemetryClicked);
     RC::UnusedVar(setup_menu);
 
     Ptr<QMenu> help_menu = menuBar()->addMenu(tr("&Help"));
@@ -248,11 +259,38 @@ namespace CML {
   }
 
 
+  void MainWindow::ConvertELCClicked() {
+    QString filename = QFileDialog::getOpenFileName(this,
+        tr("Convert ELC Recording"), last_open_dir.ToQString(),
+        tr("ELC recordings (*.elc)"));
+    if (filename != "") {
+      SetLastOpenDir(filename.toStdString());
+      hndl->ConvertELCRecording(filename.toStdString());
+    }
+  }
+
+
+  void MainWindow::RecoverEDFClicked() {
+    QString filename = QFileDialog::getOpenFileName(this,
+        tr("Recover EDF Recording"), last_open_dir.ToQString(),
+        tr("EDF recordings (*.edf)"));
+    if (filename != "") {
+      SetLastOpenDir(filename.toStdString());
+      hndl->RecoverEDFRecording(filename.toStdString());
+    }
+  }
+
+
   void MainWindow::SignalQualityClicked() {
     hndl->RunSignalQuality();
   }
 
 
+  void MainWindow::TelemetryClicked() {
+    telemetry_window->Open();
+  }
+
+
   void MainWindow::HelpAboutClicked() {
     AboutWin();
   }
@@ -6,6 +6,7 @@
 #include "Handler.h"
 #include "OpenConfigDialog.h"
 #include "StatusPanel.h"
+#include "TelemetryWindow.h"
 #include <QMainWindow>
 
 class QGroupBox;
@@ -86,7 +87,10 @@ namespace CML {
     public slots:
 
     void FileOpenClicked();
+    void ConvertELCClicked();
+    void RecoverEDFClicked();
     void SignalQualityClicked();
+    void TelemetryClicked();
     void HelpAboutClicked();
 
     protected:
@@ -124,6 +128,7 @@ namespace CML {
     RC::Ptr<QStackedLayout> stim_panels;
 
     RC::APtr<OpenConfigDialog> open_config_dialog;
+    RC::APtr<TelemetryWindow> telemetry_window;
     RC::Data1D<RC::Ptr<StimConfigBox>> stim_config_boxes;
     RC::Data1D<RC::Ptr<MinMaxStimConfigBox>> min_max_stim_config_boxes;
     RC::Ptr<LocConfigBox> loc_config_chans;
@@ -78,19 +78,16 @@ namespace CML {
   void NetWorker::DataReady() {
     DataReadyBefore();
     auto new_data = con->readAll();
-    buffer += RStr(new_data.data(), size_t(new_data.size()));
-    Data1D<RStr> split;
-    while (buffer.Contains("\n")) {
-      split = buffer.SplitFirst('\n');
-      buffer = split[1];
-      ProcessCommand(split[0]);
-    }
+    framer.Append(new_data.data(), size_t(new_data.size()),
+        [&](std::string_view line) {
+          ProcessCommand(RStr(line.data(), line.size()));
+        });
     DataReadyAfter();
   }
 
   void NetWorker::Disconnected() {
     DisconnectedBefore();
-    buffer.clear();
+    framer.Clear();
     // Message required, unplanned disconnect.
     if (connected) {
       connected = false;
@@ -1,6 +1,7 @@
 #ifndef NETWORKER_H
 #define NETWORKER_H
 
+#include "LineFramer.h"
 #include "RC/APtr.h"
 #include "RC/RStr.h"
 #include "RC/Ptr.h"
@@ -60,7 +61,7 @@ namespace CML {
     RC::Ptr<Handler> hndl;
     RC::APtr<QTcpServer> server;
     RC::APtr<QTcpSocket> con;
-    RC::RStr buffer;
+    LineFramer framer;
     bool stop_on_disconnect = false;
     bool configured = false;
     bool connected = false;
@@ -1,7 +1,6 @@
 #include "NormalizePowers.h"
 #include "RC/RStr.h"
 #include "EventLog.h"
-#include "JSONLines.h"
 
 namespace CML {
   /// Default constructor that initializes and resets the internal lists
@@ -18,6 +17,8 @@ namespace CML {
         rolling_powers[i][j].SetSize(eventlen);
       }
     }
+
+    kernels = FeatureKernelSet::Select(freqlen);
   }
 
   /// Reset all of the values back to 0
@@ -30,6 +31,7 @@ namespace CML {
         rolling_powers[i][j].Reset();
       }
     }
+    flat_stats_valid = false;
   }
 
   /// Update the rolling statistics with a new set of values
@@ -57,11 +59,13 @@ namespace CML {
       }
     }
 
+    UpdateFlatStats();
+
     if (event_log.IsSet()) {
-      JSONFile normalization_stats;
-      normalization_stats.Set(means, "means");
-      normalization_stats.Set(sample_std_devs, "sample_std_devs");
-      event_log->Log(MakeResp("NORMALIZATION_STATS", 0, normalization_stats).Line());
+      auto normalization_stats = event_log->NewRecord("NORMALIZATION_STATS", 0);
+      normalization_stats->Add("means", means);
+      normalization_stats->Add("sample_std_devs", sample_std_devs);
+      event_log->Submit(normalization_stats);
     }
   }
 
@@ -85,6 +89,12 @@ namespace CML {
     RC::APtr<EEGPowers> out_data = new EEGPowers(in_data->sampling_rate, 1, chanlen, freqlen);
     auto& out_datar = out_data->data;
 
+    if (flat_stats_valid) {
+      kernels.ZScore(in_datar, out_datar, flat_means, flat_std_devs,
+          div_by_zero_eq_zero);
+      return out_data;
+    }
+
     RC_ForRange(i, 0, freqlen) { // Iterate over freqlen
       RC_ForRange(j, 0, chanlen) { // Iterate over chanlen
         out_datar[i][j] = rolling_powers[i][j].ZScore(in_datar[i][j], div_by_zero_eq_zero);
@@ -93,6 +103,29 @@ namespace CML {
     return out_data;
   }
 
+  /// Caches the single-event statistics in flat arrays for the ZScore kernel
+  void NormalizePowers::UpdateFlatStats() {
+    size_t freqlen = np_set.freqlen;
+    size_t chanlen = np_set.chanlen;
+
+    flat_stats_valid = false;
+    if ( (np_set.eventlen != 1) || (freqlen == 0) || (chanlen == 0) ||
+         (rolling_powers[0][0].GetCount() < 2) ) {
+      return;
+    }
+
+    flat_means.Resize(freqlen * chanlen);
+    flat_std_devs.Resize(freqlen * chanlen);
+    RC_ForRange(i, 0, freqlen) { // Iterate over freqlen
+      RC_ForRange(j, 0, chanlen) { // Iterate over chanlen
+        auto stats = rolling_powers[i][j].GetStats();
+        flat_means[i*chanlen + j] = stats.means[0];
+        flat_std_devs[i*chanlen + j] = stats.sample_std_devs[0];
+      }
+    }
+    flat_stats_valid = true;
+  }
+
   // TODO: JPB: (feature) Implement NormalizePowers::GetStats()
   //            You can make the PrintStats better once you implement this
   /// Returns the current statistics from the collected data
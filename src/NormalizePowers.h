@@ -3,6 +3,7 @@
 
 #include "EEGPowers.h"
 #include "RollingStats.h"
+#include "FeatureKernels.h"
 #include "RC/Data2D.h"
 #include "RC/Ptr.h"
 #include "RCqt/Worker.h"
@@ -32,8 +33,17 @@ namespace CML {
 
 
     protected:
+    void UpdateFlatStats();
+
     NormalizePowersSettings np_set;
     RC::Data2D<RollingStats> rolling_powers;
+
+    // Single-event statistics flattened for the ZScore kernel, frequencies
+    // outer.  Valid once every RollingStats has at least 2 values.
+    FeatureKernelSet kernels;
+    RC::Data1D<double> flat_means;
+    RC::Data1D<double> flat_std_devs;
+    bool flat_stats_valid = false;
   };
 }
 
@@ -0,0 +1,210 @@
+#include "OnlineLogReg.h"
+#include "Handler.h"
+#include "JSONLines.h"
+#include "RC/Macros.h"
+#include <cmath>
+
+namespace CML {
+  /// Constructor which warm-starts from the currently loaded weights
+  /** @param hndl The Handler, for event logging
+   *  @param settings The learning rate, regularization, and update schedule
+   *  @param weights The initial classifier weights
+   */
+  OnlineLogReg::OnlineLogReg(RC::Ptr<Handler> hndl,
+      OnlineLogRegSettings settings, RC::APtr<const FeatureWeights> weights)
+    : hndl(hndl), settings(settings), published(weights) {
+    if (this->settings.validation_stride < 2) {
+      Throw_RC_Error("Online classifier validation_stride must be at least 2.");
+    }
+  }
+
+  double OnlineLogReg::Sigmoid(double logodds) {
+    return 1 / (1 + std::exp(-logodds));
+  }
+
+  /// Handler that stores classifier features until their label arrives
+  /** @param data The normalized features sent to the classifier
+   *  @param task_classifier_settings The classification event settings
+   */
+  void OnlineLogReg::AddFeatures_Handler(RC::APtr<const EEGPowers>& data,
+      const TaskClassifierSettings& task_classifier_settings) {
+    // Normalization events have no z-scored features to learn from.
+    if (task_classifier_settings.cl_type == ClassificationType::NORMALIZE) {
+      return;
+    }
+
+    auto& datar = data->data;
+    auto& coef = published->coef;
+    if ( (datar.size1() != 1) ||
+         (datar.size2() != coef.size1()) ||
+         (datar.size3() != coef.size2()) ) {
+      Throw_RC_Error("Online classifier features do not match the "
+          "classifier weight dimensions.");
+    }
+
+    LabelledFeatures ev;
+    ev.classif_id = task_classifier_settings.classif_id;
+    ev.features.Resize(datar.size3() * datar.size2());
+    ev.label = false;
+    RC_ForRange(i, 0, datar.size3()) { // Iterate over frequencies
+      RC_ForRange(j, 0, datar.size2()) { // Iterate over channels
+        ev.features[i*datar.size2() + j] = datar[i][j][0];
+      }
+    }
+
+    pending += ev;
+    while (pending.size() > settings.max_pending_events) {
+      pending.Remove(0);
+    }
+  }
+
+  /// Handler that pairs a task label with the stored features for an event
+  /** @param classif_id The id of the classification event being labelled
+   *  @param label True for the positive class (e.g., recalled)
+   */
+  void OnlineLogReg::AddLabel_Handler(const uint64_t& classif_id,
+      const bool& label) {
+    size_t p = 0;
+    for (; p<pending.size(); p++) {
+      if (pending[p].classif_id == classif_id) {
+        break;
+      }
+    }
+    if (p == pending.size()) {
+      JSONFile data;
+      data.Set("no features for id", "error");
+      hndl->event_log.Log(MakeResp("ONLINE_CLASSIFIER_LABEL", classif_id,
+            data).Line());
+      return;
+    }
+
+    pending[p].label = label;
+    labelled += pending[p];
+    pending.Remove(p);
+    while (labelled.size() > settings.max_labelled_events) {
+      labelled.Remove(0);
+    }
+
+    label_count++;
+    labels_since_update++;
+    if (labelled.size() >= settings.min_labelled_events &&
+        labels_since_update >= settings.update_interval) {
+      labels_since_update = 0;
+      Train();
+    }
+  }
+
+  void OnlineLogReg::SetCallback_Handler(const WeightsCallback& new_callback) {
+    callback = new_callback;
+  }
+
+  /// Mean log loss of a model over a set of labelled events
+  double OnlineLogReg::LogLoss(const RC::Data1D<double>& coef,
+      double intercept, const RC::Data1D<LabelledFeatures>& events) {
+    const double eps = 1e-12;
+    double loss = 0;
+    RC_ForIndex(e, events) {
+      double logodds = intercept;
+      RC_ForIndex(k, coef) {
+        logodds += coef[k] * events[e].features[k];
+      }
+      double prob = Sigmoid(logodds);
+      loss -= events[e].label ? std::log(prob + eps) : std::log(1-prob + eps);
+    }
+    return loss / events.size();
+  }
+
+  /// Warm-started L2-regularized SGD over the labelled window, publishing
+  /// the result only if it improves the held-out log loss.
+  void OnlineLogReg::Train() {
+    RC::Data1D<LabelledFeatures> train;
+    RC::Data1D<LabelledFeatures> validate;
+    size_t train_pos = 0;
+    // Split by classif_id, not window position, so events stay on one side
+    // as the window slides, and the published weights are never validated
+    // on events they were trained on.
+    RC_ForIndex(e, labelled) {
+      if (labelled[e].classif_id % settings.validation_stride == 0) {
+        validate += labelled[e];
+      }
+      else {
+        train += labelled[e];
+        train_pos += labelled[e].label ? 1 : 0;
+      }
+    }
+    if (validate.IsEmpty() || train_pos == 0 || train_pos == train.size()) {
+      // Need both classes to train, and something to validate against.
+      return;
+    }
+
+    size_t freqlen = published->coef.size2();
+    size_t chanlen = published->coef.size1();
+
+    RC::Data1D<double> prev_coef(freqlen * chanlen);
+    RC_ForRange(i, 0, freqlen) {
+      RC_ForRange(j, 0, chanlen) {
+        prev_coef[i*chanlen + j] = published->coef[i][j];
+      }
+    }
+    double prev_intercept = published->intercept;
+
+    RC::Data1D<double> coef = prev_coef;
+    double intercept = prev_intercept;
+
+    RC::Data1D<size_t> order(train.size());
+    RC_ForIndex(e, order) { order[e] = e; }
+
+    RC_ForRange(epoch, 0, settings.epochs) {
+      if (ShouldAbort()) { return; }
+      order.Shuffle();
+      RC_ForIndex(o, order) {
+        auto& ev = train[order[o]];
+        double logodds = intercept;
+        RC_ForIndex(k, coef) {
+          logodds += coef[k] * ev.features[k];
+        }
+        double grad = Sigmoid(logodds) - (ev.label ? 1.0 : 0.0);
+        RC_ForIndex(k, coef) {
+          coef[k] -= settings.learning_rate *
+            (grad * ev.features[k] + settings.l2_penalty * coef[k]);
+        }
+        intercept -= settings.learning_rate * grad;
+      }
+    }
+
+    bool finite = std::isfinite(intercept);
+    RC_ForIndex(k, coef) {
+      finite = finite && std::isfinite(coef[k]);
+    }
+
+    double prev_loss = LogLoss(prev_coef, prev_intercept, validate);
+    double new_loss = finite ? LogLoss(coef, intercept, validate) : prev_loss;
+    bool publish = finite && new_loss < prev_loss;
+
+    JSONFile data;
+    data.Set(label_count, "label_count");
+    data.Set(train.size(), "train_count");
+    data.Set(validate.size(), "validate_count");
+    data.Set(prev_loss, "prev_loss");
+    data.Set(new_loss, "new_loss");
+    data.Set(publish, "published");
+    hndl->event_log.Log(MakeResp("ONLINE_CLASSIFIER_UPDATE", 0, data).Line());
+
+    if ( ! publish ) {
+      return;
+    }
+
+    auto weights_mut = RC::MakeAPtr<FeatureWeights>(*published);
+    weights_mut->intercept = intercept;
+    RC_ForRange(i, 0, freqlen) {
+      RC_ForRange(j, 0, chanlen) {
+        weights_mut->coef[i][j] = coef[i*chanlen + j];
+      }
+    }
+    published = weights_mut.ExtractConst();
+
+    if (callback.IsSet()) {
+      callback(published);
+    }
+  }
+}
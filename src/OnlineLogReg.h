@@ -0,0 +1,82 @@
+#ifndef ONLINELOGREG_H
+#define ONLINELOGREG_H
+
+#include "EEGPowers.h"
+#include "FeatureWeights.h"
+#include "TaskClassifierSettings.h"
+#include "RC/APtr.h"
+#include "RC/Data1D.h"
+#include "RC/Ptr.h"
+#include "RCqt/Worker.h"
+
+namespace CML {
+  class Handler;
+
+  using FeatureCallback = RCqt::TaskCaller<RC::APtr<const EEGPowers>, const TaskClassifierSettings>;
+  using WeightsCallback = RCqt::TaskCaller<RC::APtr<const FeatureWeights>>;
+
+  class OnlineLogRegSettings {
+    public:
+    double learning_rate = 0.01;
+    double l2_penalty = 1e-3;
+    size_t epochs = 20;
+    size_t min_labelled_events = 40;
+    size_t update_interval = 10;  // Retrain after this many new labels.
+    size_t max_labelled_events = 2000;  // Sliding window of training data.
+    size_t max_pending_events = 256;  // Unlabelled features kept for pairing.
+    size_t validation_stride = 5;  // Held out if classif_id % N == 0.
+  };
+
+  /// An online logistic regression learner which warm-starts from the
+  /// loaded classifier weights and retrains on in-session labelled features.
+  /** Features arrive through the same FeatureCallback used by the
+   *  Classifier, and are paired by classif_id with labels from the task.
+   *  Training runs on this worker's thread, and candidate weights are only
+   *  published through the WeightsCallback after validating on held-out
+   *  events, so the classification path never waits on training.
+   */
+  class OnlineLogReg : public RCqt::WorkerThread {
+    public:
+    OnlineLogReg(RC::Ptr<Handler> hndl, OnlineLogRegSettings settings,
+        RC::APtr<const FeatureWeights> weights);
+
+    FeatureCallback AddFeatures =
+      TaskHandler(OnlineLogReg::AddFeatures_Handler);
+
+    RCqt::TaskCaller<const uint64_t, const bool> AddLabel =
+      TaskHandler(OnlineLogReg::AddLabel_Handler);
+
+    RCqt::TaskCaller<const WeightsCallback> SetCallback =
+      TaskHandler(OnlineLogReg::SetCallback_Handler);
+
+    static double Sigmoid(double logodds);
+
+    protected:
+    void AddFeatures_Handler(RC::APtr<const EEGPowers>& data,
+        const TaskClassifierSettings& task_classifier_settings);
+    void AddLabel_Handler(const uint64_t& classif_id, const bool& label);
+    void SetCallback_Handler(const WeightsCallback& new_callback);
+
+    struct LabelledFeatures {
+      uint64_t classif_id;
+      RC::Data1D<double> features;  // frequencies outer, channels inner
+      bool label;
+    };
+
+    void Train();
+    double LogLoss(const RC::Data1D<double>& coef, double intercept,
+        const RC::Data1D<LabelledFeatures>& events);
+
+    RC::Ptr<Handler> hndl;
+    OnlineLogRegSettings settings;
+    WeightsCallback callback;
+
+    RC::APtr<const FeatureWeights> published;
+    RC::Data1D<LabelledFeatures> pending;
+    RC::Data1D<LabelledFeatures> labelled;
+    size_t labels_since_update = 0;
+    size_t label_count = 0;
+  };
+}
+
+#endif // ONLINELOGREG_H
@@ -0,0 +1,108 @@
+#include "PhaseEstimator.h"
+#include "RC/Errors.h"
+#include "RC/RStr.h"
+#include <cmath>
+
+namespace CML {
+  /// Constructor which precomputes the endpoint-corrected Hilbert kernel
+  /** @param settings The frequency band, sampling rate, and window length
+   */
+  PhaseEstimator::PhaseEstimator(const PhaseEstimatorSettings& settings)
+    : settings(settings) {
+    size_t N = settings.window_len;
+    const double fs = settings.sampling_rate;
+    if ( (settings.low_freq <= 0) || (settings.high_freq <= settings.low_freq) ||
+         (settings.high_freq >= fs/2) ) {
+      Throw_RC_Error((RC::RStr("Invalid phase estimation band (") +
+            settings.low_freq + ", " + settings.high_freq + ") Hz for a " +
+            "sampling rate of " + settings.sampling_rate + " Hz.").c_str());
+    }
+    if (N < fs / settings.low_freq) {
+      Throw_RC_Error((RC::RStr("Phase estimation window of ") + N +
+            " samples is shorter than one cycle of " + settings.low_freq +
+            " Hz.").c_str());
+    }
+
+    bandpass.setup(settings.filter_order, fs,
+        (settings.low_freq + settings.high_freq) / 2,
+        settings.high_freq - settings.low_freq);
+
+    // Analytic signal weights: positive frequencies doubled, negative
+    // frequencies and DC zeroed, shaped by the causal band-pass response.
+    // The causal response is what suppresses the distortion at the window
+    // endpoint.
+    RC::Data1D<std::complex<double>> response(N/2);
+    response.Zero();
+    RC_ForRange(k, 1, N/2) {
+      response[k] = bandpass.response(double(k)/N);
+    }
+
+    // Evaluate the inverse DFT at the final sample, folded into a kernel
+    // over the window samples.
+    kernel.Resize(N);
+    RC_ForRange(n, 0, N) {
+      std::complex<double> c = 0;
+      RC_ForRange(k, 1, N/2) {
+        double angle = 2 * M_PI * double(k) * double(N-1-n) / N;
+        c += (2.0 * response[k] / double(N)) * std::polar(1.0, angle);
+      }
+      kernel[n] = c;
+    }
+
+    window.Resize(N+1);
+    Reset();
+  }
+
+  void PhaseEstimator::Reset() {
+    window.Zero();
+    window_pos = 0;
+    filled = 0;
+  }
+
+  /// Appends new samples to the sliding window
+  /** @param samples The new samples, oldest first
+   */
+  void PhaseEstimator::Process(const RC::Data1D<double>& samples) {
+    const size_t N = window.size();
+    RC_ForIndex(i, samples) {
+      window[window_pos] = samples[i];
+      window_pos = (window_pos + 1) % N;
+    }
+    filled = std::min(N, filled + samples.size());
+  }
+
+  std::complex<double> PhaseEstimator::Analytic() const {
+    return ApplyKernel(0);
+  }
+
+  void PhaseEstimator::Estimate(double& phase, double& freq,
+      double& amplitude) const {
+    std::complex<double> z = ApplyKernel(0);
+    std::complex<double> z_prev = ApplyKernel(1);
+
+    freq = std::arg(z * std::conj(z_prev)) * settings.sampling_rate /
+      (2 * M_PI);
+    amplitude = std::abs(z);
+
+    // Remove the causal filter's phase shift at this frequency.
+    double norm_freq = std::max(0.0, std::min(0.5,
+          freq / settings.sampling_rate));
+    phase = std::arg(z * std::conj(bandpass.response(norm_freq)));
+  }
+
+  std::complex<double> PhaseEstimator::ApplyKernel(
+      size_t samples_back) const {
+    const size_t ring_len = window.size();
+    const size_t N = kernel.size();
+    const double* w = window.Raw();
+    const std::complex<double>* c = kernel.Raw();
+    // window_pos is the oldest sample in the ring once it is full.
+    size_t start = (window_pos + 1 - samples_back) % ring_len;
+    std::complex<double> z = 0;
+    for (size_t n=0; n<N; n++) {
+      size_t pos = start + n;
+      z += c[n] * w[pos < ring_len ? pos : pos - ring_len];
+    }
+    return z;
+  }
+}
@@ -0,0 +1,66 @@
+#ifndef PHASEESTIMATOR_H
+#define PHASEESTIMATOR_H
+
+#include <complex>
+#include "RC/Data1D.h"
+#include "DSPFilters/Dsp.h"
+
+namespace CML {
+  class PhaseEstimatorSettings {
+    public:
+    double low_freq = 4;
+    double high_freq = 8;
+    size_t sampling_rate = 1000;
+    size_t window_len = 256;  // samples
+    int filter_order = 2;
+  };
+
+  /// A causal instantaneous phase estimator for a single channel.
+  /** This implements the endpoint-corrected Hilbert transform (ecHT), where
+   *  the analytic signal of a sliding window is band-limited by the
+   *  frequency response of a causal Butterworth band-pass before taking the
+   *  sample at the end of the window.  Because only the endpoint is needed,
+   *  the whole transform collapses to a precomputed complex kernel applied
+   *  to the window, so each estimate is O(window_len) with no FFT.
+   */
+  class PhaseEstimator {
+    public:
+    PhaseEstimator(const PhaseEstimatorSettings& settings);
+
+    void Reset();
+    void Process(const RC::Data1D<double>& samples);
+    bool Ready() const { return filled == window.size(); }
+
+    /// The analytic signal at the most recent sample.
+    std::complex<double> Analytic() const;
+
+    /// Instantaneous phase and frequency at the most recent sample.
+    /** The phase is corrected for the causal filter's phase response at
+     *  the instantaneous frequency.
+     *  @param phase Output phase in radians, in [-pi, pi]
+     *  @param freq Output frequency in Hz
+     *  @param amplitude Output analytic amplitude
+     */
+    void Estimate(double& phase, double& freq, double& amplitude) const;
+
+    protected:
+    PhaseEstimatorSettings settings;
+
+    // Ring buffer of the most recent window_len+1 samples, so the estimate
+    // can also be evaluated for the window ending one sample earlier.
+    RC::Data1D<double> window;
+    size_t window_pos = 0;
+    size_t filled = 0;
+
+    std::complex<double> ApplyKernel(size_t samples_back) const;
+
+    // kernel[n] multiplies the n-th oldest sample in a window to give the
+    // analytic signal at the window's final sample.
+    RC::Data1D<std::complex<double>> kernel;
+
+    // The causal band-pass, for its phase response.
+    Dsp::Butterworth::BandPass<4> bandpass;
+  };
+}
+
+#endif // PHASEESTIMATOR_H
@@ -0,0 +1,137 @@
+#include "PhaseStim.h"
+#include "EEGAcq.h"
+#include "Handler.h"
+#include "JSONLines.h"
+#include "StimWorker.h"
+#include "RC/Macros.h"
+#include "RC/RTime.h"
+#include <cmath>
+
+namespace CML {
+  static constexpr double max_phase_error_deg = 10;
+
+
+  /// Constructor which sets up the estimators and registers on EEGAcq
+  /** @param hndl The Handler, for EEGAcq, StimWorker, and event logging
+   *  @param settings The channels, band, and trigger settings
+   *  @param sampling_rate The sampling rate of the EEGAcq callback data
+   */
+  PhaseStim::PhaseStim(RC::Ptr<Handler> hndl, PhaseStimSettings settings,
+      size_t sampling_rate)
+    : hndl(hndl), settings(settings),
+      trigger(hndl, "PHASE_STIM", "Phase-locked stimulation",
+          settings.trigger) {
+    if (settings.channels.IsEmpty()) {
+      Throw_RC_Error("Phase-locked stimulation requires at least one "
+          "channel.");
+    }
+
+    PhaseEstimatorSettings pe_set;
+    pe_set.low_freq = settings.low_freq;
+    pe_set.high_freq = settings.high_freq;
+    pe_set.sampling_rate = sampling_rate;
+    pe_set.window_len = settings.window_ms * sampling_rate / 1000;
+    RC_ForIndex(c, settings.channels) {
+      estimators += RC::MakeAPtr<PhaseEstimator>(pe_set);
+    }
+
+    callback_ID = "PhaseStim";
+    hndl->eeg_acq.RegisterEEGCallback(callback_ID, Process);
+    hndl->eeg_acq.SetEEGCallbackPolicy(callback_ID,
+        EEGCallbackPolicy::Realtime(this));
+  }
+
+  PhaseStim::~PhaseStim() {
+    Shutdown_Handler();
+  }
+
+  void PhaseStim::Shutdown_Handler() {
+    if (trigger.IsArmed()) {
+      trigger.SetArmed(false);
+    }
+    if (callback_ID.size() > 0) {
+      hndl->eeg_acq.RemoveEEGCallback(callback_ID);
+      callback_ID = "";
+    }
+  }
+
+  void PhaseStim::SetArmed_Handler(const bool& new_armed) {
+    trigger.SetArmed(new_armed);
+  }
+
+  /// Handler that updates the phase estimates and triggers stimulation
+  /** @param data The newest block of referenced, binned EEG data
+   */
+  void PhaseStim::Process_Handler(RC::APtr<const EEGDataDouble>& data) {
+    auto& datar = data->data;
+    RC_ForIndex(c, settings.channels) {
+      size_t chan = settings.channels[c];
+      if (chan >= datar.size()) {
+        Throw_RC_Error((RC::RStr("Phase-locked stimulation channel ") + chan +
+              " is out of range for " + datar.size() + " channels.").c_str());
+      }
+      estimators[c]->Process(datar[chan]);
+    }
+
+    if (!trigger.IsArmed() || ShouldAbort()) {
+      return;
+    }
+
+    // Amplitude-weighted circular mean across channels.
+    double cos_sum = 0;
+    double sin_sum = 0;
+    double freq_sum = 0;
+    double amp_sum = 0;
+    RC_ForIndex(c, estimators) {
+      if (!estimators[c]->Ready()) {
+        return;
+      }
+      double phase, freq, amp;
+      estimators[c]->Estimate(phase, freq, amp);
+      cos_sum += amp * std::cos(phase);
+      sin_sum += amp * std::sin(phase);
+      freq_sum += freq;
+      amp_sum += amp;
+    }
+    double phase = std::atan2(sin_sum, cos_sum);
+    double freq = freq_sum / estimators.size();
+    double amp = amp_sum / estimators.size();
+
+    // Phase is not meaningful without an in-band oscillation.
+    if ( (amp < settings.amplitude_threshold) ||
+         (freq < settings.low_freq) || (freq > settings.high_freq) ) {
+      return;
+    }
+
+    f64 now = RC::Time::Get();
+    if (trigger.Refractory(now)) {
+      return;
+    }
+
+    double cur_phase = phase + 2 * M_PI * freq * settings.latency_ms * 1e-3;
+    double target = settings.target_phase_deg * M_PI / 180;
+    double to_go = std::fmod(target - cur_phase, 2 * M_PI);
+    if (to_go < 0) {
+      to_go += 2 * M_PI;
+    }
+    double wait_sec = to_go / (2 * M_PI * freq);
+    if (wait_sec * 1e3 > settings.max_wait_ms) {
+      return;
+    }
+
+    // Later than this, the stimulation would miss the target phase by
+    // more than max_phase_error_deg and is skipped instead.
+    f64 target_sec = now + wait_sec;
+    f64 deadline_sec = target_sec + max_phase_error_deg / (360 * freq);
+    trigger.Triggered(target_sec);
+    hndl->stim_worker.ScheduleStimulation(target_sec, deadline_sec);
+
+    JSONFile event;
+    event.Set(phase * 180 / M_PI, "phase");
+    event.Set(freq, "frequency");
+    event.Set(amp, "amplitude");
+    event.Set(wait_sec * 1e3, "wait_ms");
+    event.Set(settings.target_phase_deg, "target_phase");
+    hndl->event_log.Log(MakeResp("PHASE_STIM", 0, event).Line());
+  }
+}
@@ -0,0 +1,73 @@
+#ifndef PHASESTIM_H
+#define PHASESTIM_H
+
+#include "EEGData.h"
+#include "PhaseEstimator.h"
+#include "StimTrigger.h"
+#include "RC/APtr.h"
+#include "RC/Data1D.h"
+#include "RC/Ptr.h"
+#include "RC/RStr.h"
+#include "RCqt/Worker.h"
+
+namespace CML {
+  class Handler;
+
+  class PhaseStimSettings {
+    public:
+    RC::Data1D<size_t> channels;  // Indices into the EEGAcq callback data.
+    double low_freq = 4;
+    double high_freq = 8;
+    size_t window_ms = 500;
+    double target_phase_deg = 0;  // 0 is the peak, 180 the trough.
+    double amplitude_threshold = 0;
+    // Delay from the newest acquired sample to now, projected forward.
+    double latency_ms = 0;
+    // Only schedule the target phase if it arrives this soon, otherwise
+    // the next acquisition block gives a fresher estimate.
+    double max_wait_ms = 10;
+    StimTriggerSettings trigger;
+  };
+
+  /// Phase-locked stimulation from a causal phase estimate of the live EEG.
+  /** Each acquisition block updates a PhaseEstimator per selected channel.
+   *  When armed and the amplitude-weighted mean phase is projected to reach
+   *  the target phase within max_wait_ms, this schedules the stimulation
+   *  with StimWorker::ScheduleStimulation, so this worker never waits and
+   *  the following blocks are processed on time.
+   */
+  class PhaseStim : public RCqt::WorkerThread {
+    public:
+    PhaseStim(RC::Ptr<Handler> hndl, PhaseStimSettings settings,
+        size_t sampling_rate);
+    ~PhaseStim();
+
+    // Rule of 3.
+    PhaseStim(const PhaseStim&) = delete;
+    PhaseStim& operator=(const PhaseStim&) = delete;
+
+    RCqt::TaskCaller<const bool> SetArmed =
+      TaskHandler(PhaseStim::SetArmed_Handler);
+
+    RCqt::TaskBlocker<> Shutdown =
+      TaskHandler(PhaseStim::Shutdown_Handler);
+
+    protected:
+    RCqt::TaskCaller<RC::APtr<const EEGDataDouble>> Process =
+      TaskHandler(PhaseStim::Process_Handler);
+
+    void Process_Handler(RC::APtr<const EEGDataDouble>& data);
+    void SetArmed_Handler(const bool& new_armed);
+    void Shutdown_Handler();
+
+    RC::Ptr<Handler> hndl;
+    RC::RStr callback_ID;
+
+    PhaseStimSettings settings;
+    RC::Data1D<RC::APtr<PhaseEstimator>> estimators;
+
+    StimTrigger trigger;
+  };
+}
+
+#endif // PHASESTIM_H
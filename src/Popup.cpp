@@ -34,10 +34,18 @@ namespace CML {
 
 
   void PopupManager::Info_Handler(const RStr& message, const RStr& title) {
+    if (headless) {
+      LogMsg_Handler(title + "\n" + message);
+      return;
+    }
     QMessageBox::information(nullptr, title.c_str(), message.c_str());
   }
 
   bool PopupManager::Confirm_Handler(const RStr& message, const RStr& title) {
+    if (headless) {
+      LogMsg_Handler("Auto-confirmed: " + title + "\n" + message);
+      return true;
+    }
     return (QMessageBox::question(nullptr, title.c_str(), message.c_str(),
             QMessageBox::No | QMessageBox::Yes, QMessageBox::Yes)
             == QMessageBox::Yes);
@@ -65,6 +73,13 @@ namespace CML {
     else {
       LogMsg_Handler(title + "\n" + log_message);
     }
+    if (headless) {
+      // Without a log file, LogMsg already wrote it to stderr.
+      if (log_file.IsOpen()) {
+        std::cerr << title << ": " << message << std::endl;
+      }
+      return;
+    }
     QMessageBox::warning(nullptr, title.c_str(), message.c_str());
   }
 
@@ -72,6 +87,10 @@ namespace CML {
     log_file.Open(filename, APPEND);
   }
 
+  void PopupManager::SetHeadless_Handler(const bool& new_headless) {
+    headless = new_headless;
+  }
+
 
   void DispatchError(RC::ErrorMsgFatal& err) {
     RC::RStr errormsg = RC::RStr("Fatal Error:  ")+err.what();
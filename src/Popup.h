@@ -60,6 +60,10 @@ namespace CML {
 
     RCqt::TaskCaller<const RC::RStr> SetLogFile =
       TaskHandler(PopupManager::SetLogFile_Handler);
+    /// When headless, messages go only to the log and stderr, and every
+    /// confirmation is answered yes.
+    RCqt::TaskCaller<const bool> SetHeadless =
+      TaskHandler(PopupManager::SetHeadless_Handler);
 
     protected:
 
@@ -70,8 +74,10 @@ namespace CML {
         const RC::RStr& log_message);
 
     void SetLogFile_Handler(const RC::RStr& filename);
+    void SetHeadless_Handler(const bool& new_headless);
 
     RC::FileWrite log_file;
+    bool headless = false;
 
     private: signals:
     void InfoSignal(RC::RStr message, RC::RStr title);
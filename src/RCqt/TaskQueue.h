@@ -0,0 +1,174 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// RCqt Library
+//
+// Distributed under the Boost Software License, v1.0. (LICENSE.txt)
+//
+// TaskQueue - A bounded lock-free queue and a lock-free block pool, used
+// by Worker when RCQT_LOCKFREE_QUEUE is defined.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef TASKQUEUE_H
+#define TASKQUEUE_H
+
+#include "../RC/RCconfig.h"
+#include "../RC/Types.h"
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <new>
+
+namespace RCqt {
+  /// A bounded lock-free queue of pointers.
+  /** This is the array-based queue by Dmitry Vyukov, in which every cell
+   *  carries a sequence number that tells producers and consumers whether
+   *  the cell is free for their lap around the ring.  It is safe for any
+   *  number of producers and consumers, with one compare-exchange per
+   *  operation and no ABA hazard.  Capacity is rounded up to a power of 2.
+   */
+  template<class T>
+  class BoundedQueue {
+    public:
+    BoundedQueue(size_t capacity) {
+      size_t cap = 2;
+      while (cap < capacity) {
+        cap *= 2;
+      }
+      mask = cap - 1;
+      cells = new Cell[cap];
+      for (size_t i=0; i<cap; i++) {
+        cells[i].seq.store(i, std::memory_order_relaxed);
+        cells[i].item = NULL;
+      }
+      enqueue_pos.store(0, std::memory_order_relaxed);
+      dequeue_pos.store(0, std::memory_order_relaxed);
+    }
+
+    ~BoundedQueue() { delete[] cells; }
+
+    /// Returns false if the queue is full.
+    bool Push(T* item) {
+      Cell* cell;
+      size_t pos = enqueue_pos.load(std::memory_order_relaxed);
+      while (true) {
+        cell = &cells[pos & mask];
+        size_t seq = cell->seq.load(std::memory_order_acquire);
+        intptr_t diff = intptr_t(seq) - intptr_t(pos);
+        if (diff == 0) {
+          if (enqueue_pos.compare_exchange_weak(pos, pos + 1,
+                std::memory_order_relaxed)) {
+            break;
+          }
+        }
+        else if (diff < 0) {
+          return false;
+        }
+        else {
+          pos = enqueue_pos.load(std::memory_order_relaxed);
+        }
+      }
+      cell->item = item;
+      cell->seq.store(pos + 1, std::memory_order_release);
+      return true;
+    }
+
+    /// Returns NULL if the queue is empty.
+    T* Pop() {
+      Cell* cell;
+      size_t pos = dequeue_pos.load(std::memory_order_relaxed);
+      while (true) {
+        cell = &cells[pos & mask];
+        size_t seq = cell->seq.load(std::memory_order_acquire);
+        intptr_t diff = intptr_t(seq) - intptr_t(pos + 1);
+        if (diff == 0) {
+          if (dequeue_pos.compare_exchange_weak(pos, pos + 1,
+                std::memory_order_relaxed)) {
+            break;
+          }
+        }
+        else if (diff < 0) {
+          return NULL;
+        }
+        else {
+          pos = dequeue_pos.load(std::memory_order_relaxed);
+        }
+      }
+      T* item = cell->item;
+      cell->seq.store(pos + mask + 1, std::memory_order_release);
+      return item;
+    }
+
+    size_t Capacity() const { return mask + 1; }
+
+    private:
+    BoundedQueue(const BoundedQueue& other);
+    BoundedQueue& operator=(const BoundedQueue& other);
+
+    struct Cell {
+      std::atomic<size_t> seq;
+      T* item;
+    };
+
+    Cell* cells;
+    size_t mask;
+    // Separate cache lines so producers and the consumer do not contend.
+    alignas(64) std::atomic<size_t> enqueue_pos;
+    alignas(64) std::atomic<size_t> dequeue_pos;
+  };
+
+
+  /// A process-wide lock-free pool of small memory blocks.
+  /** Blocks are grouped in size classes of 64 bytes up to max_pooled, and
+   *  each class keeps up to pool_depth freed blocks for reuse.  Larger
+   *  requests, an empty class, or a full class fall through to the global
+   *  operator new and delete, so the pool never fails.  Freeing may happen
+   *  on a different thread from allocation.
+   */
+  class BlockPool {
+    public:
+    static const size_t class_size = 64;
+    static const size_t max_pooled = 512;
+    static const size_t pool_depth = 1024;
+
+    static void* Allocate(size_t size) {
+      if (size > max_pooled) {
+        return ::operator new(size);
+      }
+      size_t c = SizeClass(size);
+      void* block = FreeList(c).Pop();
+      if (block == NULL) {
+        block = ::operator new((c+1) * class_size);
+      }
+      return block;
+    }
+
+    static void Free(void* block, size_t size) {
+      if (block == NULL) {
+        return;
+      }
+      if (size > max_pooled || !FreeList(SizeClass(size)).Push(block)) {
+        ::operator delete(block);
+      }
+    }
+
+    private:
+    static size_t SizeClass(size_t size) {
+      return (size == 0) ? 0 : (size - 1) / class_size;
+    }
+
+    static BoundedQueue<void>& FreeList(size_t c) {
+      // Intentionally never destructed, so blocks can be freed during
+      // static destruction.
+      static BoundedQueue<void>* lists[max_pooled / class_size] = {
+        new BoundedQueue<void>(pool_depth), new BoundedQueue<void>(pool_depth),
+        new BoundedQueue<void>(pool_depth), new BoundedQueue<void>(pool_depth),
+        new BoundedQueue<void>(pool_depth), new BoundedQueue<void>(pool_depth),
+        new BoundedQueue<void>(pool_depth), new BoundedQueue<void>(pool_depth)
+      };
+      return *lists[c];
+    }
+  };
+}
+
+#endif // TASKQUEUE_H
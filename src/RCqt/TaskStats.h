@@ -0,0 +1,148 @@
+//////////////////////////////////////////////////////////////////////////
+//
+// RCqt Library
+//
+// Distributed under the Boost Software License, v1.0. (LICENSE.txt)
+//
+// TaskStats - Lock-free per-task timing histograms, recorded by Worker for
+// the queue wait and handler runtime of every task.
+//
+//////////////////////////////////////////////////////////////////////////
+
+#ifndef TASKSTATS_H
+#define TASKSTATS_H
+
+#include "../RC/RCconfig.h"
+#include "../RC/Data1D.h"
+#include "../RC/RStr.h"
+#include "../RC/Types.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+
+namespace RCqt {
+  /// A summary of a LatencyHistogram at one point in time.
+  class LatencySummary {
+    public:
+    u64 count = 0;
+    f64 mean_us = 0;
+    // Percentiles are the upper edge of the bin they fall in.
+    f64 p50_us = 0;
+    f64 p99_us = 0;
+    f64 max_us = 0;
+  };
+
+
+  /// A lock-free histogram of durations, in power of 2 microsecond bins.
+  /** Bin 0 holds durations under 1us, and bin i holds [2^(i-1), 2^i) us,
+   *  with the last bin open ended.  Recording is a handful of relaxed
+   *  atomic operations and safe from any thread.
+   */
+  class LatencyHistogram {
+    public:
+    static const size_t num_bins = 32;
+
+    LatencyHistogram() {
+      for (size_t i=0; i<num_bins; i++) {
+        bins[i].store(0, std::memory_order_relaxed);
+      }
+    }
+
+    void Record(u64 ns) {
+      u64 us = ns / 1000;
+      size_t bin = 0;
+      while (us > 0 && bin < num_bins-1) {
+        us >>= 1;
+        bin++;
+      }
+      bins[bin].fetch_add(1, std::memory_order_relaxed);
+      count.fetch_add(1, std::memory_order_relaxed);
+      total_ns.fetch_add(ns, std::memory_order_relaxed);
+      u64 prev = max_ns.load(std::memory_order_relaxed);
+      while (prev < ns &&
+             !max_ns.compare_exchange_weak(prev, ns,
+               std::memory_order_relaxed)) {
+      }
+    }
+
+    LatencySummary Summary() const {
+      LatencySummary summary;
+      u64 counts[num_bins];
+      for (size_t i=0; i<num_bins; i++) {
+        counts[i] = bins[i].load(std::memory_order_relaxed);
+        summary.count += counts[i];
+      }
+      if (summary.count == 0) {
+        return summary;
+      }
+      summary.mean_us = total_ns.load(std::memory_order_relaxed) * 1e-3 /
+        count.load(std::memory_order_relaxed);
+      summary.max_us = max_ns.load(std::memory_order_relaxed) * 1e-3;
+      summary.p50_us = std::min(summary.max_us,
+          Percentile(counts, summary.count, 0.50));
+      summary.p99_us = std::min(summary.max_us,
+          Percentile(counts, summary.count, 0.99));
+      return summary;
+    }
+
+    private:
+    LatencyHistogram(const LatencyHistogram& other);
+    LatencyHistogram& operator=(const LatencyHistogram& other);
+
+    static f64 Percentile(const u64* counts, u64 total, f64 frac) {
+      u64 target = u64(frac * total);
+      u64 sum = 0;
+      for (size_t i=0; i<num_bins; i++) {
+        sum += counts[i];
+        if (sum > target) {
+          return f64(u64(1) << i);
+        }
+      }
+      return f64(u64(1) << (num_bins-1));
+    }
+
+    std::atomic<u64> bins[num_bins];
+    std::atomic<u64> count{0};
+    std::atomic<u64> total_ns{0};
+    std::atomic<u64> max_ns{0};
+  };
+
+
+  /// The timing histograms for one named task on one Worker.
+  class TaskStats {
+    public:
+    TaskStats(const RC::RStr& name) : name(name) { }
+
+    static u64 Now() {
+      return u64(std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::steady_clock::now().time_since_epoch()).count());
+    }
+
+    const RC::RStr name;
+    // From the task being called to its handler starting.
+    LatencyHistogram wait;
+    // The handler's own runtime.
+    LatencyHistogram run;
+  };
+
+
+  class TaskStatsSnapshot {
+    public:
+    RC::RStr name;
+    LatencySummary wait;
+    LatencySummary run;
+  };
+
+
+  class WorkerStatsSnapshot {
+    public:
+    // Tasks queued or running when the snapshot was taken.
+    u64 queue_depth = 0;
+    u64 peak_queue_depth = 0;
+    // Only tasks that have run at least once.
+    RC::Data1D<TaskStatsSnapshot> tasks;
+  };
+}
+
+#endif // TASKSTATS_H
+
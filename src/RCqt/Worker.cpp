@@ -8,6 +8,7 @@
 
 #include "Worker.h"
 #include <QCoreApplication>
+#include <QMutexLocker>
 #include <QMetaType>
 #include <QObject>
 
@@ -39,11 +40,20 @@ namespace RCqt {
 
     connect(this, &WorkerQObject::TerminateIfEmptySignal,
             this, &WorkerQObject::TerminateIfEmptySlot, Qt::QueuedConnection);
+
+    // Always queued, so draining happens in the worker's event loop.
+    connect(this, &WorkerQObject::DoDrain, this, &WorkerQObject::DrainSlot,
+            Qt::QueuedConnection);
   }
 
 
   Worker::Worker(bool run_as_new_thread)
-    : worker_qobject(this) {
+    : worker_qobject(this)
+#ifdef RCQT_LOCKFREE_QUEUE
+    , queue(queue_capacity)
+    , drain_pending(false)
+#endif
+    {
 
     worker_map_mutex.lock();
     worker_map.insert(MapPair(this, this));
@@ -58,6 +68,9 @@ namespace RCqt {
 
   Worker::~Worker() {
     ExitWait();
+#ifdef RCQT_LOCKFREE_QUEUE
+    DiscardQueue();
+#endif
 
     worker_map_mutex.lock();
     worker_map.erase(this);
@@ -74,6 +87,113 @@ namespace RCqt {
   }
 
 
+#ifdef RCQT_LOCKFREE_QUEUE
+  // Deletes a command on scope exit, including during exception unwinding,
+  // then releases any caller blocked on it.
+  class CommandFinisher {
+    public:
+    CommandFinisher(WorkerCommand* cmd) : cmd(cmd) { }
+    ~CommandFinisher() {
+      QSemaphore* done = cmd->done;
+      delete cmd;
+      if (done) {
+        done->release();
+      }
+    }
+    private:
+    WorkerCommand* cmd;
+  };
+
+
+  void Worker::Post(WorkerCommand* cmd, TaskType task_type) {
+    // Same-thread and direct calling run immediately, as the Qt
+    // AutoConnection does for the default backend.
+    if ( (direct_calling && KeepGoing()) ||
+         (QThread::currentThread() == worker_qobject.thread()) ) {
+      CommandFinisher finisher(cmd);
+      if (KeepGoing()) {
+        cmd->Execute();
+      }
+      return;
+    }
+
+    if (task_type != BLOCKTASK) {
+      Enqueue(cmd);
+      return;
+    }
+
+    QSemaphore done;
+    cmd->done = &done;
+    Enqueue(cmd);
+    // If the worker exits with this still queued, discard it ourselves.
+    while (!done.tryAcquire(1, 20)) {
+      if (IsDisabled() && !thread.isRunning()) {
+        DiscardQueue();
+      }
+    }
+  }
+
+
+  void Worker::Enqueue(WorkerCommand* cmd) {
+    while (!queue.Push(cmd)) {
+      if (IsDisabled()) {
+        CommandFinisher finisher(cmd);
+        return;
+      }
+      QThread::yieldCurrentThread();
+    }
+    WakeForDrain();
+  }
+
+
+  // Queued by Abort so that it ends in queue order, skipping only the
+  // commands posted before it, as the queued DoneAbort signal does for the
+  // default backend.
+  class AbortDoneCommand : public WorkerCommand {
+    public:
+    AbortDoneCommand(RC::Ptr<Worker> worker) : WorkerCommand(worker) {
+      ends_abort = true;
+    }
+    void Run() { }
+  };
+
+
+  void Worker::EnqueueAbortDone() {
+    WorkerCommand* cmd = new AbortDoneCommand(this);
+    if (QThread::currentThread() != worker_qobject.thread()) {
+      Enqueue(cmd);
+      return;
+    }
+
+    // Never wait on our own full queue.  The rare fallback ends the abort
+    // from the event loop instead.
+    if (queue.Push(cmd)) {
+      WakeForDrain();
+    }
+    else {
+      CommandFinisher finisher(cmd);
+      worker_qobject.EmitDoneAbort();
+    }
+  }
+
+
+  void Worker::WakeForDrain() {
+    // Only one drain signal is outstanding at a time.
+    if (!drain_pending.exchange(true)) {
+      worker_qobject.EmitDrain();
+    }
+  }
+
+
+  void Worker::DiscardQueue() {
+    WorkerCommand* cmd;
+    while ((cmd = queue.Pop()) != NULL) {
+      CommandFinisher finisher(cmd);
+    }
+  }
+#endif
+
+
   void Worker::ExitAllWorkers() {
     bool empty = false;
     while (!empty) {
@@ -132,6 +252,43 @@ namespace RCqt {
   }
 
 
+  RC::Ptr<TaskStats> Worker::GetTaskStats(const char* name) {
+    std::string key = (name == NULL) ? "unnamed" : name;
+    const std::string suffix = "_Handler";
+    if (key.size() > suffix.size() &&
+        key.compare(key.size()-suffix.size(), suffix.size(), suffix) == 0) {
+      key.erase(key.size()-suffix.size());
+    }
+
+    QMutexLocker lock(&stats_mutex);
+    auto it = task_stats.find(key);
+    if (it == task_stats.end()) {
+      it = task_stats.insert(std::make_pair(key,
+            RC::APtr<TaskStats>(new TaskStats(key)))).first;
+    }
+    return it->second.Raw();
+  }
+
+
+  WorkerStatsSnapshot Worker::StatsSnapshot() const {
+    WorkerStatsSnapshot snapshot;
+    snapshot.queue_depth = task_count.Count();
+    snapshot.peak_queue_depth = task_count.Peak();
+
+    QMutexLocker lock(&stats_mutex);
+    for (auto& entry : task_stats) {
+      TaskStatsSnapshot task;
+      task.name = entry.second->name;
+      task.wait = entry.second->wait.Summary();
+      task.run = entry.second->run.Summary();
+      if (task.run.count > 0) {
+        snapshot.tasks += task;
+      }
+    }
+    return snapshot;
+  }
+
+
   bool Worker::IsMapEmpty() {
     worker_map_mutex.lock();     // LOCK
     bool do_terminate = false;
@@ -148,7 +305,7 @@ namespace RCqt {
     if (Worker::direct_calling && worker->KeepGoing()) {
       // To happen only if multithreading not active yet.
       // Enabled with Worker::DirectCallingScope
-      cmd->Run();
+      cmd->Execute();
     }
     else {
       switch(task_type) {
@@ -169,8 +326,40 @@ namespace RCqt {
 
   void WorkerQObject::CommandSlot(RC::APtr<WorkerCommand> cmd) const {
     if (worker->KeepGoing()) {
-      cmd->Run();
+      cmd->Execute();
+    }
+  }
+
+
+  void WorkerQObject::DrainSlot() {
+#ifdef RCQT_LOCKFREE_QUEUE
+    // Clear first, so a command pushed during the drain signals again.
+    worker->drain_pending.store(false);
+
+    // Bounded, so other events like timers still get serviced.
+    size_t limit = worker->queue.Capacity();
+    for (size_t i=0; i<limit; i++) {
+      WorkerCommand* cmd = worker->queue.Pop();
+      if (cmd == NULL) {
+        return;
+      }
+
+      CommandFinisher finisher(cmd);
+      if (cmd->ends_abort) {
+        worker->abort_level.Lower();
+      }
+      else if (worker->KeepGoing()) {
+        try {
+          cmd->Execute();
+        }
+        catch (...) {
+          worker->WakeForDrain();  // Don't strand the rest of the queue.
+          throw;
+        }
+      }
     }
+    worker->WakeForDrain();
+#endif
   }
 
 
@@ -189,6 +378,9 @@ namespace RCqt {
     }
     Worker::worker_map_mutex.unlock();
     worker->thread.exit(0);
+#ifdef RCQT_LOCKFREE_QUEUE
+    worker->DiscardQueue();
+#endif
     if (do_terminate) {
       DoTerminate();
     }
@@ -226,6 +418,19 @@ namespace RCqt {
     }
   }
 
+  void WorkerCommand::Execute() {
+    if (stats.IsNull()) {
+      Run();
+      return;
+    }
+
+    u64 start_ns = TaskStats::Now();
+    stats->wait.Record(start_ns - enqueue_ns);
+    Run();
+    stats->run.Record(TaskStats::Now() - start_ns);
+  }
+
+
   WorkerCommand::~WorkerCommand() {
     worker->task_count.Dec();
   }
@@ -50,6 +50,7 @@
 // TaskCaller<ParameterTypes...>              // This is asynchronous.
 // TaskBlocker<ParameterTypes...>             // This blocks until completion.
 // TaskGetter<ReturnType, ParameterTypes...>  // This blocks with return value.
+// TaskCoalescer<ParameterType>               // Asynchronous, newest only.
 //
 // Each caller must then be initialized to a handler with the TaskHandler
 // convenience macro, which takes a non-overloaded fully qualified member
@@ -72,6 +73,18 @@
 // a reference.  Also, the Task functor always receives parameters by
 // reference.
 //
+// TaskCoalescer is for frequent updates where only the current state matters,
+// such as display refreshes.  Values passed while one is already pending are
+// held in a bounded lock-free buffer, and when the single queued task runs
+// the handler receives only the newest, or the result of an optional merge
+// function applied to all of them in call order.  The caller never blocks,
+// and a stalled Worker accumulates at most one queued task per coalescer.
+// Because the pending values are delivered at the position of the first,
+// they can run ahead of other tasks queued on the same Worker after it.
+//
+//   TaskCoalescer<const string> SetStatus =
+//     TaskHandler(MyWorker::SetStatus_Handler);
+//
 // Efficiency notes:
 //
 //   When the ParameterTypes are by value, the copy constructor is called
@@ -86,6 +99,24 @@
 //   When TaskGetter's ReturnType is a reference, no copy constructors or
 //   assignment operators are called.
 //
+// Telemetry:
+//
+//   Each Worker times every task from the call to the handler starting, and
+//   the handler's runtime, into lock-free histograms per task name.  Tasks
+//   initialized with TaskHandler are named after their handler, and others
+//   are grouped as "unnamed".  StatsSnapshot() reads them from any thread.
+//
+// Queue backends:
+//
+//   By default each task is a heap allocated command sent through a Qt
+//   queued signal.  Defining RCQT_LOCKFREE_QUEUE instead sends commands
+//   through a bounded lock-free queue per Worker, with command objects
+//   drawn from a lock-free BlockPool, and a Qt signal only to wake an idle
+//   Worker.  Task ordering, blocking, same-thread direct calling, and Abort
+//   semantics are the same in both:  Abort skips the tasks posted before
+//   it, and tasks posted after it run.  A producer finding the queue full
+//   yields until there is space.
+//
 ////////////////////////////////////////////////////////////////////////////
 
 
@@ -96,18 +127,25 @@
 #include "../RC/Ptr.h"
 #include "../RC/APtr.h"
 #include "../RC/Caller.h"
+#include "../RC/Data1D.h"
 #include "../RC/RTime.h"
 #include "../RC/Tuple.h"
+#include "TaskQueue.h"
+#include "TaskStats.h"
+#include <atomic>
 #include <map>
+#include <string>
 #include <QMutex>
+#include <QSemaphore>
 #include <QThread>
+#include <type_traits>
 
 #ifndef CPP11
 #error "Error, C++11 is required."
 #endif
 
 
-#define TaskHandler(func) {this, RC::MakeCaller(this, &func)}
+#define TaskHandler(func) {this, RC::MakeCaller(this, &func), #func}
 
 namespace RCqt {
   enum TaskType { AUTOTASK, BLOCKTASK };
@@ -131,6 +169,10 @@ namespace RCqt {
       void DoFinalExit();
       void TerminateIfEmptySignal();
     private slots:  void CommandSlot(RC::APtr<WorkerCommand> cmd) const;
+
+    public:  void EmitDrain() { emit DoDrain(); }
+    private: signals:  void DoDrain();
+    private slots:  void DrainSlot();
     private:  void DoTerminate();
               void QueueTerminateIfEmpty();
 
@@ -171,40 +213,33 @@ namespace RCqt {
     class AbortLevel {
       public:
       AbortLevel() : level(0), disabled(false) {}
-      void Raise() { mutex.lock(); level++; mutex.unlock(); }
-      void Lower() { mutex.lock(); level--; mutex.unlock(); }
-      bool ShouldAbort() const {
-        bool ret;
-        mutex.lock();
-        ret = disabled || (level > 0);
-        mutex.unlock();
-        return ret;
-      }
-      void Disable() { mutex.lock(); disabled = true; mutex.unlock(); }
-      bool IsDisabled() const {
-        bool ret;
-        mutex.lock();
-        ret = disabled;
-        mutex.unlock();
-        return ret;
-      }
+      void Raise() { level++; }
+      void Lower() { level--; }
+      bool ShouldAbort() const { return disabled || (level > 0); }
+      void Disable() { disabled = true; }
+      bool IsDisabled() const { return disabled; }
       private:
-      mutable QMutex mutex;
-      u64 level;
-      bool disabled;
+      std::atomic<u64> level;
+      std::atomic<bool> disabled;
     };
 
 
     class TaskCount {
       public:
-      TaskCount() : count(0) {}
-      void Inc() { mutex.lock(); count++; mutex.unlock(); }
-      void Dec() { mutex.lock(); count--; mutex.unlock(); }
-      u64 Count() const {
-        u64 ret; mutex.lock(); ret=count; mutex.unlock(); return ret; }
+      TaskCount() : count(0), peak(0) {}
+      void Inc() {
+        u64 now = ++count;
+        u64 prev = peak.load(std::memory_order_relaxed);
+        while (prev < now && !peak.compare_exchange_weak(prev, now,
+                std::memory_order_relaxed)) {
+        }
+      }
+      void Dec() { count--; }
+      u64 Count() const { return count; }
+      u64 Peak() const { return peak; }
       private:
-      mutable QMutex mutex;
-      u64 count;
+      std::atomic<u64> count;
+      std::atomic<u64> peak;
     };
 
 
@@ -216,6 +251,11 @@ namespace RCqt {
     void CommandEmitter(RC::APtr<WorkerCommand> &cmd,
                         TaskType task_type=AUTOTASK) const;
 
+#ifdef RCQT_LOCKFREE_QUEUE
+    // Takes ownership of cmd.
+    void Post(WorkerCommand* cmd, TaskType task_type=AUTOTASK);
+#endif
+
     private:  // Disallow
     inline Worker(const Worker& other);
     inline Worker& operator=(const Worker& other);
@@ -230,7 +270,11 @@ namespace RCqt {
 
     void Abort() {
       abort_level.Raise();
+#ifdef RCQT_LOCKFREE_QUEUE
+      EnqueueAbortDone();
+#else
       worker_qobject.EmitDoneAbort();
+#endif
     }
     bool ShouldAbort() const { return abort_level.ShouldAbort(); }
     bool KeepGoing() const { return ! ShouldAbort(); }
@@ -256,17 +300,38 @@ namespace RCqt {
       return task_count.Count();
     }
 
+    // Returns the histograms for the named task, creating them if needed.
+    // A trailing "_Handler" is dropped from the name, and NULL is "unnamed".
+    RC::Ptr<TaskStats> GetTaskStats(const char* name);
+    WorkerStatsSnapshot StatsSnapshot() const;
+
 
     private:
 
     static bool IsMapEmpty();
 
+#ifdef RCQT_LOCKFREE_QUEUE
+    void Enqueue(WorkerCommand* cmd);
+    void EnqueueAbortDone();
+    void WakeForDrain();
+    void DiscardQueue();
+#endif
+
     QThread thread;
 
     AbortLevel abort_level;
     TaskCount task_count;
     WorkerQObject worker_qobject;
 
+#ifdef RCQT_LOCKFREE_QUEUE
+    static const size_t queue_capacity = 4096;
+    BoundedQueue<WorkerCommand> queue;
+    std::atomic<bool> drain_pending;
+#endif
+
+    mutable QMutex stats_mutex;
+    std::map<std::string, RC::APtr<TaskStats>> task_stats;
+
     static QMutex safe_delete;
     static QMutex worker_map_mutex;
     static MapType worker_map;
@@ -278,11 +343,34 @@ namespace RCqt {
 
   class WorkerCommand {
     public:
-    WorkerCommand(RC::Ptr<Worker> worker) : worker(worker) {
+    WorkerCommand(RC::Ptr<Worker> worker)
+      : enqueue_ns(TaskStats::Now())
+      , worker(worker) {
       worker->task_count.Inc();
     }
     virtual ~WorkerCommand();
     virtual void Run() = 0;
+
+    // Run, recording the wait and runtime into stats if set.
+    void Execute();
+
+    u64 enqueue_ns;
+    RC::Ptr<TaskStats> stats;
+
+#ifdef RCQT_LOCKFREE_QUEUE
+    static void* operator new(size_t size) {
+      return BlockPool::Allocate(size);
+    }
+    static void operator delete(void* ptr, size_t size) {
+      BlockPool::Free(ptr, size);
+    }
+
+    // Released after the command is finished or discarded, for blocking.
+    QSemaphore* done = NULL;
+    // Marks the end of an Abort in queue order, in place of DoneAbort.
+    bool ends_abort = false;
+#endif
+
     private:
     WorkerCommand(const WorkerCommand& other);
     WorkerCommand& operator=(const WorkerCommand& other);
@@ -365,19 +453,36 @@ namespace RCqt {
     public:
     BaseTaskClass() { }
     BaseTaskClass(const RC::Ptr<Worker>& worker,
-                  const RC::Caller<void, Params&...>& handler)
+                  const RC::Caller<void, Params&...>& handler,
+                  const char* name=NULL)
       : worker(worker)
       , handler(handler) {
+      if (worker.IsSet()) {
+        stats = this->worker->GetTaskStats(name);
+      }
+    }
+    BaseTaskClass(const RC::Ptr<Worker>& worker,
+                  const RC::Caller<void, Params&...>& handler,
+                  const RC::Ptr<TaskStats>& stats)
+      : worker(worker)
+      , handler(handler)
+      , stats(stats) {
     }
 
     virtual void operator()(Params&... params) const {
-      RC::APtr<WorkerCommand> cmd =
+      WorkerCommand* cmd =
         new CommandTempl<void, Params...>(worker, handler, params...);
-      worker->CommandEmitter(cmd, task_type);
+      cmd->stats = stats;
+#ifdef RCQT_LOCKFREE_QUEUE
+      worker.Raw()->Post(cmd, task_type);
+#else
+      RC::APtr<WorkerCommand> cmd_ptr = cmd;
+      worker->CommandEmitter(cmd_ptr, task_type);
+#endif
     }
 
     virtual RC::CallerBase<void, Params&...>* Copy() const {
-      return new BaseTaskClass<task_type, Params...>(worker, handler);
+      return new BaseTaskClass<task_type, Params...>(worker, handler, stats);
     }
 
     /// Call the referenced function.
@@ -402,19 +507,26 @@ namespace RCqt {
     protected:
     RC::Ptr<Worker> worker;
     RC::Caller<void, Params&...> handler;
+    RC::Ptr<TaskStats> stats;
   };
 
   template<class... Params>
   class TaskCaller : public BaseTaskClass<AUTOTASK, Params...> {
     public:
     TaskCaller() { }
-    TaskCaller(RC::Ptr<Worker> worker, RC::Caller<void, Params&...> handler)
-      : BaseTaskClass<AUTOTASK, Params...>(worker, handler) {
+    TaskCaller(RC::Ptr<Worker> worker, RC::Caller<void, Params&...> handler,
+               const char* name=NULL)
+      : BaseTaskClass<AUTOTASK, Params...>(worker, handler, name) {
+    }
+    TaskCaller(RC::Ptr<Worker> worker, RC::Caller<void, Params&...> handler,
+               RC::Ptr<TaskStats> stats)
+      : BaseTaskClass<AUTOTASK, Params...>(worker, handler, stats) {
     }
     virtual RC::CallerBase<void, Params&...>* Copy() const {
       return new TaskCaller<Params...>(
           BaseTaskClass<AUTOTASK, Params...>::worker,
-          BaseTaskClass<AUTOTASK, Params...>::handler);
+          BaseTaskClass<AUTOTASK, Params...>::handler,
+          BaseTaskClass<AUTOTASK, Params...>::stats);
     }
   };
 
@@ -422,13 +534,19 @@ namespace RCqt {
   class TaskBlocker : public BaseTaskClass<BLOCKTASK, Params...> {
     public:
     TaskBlocker() { }
-    TaskBlocker(RC::Ptr<Worker> worker, RC::Caller<void, Params&...> handler)
-      : BaseTaskClass<BLOCKTASK, Params...>(worker, handler) {
+    TaskBlocker(RC::Ptr<Worker> worker, RC::Caller<void, Params&...> handler,
+                const char* name=NULL)
+      : BaseTaskClass<BLOCKTASK, Params...>(worker, handler, name) {
+    }
+    TaskBlocker(RC::Ptr<Worker> worker, RC::Caller<void, Params&...> handler,
+                RC::Ptr<TaskStats> stats)
+      : BaseTaskClass<BLOCKTASK, Params...>(worker, handler, stats) {
     }
     virtual RC::CallerBase<void, Params&...>* Copy() const {
       return new TaskBlocker<Params...>(
           BaseTaskClass<BLOCKTASK, Params...>::worker,
-          BaseTaskClass<BLOCKTASK, Params...>::handler);
+          BaseTaskClass<BLOCKTASK, Params...>::handler,
+          BaseTaskClass<BLOCKTASK, Params...>::stats);
     }
   };
 
@@ -436,24 +554,40 @@ namespace RCqt {
   class TaskGetter : public RC::CallerBase<RetType, Params&...> {
     public:
     TaskGetter() { }
-    TaskGetter(RC::Ptr<Worker> worker, RC::Caller<RetType, Params&...> handler)
+    TaskGetter(RC::Ptr<Worker> worker, RC::Caller<RetType, Params&...> handler,
+               const char* name=NULL)
       : worker(worker)
       , handler(handler) {
+      if (worker.IsSet()) {
+        stats = worker->GetTaskStats(name);
+      }
+    }
+    TaskGetter(RC::Ptr<Worker> worker, RC::Caller<RetType, Params&...> handler,
+               RC::Ptr<TaskStats> stats)
+      : worker(worker)
+      , handler(handler)
+      , stats(stats) {
     }
     virtual RetType operator()(Params&... params) const {
       RetType retval;
-      RC::APtr<WorkerCommand> cmd =
-        new CommandTempl<RetType, Params...>
+      WorkerCommand* cmd = new CommandTempl<RetType, Params...>
               (worker, handler, retval, params...);
-      worker->CommandEmitter(cmd, BLOCKTASK);
+      cmd->stats = stats;
+#ifdef RCQT_LOCKFREE_QUEUE
+      worker.Raw()->Post(cmd, BLOCKTASK);
+#else
+      RC::APtr<WorkerCommand> cmd_ptr = cmd;
+      worker->CommandEmitter(cmd_ptr, BLOCKTASK);
+#endif
       return retval;
     }
     virtual RC::CallerBase<RetType, Params&...>* Copy() const {
-      return new TaskGetter<RetType, Params...>(worker, handler);
+      return new TaskGetter<RetType, Params...>(worker, handler, stats);
     }
     protected:
     RC::Ptr<Worker> worker;
     RC::Caller<RetType, Params&...> handler;
+    RC::Ptr<TaskStats> stats;
   };
 
 
@@ -462,24 +596,162 @@ namespace RCqt {
       : public RC::CallerBase<RetType&, Params&...> {
     public:
     TaskGetter() { }
-    TaskGetter(RC::Ptr<Worker> worker, RC::Caller<RetType&, Params&...> handler)
+    TaskGetter(RC::Ptr<Worker> worker, RC::Caller<RetType&, Params&...> handler,
+               const char* name=NULL)
       : worker(worker)
       , handler(handler) {
+      if (worker.IsSet()) {
+        stats = worker->GetTaskStats(name);
+      }
+    }
+    TaskGetter(RC::Ptr<Worker> worker, RC::Caller<RetType&, Params&...> handler,
+               RC::Ptr<TaskStats> stats)
+      : worker(worker)
+      , handler(handler)
+      , stats(stats) {
     }
     virtual RetType& operator()(Params&... params) const {
       RC::Ptr<RetType> retval;
-      RC::APtr<WorkerCommand> cmd =
-        new CommandTempl<RetType&, Params...>
+      WorkerCommand* cmd = new CommandTempl<RetType&, Params...>
               (worker, handler, retval, params...);
-      worker->CommandEmitter(cmd, BLOCKTASK);
+      cmd->stats = stats;
+#ifdef RCQT_LOCKFREE_QUEUE
+      worker.Raw()->Post(cmd, BLOCKTASK);
+#else
+      RC::APtr<WorkerCommand> cmd_ptr = cmd;
+      worker->CommandEmitter(cmd_ptr, BLOCKTASK);
+#endif
       return *retval;
     }
     virtual RC::CallerBase<RetType&, Params&...>* Copy() const {
-      return new TaskGetter<RetType&, Params...>(worker, handler);
+      return new TaskGetter<RetType&, Params...>(worker, handler, stats);
     }
     protected:
     RC::Ptr<Worker> worker;
     RC::Caller<RetType&, Params&...> handler;
+    RC::Ptr<TaskStats> stats;
+  };
+
+
+  template<class Param>
+  class TaskCoalescer : public RC::CallerBase<void, Param&> {
+    static_assert(!std::is_reference<Param>::value,
+        "TaskCoalescer parameters must be by value.");
+
+    public:
+    using Value = typename std::remove_const<Param>::type;
+    // Receives two or more pending values, oldest first.
+    using MergeFunc = RC::Caller<Value, RC::Data1D<Value>&>;
+
+    static const size_t default_capacity = 256;
+
+    TaskCoalescer() { }
+    TaskCoalescer(RC::Ptr<Worker> worker, RC::Caller<void, Param&> handler,
+                  const char* name=NULL)
+      : state(new State(worker, handler, MergeFunc(), default_capacity,
+                        name)) {
+    }
+    TaskCoalescer(RC::Ptr<Worker> worker, RC::Caller<void, Param&> handler,
+                  MergeFunc merge, const char* name=NULL,
+                  size_t capacity=default_capacity)
+      : state(new State(worker, handler, merge, capacity, name)) {
+    }
+
+    virtual void operator()(Param& param) const {
+      state.Raw()->Add(state, param);
+    }
+
+    virtual RC::CallerBase<void, Param&>* Copy() const {
+      return new TaskCoalescer<Param>(*this);
+    }
+
+    virtual bool IsSet() { return state.IsSet(); }
+
+    /// The number of values discarded unseen because the buffer was full.
+    u64 Dropped() const { return state->dropped; }
+
+    protected:
+    class State {
+      public:
+      State(RC::Ptr<Worker> worker, RC::Caller<void, Param&> handler,
+            MergeFunc merge, size_t capacity, const char* name)
+        : worker(worker)
+        , handler(handler)
+        , merge(merge)
+        , queue(capacity)
+        , pending(false)
+        , dropped(0) {
+        stats = worker->GetTaskStats(name);
+      }
+
+      ~State() {
+        Value* value;
+        while ((value = queue.Pop()) != NULL) {
+          delete value;
+        }
+      }
+
+      void Add(const RC::APtr<State>& self, Param& param) {
+        Value* value = new Value(param);
+        while (!queue.Push(value)) {
+          // The Worker has fallen behind by a full buffer, so the oldest
+          // value is stale.
+          Value* oldest = queue.Pop();
+          if (oldest != NULL) {
+            delete oldest;
+            dropped++;
+          }
+        }
+
+        if (!pending.exchange(true)) {
+          RC::APtr<State> keep = self;
+          TaskCaller<> drain(worker, RC::Caller<>([keep]() {
+                keep.Raw()->Drain(); }), stats);
+          drain();
+        }
+      }
+
+      void Drain() {
+        // Cleared before taking values, so any value added after this point
+        // posts another drain.  Only values added before it, which fit in
+        // the buffer, need collecting here.
+        pending.exchange(false);
+
+        RC::Data1D<Value> values;
+        Value* value;
+        for (size_t i=0; i<queue.Capacity() &&
+             (value = queue.Pop()) != NULL; i++) {
+          RC::APtr<Value> owned(value);
+          if (merge.IsSet() || values.IsEmpty()) {
+            values += *owned;
+          }
+          else {
+            values[0] = *owned;
+          }
+        }
+
+        if (values.IsEmpty()) {
+          return;
+        }
+        if (values.size() == 1) {
+          handler(values[0]);
+        }
+        else {
+          Value merged = merge(values);
+          handler(merged);
+        }
+      }
+
+      RC::Ptr<Worker> worker;
+      RC::Caller<void, Param&> handler;
+      MergeFunc merge;
+      BoundedQueue<Value> queue;
+      std::atomic<bool> pending;
+      std::atomic<u64> dropped;
+      RC::Ptr<TaskStats> stats;
+    };
+
+    RC::APtr<State> state;
   };
 
 
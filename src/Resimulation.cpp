@@ -0,0 +1,237 @@
+#include "Resimulation.h"
+#include "RC/File.h"
+#include "RC/Errors.h"
+#include <algorithm>
+#include <cmath>
+#include <unordered_map>
+#include <vector>
+
+namespace CML {
+  bool ResimSettings::ParseArgs(int argc, char* argv[]) {
+    auto Value = [&](int& i) {
+      if (i+1 >= argc) {
+        Throw_RC_Error((RC::RStr("Missing value for ") + argv[i]).c_str());
+      }
+      i++;
+      return RC::RStr(argv[i]);
+    };
+
+    for (int i=1; i<argc; i++) {
+      RC::RStr arg(argv[i]);
+      if (arg == "--resim") {
+        session_dir = Value(i);
+      }
+      else if (arg == "--config") {
+        config_file = Value(i);
+      }
+      else if (arg == "--out") {
+        out_dir = Value(i);
+      }
+      else if (arg == "--tolerance") {
+        tolerance = Value(i).Get_f64();
+      }
+    }
+
+    if ( ! IsSet() ) {
+      return false;
+    }
+    // EDFReplay reads one file, and with rotation eeg_data.edf holds only
+    // the first segment, after which every remaining event would be
+    // delivered at once.
+    if (RC::File::Exists(RC::File::FullPath(session_dir,
+            "eeg_data_segments.json"))) {
+      Throw_RC_Type(File, ("Cannot re-simulate " + session_dir +
+            ", its EEG recording was rotated into segments.").c_str());
+    }
+    if (out_dir.empty()) {
+      out_dir = RC::File::FullPath(session_dir, "resim");
+    }
+    return true;
+  }
+
+
+  JSONFile ResimSettings::SysConfigOverrides() const {
+    JSONFile over;
+    over.Set(std::string("EDFReplay"), "eeg_system");
+    over.Set(RC::File::FullPath(session_dir, "eeg_data.edf").Raw(),
+        "replay_file");
+    over.Set(true, "replay_virtual_clock");
+    over.Set(LoggedEventLog().Raw(), "replay_events");
+    // Only the CereStim simulator may be driven during a re-simulation.
+    over.Set(std::string("CereStim"), "stim_system");
+    over.Set(true, "skip_signal_quality");
+    over.Set(out_dir.Raw(), "data_dir");
+    return over;
+  }
+
+
+  RC::RStr ResimSettings::LoggedEventLog() const {
+    return RC::File::FullPath(session_dir, "event.log");
+  }
+
+
+  RC::RStr ResimSettings::StageConfig() const {
+    if ( ! config_file.empty() ) {
+      return config_file;
+    }
+
+    RC::RStr stage_dir = RC::File::FullPath(out_dir, "config");
+    RC::File::MakeDir(out_dir);
+    RC::File::MakeDir(stage_dir);
+
+    JSONFile conf(RC::File::FullPath(session_dir, "experiment_config.json"));
+    // StartExperiment saves these into the session directory by basename.
+    auto Stage = [&](nlohmann::json& path) {
+      RC::RStr base = RC::File::Basename(path.get<std::string>());
+      RC::File::Copy(RC::File::FullPath(session_dir, base),
+          RC::File::FullPath(stage_dir, base));
+      path = base.Raw();
+    };
+    for (const char* key : {"electrode_config_file",
+        "bipolar_electrode_config_file"}) {
+      if (conf.json.contains(key) && conf.json[key].is_string()) {
+        Stage(conf.json[key]);
+      }
+    }
+    auto classif = conf.json.find("experiment");
+    if (classif != conf.json.end() && classif->contains("classifier") &&
+        (*classif)["classifier"].contains("classifier_file")) {
+      Stage((*classif)["classifier"]["classifier_file"]);
+    }
+
+    RC::RStr staged = RC::File::FullPath(stage_dir, "experiment_config.json");
+    conf.Save(staged);
+    return staged;
+  }
+
+
+  static bool IsClassifierType(const std::string& type) {
+    auto EndsWith = [&](const std::string& suffix) {
+      return type.size() >= suffix.size() &&
+        type.compare(type.size()-suffix.size(), suffix.size(), suffix) == 0;
+    };
+    return EndsWith("_CLASSIFY") || EndsWith("_DECISION") ||
+      type.compare(0, 9, "CLASSIFY_") == 0;
+  }
+
+
+  namespace {
+    class ClassifierEntries {
+      public:
+      void Load(const RC::RStr& event_log) {
+        RC::FileRead fr(event_log);
+        RC::Data1D<RC::RStr> lines;
+        fr.ReadAllLines(lines);
+
+        std::unordered_map<std::string, size_t> occurrences;
+        for (size_t i=0; i<lines.size(); i++) {
+          nlohmann::json line;
+          try {
+            line = nlohmann::json::parse(lines[i].c_str());
+          }
+          catch (...) {
+            continue;
+          }
+          if ( ! line.is_object() || ! line.contains("type") ||
+               ! line["type"].is_string() ) {
+            continue;
+          }
+          std::string type = line["type"];
+          if ( ! IsClassifierType(type) ) {
+            continue;
+          }
+
+          std::string key = type + "/" +
+            (line.contains("id") ? line["id"].dump() : std::string("-"));
+          key += "#" + std::to_string(occurrences[key]++);
+          index[key] = keys.size();
+          keys.push_back(key);
+          data.push_back(line.contains("data") ? line["data"] :
+              nlohmann::json::object());
+        }
+      }
+
+      const nlohmann::json* Find(const std::string& key) const {
+        auto it = index.find(key);
+        return it == index.end() ? nullptr : &data[it->second];
+      }
+
+      std::vector<std::string> keys;
+      std::vector<nlohmann::json> data;
+      std::unordered_map<std::string, size_t> index;
+    };
+  }
+
+
+  JSONFile DiffClassifierLogs(const RC::RStr& logged_file,
+      const RC::RStr& resim_file, f64 tolerance) {
+    ClassifierEntries logged;
+    ClassifierEntries resim;
+    logged.Load(logged_file);
+    resim.Load(resim_file);
+
+    size_t matched = 0;
+    f64 max_result_diff = 0;
+    nlohmann::json mismatches = nlohmann::json::array();
+    nlohmann::json missing = nlohmann::json::array();
+    nlohmann::json extra = nlohmann::json::array();
+
+    for (size_t i=0; i<logged.keys.size(); i++) {
+      const nlohmann::json& before = logged.data[i];
+      const nlohmann::json* after = resim.Find(logged.keys[i]);
+      if (after == nullptr) {
+        missing.push_back(logged.keys[i]);
+        continue;
+      }
+
+      bool same = true;
+      if (before.contains("result") || after->contains("result")) {
+        if (before.contains("result") && after->contains("result") &&
+            before["result"].is_number() && (*after)["result"].is_number()) {
+          f64 diff = std::abs(before["result"].get<f64>() -
+              (*after)["result"].get<f64>());
+          max_result_diff = std::max(max_result_diff, diff);
+          same = diff <= tolerance;
+        }
+        else {
+          same = false;
+        }
+      }
+      if (before.value("decision", nlohmann::json()) !=
+          after->value("decision", nlohmann::json())) {
+        same = false;
+      }
+
+      if (same) {
+        matched++;
+      }
+      else {
+        mismatches.push_back({{"key", logged.keys[i]}, {"logged", before},
+            {"resim", *after}});
+      }
+    }
+
+    for (size_t i=0; i<resim.keys.size(); i++) {
+      if (logged.Find(resim.keys[i]) == nullptr) {
+        extra.push_back(resim.keys[i]);
+      }
+    }
+
+    JSONFile report;
+    report.SetFilename("ResimDiff");
+    report.Set(logged_file.Raw(), "logged_file");
+    report.Set(resim_file.Raw(), "resim_file");
+    report.Set(tolerance, "tolerance");
+    report.Set(logged.keys.size(), "logged_count");
+    report.Set(resim.keys.size(), "resim_count");
+    report.Set(matched, "matched");
+    report.Set(max_result_diff, "max_result_diff");
+    report.json["mismatches"] = mismatches;
+    report.json["missing"] = missing;
+    report.json["extra"] = extra;
+    report.Set(mismatches.empty() && missing.empty() && extra.empty(),
+        "match");
+    return report;
+  }
+}
+
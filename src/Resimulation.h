@@ -0,0 +1,61 @@
+#ifndef RESIMULATION_H
+#define RESIMULATION_H
+
+#include "ConfigFile.h"
+#include "RC/RStr.h"
+#include "RC/Types.h"
+
+namespace CML {
+  /// Settings for re-running a recorded session headless.
+  /** The session's eeg_data.edf and event.log are replayed on a virtual
+   *  clock through the real task, classifier, and stim chain, and the
+   *  recomputed classifier results and stim decisions are diffed against
+   *  the logged ones into resim_diff.json in the new session directory.
+   *  Each run is a separate process with its own output directory, so any
+   *  number can run in parallel.  Sessions recorded with EDF rotation
+   *  are refused, as replay reads a single file.
+   */
+  class ResimSettings {
+    public:
+    /// Reads --resim session_dir [--config file] [--out dir]
+    /// [--tolerance x] from the command line.
+    /** @return False if --resim is not present.
+     */
+    bool ParseArgs(int argc, char* argv[]);
+
+    /// The sys_config.json values that replay session_dir.
+    JSONFile SysConfigOverrides() const;
+
+    /// The experiment config to open for the re-simulation.
+    /** Without --config, the session's saved experiment_config.json and the
+     *  electrode and classifier files copied beside it are staged into
+     *  out_dir/config, with paths pointing at the copies.
+     */
+    RC::RStr StageConfig() const;
+
+    bool IsSet() const { return ! session_dir.empty(); }
+    RC::RStr LoggedEventLog() const;
+
+    RC::RStr session_dir;
+    // An experiment config to use in place of the session's own.
+    RC::RStr config_file;
+    // The ElememData directory for the new session, session_dir/resim by
+    // default.
+    RC::RStr out_dir;
+    // The largest classifier result difference counted as a match.
+    f64 tolerance = 1e-9;
+  };
+
+
+  /// Compares the classifier results and stim decisions of two event logs.
+  /** Entries of each *_CLASSIFY and *_DECISION type are matched by type,
+   *  id, and order of occurrence.
+   *  @return A report whose "match" is true if every entry is present in
+   *  both with results within tolerance and equal decisions.
+   */
+  JSONFile DiffClassifierLogs(const RC::RStr& logged_file,
+      const RC::RStr& resim_file, f64 tolerance);
+}
+
+#endif // RESIMULATION_H
+
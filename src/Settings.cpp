@@ -25,6 +25,9 @@ namespace CML {
       Throw_RC_Type(File, (sys_conf_file + " could not be opened.").c_str());
     }
     load_sys_conf->Load(fr);
+    if (sys_config_overrides.IsSet()) {
+      load_sys_conf->json.merge_patch(sys_config_overrides->json);
+    }
 
     uint32_t chan_count;
     load_sys_conf->Get(chan_count, "channel_count");
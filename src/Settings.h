@@ -53,6 +53,8 @@ namespace CML {
     size_t GridSize() const;
 
     RC::APtr<const JSONFile> sys_config;
+    // Merged over sys_config.json by LoadSystemConfig when set.
+    RC::APtr<const JSONFile> sys_config_overrides;
 
     RC::APtr<const JSONFile> exp_config;
     RC::APtr<const CSVFile> elec_config;
@@ -27,6 +27,8 @@ namespace CML {
 
     Abort();
     eeg_acq->RegisterEEGMonoCallback("SigQuality", Process);
+    eeg_acq->SetEEGMonoCallbackPolicy("SigQuality",
+        EEGCallbackPolicy::Realtime(this));
     if (meas_seconds > 5) {
       PopupWin("Running " + RC::RStr(meas_seconds) +
           " second signal quality check", "Signal Quality");
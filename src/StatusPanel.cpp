@@ -67,12 +67,34 @@ namespace CML {
     stimming->SetColor(stim_off_color);
   }
 
+  // Negative values come from Clear.
   void StatusPanel::SetSession_Handler(const int64_t& session_num) {
-    session->Set(session_num);
+    if (session_num < 0) {
+      session->Set("");
+    }
+    else {
+      session->Set(session_num);
+    }
   }
 
   void StatusPanel::SetTrial_Handler(const int64_t& trial_num) {
-    trial->Set(trial_num);
+    if (trial_num < 0) {
+      trial->Set("");
+    }
+    else {
+      trial->Set(trial_num);
+    }
+  }
+
+  void StatusPanel::ClearStimList_Handler() {
+    stim_enabled->Set("");
+  }
+
+  void StatusPanel::Clear() {
+    ClearStimList();
+    SetEvent("UNCONFIGURED");
+    SetSession(-1);
+    SetTrial(-1);
   }
 
   void StatusPanel::Clear_Handler() {
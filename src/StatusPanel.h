@@ -20,18 +20,22 @@ namespace CML {
       TaskHandler(StatusPanel::SetExperiment_Handler);
     RCqt::TaskCaller<const bool> SetStimList =
       TaskHandler(StatusPanel::SetStimList_Handler);
-    RCqt::TaskCaller<const RC::RStr> SetEvent =
+    RCqt::TaskCoalescer<const RC::RStr> SetEvent =
       TaskHandler(StatusPanel::SetEvent_Handler);
     RCqt::TaskCaller<const uint32_t> SetStimming =
       TaskHandler(StatusPanel::SetStimming_Handler);
-    RCqt::TaskCaller<const int64_t> SetSession =
+    RCqt::TaskCoalescer<const int64_t> SetSession =
       TaskHandler(StatusPanel::SetSession_Handler);
-    RCqt::TaskCaller<const int64_t> SetTrial =
+    RCqt::TaskCoalescer<const int64_t> SetTrial =
       TaskHandler(StatusPanel::SetTrial_Handler);
-    RCqt::TaskCaller<> Clear =
-      TaskHandler(StatusPanel::Clear_Handler);
+    /// Resets the indicators, through the same coalescers as their
+    /// setters, so that no update made after this is cleared out of order.
+    void Clear();
 
     protected:
+    RCqt::TaskCaller<> ClearStimList =
+      TaskHandler(StatusPanel::ClearStimList_Handler);
+
     void SetSubject_Handler(const RC::RStr& subj);
     void SetExperiment_Handler(const RC::RStr& exp);
     void SetStimList_Handler(const bool& stim_list);
@@ -39,6 +43,7 @@ namespace CML {
     void SetStimming_Handler(const uint32_t& duration_us);
     void SetSession_Handler(const int64_t& session_num);
     void SetTrial_Handler(const int64_t& trial_num);
+    void ClearStimList_Handler();
     void Clear_Handler();
 
     protected slots:
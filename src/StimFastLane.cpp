@@ -0,0 +1,111 @@
+#include "StimFastLane.h"
+#include "RCqt/TaskStats.h"
+#include <future>
+
+#ifdef __linux__
+#include <climits>
+#include <linux/futex.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+namespace CML {
+#ifdef __linux__
+  void WakeFlag::Wake() {
+    word.store(1, std::memory_order_release);
+    syscall(SYS_futex, reinterpret_cast<int*>(&word), FUTEX_WAKE_PRIVATE, 1,
+        NULL, NULL, 0);
+  }
+
+
+  void WakeFlag::Wait() {
+    while (word.exchange(0, std::memory_order_acquire) == 0) {
+      // Returns immediately if word is no longer 0.
+      syscall(SYS_futex, reinterpret_cast<int*>(&word), FUTEX_WAIT_PRIVATE,
+          0, NULL, NULL, 0);
+    }
+  }
+#else
+  void WakeFlag::Wake() {
+    {
+      std::lock_guard<std::mutex> lock(mutex);
+      word.store(1);
+    }
+    cond.notify_one();
+  }
+
+
+  void WakeFlag::Wait() {
+    std::unique_lock<std::mutex> lock(mutex);
+    cond.wait(lock, [&]() { return word.load() != 0; });
+    word.store(0);
+  }
+#endif
+
+
+  StimFastLane::StimFastLane(RC::Caller<void, const u64> fire)
+    : fire(fire) {
+  }
+
+
+  StimFastLane::~StimFastLane() {
+    Stop();
+  }
+
+
+  JSONFile StimFastLane::Start(const ThreadSchedSettings& sched) {
+    Stop();
+
+    std::promise<JSONFile> report;
+    std::future<JSONFile> result = report.get_future();
+    stopping = false;
+    pending_ns = 0;
+    thread = std::thread([this, sched, &report]() {
+      JSONFile applied = ApplyThreadSched(sched);
+      running = true;
+      report.set_value(applied);
+      Run();
+    });
+    return result.get();
+  }
+
+
+  void StimFastLane::Stop() {
+    if (thread.joinable()) {
+      stopping = true;
+      wake.Wake();
+      thread.join();
+    }
+    running = false;
+  }
+
+
+  bool StimFastLane::Trigger() {
+    if (!running.load(std::memory_order_acquire)) {
+      return false;
+    }
+    u64 none = 0;
+    if (!pending_ns.compare_exchange_strong(none, RCqt::TaskStats::Now())) {
+      return false;
+    }
+    wake.Wake();
+    return true;
+  }
+
+
+  void StimFastLane::Run() {
+    while (true) {
+      wake.Wait();
+      if (stopping.load()) {
+        break;
+      }
+      u64 trigger_ns = pending_ns.load(std::memory_order_acquire);
+      if (trigger_ns != 0) {
+        fire(trigger_ns);
+        pending_ns.store(0, std::memory_order_release);
+      }
+    }
+    running = false;
+  }
+}
+
@@ -0,0 +1,77 @@
+#ifndef STIMFASTLANE_H
+#define STIMFASTLANE_H
+
+#include "ConfigFile.h"
+#include "ThreadSched.h"
+#include "RC/Caller.h"
+#include "RC/Types.h"
+#include <atomic>
+#include <thread>
+#ifndef __linux__
+#include <condition_variable>
+#include <mutex>
+#endif
+
+namespace CML {
+  /// A one-shot wake-up between threads, without an event loop.
+  /** On Linux this is a futex on a single word, so Wake is one atomic
+   *  store and a syscall only when a thread is waiting.  Elsewhere it
+   *  falls back to a condition variable.
+   */
+  class WakeFlag {
+    public:
+    void Wake();
+    // Blocks until Wake is called, consuming it.
+    void Wait();
+
+    protected:
+    std::atomic<int> word{0};
+#ifndef __linux__
+    std::mutex mutex;
+    std::condition_variable cond;
+#endif
+  };
+
+
+  /// A dedicated thread for firing stimulation with minimal latency.
+  /** Trigger may be called from any thread, and wakes the lane thread,
+   *  which calls fire with the TaskStats::Now() time of the trigger.
+   *  Only one trigger is pending at a time, so a trigger arriving before
+   *  the previous one fires is refused, for the caller to handle through
+   *  the regular task queue.
+   */
+  class StimFastLane {
+    public:
+    StimFastLane(RC::Caller<void, const u64> fire);
+    ~StimFastLane();
+
+    // Rule of 3.
+    StimFastLane(const StimFastLane&) = delete;
+    StimFastLane& operator=(const StimFastLane&) = delete;
+
+    /// Starts the lane thread with the given scheduling.
+    /** @return The effective scheduling, as with ApplyThreadSched.
+     */
+    JSONFile Start(const ThreadSchedSettings& sched);
+    void Stop();
+
+    /// Returns false if not running or a trigger is already pending.
+    bool Trigger();
+
+    bool IsRunning() const { return running.load(); }
+
+    protected:
+    void Run();
+
+    RC::Caller<void, const u64> fire;
+    WakeFlag wake;
+    // 0 when no trigger is pending.
+    std::atomic<u64> pending_ns{0};
+    std::atomic<bool> running{false};
+    std::atomic<bool> stopping{false};
+    std::thread thread;
+  };
+}
+
+#endif // STIMFASTLANE_H
+
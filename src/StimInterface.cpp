@@ -179,6 +179,14 @@ namespace CML {
     is_configured = true;
   }
 
+  void StimInterface::PreloadProfiles_Handler(
+      const std::vector<StimProfile>& profiles) {
+    // Device slots may be reassigned.
+    is_configured = false;
+
+    PreloadProfiles_Helper(profiles);
+  }
+
   float StimInterface::GetBurstSlowFreq_Handler() {
     return burst_slow_freq;
   }
@@ -64,6 +64,11 @@ namespace CML {
     //
     //       Also, all arguments MUST be pass by value
     virtual void ConfigureStimulation(StimProfile profile) = 0;
+    // Uploads a bank of profiles in advance where the device supports it,
+    // so ConfigureStimulation of any of them only selects it.  Throws if
+    // the bank does not fit, leaving ConfigureStimulation to work as
+    // without a bank.  The current configuration must be set again after.
+    virtual void PreloadProfiles(std::vector<StimProfile> profiles) = 0;
     virtual void OpenInterface() = 0;
     virtual void CloseInterface() = 0;
     virtual void Stimulate() = 0;
@@ -74,11 +79,14 @@ namespace CML {
 
     protected:
     virtual void ConfigureStimulation_Helper(const StimProfile& profile) = 0;
+    virtual void PreloadProfiles_Helper(
+        const std::vector<StimProfile>& profiles) = 0;
     virtual void OpenInterface_Helper() = 0;
     virtual void CloseInterface_Helper() = 0;
     virtual void Stimulate_Helper() = 0;
 
     void ConfigureStimulation_Handler(const StimProfile& profile);
+    void PreloadProfiles_Handler(const std::vector<StimProfile>& profiles);
     void OpenInterface_Handler();
     void CloseInterface_Handler();
     void Stimulate_Handler();
@@ -24,6 +24,8 @@ namespace CML {
     StimNetWorker& operator=(const StimNetWorker&) = delete;
 
     void ConfigureStimulation(StimProfile profile) override { RCqt::TaskCaller<const StimProfile> configure = TaskHandler(StimNetWorker::ConfigureStimulation_Handler); configure(profile); }
+    // The stim network process is configured per event, with no bank.
+    void PreloadProfiles(std::vector<StimProfile> /*profiles*/) override { }
     void OpenInterface() override { RCqt::TaskCaller<> open = TaskHandler(StimNetWorker::OpenInterface_Handler); open(); }
     void CloseInterface() override { RCqt::TaskCaller<> close = TaskHandler(StimNetWorker::CloseInterface_Handler); close(); }
     void Stimulate() override { RCqt::TaskCaller<> stim = TaskHandler(StimNetWorker::Stimulate_Handler); stim(); }
@@ -37,6 +39,7 @@ namespace CML {
 
     protected:
     void ConfigureStimulation_Helper(const StimProfile& profile) override;
+    void PreloadProfiles_Helper(const std::vector<StimProfile>& /*profiles*/) override { }
     void Stimulate_Helper() override;
     void OpenInterface_Helper() override;
     void CloseInterface_Helper() override;
@@ -0,0 +1,37 @@
+#include "StimTrigger.h"
+#include "Handler.h"
+#include "JSONLines.h"
+#include "StimWorker.h"
+#include "RC/Errors.h"
+#include "RC/RTime.h"
+
+namespace CML {
+  StimTrigger::StimTrigger(RC::Ptr<Handler> hndl, const RC::RStr& event_type,
+      const RC::RStr& description, StimTriggerSettings settings)
+    : hndl(hndl), event_type(event_type), settings(settings) {
+    f64 min_refractory_sec = settings.stim_duration_sec +
+      StimWorker::stim_lockout_sec;
+    if (settings.refractory_sec <= min_refractory_sec) {
+      Throw_RC_Error((description + " refractory_sec must exceed the "
+            "stimulation duration plus lockout of " +
+            RC::RStr(min_refractory_sec) + " seconds.").c_str());
+    }
+
+    // So that the first trigger is allowed.
+    last_trigger_sec = RC::Time::Get() - settings.refractory_sec;
+  }
+
+
+  void StimTrigger::SetArmed(bool new_armed) {
+    armed = new_armed;
+
+    JSONFile data;
+    data.Set(armed, "armed");
+    hndl->event_log.Log(MakeResp(event_type + "_ARMED", 0, data).Line());
+  }
+
+
+  bool StimTrigger::Refractory(f64 now_sec) const {
+    return now_sec - last_trigger_sec < settings.refractory_sec;
+  }
+}
@@ -0,0 +1,57 @@
+#ifndef STIMTRIGGER_H
+#define STIMTRIGGER_H
+
+#include "RC/Ptr.h"
+#include "RC/RStr.h"
+#include "RC/Types.h"
+
+namespace CML {
+  class Handler;
+
+  class StimTriggerSettings {
+    public:
+    // Minimum time between triggers.  Must exceed stim_duration_sec plus
+    // StimWorker::stim_lockout_sec.
+    double refractory_sec = 1;
+    // The longest stimulation event the approved channels can produce.
+    double stim_duration_sec = 0;
+  };
+
+  /// The arming and refractory state of a free-running stim trigger.
+  /** Owned by the trigger's worker and used only on its thread.  Triggers
+   *  start disarmed, are armed when the task reports READY, and are
+   *  disarmed when the experiment stops.
+   */
+  class StimTrigger {
+    public:
+    /// Validates the settings, throwing on a refractory period too short.
+    /** @param hndl The Handler, for event logging
+     *  @param event_type The event log type, with "_ARMED" for arming
+     *  @param description For error messages, e.g. "Phase-locked
+     *  stimulation"
+     *  @param settings The refractory settings
+     */
+    StimTrigger(RC::Ptr<Handler> hndl, const RC::RStr& event_type,
+        const RC::RStr& description, StimTriggerSettings settings);
+
+    /// Sets and logs the armed state.
+    void SetArmed(bool new_armed);
+    bool IsArmed() const { return armed; }
+
+    /// True if a trigger at now_sec would fall within the refractory
+    /// period of the last one.
+    bool Refractory(f64 now_sec) const;
+    /// Records a trigger for stimulation at onset_sec.
+    void Triggered(f64 onset_sec) { last_trigger_sec = onset_sec; }
+
+    protected:
+    RC::Ptr<Handler> hndl;
+    RC::RStr event_type;
+    StimTriggerSettings settings;
+
+    bool armed = false;
+    f64 last_trigger_sec;
+  };
+}
+
+#endif // STIMTRIGGER_H
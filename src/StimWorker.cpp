@@ -3,13 +3,16 @@
 #include "EventLog.h"
 #include "Handler.h"
 #include "JSONLines.h"
+#include "Popup.h"
 #include "StatusPanel.h"
+#include <cmath>
 
 namespace CML {
   StimWorker::StimWorker(RC::Ptr<Handler> hndl)
     : hndl(hndl) {
     // first stim event should always pass lockout constraint
     prev_stim_offset_time_sec = -stim_lockout_sec;
+    fast_stats = GetTaskStats("FastStimulate");
   }
 
   StimulatorType StimWorker::GetStimulatorType() const {
@@ -22,10 +25,12 @@ namespace CML {
   }
 
   void StimWorker::SetStimInterface_Handler(RC::APtr<StimInterface>& new_interface) {
+    QMutexLocker lock(&stim_mutex);
     stim_interface = new_interface;
   }
 
   void StimWorker::Open_Handler() {
+    QMutexLocker lock(&stim_mutex);
     if (stim_interface.IsNull()) {
       Throw_RC_Error("The stim_interface in StimWorker is null on Configure");
     }
@@ -35,48 +40,133 @@ namespace CML {
   }
 
   void StimWorker::ConfigureStimulation_Handler(const StimProfile& profile) {
+    QMutexLocker lock(&stim_mutex);
     if (stim_interface.IsNull()) {
       Throw_RC_Error("The stim_interface in StimWorker is null on Configure");
     }
 
     cur_profile = profile;
+    RC::Time timer;
     stim_interface->ConfigureStimulation(profile);
+    f64 config_ms = timer.SinceStart()*1e3;
 
     max_duration = 0;
     for (size_t i=0; i<profile.size(); i++) {
       max_duration = std::max(max_duration, profile[i].duration);
     }
+
+    // Welford's running variance.
+    config_count++;
+    f64 delta = config_ms - config_mean_ms;
+    config_mean_ms += delta / config_count;
+    config_m2 += delta * (config_ms - config_mean_ms);
+
+    JSONFile event = MakeResp("STIM_CONFIG_TIME");
+    event.Set(config_ms, "data", "config_ms");
+    event.Set(config_mean_ms, "data", "mean_ms");
+    event.Set((config_count > 1) ? std::sqrt(config_m2 / (config_count-1)) :
+        0.0, "data", "sd_ms");
+    event.Set(config_count, "data", "count");
+    hndl->event_log.Log(event.Line());
+  }
+
+
+  /// Preloads a bank of stimulation profiles into the stimulator.
+  /** Where the stimulator cannot hold the bank, this is logged and each
+   *  ConfigureStimulation programs the device as before.  The current
+   *  profile, if any, is configured again afterwards.
+   *  @param profiles Every profile the experiment may configure
+   */
+  void StimWorker::PreloadStimProfiles_Handler(
+      const RC::Data1D<StimProfile>& profiles) {
+    {
+      QMutexLocker lock(&stim_mutex);
+      if (stim_interface.IsNull()) {
+        Throw_RC_Error("The stim_interface in StimWorker is null on "
+            "PreloadStimProfiles");
+      }
+
+      std::vector<StimProfile> bank(profiles.begin(), profiles.end());
+      JSONFile event = MakeResp("STIM_PROFILE_BANK");
+      event.Set(bank.size(), "data", "profiles");
+      RC::Time timer;
+      try {
+        stim_interface->PreloadProfiles(bank);
+        event.Set(true, "data", "loaded");
+      }
+      catch (std::exception& ex) {
+        event.Set(false, "data", "loaded");
+        event.Set(ex.what(), "data", "error");
+      }
+      event.Set(timer.SinceStart()*1e3, "data", "load_ms");
+      hndl->event_log.Log(event.Line());
+    }
+
+    if (cur_profile.size() > 0) {
+      ConfigureStimulation_Handler(cur_profile);
+    }
   }
 
 
   void StimWorker::Stimulate_Handler() {
+    QMutexLocker lock(&stim_mutex);
     if (stim_interface.IsNull()) {
       Throw_RC_Error("The stim_interface in StimWorker is null on Stimulate");
     }
 
-    // Setup theta-burst values
-    size_t num_bursts = 1;
-    f64 burst_period = 0;
-    if (stim_interface->GetBurstSlowFreq() > 0) {
-      num_bursts = std::round(1e-6 * stim_interface->GetBurstDuration_us() *
-          stim_interface->GetBurstSlowFreq());
-      burst_period = 1.0 / stim_interface->GetBurstSlowFreq();
-    }
-
-    // Safety check to stop repeated stimulation
     f64 cur_stim_onset_time_sec = RC::Time::Get();
-    if (cur_stim_onset_time_sec - prev_stim_offset_time_sec < stim_lockout_sec) {
+    AbortOnLockout(cur_stim_onset_time_sec);
+
+    StimulateAt(cur_stim_onset_time_sec);
+  }
+
+
+  // Safety check to stop repeated stimulation requested by the task.  With
+  // stim_mutex held, aborts the experiment if onset_sec is within the
+  // lockout.
+  void StimWorker::AbortOnLockout(f64 onset_sec) {
+    if (onset_sec - prev_stim_offset_time_sec < stim_lockout_sec) {
       Abort();
       hndl->Abort();
       Throw_RC_Error((string("Stimulation requested before ") +
                       to_string(stim_lockout_sec) +
                       string(" seconds after start of previous stimulation event. Aborting experiment for safety.")).c_str());
     }
+  }
+
+
+  /// The full duration of one stimulation event with the current settings.
+  /** @param num_bursts Set to the number of theta-bursts, or 1
+   *  @param burst_period Set to the seconds between burst onsets
+   *  @return The seconds from onset to offset.
+   */
+  f64 StimWorker::StimDurationSec(size_t& num_bursts,
+      f64& burst_period) {
+    num_bursts = 1;
+    burst_period = 0;
+    if (stim_interface->GetBurstSlowFreq() > 0) {
+      num_bursts = std::round(1e-6 * stim_interface->GetBurstDuration_us() *
+          stim_interface->GetBurstSlowFreq());
+      burst_period = 1.0 / stim_interface->GetBurstSlowFreq();
+    }
+    return (num_bursts-1)*burst_period + max_duration*1e-6;
+  }
+
+
+  // Stimulates immediately, with lockout already checked and stim_mutex
+  // held.  Returns the TaskStats::Now() time after the first pulse.
+  u64 StimWorker::StimulateAt(f64 cur_stim_onset_time_sec) {
+    // Setup theta-burst values
+    size_t num_bursts;
+    f64 burst_period;
+    f64 duration_sec = StimDurationSec(num_bursts, burst_period);
 
     // Stimulate
     RC::Time timer;
     stim_interface->Stimulate();
+    u64 pulse_ns = RCqt::TaskStats::Now();
     status_panel->SetStimming(max_duration);
+    hndl->eeg_acq.MarkStimulation(cur_stim_onset_time_sec, duration_sec);
 
     // Log Stimulation
     JSONFile event_base = MakeResp("STIMMING");
@@ -108,7 +198,7 @@ namespace CML {
       }
 
       if (ShouldAbort()) {
-        return;
+        return pulse_ns;
       }
 
       stim_interface->Stimulate();
@@ -116,9 +206,250 @@ namespace CML {
 
     // Safety check stim offset
     prev_stim_offset_time_sec = RC::Time::Get();
+    return pulse_ns;
+  }
+
+  void StimWorker::TryStimulate_Handler() {
+    // Held through the stimulation, so nothing stims between the check and
+    // StimulateAt.
+    QMutexLocker lock(&stim_mutex);
+    if (stim_interface.IsNull()) {
+      Throw_RC_Error("The stim_interface in StimWorker is null on "
+          "TryStimulate");
+    }
+
+    f64 cur_stim_onset_time_sec = RC::Time::Get();
+    if (!LockoutClear(cur_stim_onset_time_sec)) {
+      return;
+    }
+
+    StimulateAt(cur_stim_onset_time_sec);
+  }
+
+
+  // With stim_mutex held, returns false and logs STIM_SKIPPED if onset_sec
+  // is within the lockout.
+  bool StimWorker::LockoutClear(f64 onset_sec) {
+    f64 since_offset_sec = onset_sec - prev_stim_offset_time_sec;
+    if (since_offset_sec < stim_lockout_sec) {
+      JSONFile event = MakeResp("STIM_SKIPPED");
+      event.Set("lockout", "data", "reason");
+      event.Set(since_offset_sec*1e3, "data", "since_offset_ms");
+      hndl->event_log.Log(event.Line());
+      return false;
+    }
+    return true;
   }
 
+  /// Schedules a stimulation event for an absolute time.
+  /** The request is rejected now if it is already past its deadline, or if
+   *  it would start within the lockout of the previous or any other
+   *  scheduled stimulation event, and rejected at firing time if it has
+   *  missed its deadline.  Each rejection is logged as STIM_SKIPPED, and
+   *  each stimulation as STIM_TIMING with its onset error.
+   *  @param target_sec The RC::Time::Get() time to stimulate at
+   *  @param deadline_sec The latest acceptable onset time
+   */
+  void StimWorker::ScheduleStimulation_Handler(const f64& target_sec,
+      const f64& deadline_sec) {
+    QMutexLocker lock(&stim_mutex);
+    if (stim_interface.IsNull()) {
+      Throw_RC_Error("The stim_interface in StimWorker is null on "
+          "ScheduleStimulation");
+    }
+
+    f64 now = RC::Time::Get();
+    if (deadline_sec < target_sec || now > deadline_sec) {
+      LogSkipped("deadline", target_sec, deadline_sec);
+      return;
+    }
+
+    size_t num_bursts;
+    f64 burst_period;
+    f64 duration_sec = StimDurationSec(num_bursts, burst_period);
+    f64 onset_sec = std::max(target_sec, now);
+    bool conflict =
+      onset_sec - prev_stim_offset_time_sec < stim_lockout_sec;
+    for (size_t i=0; i<scheduled.size() && !conflict; i++) {
+      f64 other_sec = scheduled[i].target_sec;
+      conflict =
+        onset_sec < other_sec + duration_sec + stim_lockout_sec &&
+        other_sec < onset_sec + duration_sec + stim_lockout_sec;
+    }
+    if (conflict) {
+      LogSkipped("lockout", target_sec, deadline_sec);
+      return;
+    }
+
+    size_t pos = 0;
+    while (pos < scheduled.size() && scheduled[pos].target_sec <= target_sec) {
+      pos++;
+    }
+    scheduled.Insert(pos, ScheduledStim{target_sec, deadline_sec});
+
+    BeScheduleTimerSet();
+  }
+
+
+  void StimWorker::CancelScheduledStimulation_Handler() {
+    for (size_t i=0; i<scheduled.size(); i++) {
+      LogSkipped("cancelled", scheduled[i].target_sec,
+          scheduled[i].deadline_sec);
+    }
+    scheduled.Clear();
+    if (schedule_timer.IsSet()) {
+      schedule_timer->stop();
+    }
+  }
+
+
+  void StimWorker::LogSkipped(const RC::RStr& reason, f64 target_sec,
+      f64 deadline_sec) {
+    JSONFile event = MakeResp("STIM_SKIPPED");
+    event.Set(reason.Raw(), "data", "reason");
+    event.Set(target_sec*1e3, "data", "target_ms");
+    event.Set(deadline_sec*1e3, "data", "deadline_ms");
+    event.Set((RC::Time::Get() - prev_stim_offset_time_sec)*1e3, "data",
+        "since_offset_ms");
+    hndl->event_log.Log(event.Line());
+  }
+
+
+  void StimWorker::BeScheduleTimerSet() {
+    if (DirectCallingMode()) {
+      return;
+    }
+    if (schedule_timer.IsNull()) {
+      schedule_timer = new QTimer();
+      AddToThread(schedule_timer);  // For maintenance robustness.
+      schedule_timer->setTimerType(Qt::PreciseTimer);
+      schedule_timer->setSingleShot(true);
+      // Okay because timer allocated within StimWorker thread here.
+      QObject::connect(schedule_timer.Raw(), &QTimer::timeout,
+        RC::MakeCaller(this, &StimWorker::ScheduleTick));
+    }
+
+    if (scheduled.size() == 0) {
+      schedule_timer->stop();
+      return;
+    }
+
+    // Rounded down, so the timer never fires after the spin window opens.
+    f64 wait_sec = scheduled[0].target_sec - schedule_spin_sec -
+      RC::Time::Get();
+    schedule_timer->start(std::max(0, int(wait_sec*1e3)));
+  }
+
+
+  void StimWorker::ScheduleTick() {
+    // A raw timer slot, so errors are reported here as a task would.
+    try {
+      while (scheduled.size() > 0 &&
+          scheduled[0].target_sec - schedule_spin_sec <= RC::Time::Get()) {
+        ScheduledStim next = scheduled[0];
+        scheduled.Remove(0);
+
+        // Spin before locking, so the fast lane is never held up by it.
+        while (RC::Time::Get() < next.target_sec) { }
+
+        QMutexLocker lock(&stim_mutex);
+        f64 onset_sec = RC::Time::Get();
+        if (stim_interface.IsNull() || ShouldAbort()) {
+          LogSkipped("cancelled", next.target_sec, next.deadline_sec);
+        }
+        else if (onset_sec > next.deadline_sec) {
+          LogSkipped("deadline", next.target_sec, next.deadline_sec);
+        }
+        else if (onset_sec - prev_stim_offset_time_sec < stim_lockout_sec) {
+          LogSkipped("lockout", next.target_sec, next.deadline_sec);
+        }
+        else {
+          StimulateAt(onset_sec);
+
+          JSONFile event = MakeResp("STIM_TIMING");
+          event.Set(next.target_sec*1e3, "data", "target_ms");
+          event.Set(next.deadline_sec*1e3, "data", "deadline_ms");
+          event.Set(onset_sec*1e3, "data", "onset_ms");
+          event.Set((onset_sec - next.target_sec)*1e3, "data", "error_ms");
+          hndl->event_log.Log(event.Line());
+        }
+      }
+    }
+    catch (std::exception& ex) {
+      CancelScheduledStimulation_Handler();
+      hndl->StopExperiment();
+      ErrorWin(RC::RStr("Scheduled stimulation failed:\n") + ex.what() +
+          "\nExperiment stopped.");
+      return;
+    }
+
+    BeScheduleTimerSet();
+  }
+
+
+  /// Starts the dedicated fast lane thread used by FastStimulate.
+  /** @param sched The thread scheduling for the fast lane thread
+   *  @return The effective scheduling, as with ApplyThreadSched.
+   */
+  JSONFile StimWorker::StartFastLane_Handler(
+      const ThreadSchedSettings& sched) {
+    if (fast_lane.IsNull()) {
+      fast_lane = new StimFastLane(RC::Caller<void, const u64>(
+            [this](const u64 trigger_ns) { FastFire(trigger_ns); }));
+    }
+    JSONFile result = fast_lane->Start(sched);
+    fast_lane_live.store(fast_lane.Raw(), std::memory_order_release);
+    return result;
+  }
+
+
+  void StimWorker::StopFastLane_Handler() {
+    if (fast_lane.IsSet()) {
+      fast_lane->Stop();
+    }
+  }
+
+
+  bool StimWorker::FastStimulate() {
+    StimFastLane* lane = fast_lane_live.load(std::memory_order_acquire);
+    return lane && lane->Trigger();
+  }
+
+
+  // Runs on the fast lane thread.
+  void StimWorker::FastFire(u64 trigger_ns) {
+    u64 wake_ns = RCqt::TaskStats::Now();
+    try {
+      QMutexLocker lock(&stim_mutex);
+      if (stim_interface.IsNull() || ShouldAbort()) {
+        // The queued path reports these.
+        Stimulate();
+        return;
+      }
+      // A task STIM, so a lockout violation aborts as on the queued path.
+      f64 onset_sec = RC::Time::Get();
+      AbortOnLockout(onset_sec);
+
+      u64 pulse_ns = StimulateAt(onset_sec);
+      fast_stats->wait.Record(wake_ns - trigger_ns);
+      fast_stats->run.Record(pulse_ns - wake_ns);
+
+      JSONFile event = MakeResp("STIM_FAST_LANE");
+      event.Set((wake_ns - trigger_ns)*1e-3, "data", "wake_us");
+      event.Set((pulse_ns - trigger_ns)*1e-3, "data", "pulse_us");
+      hndl->event_log.Log(event.Line());
+    }
+    catch (std::exception& ex) {
+      // Errors cannot propagate from the fast lane thread.
+      ErrorWin(RC::RStr("Fast lane stimulation failed:\n") + ex.what());
+    }
+  }
+
+
   void StimWorker::CloseStim_Handler() {
+    StopFastLane_Handler();
+    CancelScheduledStimulation_Handler();
+    QMutexLocker lock(&stim_mutex);
     if (stim_interface.IsSet()) {
       stim_interface->CloseInterface();
     }
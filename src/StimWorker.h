@@ -2,8 +2,12 @@
 #define STIMWORKER_H
 
 #include "CereStim.h"
+#include "StimFastLane.h"
 #include "RC/Ptr.h"
 #include "RCqt/Worker.h"
+#include <QMutex>
+#include <QTimer>
+#include <atomic>
 
 namespace CML {
   enum class StimulatorType { CereStim, Simulator };
@@ -27,14 +31,52 @@ namespace CML {
     RCqt::TaskCaller<const StimProfile> ConfigureStimulation =
       TaskHandler(StimWorker::ConfigureStimulation_Handler);
 
+    // Uploads all profiles an experiment will use at its start, so that
+    // ConfigureStimulation only selects among them.
+    RCqt::TaskCaller<const RC::Data1D<StimProfile>> PreloadStimProfiles =
+      TaskHandler(StimWorker::PreloadStimProfiles_Handler);
+
     RCqt::TaskCaller<> Stimulate =
       TaskHandler(StimWorker::Stimulate_Handler);
 
+    // For free-running triggers:  skips and logs stimulation requests within
+    // the lockout instead of aborting the experiment.
+    RCqt::TaskCaller<> TryStimulate =
+      TaskHandler(StimWorker::TryStimulate_Handler);
+
+    // Stimulates at target_sec, in RC::Time::Get() seconds.  Requests that
+    // cannot start by deadline_sec or would violate the lockout are
+    // rejected and logged as STIM_SKIPPED.
+    RCqt::TaskCaller<const f64, const f64> ScheduleStimulation =
+      TaskHandler(StimWorker::ScheduleStimulation_Handler);
+
+    RCqt::TaskCaller<> CancelScheduledStimulation =
+      TaskHandler(StimWorker::CancelScheduledStimulation_Handler);
+
+    // Starts the low latency lane used by FastStimulate, with the given
+    // thread scheduling, returning the effective scheduling.
+    RCqt::TaskGetter<JSONFile, const ThreadSchedSettings> StartFastLane =
+      TaskHandler(StimWorker::StartFastLane_Handler);
+
+    RCqt::TaskBlocker<> StopFastLane =
+      TaskHandler(StimWorker::StopFastLane_Handler);
+
     RCqt::TaskBlocker<> CloseStim =
       TaskHandler(StimWorker::CloseStim_Handler);
 
     StimulatorType GetStimulatorType() const;
 
+    // Thread-safe.  Stimulates from the fast lane, bypassing the task
+    // queue, with the lockout enforced as by Stimulate.  Returns false if
+    // the fast lane is not running or busy, in which case the caller should
+    // use Stimulate.
+    bool FastStimulate();
+
+    static constexpr f64 stim_lockout_sec = 0.5;
+    // Scheduled stimulation wakes this early and spins until the target,
+    // absorbing timer jitter.
+    static constexpr f64 schedule_spin_sec = 0.002;
+
     protected:
     void SetStatusPanel_Handler(const RC::Ptr<StatusPanel>& set_panel) {
       status_panel = set_panel;
@@ -43,10 +85,33 @@ namespace CML {
     void Open_Handler();
     void SetStimInterface_Handler(RC::APtr<StimInterface>& new_interface);
     void ConfigureStimulation_Handler(const StimProfile& profile);
+    void PreloadStimProfiles_Handler(const RC::Data1D<StimProfile>& profiles);
     void Stimulate_Handler();
+    void TryStimulate_Handler();
+    void ScheduleStimulation_Handler(const f64& target_sec,
+                                     const f64& deadline_sec);
+    void CancelScheduledStimulation_Handler();
 
+    JSONFile StartFastLane_Handler(const ThreadSchedSettings& sched);
+    void StopFastLane_Handler();
     void CloseStim_Handler();
 
+    void FastFire(u64 trigger_ns);
+    u64 StimulateAt(f64 onset_sec);
+    bool LockoutClear(f64 onset_sec);
+    void AbortOnLockout(f64 onset_sec);
+    f64 StimDurationSec(size_t& num_bursts, f64& burst_period);
+    void LogSkipped(const RC::RStr& reason, f64 target_sec,
+                    f64 deadline_sec);
+    void BeScheduleTimerSet();
+    void ScheduleTick();
+
+    class ScheduledStim {
+      public:
+      f64 target_sec;
+      f64 deadline_sec;
+    };
+
     RC::Ptr<Handler> hndl;
     RC::Ptr<StatusPanel> status_panel;
 
@@ -54,8 +119,27 @@ namespace CML {
     StimProfile cur_profile;
 
     uint32_t max_duration = 0;
-    const f64 stim_lockout_sec = 0.5;
+
+    // Running configuration time statistics, for STIM_CONFIG_TIME.
+    u64 config_count = 0;
+    f64 config_mean_ms = 0;
+    f64 config_m2 = 0;
     f64 prev_stim_offset_time_sec;
+
+    // Sorted by target_sec.
+    RC::Data1D<ScheduledStim> scheduled;
+    RC::APtr<QTimer> schedule_timer;
+
+    // Held for all use of stim_interface and the stimulation state, which
+    // is shared with the fast lane thread.
+    QMutex stim_mutex;
+    // Queue wait is trigger to fast lane wake-up, and runtime is wake-up
+    // to the first stimulation pulse.
+    RC::Ptr<RCqt::TaskStats> fast_stats;
+    // Set once the lane has started, for FastStimulate on other threads.
+    std::atomic<StimFastLane*> fast_lane_live{nullptr};
+    // Last, so the lane thread stops before the rest is destructed.
+    RC::APtr<StimFastLane> fast_lane;
   };
 }
 
@@ -12,6 +12,8 @@ namespace CML {
       sampling_rate(sampling_rate) {
     callback_ID = RC::RStr("TaskClassifierManager_") + sampling_rate;
     hndl->eeg_acq.RegisterEEGCallback(callback_ID, ClassifyData);
+    hndl->eeg_acq.SetEEGCallbackPolicy(callback_ID,
+        EEGCallbackPolicy::Realtime(this));
   }
 
   TaskClassifierManager::~TaskClassifierManager() {
@@ -0,0 +1,254 @@
+#include "TaskMessageScan.h"
+#include <cstdio>
+
+namespace CML {
+  namespace {
+    enum class Kind { String, Number, True, False, Null };
+
+    class Cursor {
+      public:
+      Cursor(std::string_view in) : in(in) { }
+
+      void SkipSpace() {
+        while (i < in.size() && (in[i] == ' ' || in[i] == '\t' ||
+              in[i] == '\r' || in[i] == '\n')) {
+          i++;
+        }
+      }
+
+      bool Expect(char c) {
+        SkipSpace();
+        if (i < in.size() && in[i] == c) {
+          i++;
+          return true;
+        }
+        return false;
+      }
+
+      bool String(std::string_view& str) {
+        if (!Expect('"')) {
+          return false;
+        }
+        size_t start = i;
+        while (i < in.size() && in[i] != '"') {
+          if (in[i] == '\\') {
+            return false;
+          }
+          i++;
+        }
+        if (i >= in.size()) {
+          return false;
+        }
+        str = in.substr(start, i-start);
+        i++;
+        return true;
+      }
+
+      bool Word(std::string_view word) {
+        if (in.compare(i, word.size(), word) != 0) {
+          return false;
+        }
+        i += word.size();
+        return true;
+      }
+
+      bool Scalar(Kind& kind, std::string_view& val, size_t& pos) {
+        SkipSpace();
+        pos = i;
+        if (i >= in.size()) {
+          return false;
+        }
+        char c = in[i];
+        if (c == '"') {
+          kind = Kind::String;
+          return String(val);
+        }
+        if (c == '-' || (c >= '0' && c <= '9')) {
+          kind = Kind::Number;
+          while (i < in.size() && (in[i] == '-' || in[i] == '+' ||
+                in[i] == '.' || in[i] == 'e' || in[i] == 'E' ||
+                (in[i] >= '0' && in[i] <= '9'))) {
+            i++;
+          }
+          val = in.substr(pos, i-pos);
+          return true;
+        }
+        if (Word("true")) {
+          kind = Kind::True;
+        }
+        else if (Word("false")) {
+          kind = Kind::False;
+        }
+        else if (Word("null")) {
+          kind = Kind::Null;
+        }
+        else {
+          return false;
+        }
+        val = in.substr(pos, i-pos);
+        return true;
+      }
+
+      bool AtEnd() {
+        SkipSpace();
+        return i == in.size();
+      }
+
+      std::string_view in;
+      size_t i = 0;
+    };
+
+    bool ToU64(std::string_view str, uint64_t& val) {
+      if (str.empty() || str.size() > 19) {
+        return false;
+      }
+      val = 0;
+      for (char c : str) {
+        if (c < '0' || c > '9') {
+          return false;
+        }
+        val = val*10 + uint64_t(c - '0');
+      }
+      return true;
+    }
+
+    bool ToBool(Kind kind, bool& val) {
+      if (kind != Kind::True && kind != Kind::False) {
+        return false;
+      }
+      val = (kind == Kind::True);
+      return true;
+    }
+  }
+
+
+  bool TaskMessageScan::Scan(std::string_view in) {
+    *this = TaskMessageScan();
+    line = in;
+
+    Cursor cur(in);
+    bool has_type = false;
+    bool has_id = false;
+    bool has_data = false;
+
+    if (!cur.Expect('{')) {
+      return false;
+    }
+    bool first = true;
+    while (!cur.Expect('}')) {
+      if (!first && !cur.Expect(',')) {
+        return false;
+      }
+      first = false;
+
+      std::string_view key;
+      if (!cur.String(key) || !cur.Expect(':')) {
+        return false;
+      }
+
+      if (key == "data") {
+        if (has_data || !cur.Expect('{')) {
+          return false;
+        }
+        has_data = true;
+        bool data_first = true;
+        while (!cur.Expect('}')) {
+          if (!data_first && !cur.Expect(',')) {
+            return false;
+          }
+          data_first = false;
+
+          std::string_view dkey;
+          Kind kind;
+          std::string_view val;
+          size_t pos;
+          if (!cur.String(dkey) || !cur.Expect(':') ||
+              !cur.Scalar(kind, val, pos)) {
+            return false;
+          }
+          if (dkey == "count") {
+            if (has_count || kind != Kind::Number || !ToU64(val, count)) {
+              return false;
+            }
+            has_count = true;
+          }
+          else if (dkey == "stim") {
+            if (has_stim || !ToBool(kind, stim)) {
+              return false;
+            }
+            has_stim = true;
+          }
+          else if (dkey == "classifyms") {
+            if (has_classifyms || kind != Kind::Number ||
+                !ToU64(val, classifyms)) {
+              return false;
+            }
+            has_classifyms = true;
+          }
+        }
+        continue;
+      }
+
+      Kind kind;
+      std::string_view val;
+      size_t pos;
+      if (!cur.Scalar(kind, val, pos)) {
+        return false;
+      }
+      if (key == "type") {
+        if (has_type || kind != Kind::String) {
+          return false;
+        }
+        type = val;
+        has_type = true;
+      }
+      else if (key == "id") {
+        if (has_id || kind != Kind::Number || !ToU64(val, id)) {
+          return false;
+        }
+        has_id = true;
+      }
+      else if (key == "time") {
+        if (has_time) {
+          return false;
+        }
+        time_pos = pos;
+        time_len = val.size() + (kind == Kind::String ? 2 : 0);
+        has_time = true;
+      }
+    }
+
+    return has_type && cur.AtEnd();
+  }
+
+
+  bool TaskMessageScan::IsStimTrigger() const {
+    return type == "STIM" || (type == "WORD" && has_stim && stim);
+  }
+
+
+  RC::RStr TaskMessageScan::StampedLine(f64 time_ms) const {
+    char stamp[64];
+    int len = snprintf(stamp, sizeof(stamp), "%.3f", time_ms);
+    std::string_view stamp_view(stamp, size_t(len));
+
+    std::string out;
+    if (has_time) {
+      out.reserve(line.size() - time_len + stamp_view.size());
+      out.append(line.substr(0, time_pos));
+      out.append(stamp_view);
+      out.append(line.substr(time_pos + time_len));
+    }
+    else {
+      size_t brace = line.find('{') + 1;
+      out.reserve(line.size() + stamp_view.size() + 10);
+      out.append(line.substr(0, brace));
+      out.append("\"time\":");
+      out.append(stamp_view);
+      out.append(",");
+      out.append(line.substr(brace));
+    }
+    return RC::RStr(out);
+  }
+}
+
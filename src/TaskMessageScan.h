@@ -0,0 +1,46 @@
+#ifndef TASKMESSAGESCAN_H
+#define TASKMESSAGESCAN_H
+
+#include "RC/RStr.h"
+#include "RC/Types.h"
+#include <string_view>
+
+namespace CML {
+  /// The fields of a flat task laptop message, scanned without allocating.
+  /** Scan accepts only a top level object of scalars, plus a "data" object
+   *  of scalars, with no escaped strings or repeated keys.  Anything else
+   *  returns false and should take the full JSONFile parse.  The views
+   *  refer into the scanned line, which must outlive this.
+   */
+  class TaskMessageScan {
+    public:
+    bool Scan(std::string_view in);
+
+    /// True for "STIM", or "WORD" with a data "stim" of true.
+    bool IsStimTrigger() const;
+
+    /// The scanned line with the "time" value replaced by time_ms.
+    /** If there is no "time", it is inserted as the first key.
+     */
+    RC::RStr StampedLine(f64 time_ms) const;
+
+    std::string_view line;
+    std::string_view type;
+    uint64_t id = uint64_t(-1);
+    // The "time" value within line.
+    size_t time_pos = 0;
+    size_t time_len = 0;
+    bool has_time = false;
+
+    // From "data".
+    uint64_t count = 0;
+    bool has_count = false;
+    bool stim = false;
+    bool has_stim = false;
+    uint64_t classifyms = 0;
+    bool has_classifyms = false;
+  };
+}
+
+#endif // TASKMESSAGESCAN_H
+
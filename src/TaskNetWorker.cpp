@@ -4,6 +4,7 @@
 #include "JSONLines.h"
 #include "Popup.h"
 #include "StatusPanel.h"
+#include "TaskMessageScan.h"
 #include "RC/Data1D.h"
 
 using namespace RC;
@@ -21,11 +22,25 @@ namespace CML {
       status_panel = set_panel;
   }
 
+  void TaskNetWorker::ReplayCommand_Handler(const RC::RStr& cmd) {
+    replaying = true;
+    try {
+      ProcessCommand(cmd);
+    }
+    catch (...) {
+      replaying = false;
+      throw;
+    }
+    replaying = false;
+  }
+
   void TaskNetWorker::LogAndSend(JSONFile& msg) {
     RC::RStr line = msg.Line();
     hndl->event_log.Log(line);
 
-    Send(line);
+    if (!replaying) {
+      Send(line);
+    }
   }
 
   void TaskNetWorker::ProcessCommand(RC::RStr cmd) {
@@ -38,6 +53,19 @@ namespace CML {
     RC_DEBOUT(cmd);
 #endif // TESTING
 
+    TaskMessageScan scan;
+    bool scanned = scan.Scan(cmd.Raw());
+
+    // Stimulate before logging, if the fast lane is running.  Only lines
+    // the scan fully validated qualify, and the rest stimulate through the
+    // queued path after their full parse.
+    bool fast_stimmed = configured && scanned && scan.IsStimTrigger() &&
+      hndl->stim_worker.FastStimulate();
+
+    if (configured && scanned && ProcessHot(scan, fast_stimmed)) {
+      return;
+    }
+
     JSONFile inp;
     inp.SetFilename("TaskLaptopCommand");
     inp.Parse(cmd);
@@ -71,6 +99,12 @@ namespace CML {
       }
       if (type == "READY") {
         hndl->eeg_acq.StartingExperiment();  // notify, replay needs this.
+        if (hndl->phase_stim.IsSet()) {
+          hndl->phase_stim->SetArmed(true);
+        }
+        if (hndl->band_power_stim.IsSet()) {
+          hndl->band_power_stim->SetArmed(true);
+        }
         JSONFile response = MakeResp("START");
         LogAndSend(response);
       }
@@ -85,7 +119,7 @@ namespace CML {
         LogAndSend(response);
       }
       else if (type == "WORD") {
-        ProtWord(inp);
+        ProtWord(inp, fast_stimmed);
         status_panel->SetEvent(type);
       }
       else if (type == "STIMSELECT") {
@@ -94,7 +128,9 @@ namespace CML {
         hndl->SelectStim(stimtag);
       }
       else if (type == "STIM") {
-        hndl->stim_worker.Stimulate();
+        if (!fast_stimmed) {
+          hndl->stim_worker.Stimulate();
+        }
       }
       else if (type == "CLSTIM") {
         uint64_t classify_ms;
@@ -114,6 +150,13 @@ namespace CML {
         hndl->task_classifier_manager->ProcessClassifierEvent(
             ClassificationType::NORMALIZE, classify_ms, id);
       }
+      else if (type == "CLLABEL") {
+        bool label;
+        inp.Get(label, "data", "label");
+        if (hndl->online_learner.IsSet()) {
+          hndl->online_learner->AddLabel(id, label);
+        }
+      }
       else if (type == "CCLSTARTSTIM") {
         uint64_t duration_s;
         inp.Get(duration_s, "data", "duration");
@@ -147,6 +190,41 @@ namespace CML {
   }
 
 
+  bool TaskNetWorker::ProcessHot(const TaskMessageScan& scan,
+      bool fast_stimmed) {
+    if (scan.type == "HEARTBEAT") {
+      hndl->event_log.Log(scan.StampedLine(Time::Get()*1e3));
+      JSONFile response = MakeResp("HEARTBEAT_OK");
+      if (scan.has_count) {
+        response.Set(scan.count, "data", "count");
+      }
+      LogAndSend(response);
+    }
+    else if (scan.type == "WORD") {
+      hndl->event_log.Log(scan.StampedLine(Time::Get()*1e3));
+      if (scan.has_stim && scan.stim && !fast_stimmed) {
+        hndl->stim_worker.Stimulate();
+      }
+      status_panel->SetEvent("WORD");
+    }
+    else if (scan.type == "STIM") {
+      hndl->event_log.Log(scan.StampedLine(Time::Get()*1e3));
+      if (!fast_stimmed) {
+        hndl->stim_worker.Stimulate();
+      }
+    }
+    else if (scan.type == "CLSTIM" && scan.has_classifyms) {
+      hndl->event_log.Log(scan.StampedLine(Time::Get()*1e3));
+      hndl->task_classifier_manager->ProcessClassifierEvent(
+          ClassificationType::STIM, scan.classifyms, scan.id);
+    }
+    else {
+      return false;
+    }
+    return true;
+  }
+
+
   void TaskNetWorker::ProtConfigure(const JSONFile& inp) {
     Data1D<RStr> errors;
     Data1D<RStr> stimtags;
@@ -196,11 +274,11 @@ namespace CML {
     }
   }
 
-  void TaskNetWorker::ProtWord(const JSONFile& inp) {
+  void TaskNetWorker::ProtWord(const JSONFile& inp, bool fast_stimmed) {
     bool do_stim;
 
     if (inp.TryGet(do_stim, "data", "stim")) {
-      if (do_stim) {
+      if (do_stim && !fast_stimmed) {
         hndl->stim_worker.Stimulate();
       }
     }
@@ -7,6 +7,7 @@ namespace CML {
   class Handler;
   class JSONFile;
   class StatusPanel;
+  class TaskMessageScan;
 
   class TaskNetWorker : public NetWorker {
     public:
@@ -21,23 +22,34 @@ namespace CML {
     RCqt::TaskCaller<const RC::Ptr<StatusPanel>> SetStatusPanel =
       TaskHandler(TaskNetWorker::SetStatusPanel_Handler);
 
+    /// Processes a task laptop message replayed from a prior session.
+    /** Responses are logged but not sent.
+     */
+    RCqt::TaskCaller<const RC::RStr> ReplayCommand =
+      TaskHandler(TaskNetWorker::ReplayCommand_Handler);
+
     protected:
     void DisconnectedBefore() override;
 
     void LogAndSend(JSONFile& msg);
 
     void ProcessCommand(RC::RStr cmd) override;
+    // Handles the frequent message types from a scan, without a full
+    // parse.  Returns false to fall back to the full parse.
+    bool ProcessHot(const TaskMessageScan& scan, bool fast_stimmed);
 
     void SetStatusPanel_Handler(const RC::Ptr<StatusPanel>& set_panel);
+    void ReplayCommand_Handler(const RC::RStr& cmd);
 
     void ProtConfigure(const JSONFile& inp);
-    void ProtWord(const JSONFile& inp);
+    void ProtWord(const JSONFile& inp, bool fast_stimmed);
 
     void Compare(RC::Data1D<RC::RStr>& errors, const RC::RStr& label,
         const std::string& a, const std::string& b);
 
     RC::Ptr<StatusPanel> status_panel;
     RC::Ptr<Handler> hndl;
+    bool replaying = false;
   };
 }
 
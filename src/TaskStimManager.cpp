@@ -3,7 +3,6 @@
 #include "Classifier.h"
 #include "EEGAcq.h"
 #include "Handler.h"
-#include "JSONLines.h"
 
 namespace CML {
   TaskStimManager::TaskStimManager(RC::Ptr<Handler> hndl) : hndl(hndl) {
@@ -17,11 +16,7 @@ namespace CML {
     bool stim_type =
       (task_classifier_settings.cl_type == ClassificationType::STIM);
 
-    JSONFile data;
-    data.Set(result, "result");
-    data.Set(stim, "decision");
-
-    const RC::RStr type = [&] {
+    const char* type = [&] {
         switch (task_classifier_settings.cl_type) {
           case ClassificationType::STIM: return "STIM_DECISION";
           case ClassificationType::SHAM: return "SHAM_DECISION";
@@ -31,8 +26,11 @@ namespace CML {
         }
     }();
 
-    auto resp = MakeResp(type, task_classifier_settings.classif_id, data);
-    hndl->event_log.Log(resp.Line());
+    auto resp = hndl->event_log.NewRecord(type,
+        task_classifier_settings.classif_id);
+    resp->Add("result", result);
+    resp->Add("decision", stim);
+    hndl->event_log.Submit(resp);
 
     f64 stim_time_sec = RC::Time::Get();
     if (stim_type && stim) {
@@ -0,0 +1,92 @@
+#include "TelemetryWindow.h"
+#include "Handler.h"
+#include <QCloseEvent>
+#include <QHeaderView>
+#include <QTableWidget>
+#include <QVBoxLayout>
+#include <algorithm>
+
+namespace CML {
+  TelemetryWindow::TelemetryWindow(RC::Ptr<Handler> hndl)
+    : hndl(hndl) {
+    setWindowTitle("Worker Telemetry");
+
+    QStringList headers;
+    headers << "Worker" << "Task" << "Queued" << "Peak" << "Count"
+      << "Wait mean (ms)" << "Wait p99 (ms)" << "Wait max (ms)"
+      << "Run mean (ms)" << "Run p99 (ms)" << "Run max (ms)";
+
+    table = new QTableWidget(0, headers.size());
+    table->setHorizontalHeaderLabels(headers);
+    table->setEditTriggers(QAbstractItemView::NoEditTriggers);
+    table->verticalHeader()->setVisible(false);
+    table->horizontalHeader()->setSectionResizeMode(
+        QHeaderView::ResizeToContents);
+
+    RC::Ptr<QVBoxLayout> layout = new QVBoxLayout();
+    layout->addWidget(table);
+    setLayout(layout);
+    resize(900, 500);
+  }
+
+  void TelemetryWindow::Open_Handler() {
+    show();
+    raise();
+    hndl->WatchWorkerTelemetry(Update);
+  }
+
+  void TelemetryWindow::Update_Handler(const WorkerTelemetryList& list) {
+    if (!isVisible()) {
+      return;
+    }
+
+    size_t rows = 0;
+    RC_ForEach(worker, list) {
+      rows += std::max(size_t(1), worker.stats.tasks.size());
+    }
+    table->setRowCount(int(rows));
+
+    int row = 0;
+    auto set = [&](int col, const RC::RStr& text) {
+      QTableWidgetItem* item = table->item(row, col);
+      if (item == NULL) {
+        item = new QTableWidgetItem();
+        table->setItem(row, col, item);
+      }
+      item->setText(text.c_str());
+    };
+    auto set_ms = [&](int col, f64 us) {
+      set(col, RC::RStr(us * 1e-3, RC::FIXED, 3));
+    };
+
+    RC_ForEach(worker, list) {
+      auto& tasks = worker.stats.tasks;
+      size_t worker_rows = std::max(size_t(1), tasks.size());
+      for (size_t t=0; t<worker_rows; t++, row++) {
+        set(0, worker.name);
+        set(2, RC::RStr(worker.stats.queue_depth));
+        set(3, RC::RStr(worker.stats.peak_queue_depth));
+        if (tasks.IsEmpty()) {
+          set(1, "");
+          for (int col=4; col<table->columnCount(); col++) {
+            set(col, "");
+          }
+          continue;
+        }
+        set(1, tasks[t].name);
+        set(4, RC::RStr(tasks[t].run.count));
+        set_ms(5, tasks[t].wait.mean_us);
+        set_ms(6, tasks[t].wait.p99_us);
+        set_ms(7, tasks[t].wait.max_us);
+        set_ms(8, tasks[t].run.mean_us);
+        set_ms(9, tasks[t].run.p99_us);
+        set_ms(10, tasks[t].run.max_us);
+      }
+    }
+  }
+
+  void TelemetryWindow::closeEvent(QCloseEvent* event) {
+    hndl->WatchWorkerTelemetry(WorkerTelemetryCallback());
+    event->accept();
+  }
+}
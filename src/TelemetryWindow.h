@@ -0,0 +1,41 @@
+#ifndef TELEMETRYWINDOW_H
+#define TELEMETRYWINDOW_H
+
+#include "RC/RC.h"
+#include "RCqt/Worker.h"
+#include "WorkerTelemetry.h"
+#include <QWidget>
+
+class QTableWidget;
+
+namespace CML {
+  class Handler;
+
+  /// A live table of the queue depth and task timing of every worker.
+  class TelemetryWindow : public QWidget, public RCqt::Worker {
+    Q_OBJECT
+
+    public:
+    TelemetryWindow(RC::Ptr<Handler> hndl);
+
+    // Rule of 3.
+    TelemetryWindow(const TelemetryWindow&) = delete;
+    TelemetryWindow& operator=(const TelemetryWindow&) = delete;
+
+    RCqt::TaskCaller<> Open =
+      TaskHandler(TelemetryWindow::Open_Handler);
+    RCqt::TaskCoalescer<const WorkerTelemetryList> Update =
+      TaskHandler(TelemetryWindow::Update_Handler);
+
+    protected:
+    void Open_Handler();
+    void Update_Handler(const WorkerTelemetryList& list);
+
+    void closeEvent(QCloseEvent* event);
+
+    RC::Ptr<Handler> hndl;
+    RC::Ptr<QTableWidget> table;
+  };
+}
+
+#endif // TELEMETRYWINDOW_H
@@ -9,6 +9,18 @@
 #include "ClassifierLogReg.h"
 #include "WeightManager.h"
 #include "Handler.h"
+#include "LineFramer.h"
+#include "TaskMessageScan.h"
+#include "EDFMap.h"
+#include "EDFSynch.h"
+#include "ELCFormat.h"
+#include "EventRecord.h"
+#include "FeatureStore.h"
+#include "JSONLines.h"
+#include "edflib/edflib.h"
+#include <cmath>
+#include <numeric>
+#include <random>
 
 
 namespace CML {
@@ -305,6 +317,107 @@ namespace CML {
     out_powers->Print();
   }
 
+  // Checks each compiled kernel set, and the runtime-sized one, against the
+  // loops they replaced, which must match bit for bit.
+  void TestFeatureKernels() {
+    size_t chanlen = 5;
+    size_t eventlen = 20;
+    size_t num_updates = 6;
+    size_t failed = 0;
+
+    // Fractional values, so any change in summation order shows.
+    auto Powers = [&](size_t freqlen, size_t events, double phase) {
+      RC::APtr<EEGPowers> powers = new EEGPowers(1000, events, chanlen,
+          freqlen);
+      auto& datar = powers->data;
+      RC_ForRange(i, 0, freqlen) { // Iterate over frequencies
+        RC_ForRange(j, 0, chanlen) { // Iterate over channels
+          RC_ForRange(k, 0, events) { // Iterate over events
+            datar[i][j][k] = 3.7 * std::sin(0.37*((i*chanlen + j)*events +
+                  k) + phase) + 1.3;
+          }
+        }
+      }
+      return powers;
+    };
+
+    for (size_t freqlen : {4, 5, 6, 8, 10, 12, 16}) {
+      FeatureKernelSet kernels = FeatureKernelSet::Select(freqlen);
+      size_t mismatches = 0;
+
+      // AvgOverTime, as the std::accumulate loop computed it.
+      RC::APtr<const EEGPowers> in_powers =
+        Powers(freqlen, eventlen, 0.1).ExtractConst();
+      RC::APtr<EEGPowers> avg = FeatureFilters::AvgOverTime(in_powers, false,
+          kernels);
+      RC_ForRange(i, 0, freqlen) { // Iterate over frequencies
+        RC_ForRange(j, 0, chanlen) { // Iterate over channels
+          auto& events = in_powers->data[i][j];
+          double expected = std::accumulate(events.begin(), events.end(),
+              0.0) / static_cast<double>(eventlen);
+          mismatches += (avg->data[i][j][0] != expected);
+        }
+      }
+
+      // LogOdds, as ClassifierLogReg::Classification computed it.
+      RC::Data2D<double> coef(chanlen, freqlen);
+      RC_ForRange(i, 0, freqlen) { // Iterate over frequencies
+        RC_ForRange(j, 0, chanlen) { // Iterate over channels
+          coef[i][j] = 0.01 * std::cos(0.53*(i*chanlen + j));
+        }
+      }
+      double intercept = -0.27;
+      double expected_logodds = intercept;
+      RC_ForRange(i, 0, freqlen) { // Iterate over frequencies
+        RC_ForRange(j, 0, chanlen) { // Iterate over channels
+          expected_logodds += avg->data[i][j][0] * coef[i][j];
+        }
+      }
+      mismatches += (kernels.LogOdds(avg->data, coef, intercept) !=
+          expected_logodds);
+
+      // NormalizePowers::ZScore with cached statistics, against
+      // RollingStats::ZScore.  The first channel is held constant so its
+      // std dev is 0.
+      NormalizePowersSettings np_set;
+      np_set.freqlen = freqlen;
+      np_set.chanlen = chanlen;
+      np_set.eventlen = 1;
+      NormalizePowers normalize_powers(np_set);
+      RC::Data1D<RollingStats> reference(freqlen*chanlen);
+      RC_ForIndex(f, reference) {
+        reference[f].SetSize(1);
+      }
+      for (size_t u=0; u<num_updates; u++) {
+        RC::APtr<EEGPowers> update = Powers(freqlen, 1, 0.9*u);
+        update->data[0][0][0] = 2.5;
+        RC::APtr<const EEGPowers> update_c = update.ExtractConst();
+        normalize_powers.Update(update_c);
+        RC_ForRange(i, 0, freqlen) { // Iterate over frequencies
+          RC_ForRange(j, 0, chanlen) { // Iterate over channels
+            reference[i*chanlen + j].Update(update_c->data[i][j]);
+          }
+        }
+      }
+      RC::APtr<const EEGPowers> to_zscore = avg.ExtractConst();
+      RC::APtr<EEGPowers> zscored = normalize_powers.ZScore(to_zscore, true);
+      RC_ForRange(i, 0, freqlen) { // Iterate over frequencies
+        RC_ForRange(j, 0, chanlen) { // Iterate over channels
+          double expected = reference[i*chanlen + j].ZScore(
+              to_zscore->data[i][j], true)[0];
+          mismatches += (zscored->data[i][j][0] != expected);
+        }
+      }
+
+      if (mismatches) {
+        RC_DEBOUT(RC::RStr("FeatureKernels freqlen ") + freqlen + " (" +
+            kernels.freqlen + "): " + mismatches + " mismatches\n");
+        failed++;
+      }
+    }
+    RC_DEBOUT(RC::RStr("TestFeatureKernels: ") + failed + " failed\n");
+  }
+
   void TestLog10Transform() {
     RC::APtr<const EEGPowers> in_powers = CreateTestingEEGPowers();
 
@@ -524,6 +637,497 @@ namespace CML {
     RC_DEBOUT(result);
   }
 
+  // Replays a task laptop stream, in the chunk sizes of bursty TCP reads,
+  // through the old RStr split loop and through LineFramer.  With no
+  // capture_path a stream of typical protocol messages is generated.
+  void BenchmarkLineFramer(const RC::RStr& capture_path) {
+    std::string stream;
+    if (capture_path.empty()) {
+      RC::Data1D<RC::RStr> msgs = {
+        R"({"type": "HEARTBEAT", "data": {"count": 27}, "id": 42, "time": 1620000000.0})",
+        R"({"type": "WORD", "data": {"word": "TREE", "serialpos": 3, "stim": true}, "id": 43, "time": 1620000000.5})",
+        R"({"type": "STIMSELECT", "data": {"stimtag": "LA1_LA2"}, "id": 44, "time": 1620000001.0})",
+        R"({"type": "STIM", "data": {}, "id": 45, "time": 1620000001.5})",
+        R"({"type": "CLSTIM", "data": {"classifyms": 1366}, "id": 46, "time": 1620000002.0})",
+        R"({"type": "MATH", "data": {"problem": "1+2+3=", "response": "6", "response_time_ms": 1500, "correct": true}, "id": 47, "time": 1620000002.5})",
+        R"({"type": "ISI", "data": {"duration": 1000.0}, "id": 48, "time": 1620000003.0})"
+      };
+      for (size_t i=0; i<20000; i++) {
+        stream += msgs[i % msgs.size()].Raw();
+        stream += '\n';
+      }
+    }
+    else {
+      RC::FileRead fr(capture_path);
+      RC::Data1D<char> raw;
+      fr.ReadAll(raw);
+      stream.assign(raw.Raw(), raw.size());
+    }
+
+    // Chunk sizes up to a full 64kB socket buffer, as after a stall.
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<size_t> chunk_dist(1, 65536);
+    RC::Data1D<size_t> chunks;
+    for (size_t pos=0; pos<stream.size(); ) {
+      size_t len = std::min(chunk_dist(gen), stream.size() - pos);
+      chunks += len;
+      pos += len;
+    }
+
+    size_t old_lines = 0;
+    size_t old_bytes = 0;
+    RC::Time old_timer;
+    RC::RStr buffer;
+    RC::Data1D<RC::RStr> split;
+    size_t pos = 0;
+    for (auto len : chunks) {
+      buffer += RC::RStr(stream.data() + pos, len);
+      pos += len;
+      while (buffer.Contains("\n")) {
+        split = buffer.SplitFirst('\n');
+        buffer = split[1];
+        old_lines++;
+        old_bytes += split[0].size();
+      }
+    }
+    f64 old_sec = old_timer.SinceStart();
+
+    size_t new_lines = 0;
+    size_t new_bytes = 0;
+    RC::Time new_timer;
+    LineFramer framer;
+    pos = 0;
+    for (auto len : chunks) {
+      framer.Append(stream.data() + pos, len,
+          [&](std::string_view line) {
+            RC::RStr cmd(line.data(), line.size());
+            new_lines++;
+            new_bytes += cmd.size();
+          });
+      pos += len;
+    }
+    f64 new_sec = new_timer.SinceStart();
+
+    RC_DEBOUT(RC::RStr("Stream bytes: ") + stream.size() + ", chunks: " +
+        chunks.size() + "\n");
+    RC_DEBOUT(RC::RStr("SplitFirst: ") + old_lines + " lines, " + old_bytes +
+        " bytes, " + old_sec*1e3 + " ms\n");
+    RC_DEBOUT(RC::RStr("LineFramer: ") + new_lines + " lines, " + new_bytes +
+        " bytes, " + new_sec*1e3 + " ms\n");
+    if (new_lines != old_lines || new_bytes != old_bytes) {
+      RC_DEBOUT(RC::RStr("LineFramer mismatch\n"));
+    }
+  }
+
+  // Checks which task laptop lines TaskMessageScan accepts, and which of
+  // those are stim triggers, then times it against the full JSONFile parse.
+  void TestTaskMessageScan() {
+    struct Case {
+      const char* line;
+      bool scanned;
+      bool stim;
+    };
+    RC::Data1D<Case> cases = {
+      {R"({"type": "STIM", "data": {}, "id": 45, "time": 1620000001.5})",
+        true, true},
+      {R"({"type":"WORD","data":{"word":"TREE","stim":true}})", true, true},
+      {R"({"type":"WORD","data":{"word":"TREE","stim":false}})", true, false},
+      {R"({"type":"WORD","data":{"word":"TREE"}})", true, false},
+      {R"({"type":"HEARTBEAT","data":{"count":27}})", true, false},
+      // Truncated or trailing input.
+      {R"({"type":"STIM")", false, false},
+      {R"({"type":"STIM",)", false, false},
+      {R"({"type":"STI)", false, false},
+      {R"({"type":"WORD","data":{"stim":true})", false, false},
+      {R"({"type":"STIM"}})", false, false},
+      {R"({"type":"STIM"} x)", false, false},
+      // Escaped strings.
+      {R"({"type":"ST\u0049M"})", false, false},
+      {R"({"type":"WORD","data":{"word":"a"b","stim":true}})", false, false},
+      {R"({"type":"STIM","note":"\"})", false, false},
+      // Nesting beyond a flat data object.
+      {R"({"type":"WORD","data":{"stim":true,"extra":{"stim":true}}})",
+        false, false},
+      {R"({"type":"WORD","meta":{"stim":true}})", false, false},
+      {R"({"type":"WORD","data":{"stim":[true]}})", false, false},
+      {R"(["STIM"])", false, false},
+      // Repeated keys, wrong value kinds, or no type.
+      {R"({"type":"WORD","data":{"stim":true},"type":"STIM"})", false, false},
+      {R"({"type":"WORD","data":{"stim":"true"}})", false, false},
+      {R"({"type":1})", false, false},
+      {R"({"data":{"stim":true}})", false, false},
+      {"", false, false}
+    };
+
+    size_t failed = 0;
+    TaskMessageScan scan;
+    for (auto& c : cases) {
+      bool scanned = scan.Scan(c.line);
+      bool stim = scanned && scan.IsStimTrigger();
+      if (scanned != c.scanned || stim != c.stim) {
+        RC_DEBOUT(RC::RStr("TaskMessageScan mismatch: ") + c.line + "\n");
+        failed++;
+      }
+    }
+
+    RC::RStr stamped;
+    if (scan.Scan(R"({"type":"STIM","time":1})")) {
+      stamped = scan.StampedLine(2.5);
+    }
+    if (stamped != R"({"type":"STIM","time":2.500})") {
+      RC_DEBOUT(RC::RStr("TaskMessageScan StampedLine: ") + stamped + "\n");
+      failed++;
+    }
+
+    std::string word = R"({"type": "WORD", "data": {"word": "TREE", )"
+      R"("serialpos": 3, "stim": true}, "id": 43, "time": 1620000000.5})";
+    size_t reps = 100000;
+    size_t scan_stims = 0;
+    RC::Time scan_timer;
+    for (size_t i=0; i<reps; i++) {
+      scan_stims += scan.Scan(word) && scan.IsStimTrigger();
+    }
+    f64 scan_sec = scan_timer.SinceStart();
+
+    size_t json_stims = 0;
+    RC::Time json_timer;
+    for (size_t i=0; i<reps; i++) {
+      JSONFile inp;
+      inp.Parse(word);
+      bool stim = false;
+      json_stims += inp.TryGet(stim, "data", "stim") && stim;
+    }
+    f64 json_sec = json_timer.SinceStart();
+
+    RC_DEBOUT(RC::RStr("TaskMessageScan: ") + cases.size() + " cases, " +
+        failed + " failed\n");
+    RC_DEBOUT(RC::RStr("Scan: ") + scan_sec*1e9/reps + " ns/line, " +
+        "JSONFile: " + json_sec*1e9/reps + " ns/line\n");
+    if (scan_stims != json_stims) {
+      RC_DEBOUT(RC::RStr("TaskMessageScan stim mismatch\n"));
+    }
+  }
+
+  void BenchmarkEDFMap(const RC::RStr& edf_path) {
+    // Through edflib a data record at a time, as EDFReplay used to.
+    edf_hdr_struct edf_hdr;
+    int edf_hdl = EDFSynch::OpenRead(edf_path.c_str(), &edf_hdr,
+        EDFLIB_DO_NOT_READ_ANNOTATIONS);
+    if (edf_hdl < 0) {
+      RC_DEBOUT(RC::RStr("Could not open ") + edf_path + "\n");
+      return;
+    }
+    size_t smpdr = size_t(edf_hdr.signalparam[0].smp_in_datarecord);
+    RC::Data1D<int> ibuf(smpdr);
+    i64 old_sum = 0;
+    u64 old_samples = 0;
+    RC::Time old_timer;
+    for (i64 r=0; r<edf_hdr.datarecords_in_file; r++) {
+      for (int s=0; s<edf_hdr.edfsignals; s++) {
+        int amnt = edfread_digital_samples(edf_hdl, s, int(smpdr),
+            ibuf.Raw());
+        for (int i=0; i<amnt; i++) {
+          old_sum += ibuf[i];
+        }
+        old_samples += size_t(std::max(amnt, 0));
+      }
+    }
+    f64 old_sec = old_timer.SinceStart();
+    EDFSynch::Close(edf_hdl);
+
+    // Mapped, in 30ms blocks as EEGAcq requests them at 1kHz.
+    EDFMap edf;
+    edf.Open(edf_path);
+    size_t block = std::max(size_t(1), size_t(edf.SamplingRate()*0.03));
+    std::vector<int16_t> sbuf(block);
+    i64 new_sum = 0;
+    u64 new_samples = 0;
+    RC::Time new_timer;
+    for (u64 pos=0; pos<edf.NumSamples(); pos+=block) {
+      size_t amnt = size_t(std::min(u64(block), edf.NumSamples()-pos));
+      for (size_t c=0; c<edf.NumChannels(); c++) {
+        edf.Read(sbuf.data(), c, pos, amnt);
+        for (size_t i=0; i<amnt; i++) {
+          new_sum += sbuf[i];
+        }
+        new_samples += amnt;
+      }
+    }
+    f64 new_sec = new_timer.SinceStart();
+
+    RC_DEBOUT(RC::RStr("edflib: ") + old_samples + " samples, " +
+        old_sec*1e3 + " ms\n");
+    RC_DEBOUT(RC::RStr("EDFMap: ") + new_samples + " samples, " +
+        new_sec*1e3 + " ms\n");
+    if (new_sum != old_sum || new_samples != old_samples) {
+      RC_DEBOUT(RC::RStr("EDFMap mismatch\n"));
+    }
+  }
+
+  // Encodes and decodes ELC chunks at the edges of the codec: silence, the
+  // full 16-bit range, single samples, and channels shorter than the
+  // predictor orders, then checks that corruption and truncation throw.
+  void TestELCRoundtrip() {
+    std::mt19937 gen(42);
+    std::uniform_int_distribution<int> full_dist(-32768, 32767);
+    std::uniform_int_distribution<int> step_dist(-40, 40);
+
+    auto make_chunk = [&](size_t num_samples) {
+      ELCChunk chunk;
+      chunk.first_sample = 1000;
+      chunk.num_samples = num_samples;
+      chunk.data.Resize(8);
+      for (auto& chan : chunk.data) {
+        chan.Resize(num_samples);
+      }
+      int walk = 0;
+      for (size_t i=0; i<num_samples; i++) {
+        chunk.data[0][i] = 0;
+        chunk.data[1][i] = int16_t(full_dist(gen));
+        chunk.data[2][i] = (i%2) ? 32767 : -32768;
+        chunk.data[3][i] = -32768;
+        chunk.data[4][i] = 32767;
+        chunk.data[5][i] = int16_t(int(i*97 % 65536) - 32768);
+        walk = std::max(-32768, std::min(32767, walk + step_dist(gen)));
+        chunk.data[6][i] = int16_t(walk);
+        chunk.data[7][i] = int16_t(std::round(30000 * std::sin(0.01*i)));
+      }
+      return chunk;
+    };
+
+    size_t failed = 0;
+    size_t checked = 0;
+    for (size_t num_samples : {size_t(0), size_t(1), size_t(2), size_t(3),
+        size_t(4), size_t(1000)}) {
+      ELCChunk in = make_chunk(num_samples);
+      in.Encode();
+
+      ELCChunk out;
+      out.Decode(in.encoded.Raw(), in.encoded.size());
+      checked++;
+      bool match = out.first_sample == in.first_sample &&
+        out.num_samples == in.num_samples &&
+        out.data.size() == in.data.size();
+      for (size_t c=0; match && c<in.data.size(); c++) {
+        for (size_t i=0; match && i<num_samples; i++) {
+          match = out.data[c][i] == in.data[c][i];
+        }
+      }
+      if (!match) {
+        RC_DEBOUT(RC::RStr("ELC mismatch at ") + num_samples +
+            " samples\n");
+        failed++;
+      }
+
+      if (num_samples == 0) {
+        continue;
+      }
+
+      // Corrupted payloads fail the checksum.
+      ELCChunk bad = in;
+      bad.encoded[bad.encoded.size()-1] ^= 0x01;
+      checked++;
+      try {
+        out.Decode(bad.encoded.Raw(), bad.encoded.size());
+        RC_DEBOUT(RC::RStr("ELC corruption accepted at ") + num_samples +
+            " samples\n");
+        failed++;
+      }
+      catch (RC::ErrorMsgFile&) { }
+
+      // Truncated chunks and channels throw rather than reading past the
+      // end.
+      checked++;
+      try {
+        out.Decode(in.encoded.Raw(), in.encoded.size()-1);
+        RC_DEBOUT(RC::RStr("ELC chunk truncation accepted at ") +
+            num_samples + " samples\n");
+        failed++;
+      }
+      catch (RC::ErrorMsgFile&) { }
+
+      const uint8_t* chan = in.encoded.Raw() + ELC::chunk_header_len;
+      size_t chan_len = 4 + ELC::GetU32(chan);
+      checked++;
+      try {
+        RC::Data1D<int16_t> samples(num_samples);
+        ELC::DecodeChannel(samples.Raw(), num_samples, chan, chan_len-1);
+        RC_DEBOUT(RC::RStr("ELC channel truncation accepted at ") +
+            num_samples + " samples\n");
+        failed++;
+      }
+      catch (RC::ErrorMsgFile&) { }
+    }
+
+    RC_DEBOUT(RC::RStr("TestELCRoundtrip: ") + checked + " checks, " +
+        failed + " failed\n");
+  }
+
+  // Writes a feature store with the next event's raw features arriving
+  // before the z-scored ones, as the pipeline allows, across several
+  // blocks.  Then checks the reloaded rows and classif_id joins, and that
+  // a copy cut off partway through keeps the complete blocks.
+  void TestFeatureStore() {
+    RC::RStr filename = "test_feature_store.efs";
+    RC::RStr cut_filename = "test_feature_store_cut.efs";
+    size_t num_events = 150;
+    size_t num_normalize = 20;
+    size_t chanlen = 3;
+    size_t freqlen = 2;
+    size_t num_features = chanlen*freqlen;
+
+    auto settings = [&](size_t e) {
+      TaskClassifierSettings set;
+      set.cl_type = (e < num_normalize) ? ClassificationType::NORMALIZE :
+        (e%2) ? ClassificationType::STIM : ClassificationType::SHAM;
+      set.duration_ms = 1366;
+      set.classif_id = 1000 + e;
+      return set;
+    };
+    // Z-scored features are offset from the raw ones to tell them apart.
+    int zscored_offset = 5000;
+    auto powers = [&](size_t e, int offset) {
+      return CreateTestingEEGPowers(1000, 1, chanlen, freqlen,
+          int16_t(offset + int(10*e)));
+    };
+
+    JSONFile metadata;
+    metadata.Set("test", "subject");
+    {
+      FeatureStore store;
+      store.StartFile(filename, metadata, num_features);
+      auto first = powers(0, 0);
+      store.AddRaw(first, settings(0));
+      for (size_t e=0; e<num_events; e++) {
+        if (e+1 < num_events) {
+          auto next_raw = powers(e+1, 0);
+          store.AddRaw(next_raw, settings(e+1));
+        }
+        if (e >= num_normalize) {
+          auto zscored = powers(e, zscored_offset);
+          store.AddZScored(zscored, settings(e));
+          store.AddResult(0.001*e, settings(e));
+        }
+      }
+      store.CloseFile();
+    }
+
+    size_t failed = 0;
+    auto check = [&](const FeatureStoreReader& reader, size_t rows) {
+      for (size_t r=0; r<rows; r++) {
+        size_t e = r;
+        bool normalize = e < num_normalize;
+        bool match = reader.classif_id[r] == settings(e).classif_id &&
+          reader.cl_type[r] == settings(e).cl_type &&
+          reader.has_raw[r] && reader.has_zscored[r] == !normalize;
+        for (size_t k=0; match && k<num_features; k++) {
+          match = reader.RawRow(r)[k] == f32(k + 10*e) &&
+            reader.ZScoredRow(r)[k] ==
+              (normalize ? 0 : f32(k + 10*e + zscored_offset));
+        }
+        match = match && (normalize ? std::isnan(reader.result[r]) :
+            reader.result[r] == 0.001*e);
+        if (!match) {
+          RC_DEBOUT(RC::RStr("FeatureStore mismatch at row ") + r + "\n");
+          failed++;
+        }
+      }
+    };
+
+    FeatureStoreReader reader(filename);
+    if (reader.NumRows() != num_events || reader.num_features != num_features) {
+      RC_DEBOUT(RC::RStr("FeatureStore rows: ") + reader.NumRows() + "\n");
+      failed++;
+    }
+    check(reader, std::min(reader.NumRows(), num_events));
+
+    RC::Data1D<uint8_t> bin;
+    RC::FileRead fr(filename);
+    fr.ReadAll(bin);
+    fr.Close();
+    // Halfway lands within the second feature block.
+    RC::Data1D<uint8_t> cut(bin.size()/2, bin.Raw());
+    RC::FileWrite fw(cut_filename);
+    fw.Write(cut);
+    fw.Close();
+
+    FeatureStoreReader cut_reader(cut_filename);
+    if (cut_reader.NumRows() == 0 || cut_reader.NumRows() >= num_events) {
+      RC_DEBOUT(RC::RStr("FeatureStore cut rows: ") + cut_reader.NumRows() +
+          "\n");
+      failed++;
+    }
+    check(cut_reader, std::min(cut_reader.NumRows(), num_events));
+
+    RC::File::Delete(filename);
+    RC::File::Delete(cut_filename);
+
+    RC_DEBOUT(RC::RStr("TestFeatureStore: ") + reader.NumRows() + " rows, " +
+        cut_reader.NumRows() + " after the cut, " + failed + " failed\n");
+  }
+
+  // Times the classification thread's share of logging NORMALIZATION_STATS,
+  // building the JSON line as before versus filling a reused EventRecord,
+  // and the serialization the EventLog thread now does instead.
+  void BenchmarkEventLog() {
+    size_t freqlen = 8;
+    size_t chanlen = 128;
+    size_t events = 1000;
+    RC::Data1D<RC::Data1D<RC::Data1D<double>>> means(freqlen);
+    for (size_t f=0; f<freqlen; f++) {
+      means[f].Resize(chanlen);
+      for (size_t c=0; c<chanlen; c++) {
+        means[f][c] += 0.001 * double(f*chanlen + c);
+      }
+    }
+
+    size_t json_bytes = 0;
+    RC::Time json_timer;
+    for (size_t i=0; i<events; i++) {
+      JSONFile normalization_stats;
+      normalization_stats.Set(means, "means");
+      normalization_stats.Set(means, "sample_std_devs");
+      json_bytes += MakeResp("NORMALIZATION_STATS", 0,
+          normalization_stats).Line().size();
+    }
+    f64 json_sec = json_timer.SinceStart();
+
+    EventRecord record;
+    RC::Time record_timer;
+    for (size_t i=0; i<events; i++) {
+      record.Reset("NORMALIZATION_STATS", 0);
+      record.Add("means", means);
+      record.Add("sample_std_devs", means);
+    }
+    f64 record_sec = record_timer.SinceStart();
+
+    size_t record_bytes = 0;
+    RC::Time serialize_timer;
+    for (size_t i=0; i<events; i++) {
+      record_bytes += record.ToJSON().Line().size();
+    }
+    f64 serialize_sec = serialize_timer.SinceStart();
+
+    std::vector<uint8_t> binary;
+    RC::Time binary_timer;
+    for (size_t i=0; i<events; i++) {
+      binary.clear();
+      EventLogBinary::AppendRecord(binary, record);
+    }
+    f64 binary_sec = binary_timer.SinceStart();
+
+    RC_DEBOUT(RC::RStr("MakeResp line: ") + json_sec*1e6/events +
+        " us/event, " + json_bytes/events + " bytes\n");
+    RC_DEBOUT(RC::RStr("EventRecord fill: ") + record_sec*1e6/events +
+        " us/event\n");
+    RC_DEBOUT(RC::RStr("EventLog thread JSON: ") +
+        serialize_sec*1e6/events + " us/event, " + record_bytes/events +
+        " bytes\n");
+    RC_DEBOUT(RC::RStr("EventLog thread binary: ") +
+        binary_sec*1e6/events + " us/event, " + binary.size() +
+        " bytes\n");
+  }
+
 //  void TestPyBind11() {
 //    auto& pythonInterface = PythonInterface::GetInstance();
 //    RC_DEBOUT(pythonInterface.Sqrt(2.0));
@@ -538,6 +1142,7 @@ namespace CML {
     //TestLog10Transform();
     //TestLog10TransformWithEpsilon();
     //TestAvgOverTime();
+    //TestFeatureKernels();
     //TestMirrorEnds();
     //TestRemoveMirrorEnds();
     //TestBipolarReference();
@@ -560,6 +1165,12 @@ namespace CML {
     //TestProcess_Handler();
     //TestProcess_HandlerRandomData();
     //TestClassification();
+    //BenchmarkLineFramer("");
+    //TestTaskMessageScan();
+    //BenchmarkEDFMap("eeg_data.edf");
+    //TestELCRoundtrip();
+    //TestFeatureStore();
+    //BenchmarkEventLog();
     //TestPyBind11();
     //TestPyButtfilt();
   }
@@ -27,11 +27,22 @@ namespace CML {
   void TestBipolarReference();  
   void TestMirrorEnds();
   void TestAvgOverTime();
+  void TestFeatureKernels();
   void TestLog10Transform();
   void TestMorletTransformer();
   void TestRollingStats();
   void TestNormalizePowers();
 
+  // Networking
+  void BenchmarkLineFramer(const RC::RStr& capture_path);
+  void TestTaskMessageScan();
+
+  // File formats
+  void BenchmarkEDFMap(const RC::RStr& edf_path);
+  void TestELCRoundtrip();
+  void TestFeatureStore();
+  void BenchmarkEventLog();
+
   void TestAllCode();
 
   //class TaskClassifierManagerTester : TaskClassifierManager {
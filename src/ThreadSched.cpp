@@ -0,0 +1,200 @@
+#include "ThreadSched.h"
+#include "RC/Errors.h"
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+#ifdef WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <sched.h>
+#include <sys/mman.h>
+#endif
+
+namespace CML {
+  static RC::RStr PolicyName(SchedPolicy policy) {
+    switch (policy) {
+      case SchedPolicy::FIFO: return "fifo";
+      case SchedPolicy::RR: return "rr";
+      default: return "other";
+    }
+  }
+
+  bool LoadThreadSched(const JSONFile& conf, const RC::RStr& name,
+      ThreadSchedSettings& settings) {
+    const std::string& key = name.Raw();
+    RC::RStr policy;
+    bool has_policy = conf.TryGet(policy, "thread_scheduling", key,
+        "policy");
+    bool has_cpus = conf.TryGet(settings.cpus, "thread_scheduling", key,
+        "cpus");
+    if (!has_policy && !has_cpus) {
+      return false;
+    }
+
+    if (!has_policy || policy == "other") {
+      settings.policy = SchedPolicy::Other;
+    }
+    else if (policy == "fifo") {
+      settings.policy = SchedPolicy::FIFO;
+    }
+    else if (policy == "rr") {
+      settings.policy = SchedPolicy::RR;
+    }
+    else {
+      Throw_RC_Type(File, ("Unknown sys_config.json thread_scheduling " +
+            name + " policy \"" + policy + "\", expected \"other\", " +
+            "\"fifo\", or \"rr\".").c_str());
+    }
+
+    if (settings.policy != SchedPolicy::Other) {
+      conf.Get(settings.priority, "thread_scheduling", key, "priority");
+    }
+    return true;
+  }
+
+
+#ifdef WIN32
+  JSONFile ApplyThreadSched(const ThreadSchedSettings& settings) {
+    JSONFile report;
+    std::vector<std::string> errors;
+    HANDLE thread = GetCurrentThread();
+
+    if (settings.policy != SchedPolicy::Other) {
+      int win_priority = (settings.priority >= 50) ?
+        THREAD_PRIORITY_TIME_CRITICAL : THREAD_PRIORITY_HIGHEST;
+      if (!SetThreadPriority(thread, win_priority)) {
+        errors.push_back("SetThreadPriority failed with error " +
+            std::to_string(GetLastError()));
+      }
+    }
+
+    if (settings.cpus.size() > 0) {
+      DWORD_PTR mask = 0;
+      for (size_t i=0; i<settings.cpus.size(); i++) {
+        if (settings.cpus[i] < 8*sizeof(DWORD_PTR)) {
+          mask |= DWORD_PTR(1) << settings.cpus[i];
+        }
+      }
+      if (SetThreadAffinityMask(thread, mask) == 0) {
+        errors.push_back("SetThreadAffinityMask failed with error " +
+            std::to_string(GetLastError()));
+      }
+    }
+
+    report.Set(PolicyName(settings.policy).Raw(), "policy");
+    report.Set(GetThreadPriority(thread), "priority");
+    std::vector<uint32_t> cpus;
+    for (size_t i=0; i<settings.cpus.size(); i++) {
+      cpus.push_back(settings.cpus[i]);
+    }
+    report.Set(cpus, "cpus");
+    report.Set(errors, "errors");
+    return report;
+  }
+
+
+  JSONFile LockProcessMemory() {
+    JSONFile report;
+    report.Set(false, "locked");
+    report.Set("mlockall is not supported on Windows", "error");
+    return report;
+  }
+#else
+  JSONFile ApplyThreadSched(const ThreadSchedSettings& settings) {
+    JSONFile report;
+    std::vector<std::string> errors;
+    pthread_t thread = pthread_self();
+
+    int policy = SCHED_OTHER;
+    if (settings.policy == SchedPolicy::FIFO) {
+      policy = SCHED_FIFO;
+    }
+    else if (settings.policy == SchedPolicy::RR) {
+      policy = SCHED_RR;
+    }
+    sched_param param;
+    std::memset(&param, 0, sizeof(param));
+    param.sched_priority = (policy == SCHED_OTHER) ? 0 : settings.priority;
+    int err = pthread_setschedparam(thread, policy, &param);
+    if (err) {
+      errors.push_back(std::string("pthread_setschedparam: ") +
+          std::strerror(err));
+    }
+
+#ifdef __linux__
+    if (settings.cpus.size() > 0) {
+      cpu_set_t cpu_set;
+      CPU_ZERO(&cpu_set);
+      for (size_t i=0; i<settings.cpus.size(); i++) {
+        if (settings.cpus[i] < CPU_SETSIZE) {
+          CPU_SET(settings.cpus[i], &cpu_set);
+        }
+      }
+      err = pthread_setaffinity_np(thread, sizeof(cpu_set), &cpu_set);
+      if (err) {
+        errors.push_back(std::string("pthread_setaffinity_np: ") +
+            std::strerror(err));
+      }
+    }
+#else
+    if (settings.cpus.size() > 0) {
+      errors.push_back("CPU affinity is not supported on this platform");
+    }
+#endif
+
+    // Report what actually took effect.
+    int eff_policy = SCHED_OTHER;
+    sched_param eff_param;
+    std::memset(&eff_param, 0, sizeof(eff_param));
+    pthread_getschedparam(thread, &eff_policy, &eff_param);
+    SchedPolicy eff = (eff_policy == SCHED_FIFO) ? SchedPolicy::FIFO :
+      (eff_policy == SCHED_RR) ? SchedPolicy::RR : SchedPolicy::Other;
+    report.Set(PolicyName(eff).Raw(), "policy");
+    report.Set(eff_param.sched_priority, "priority");
+
+    std::vector<uint32_t> cpus;
+#ifdef __linux__
+    cpu_set_t eff_set;
+    CPU_ZERO(&eff_set);
+    if (pthread_getaffinity_np(thread, sizeof(eff_set), &eff_set) == 0) {
+      for (uint32_t c=0; c<CPU_SETSIZE; c++) {
+        if (CPU_ISSET(c, &eff_set)) {
+          cpus.push_back(c);
+        }
+      }
+    }
+#endif
+    report.Set(cpus, "cpus");
+    report.Set(errors, "errors");
+    return report;
+  }
+
+
+  JSONFile LockProcessMemory() {
+    JSONFile report;
+    bool locked = (mlockall(MCL_CURRENT | MCL_FUTURE) == 0);
+    report.Set(locked, "locked");
+    if (!locked) {
+      report.Set(std::string("mlockall: ") + std::strerror(errno), "error");
+    }
+    return report;
+  }
+#endif
+
+
+  JSONFile ApplyWorkerSched(RCqt::Worker& worker,
+      const ThreadSchedSettings& settings) {
+    if (worker.DirectCallingMode()) {
+      Throw_RC_Error("Thread scheduling cannot be applied to workers before "
+          "multithreading has started.");
+    }
+    JSONFile report;
+    RCqt::TaskBlocker<> apply = {&worker, {[&]() {
+      report.json = ApplyThreadSched(settings).json;
+    }}};
+    apply();
+    return report;
+  }
+}
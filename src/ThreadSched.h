@@ -0,0 +1,52 @@
+#ifndef THREADSCHED_H
+#define THREADSCHED_H
+
+#include "ConfigFile.h"
+#include "RC/Data1D.h"
+#include "RC/RStr.h"
+#include "RCqt/Worker.h"
+
+namespace CML {
+  enum class SchedPolicy { Other, FIFO, RR };
+
+  class ThreadSchedSettings {
+    public:
+    SchedPolicy policy = SchedPolicy::Other;
+    // For FIFO and RR, 1 (lowest) to 99 (highest) on Linux.  On Windows,
+    // 50 and above map to time critical, and below to highest.
+    int priority = 0;
+    // CPUs to pin the thread to.  Empty leaves the affinity unchanged.
+    RC::Data1D<uint32_t> cpus;
+  };
+
+  /// Reads one worker's settings from a "thread_scheduling" config section.
+  /** @param conf The configuration file, normally sys_config.json
+   *  @param name The worker name key under "thread_scheduling"
+   *  @param settings Set to the configured values, if present
+   *  @return True if settings were configured for this name.
+   */
+  bool LoadThreadSched(const JSONFile& conf, const RC::RStr& name,
+      ThreadSchedSettings& settings);
+
+  /// Applies the settings to the calling thread.
+  /** Failures, such as missing real-time permissions, do not throw, and
+   *  are instead reported in the returned "errors" list, so a session can
+   *  proceed while recording that it did not get the requested scheduling.
+   *  @return The effective policy, priority, and cpus after applying.
+   */
+  JSONFile ApplyThreadSched(const ThreadSchedSettings& settings);
+
+  /// Applies the settings on the thread of the given Worker.
+  /** This blocks until the worker has applied them.
+   *  @return The effective settings, as with ApplyThreadSched.
+   */
+  JSONFile ApplyWorkerSched(RCqt::Worker& worker,
+      const ThreadSchedSettings& settings);
+
+  /// Locks all current and future pages of the process into RAM.
+  /** @return The effective state, with an "error" entry on failure.
+   */
+  JSONFile LockProcessMemory();
+}
+
+#endif // THREADSCHED_H
@@ -32,16 +32,22 @@ namespace CML {
     return dividend / divisor + (dividend % divisor != 0); 
   }
 
-  // True if the amount of storage exists at the specified path.
+  // The bytes of storage available at the specified path.
   // Throws an exception if the path does not exist or cannot be written to.
-  bool CheckStorage(RC::RStr path, size_t amount) {
+  uint64_t StorageAvailable(RC::RStr path) {
     QStorageInfo storage(path.ToQString());
     int64_t avail = storage.bytesAvailable();
     if ( storage.isReadOnly() || (avail < 0) ||
          (! (storage.isValid() && storage.isReady())) ) {
       Throw_RC_Type(File, (RC::RStr("Cannot write to ") + path).c_str());
     }
-    return size_t(avail) >= amount;
+    return uint64_t(avail);
+  }
+
+  // True if the amount of storage exists at the specified path.
+  // Throws an exception if the path does not exist or cannot be written to.
+  bool CheckStorage(RC::RStr path, size_t amount) {
+    return StorageAvailable(path) >= amount;
   }
 }
 
@@ -0,0 +1,42 @@
+#include "WorkerTelemetry.h"
+
+namespace CML {
+  void AddWorkerTelemetry(WorkerTelemetryList& list, const RC::RStr& name,
+      RC::Ptr<RCqt::Worker> worker) {
+    if (worker.IsNull()) {
+      return;
+    }
+    WorkerTelemetry telemetry;
+    telemetry.name = name;
+    telemetry.stats = worker->StatsSnapshot();
+    list += telemetry;
+  }
+
+  static JSONFile LatencyJSON(const RCqt::LatencySummary& summary) {
+    JSONFile latency;
+    latency.Set(summary.mean_us * 1e-3, "mean_ms");
+    latency.Set(summary.p50_us * 1e-3, "p50_ms");
+    latency.Set(summary.p99_us * 1e-3, "p99_ms");
+    latency.Set(summary.max_us * 1e-3, "max_ms");
+    return latency;
+  }
+
+  JSONFile TelemetryJSON(const WorkerTelemetryList& list) {
+    JSONFile telemetry;
+    RC_ForEach(worker, list) {
+      const std::string& wname = worker.name.Raw();
+      telemetry.Set(worker.stats.queue_depth, wname, "queue_depth");
+      telemetry.Set(worker.stats.peak_queue_depth, wname,
+          "peak_queue_depth");
+      RC_ForEach(task, worker.stats.tasks) {
+        const std::string& tname = task.name.Raw();
+        telemetry.Set(task.run.count, wname, "tasks", tname, "count");
+        telemetry.Set(LatencyJSON(task.wait).json, wname, "tasks", tname,
+            "wait");
+        telemetry.Set(LatencyJSON(task.run).json, wname, "tasks", tname,
+            "run");
+      }
+    }
+    return telemetry;
+  }
+}
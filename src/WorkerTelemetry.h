@@ -0,0 +1,33 @@
+#ifndef WORKERTELEMETRY_H
+#define WORKERTELEMETRY_H
+
+#include "ConfigFile.h"
+#include "RC/Data1D.h"
+#include "RC/RStr.h"
+#include "RCqt/Worker.h"
+
+namespace CML {
+  /// The task timing statistics of one named RCqt::Worker.
+  class WorkerTelemetry {
+    public:
+    RC::RStr name;
+    RCqt::WorkerStatsSnapshot stats;
+  };
+
+  using WorkerTelemetryList = RC::Data1D<WorkerTelemetry>;
+  using WorkerTelemetryCallback =
+    RC::Caller<void, const WorkerTelemetryList&>;
+
+  /// Appends a snapshot of the worker's statistics to the list.
+  /** Unset workers are skipped.
+   */
+  void AddWorkerTelemetry(WorkerTelemetryList& list, const RC::RStr& name,
+      RC::Ptr<RCqt::Worker> worker);
+
+  /// Converts snapshots to JSON, keyed by worker name then task name.
+  /** Times are in milliseconds.
+   */
+  JSONFile TelemetryJSON(const WorkerTelemetryList& list);
+}
+
+#endif // WORKERTELEMETRY_H